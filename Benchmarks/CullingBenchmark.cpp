@@ -0,0 +1,176 @@
+// Frustum culling microbenchmark.
+// Culls random bounding spheres against a perspective view with every kernel the CPU supports
+// and reports objects tested per millisecond as JSON. No GPU needed.
+//
+// Usage:
+//   CullingBenchmark [--counts 10000,100000,1000000] [--iterations 200] [--output results.json]
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include "Culling.h"
+
+struct BenchmarkOptions {
+	std::vector<uint32_t> objectCounts = { 10000, 100000, 1000000 };
+	uint32_t iterations = 200;
+	std::string outputPath;
+};
+
+struct KernelResult {
+	CullingKernel kernel = CullingKernel::Scalar;
+	uint32_t objectCount = 0;
+	uint32_t visible = 0;
+	bool matchesScalar = true;						//same visible set as the scalar kernel
+	double meanMs = 0.0;
+	double minMs = 0.0;
+	double objectsPerMs = 0.0;
+};
+
+static std::vector<uint32_t> parseCountList(const std::string& list) {
+	std::vector<uint32_t> counts;
+	std::stringstream stream(list);
+	std::string item;
+	while (std::getline(stream, item, ',')) {
+		if (!item.empty()) {
+			counts.push_back(static_cast<uint32_t>(std::stoul(item)));
+		}
+	}
+	return counts;
+}
+
+static bool parseOptions(int argc, char** argv, BenchmarkOptions& options) {
+	for (int i = 1; i < argc; i++) {
+		std::string arg = argv[i];
+		if (i + 1 >= argc) {
+			fprintf(stderr, "missing value for %s\n", arg.c_str());
+			return false;
+		}
+		std::string value = argv[++i];
+
+		if (arg == "--counts") options.objectCounts = parseCountList(value);
+		else if (arg == "--iterations") options.iterations = static_cast<uint32_t>(std::stoul(value));
+		else if (arg == "--output") options.outputPath = value;
+		else {
+			fprintf(stderr, "unknown option %s\n", arg.c_str());
+			return false;
+		}
+	}
+	return !options.objectCounts.empty() && options.iterations > 0;
+}
+
+//spheres scattered through a cube around the camera, about a tenth of them in view
+static SphereBounds generateBounds(uint32_t count) {
+	std::mt19937 rng(1234);
+	std::uniform_real_distribution<float> position(-100.0f, 100.0f);
+	std::uniform_real_distribution<float> radius(0.5f, 2.0f);
+
+	SphereBounds bounds;
+	bounds.resize(count);
+	for (uint32_t i = 0; i < count; i++) {
+		bounds.set(i, glm::vec3(position(rng), position(rng), position(rng)), radius(rng));
+	}
+	return bounds;
+}
+
+static std::vector<KernelResult> runCount(const BenchmarkOptions& options, uint32_t objectCount) {
+	SphereBounds bounds = generateBounds(objectCount);
+
+	glm::mat4 projection = glm::perspective(glm::radians(60.0f), 16.0f / 9.0f, 0.1f, 150.0f);
+	glm::mat4 view = glm::lookAt(glm::vec3(0.0f, 0.0f, 0.0f), glm::vec3(0.0f, 0.0f, -1.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+	Frustum frustum = extractFrustum(projection * view);
+
+	std::vector<uint32_t> scalarVisible(objectCount);
+	scalarVisible.resize(cullSpheres(CullingKernel::Scalar, frustum, bounds, scalarVisible.data()));
+
+	std::vector<KernelResult> results;
+	const CullingKernel kernels[] = { CullingKernel::Scalar, CullingKernel::SSE, CullingKernel::AVX2 };
+	for (CullingKernel kernel : kernels) {
+		if (!isCullingKernelSupported(kernel)) continue;
+
+		KernelResult result;
+		result.kernel = kernel;
+		result.objectCount = objectCount;
+
+		std::vector<uint32_t> visible(objectCount);
+		uint32_t visibleCount = 0;
+
+		//warm caches and the branch predictor before timing
+		for (uint32_t i = 0; i < 3; i++) {
+			visibleCount = cullSpheres(kernel, frustum, bounds, visible.data());
+		}
+
+		double totalMs = 0.0;
+		result.minMs = 1e30;
+		for (uint32_t i = 0; i < options.iterations; i++) {
+			auto start = std::chrono::steady_clock::now();
+			visibleCount = cullSpheres(kernel, frustum, bounds, visible.data());
+			std::chrono::duration<double, std::milli> time = std::chrono::steady_clock::now() - start;
+			totalMs += time.count();
+			result.minMs = std::min(result.minMs, time.count());
+		}
+
+		visible.resize(visibleCount);
+		result.visible = visibleCount;
+		result.matchesScalar = visible == scalarVisible;
+		result.meanMs = totalMs / options.iterations;
+		result.objectsPerMs = result.meanMs > 0.0 ? objectCount / result.meanMs : 0.0;
+		results.push_back(result);
+	}
+	return results;
+}
+
+static void writeJson(FILE* out, const BenchmarkOptions& options, const std::vector<KernelResult>& results) {
+	fprintf(out, "{\n");
+	fprintf(out, "  \"benchmark\": \"culling\",\n");
+	fprintf(out, "  \"iterations\": %u,\n", options.iterations);
+	fprintf(out, "  \"best_kernel\": \"%s\",\n", getCullingKernelName(getBestCullingKernel()));
+	fprintf(out, "  \"results\": [\n");
+	for (size_t i = 0; i < results.size(); i++) {
+		const KernelResult& r = results[i];
+		fprintf(out, "    {\"objects\": %u, \"kernel\": \"%s\", \"visible\": %u, \"matches_scalar\": %s, \"mean_ms\": %.4f, \"min_ms\": %.4f, \"objects_per_ms\": %.1f}%s\n",
+			r.objectCount, getCullingKernelName(r.kernel), r.visible, r.matchesScalar ? "true" : "false", r.meanMs, r.minMs, r.objectsPerMs,
+			i + 1 < results.size() ? "," : "");
+	}
+	fprintf(out, "  ]\n}\n");
+}
+
+int main(int argc, char** argv) {
+	BenchmarkOptions options;
+	if (!parseOptions(argc, argv, options)) {
+		fprintf(stderr, "usage: CullingBenchmark [--counts 10000,100000,1000000] [--iterations N] [--output file]\n");
+		return EXIT_FAILURE;
+	}
+
+	std::vector<KernelResult> results;
+	bool allMatch = true;
+	for (uint32_t objectCount : options.objectCounts) {
+		fprintf(stderr, "culling %u objects...\n", objectCount);
+		for (const KernelResult& result : runCount(options, objectCount)) {
+			allMatch = allMatch && result.matchesScalar;
+			results.push_back(result);
+		}
+	}
+
+	writeJson(stdout, options, results);
+	if (!options.outputPath.empty()) {
+		FILE* file = fopen(options.outputPath.c_str(), "w");
+		if (file == nullptr) {
+			fprintf(stderr, "failed to open %s\n", options.outputPath.c_str());
+			return EXIT_FAILURE;
+		}
+		writeJson(file, options, results);
+		fclose(file);
+	}
+
+	//a SIMD kernel disagreeing with the scalar reference is a bug, not just a slow result
+	return allMatch ? 0 : EXIT_FAILURE;
+}
@@ -0,0 +1,631 @@
+// End-to-end frame benchmark.
+// Renders procedurally generated scenes of increasing size with the headless renderer
+// and reports CPU frame time percentiles and draw/triangle throughput as JSON.
+//
+// Usage (run from the build directory so Shaders/ can be found):
+//   FrameBenchmark [--meshes 1,10,100] [--frames 500] [--warmup 50] [--segments 2]
+//                  [--width 1280] [--height 720] [--recording serial|parallel] [--record-threads N]
+//                  [--commands prerecorded|per-frame] [--culling cpu|gpu] [--pipeline-cache file]
+//                  [--positions float32|unorm16|float16] [--colors float32|unorm8] [--position-stream shared|separate]
+//                  [--lods 1] [--lod-threshold 1.0] [--relief 0.0] [--meshlets off|on]
+//                  [--depth-prepass off|on|both] [--depth-sort on|off] [--reverse-z off|on] [--layers 1]
+//                  [--pacing throughput|low-latency|vsync] [--frames-in-flight N] [--fps-limit F] [--sync timeline|fences]
+//                  [--output results.json]
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "VulkanRenderer.h"
+
+struct BenchmarkOptions {
+	std::vector<uint32_t> meshCounts = { 1, 10, 100, 1000, 10000, 100000 };
+	uint32_t frames = 500;
+	uint32_t warmupFrames = 50;
+	uint32_t segments = 2;						//quad subdivisions per side, 2 * segments^2 triangles per mesh
+	uint32_t width = 1280;
+	uint32_t height = 720;
+	RecordingMode recordingMode = RecordingMode::Serial;
+	uint32_t recordThreads = 0;					//parallel recording threads, 0 for one per hardware thread
+	CommandBufferMode commandBufferMode = CommandBufferMode::Prerecorded;
+	bool gpuCulling = false;					//compute pass culling with indirect draws instead of CPU culling
+	std::string pipelineCachePath = "FrameBenchmark_pipeline_cache.bin";	//deleted before the cold start
+	VertexLayout vertexLayout;
+	uint32_t lodCount = 1;						//levels of detail per mesh, 1 draws every mesh in full
+	float lodThreshold = DEFAULT_LOD_THRESHOLD;
+	float relief = 0.0f;						//height of a ripple across each quad, flat quads simplify to almost nothing
+	bool meshlets = false;						//split meshes into meshlets, culled per cluster with per frame command buffers
+	std::vector<bool> depthPrepass = { false };	//each scene runs once per entry, so both settings can be compared
+	bool depthSort = true;						//front to back draw order
+	bool reverseDepth = false;
+	uint32_t layers = 1;						//copies of the grid stacked behind each other, for overdraw
+	FramePacingMode framePacing = FramePacingMode::Throughput;	//headless there is no present, only its frames in flight apply
+	uint32_t framesInFlight = 0;				//0 for the pacing mode's own
+	float frameRateLimit = 0.0f;
+	bool timelineSemaphores = true;				//where supported, fences otherwise
+	std::string outputPath;
+};
+
+//renderer start up without (cold) and then with (warm) a pipeline cache on disk
+struct StartupResult {
+	double coldInitMs = 0.0;
+	double warmInitMs = 0.0;
+	PipelineCacheStats cold;
+	PipelineCacheStats warm;
+	std::string error;
+};
+
+struct SceneResult {
+	uint32_t meshCount = 0;
+	bool depthPrepass = false;
+	bool timelineSemaphores = false;			//what the renderer ended up using
+	uint64_t trianglesPerFrame = 0;
+	double setupMs = 0.0;
+	double recordMs = 0.0;						//prerecorded: recording every command buffer, per frame: mean per measured frame
+	double totalMs = 0.0;
+	double meanMs = 0.0;
+	double p50Ms = 0.0;
+	double p95Ms = 0.0;
+	double p99Ms = 0.0;
+	double maxMs = 0.0;
+	double drawsPerSec = 0.0;
+	double trianglesPerSec = 0.0;
+	std::vector<double> gpuFrameTimes;			//per measured frame, empty if timestamps are unsupported
+	uint64_t fragmentInvocations = 0;			//last collected frame, 0 if pipeline statistics are unsupported
+	std::vector<FrameLatency> latencies;		//per measured frame
+	DeviceAllocatorStats memoryStats;			//after scene setup
+	UploadStats uploadStats;					//scene mesh uploads
+	CullingStats cullingStats;					//last measured frame, per frame command buffers or GPU culling only
+	bool drawIndirectCount = false;				//GPU culling packed its draws with VK_KHR_draw_indirect_count
+	MeshLodStats lodChain;						//of the last mesh created, every mesh has the same shape
+	MeshletStats meshletStats;					//likewise
+	uint64_t lodObjects[MAX_MESH_LODS] = {};	//summed over measured frames
+	uint64_t lodTriangles[MAX_MESH_LODS] = {};
+	double lodSelectMs = 0.0;					//mean per measured frame
+	std::string error;
+};
+
+static std::vector<uint32_t> parseCountList(const std::string& list) {
+	std::vector<uint32_t> counts;
+	std::stringstream stream(list);
+	std::string item;
+	while (std::getline(stream, item, ',')) {
+		if (!item.empty()) {
+			counts.push_back(static_cast<uint32_t>(std::stoul(item)));
+		}
+	}
+	return counts;
+}
+
+static bool parseOptions(int argc, char** argv, BenchmarkOptions& options) {
+	for (int i = 1; i < argc; i++) {
+		std::string arg = argv[i];
+		if (i + 1 >= argc) {
+			fprintf(stderr, "missing value for %s\n", arg.c_str());
+			return false;
+		}
+		std::string value = argv[++i];
+
+		if (arg == "--meshes") options.meshCounts = parseCountList(value);
+		else if (arg == "--frames") options.frames = static_cast<uint32_t>(std::stoul(value));
+		else if (arg == "--warmup") options.warmupFrames = static_cast<uint32_t>(std::stoul(value));
+		else if (arg == "--segments") options.segments = static_cast<uint32_t>(std::stoul(value));
+		else if (arg == "--width") options.width = static_cast<uint32_t>(std::stoul(value));
+		else if (arg == "--height") options.height = static_cast<uint32_t>(std::stoul(value));
+		else if (arg == "--recording") {
+			if (value == "serial") options.recordingMode = RecordingMode::Serial;
+			else if (value == "parallel") options.recordingMode = RecordingMode::Parallel;
+			else {
+				fprintf(stderr, "unknown recording mode %s\n", value.c_str());
+				return false;
+			}
+		}
+		else if (arg == "--commands") {
+			if (value == "prerecorded") options.commandBufferMode = CommandBufferMode::Prerecorded;
+			else if (value == "per-frame") options.commandBufferMode = CommandBufferMode::PerFrame;
+			else {
+				fprintf(stderr, "unknown command buffer mode %s\n", value.c_str());
+				return false;
+			}
+		}
+		else if (arg == "--culling") {
+			if (value == "cpu") options.gpuCulling = false;
+			else if (value == "gpu") options.gpuCulling = true;
+			else {
+				fprintf(stderr, "unknown culling mode %s\n", value.c_str());
+				return false;
+			}
+		}
+		else if (arg == "--pipeline-cache") options.pipelineCachePath = value;
+		else if (arg == "--positions") {
+			if (value == "float32") options.vertexLayout.position = PositionFormat::Float32;
+			else if (value == "unorm16") options.vertexLayout.position = PositionFormat::Unorm16;
+			else if (value == "float16") options.vertexLayout.position = PositionFormat::Float16;
+			else {
+				fprintf(stderr, "unknown position format %s\n", value.c_str());
+				return false;
+			}
+		}
+		else if (arg == "--colors") {
+			if (value == "float32") options.vertexLayout.color = ColorFormat::Float32;
+			else if (value == "unorm8") options.vertexLayout.color = ColorFormat::Unorm8;
+			else {
+				fprintf(stderr, "unknown colour format %s\n", value.c_str());
+				return false;
+			}
+		}
+		else if (arg == "--position-stream") {
+			if (value == "shared") options.vertexLayout.separatePositions = false;
+			else if (value == "separate") options.vertexLayout.separatePositions = true;
+			else {
+				fprintf(stderr, "unknown position stream %s\n", value.c_str());
+				return false;
+			}
+		}
+		else if (arg == "--lods") options.lodCount = static_cast<uint32_t>(std::stoul(value));
+		else if (arg == "--lod-threshold") options.lodThreshold = std::stof(value);
+		else if (arg == "--relief") options.relief = std::stof(value);
+		else if (arg == "--meshlets") {
+			if (value == "on") options.meshlets = true;
+			else if (value == "off") options.meshlets = false;
+			else {
+				fprintf(stderr, "unknown meshlets setting %s\n", value.c_str());
+				return false;
+			}
+		}
+		else if (arg == "--depth-prepass") {
+			if (value == "on") options.depthPrepass = { true };
+			else if (value == "off") options.depthPrepass = { false };
+			else if (value == "both") options.depthPrepass = { false, true };
+			else {
+				fprintf(stderr, "unknown depth prepass setting %s\n", value.c_str());
+				return false;
+			}
+		}
+		else if (arg == "--depth-sort") {
+			if (value == "on") options.depthSort = true;
+			else if (value == "off") options.depthSort = false;
+			else {
+				fprintf(stderr, "unknown depth sort setting %s\n", value.c_str());
+				return false;
+			}
+		}
+		else if (arg == "--reverse-z") {
+			if (value == "on") options.reverseDepth = true;
+			else if (value == "off") options.reverseDepth = false;
+			else {
+				fprintf(stderr, "unknown reverse z setting %s\n", value.c_str());
+				return false;
+			}
+		}
+		else if (arg == "--pacing") {
+			if (value == "throughput") options.framePacing = FramePacingMode::Throughput;
+			else if (value == "low-latency") options.framePacing = FramePacingMode::LowLatency;
+			else if (value == "vsync") options.framePacing = FramePacingMode::VsyncCapped;
+			else {
+				fprintf(stderr, "unknown pacing mode %s\n", value.c_str());
+				return false;
+			}
+		}
+		else if (arg == "--sync") {
+			if (value == "timeline") options.timelineSemaphores = true;
+			else if (value == "fences") options.timelineSemaphores = false;
+			else {
+				fprintf(stderr, "unknown sync setting %s\n", value.c_str());
+				return false;
+			}
+		}
+		else if (arg == "--frames-in-flight") options.framesInFlight = static_cast<uint32_t>(std::stoul(value));
+		else if (arg == "--fps-limit") options.frameRateLimit = std::stof(value);
+		else if (arg == "--layers") options.layers = std::max(1u, static_cast<uint32_t>(std::stoul(value)));
+		else if (arg == "--record-threads") options.recordThreads = static_cast<uint32_t>(std::stoul(value));
+		else if (arg == "--output") options.outputPath = value;
+		else {
+			fprintf(stderr, "unknown option %s\n", arg.c_str());
+			return false;
+		}
+	}
+	return !options.meshCounts.empty() && options.frames > 0 && options.segments > 0 && options.lodCount >= 1 && options.lodCount <= MAX_MESH_LODS
+		&& options.framesInFlight <= MAX_FRAME_DRAWS;
+}
+
+//unit quad in the xy plane subdivided into segments x segments cells, one random colour per mesh, rippled in z by relief
+static void generateMesh(uint32_t segments, float relief, std::mt19937& rng, std::vector<Vertex>& vertices, std::vector<uint32_t>& indices) {
+	std::uniform_real_distribution<float> colour(0.2f, 1.0f);
+	glm::vec3 meshColour(colour(rng), colour(rng), colour(rng));
+
+	vertices.clear();
+	indices.clear();
+	for (uint32_t y = 0; y <= segments; y++) {
+		for (uint32_t x = 0; x <= segments; x++) {
+			float u = (float)x / segments - 0.5f;
+			float v = (float)y / segments - 0.5f;
+			float z = relief * std::sin(u * 12.566371f) * std::cos(v * 12.566371f);
+			vertices.push_back({ { u, v, z }, meshColour });
+		}
+	}
+
+	uint32_t rowLength = segments + 1;
+	for (uint32_t y = 0; y < segments; y++) {
+		for (uint32_t x = 0; x < segments; x++) {
+			uint32_t topLeft = y * rowLength + x;
+			uint32_t bottomLeft = topLeft + rowLength;
+			//counter clockwise to survive back face culling
+			indices.insert(indices.end(), { topLeft, topLeft + 1, bottomLeft + 1, bottomLeft + 1, bottomLeft, topLeft });
+		}
+	}
+}
+
+static double percentile(const std::vector<double>& sorted, double fraction) {
+	//nearest rank percentile
+	size_t rank = static_cast<size_t>(std::ceil(fraction * sorted.size()));
+	return sorted[std::min(sorted.size() - 1, rank > 0 ? rank - 1 : 0)];
+}
+
+static StartupResult measureStartup(const BenchmarkOptions& options) {
+	StartupResult startupResult;
+	std::remove(options.pipelineCachePath.c_str());
+
+	for (int run = 0; run < 2; run++) {
+		VulkanRenderer renderer;
+		renderer.setPipelineCachePath(options.pipelineCachePath);
+		renderer.setVertexLayout(options.vertexLayout);
+
+		auto initStart = std::chrono::steady_clock::now();
+		if (renderer.initHeadless(options.width, options.height) == EXIT_FAILURE) {
+			startupResult.error = "failed to initialise headless renderer";
+			return startupResult;
+		}
+		std::chrono::duration<double, std::milli> initTime = std::chrono::steady_clock::now() - initStart;
+
+		//cleanup writes the cache the second run starts from
+		renderer.cleanup();
+		if (run == 0) {
+			startupResult.coldInitMs = initTime.count();
+			startupResult.cold = renderer.getPipelineCacheStats();
+		}
+		else {
+			startupResult.warmInitMs = initTime.count();
+			startupResult.warm = renderer.getPipelineCacheStats();
+		}
+	}
+	return startupResult;
+}
+
+static SceneResult runScene(const BenchmarkOptions& options, uint32_t meshCount, bool depthPrepass, std::string& deviceName, VkFormat& depthFormat) {
+	SceneResult sceneResult;
+	sceneResult.meshCount = meshCount;
+	sceneResult.depthPrepass = depthPrepass;
+
+	VulkanRenderer renderer;
+	renderer.setPipelineCachePath(options.pipelineCachePath);
+	renderer.setVertexLayout(options.vertexLayout);
+	renderer.setReverseDepth(options.reverseDepth);
+	renderer.setFramePacing(options.framePacing);
+	renderer.setTimelineSemaphores(options.timelineSemaphores);
+	if (renderer.initHeadless(options.width, options.height) == EXIT_FAILURE) {
+		sceneResult.error = "failed to initialise headless renderer";
+		return sceneResult;
+	}
+	deviceName = renderer.getDeviceName();
+	depthFormat = renderer.getDepthFormat();
+	sceneResult.timelineSemaphores = renderer.isTimelineSemaphoreEnabled();
+
+	try {
+		renderer.setRecordingMode(options.recordingMode, options.recordThreads);
+		renderer.setCommandBufferMode(options.commandBufferMode);
+		MeshLodSettings lodSettings;
+		lodSettings.lodCount = options.lodCount;
+		renderer.setMeshLods(lodSettings);
+		renderer.setLodThreshold(options.lodThreshold);
+		MeshletSettings meshletSettings;
+		meshletSettings.enabled = options.meshlets;
+		renderer.setMeshlets(meshletSettings);
+		if (options.gpuCulling) {
+			if (!renderer.isGpuCullingSupported()) {
+				throw std::runtime_error("GPU culling is not supported (device features or Shaders/comp.spv missing)");
+			}
+			renderer.setGpuCulling(true);
+			sceneResult.drawIndirectCount = renderer.isDrawIndirectCountSupported();
+		}
+		renderer.setDepthSort(options.depthSort);
+		if (options.framesInFlight > 0) {
+			renderer.setFramesInFlight(options.framesInFlight);
+		}
+		renderer.setFrameRateLimit(options.frameRateLimit);
+		if (depthPrepass) {
+			if (!renderer.isDepthPrepassSupported()) {
+				throw std::runtime_error("depth prepass is not supported (Shaders/depth.spv missing)");
+			}
+			renderer.setDepthPrepass(true);
+		}
+
+		//build scene, meshes laid out on a grid that fills the view
+		auto setupStart = std::chrono::steady_clock::now();
+		std::mt19937 rng(1234);
+		std::vector<Vertex> vertices;
+		std::vector<uint32_t> indices;
+		uint32_t objectCount = meshCount * options.layers;
+		std::vector<glm::vec3> positions(objectCount);
+
+		//layers are created back to front, the order that shades every layer without sorting or a prepass
+		uint32_t columns = static_cast<uint32_t>(std::ceil(std::sqrt((double)meshCount)));
+		float spacing = 8.0f / columns;
+		for (uint32_t i = 0; i < objectCount; i++) {
+			generateMesh(options.segments, options.relief, rng, vertices, indices);
+			renderer.createMesh(&vertices, &indices);
+			sceneResult.trianglesPerFrame += indices.size() / 3;
+
+			uint32_t cell = i % meshCount;
+			uint32_t layer = options.layers - 1 - i / meshCount;
+			float x = ((cell % columns) + 0.5f) * spacing - 4.0f;
+			float y = ((cell / columns) + 0.5f) * spacing - 4.0f;
+			positions[i] = glm::vec3(x, y, -8.0f - layer * 0.5f);
+		}
+		//setup time includes the GPU finishing the uploads
+		renderer.waitForUploads();
+		std::chrono::duration<double, std::milli> setupTime = std::chrono::steady_clock::now() - setupStart;
+		sceneResult.setupMs = setupTime.count();
+		sceneResult.memoryStats = renderer.getMemoryStats();
+		sceneResult.uploadStats = renderer.getUploadStats();
+		sceneResult.lodChain = renderer.getMeshLodStats();
+		sceneResult.meshletStats = renderer.getMeshletStats();
+
+		//warm up then time each frame's model updates plus draw submission
+		float meshScale = spacing * 0.8f;
+		std::vector<double> frameTimes;
+		frameTimes.reserve(options.frames);
+		sceneResult.latencies.reserve(options.frames);
+		uint64_t lastGpuFrame = 0;
+		auto measureStart = std::chrono::steady_clock::now();
+		for (uint32_t frame = 0; frame < options.warmupFrames + options.frames; frame++) {
+			if (frame == options.warmupFrames) {
+				measureStart = std::chrono::steady_clock::now();
+			}
+			auto frameStart = std::chrono::steady_clock::now();
+
+			//the frame's model updates stand in for input, sampled once the frame slot is free
+			renderer.beginFrame();
+			renderer.markInputSampled();
+			float angle = frame * 0.5f;
+			for (uint32_t i = 0; i < objectCount; i++) {
+				glm::mat4 model = glm::translate(glm::mat4(1.0f), positions[i]);
+				model = glm::rotate(model, glm::radians(angle + i), glm::vec3(0.0f, 0.0f, 1.0f));
+				model = glm::scale(model, glm::vec3(meshScale, meshScale, meshScale));
+				renderer.updateModel(static_cast<int>(i), model);
+			}
+			renderer.draw();
+
+			std::chrono::duration<double, std::milli> frameTime = std::chrono::steady_clock::now() - frameStart;
+			if (frame >= options.warmupFrames) {
+				frameTimes.push_back(frameTime.count());
+				sceneResult.latencies.push_back(renderer.getFrameLatency());
+				if (options.commandBufferMode == CommandBufferMode::PerFrame) {
+					sceneResult.recordMs += renderer.getLastRecordMs() / options.frames;
+				}
+				if (options.commandBufferMode == CommandBufferMode::PerFrame || options.gpuCulling) {
+					sceneResult.cullingStats = renderer.getCullingStats();
+				}
+				LodStats lodStats = renderer.getLodStats();
+				for (uint32_t level = 0; level < MAX_MESH_LODS; level++) {
+					sceneResult.lodObjects[level] += lodStats.objects[level];
+					sceneResult.lodTriangles[level] += lodStats.triangles[level];
+				}
+				sceneResult.lodSelectMs += lodStats.selectMs / options.frames;
+
+				//GPU results arrive a few frames late, take each collected frame once
+				GpuFrameStats gpuStats = renderer.getGpuFrameStats();
+				if (gpuStats.timestampsValid && gpuStats.frameNumber > lastGpuFrame && gpuStats.frameNumber > options.warmupFrames) {
+					lastGpuFrame = gpuStats.frameNumber;
+					sceneResult.gpuFrameTimes.push_back(gpuStats.gpuFrameMs);
+				}
+				if (gpuStats.pipelineStatisticsValid) {
+					sceneResult.fragmentInvocations = gpuStats.fragmentShaderInvocations;
+				}
+			}
+		}
+
+		//include the GPU draining the final frames in the wall clock total
+		renderer.waitForFrame(renderer.getSubmittedFrameCount());
+		std::chrono::duration<double, std::milli> totalTime = std::chrono::steady_clock::now() - measureStart;
+		sceneResult.totalMs = totalTime.count();
+
+		//scene is static, so this is the recording done by the first frame
+		if (options.commandBufferMode == CommandBufferMode::Prerecorded) {
+			sceneResult.recordMs = renderer.getLastRecordMs();
+		}
+
+		std::vector<double> sorted = frameTimes;
+		std::sort(sorted.begin(), sorted.end());
+		double sum = 0.0;
+		for (double time : sorted) sum += time;
+
+		sceneResult.meanMs = sum / sorted.size();
+		sceneResult.p50Ms = percentile(sorted, 0.50);
+		sceneResult.p95Ms = percentile(sorted, 0.95);
+		sceneResult.p99Ms = percentile(sorted, 0.99);
+		sceneResult.maxMs = sorted.back();
+
+		double seconds = sceneResult.totalMs / 1000.0;
+		sceneResult.drawsPerSec = (double)objectCount * options.frames / seconds;
+		sceneResult.trianglesPerSec = (double)sceneResult.trianglesPerFrame * options.frames / seconds;
+	}
+	catch (const std::runtime_error& e) {
+		sceneResult.error = e.what();
+	}
+
+	renderer.cleanup();
+	return sceneResult;
+}
+
+static std::string jsonEscape(const std::string& text) {
+	std::string escaped;
+	for (char c : text) {
+		if (c == '"' || c == '\\') escaped += '\\';
+		if (c == '\n') { escaped += "\\n"; continue; }
+		escaped += c;
+	}
+	return escaped;
+}
+
+static const char* getDepthFormatName(VkFormat format) {
+	switch (format) {
+	case VK_FORMAT_D32_SFLOAT: return "d32_sfloat";
+	case VK_FORMAT_D32_SFLOAT_S8_UINT: return "d32_sfloat_s8_uint";
+	case VK_FORMAT_D24_UNORM_S8_UINT: return "d24_unorm_s8_uint";
+	case VK_FORMAT_D16_UNORM: return "d16_unorm";
+	default: return "undefined";
+	}
+}
+
+static void writeJson(FILE* out, const BenchmarkOptions& options, const std::string& deviceName, VkFormat depthFormat, const StartupResult& startup,
+	const std::vector<SceneResult>& results) {
+	fprintf(out, "{\n");
+	fprintf(out, "  \"benchmark\": \"frame\",\n");
+	fprintf(out, "  \"device\": \"%s\",\n", jsonEscape(deviceName).c_str());
+	fprintf(out, "  \"frames\": %u,\n  \"warmup_frames\": %u,\n", options.frames, options.warmupFrames);
+	fprintf(out, "  \"resolution\": [%u, %u],\n", options.width, options.height);
+	fprintf(out, "  \"recording\": \"%s\",\n", options.recordingMode == RecordingMode::Parallel ? "parallel" : "serial");
+	fprintf(out, "  \"commands\": \"%s\",\n", options.commandBufferMode == CommandBufferMode::PerFrame ? "per-frame" : "prerecorded");
+	fprintf(out, "  \"culling\": \"%s\",\n", options.gpuCulling ? "gpu" : "cpu");
+	const VertexLayout& layout = options.vertexLayout;
+	const char* positionNames[] = { "float32", "unorm16", "float16" };
+	fprintf(out, "  \"vertex_layout\": {\"positions\": \"%s\", \"colors\": \"%s\", \"position_stream\": \"%s\", \"bytes_per_vertex\": %u},\n",
+		positionNames[static_cast<int>(layout.position)], layout.color == ColorFormat::Unorm8 ? "unorm8" : "float32",
+		layout.separatePositions ? "separate" : "shared", getVertexSize(layout));
+	fprintf(out, "  \"depth\": {\"format\": \"%s\", \"reverse_z\": %s, \"sort\": %s, \"layers\": %u},\n", getDepthFormatName(depthFormat),
+		options.reverseDepth ? "true" : "false", options.depthSort ? "true" : "false", options.layers);
+	const char* pacingNames[] = { "throughput", "low-latency", "vsync" };
+	uint32_t framesInFlight = options.framesInFlight > 0 ? options.framesInFlight
+		: options.framePacing == FramePacingMode::LowLatency ? 1 : DEFAULT_FRAMES_IN_FLIGHT;
+	fprintf(out, "  \"pacing\": {\"mode\": \"%s\", \"frames_in_flight\": %u, \"fps_limit\": %.1f},\n",
+		pacingNames[static_cast<int>(options.framePacing)], framesInFlight, options.frameRateLimit);
+	if (!startup.error.empty()) {
+		fprintf(out, "  \"startup\": {\"error\": \"%s\"},\n", jsonEscape(startup.error).c_str());
+	}
+	else {
+		fprintf(out, "  \"startup\": {\"cold\": {\"init_ms\": %.3f, \"pipeline_ms\": %.3f, \"cache\": \"%s\"}, ",
+			startup.coldInitMs, startup.cold.pipelineCreateMs, jsonEscape(startup.cold.loadResult).c_str());
+		fprintf(out, "\"warm\": {\"init_ms\": %.3f, \"pipeline_ms\": %.3f, \"cache\": \"%s\", \"cache_bytes\": %zu}},\n",
+			startup.warmInitMs, startup.warm.pipelineCreateMs, jsonEscape(startup.warm.loadResult).c_str(), startup.warm.loadedBytes);
+	}
+	fprintf(out, "  \"results\": [\n");
+	for (size_t i = 0; i < results.size(); i++) {
+		const SceneResult& r = results[i];
+		fprintf(out, "    {\"meshes\": %u, \"depth_prepass\": %s, \"sync\": \"%s\", \"triangles_per_frame\": %llu, ", r.meshCount,
+			r.depthPrepass ? "true" : "false", r.timelineSemaphores ? "timeline" : "fences", (unsigned long long)r.trianglesPerFrame);
+		if (!r.error.empty()) {
+			fprintf(out, "\"error\": \"%s\"}", jsonEscape(r.error).c_str());
+		}
+		else {
+			fprintf(out, "\"setup_ms\": %.3f, \"record_ms\": %.3f, \"total_ms\": %.3f, ", r.setupMs, r.recordMs, r.totalMs);
+			fprintf(out, "\"cpu_frame_ms\": {\"mean\": %.4f, \"p50\": %.4f, \"p95\": %.4f, \"p99\": %.4f, \"max\": %.4f}, ",
+				r.meanMs, r.p50Ms, r.p95Ms, r.p99Ms, r.maxMs);
+			fprintf(out, "\"draws_per_sec\": %.1f, \"triangles_per_sec\": %.1f", r.drawsPerSec, r.trianglesPerSec);
+			if (!r.gpuFrameTimes.empty()) {
+				std::vector<double> sorted = r.gpuFrameTimes;
+				std::sort(sorted.begin(), sorted.end());
+				fprintf(out, ", \"gpu_frame_ms\": {\"p50\": %.4f, \"p95\": %.4f, \"max\": %.4f, \"samples\": %zu}",
+					percentile(sorted, 0.50), percentile(sorted, 0.95), sorted.back(), sorted.size());
+			}
+			if (r.fragmentInvocations > 0) {
+				fprintf(out, ", \"fragment_invocations\": %llu", (unsigned long long)r.fragmentInvocations);
+			}
+			if (!r.latencies.empty()) {
+				//input sample to submission, then the mean of the waits before the sample
+				std::vector<double> sorted;
+				double slotWait = 0.0, limiterWait = 0.0;
+				for (const FrameLatency& latency : r.latencies) {
+					sorted.push_back(latency.inputToSubmitMs);
+					slotWait += latency.slotWaitMs / r.latencies.size();
+					limiterWait += latency.limiterWaitMs / r.latencies.size();
+				}
+				std::sort(sorted.begin(), sorted.end());
+				fprintf(out, ", \"latency\": {\"input_to_submit_ms\": {\"p50\": %.4f, \"p95\": %.4f, \"max\": %.4f}, \"slot_wait_ms\": %.4f, \"limiter_wait_ms\": %.4f}",
+					percentile(sorted, 0.50), percentile(sorted, 0.95), sorted.back(), slotWait, limiterWait);
+			}
+			const DeviceAllocatorStats& memory = r.memoryStats;
+			fprintf(out, ", \"device_memory\": {\"allocations\": %u, \"vk_allocations\": %u, \"blocks\": %u, \"reserved_mb\": %.2f, \"used_mb\": %.2f, \"fragmentation\": %.4f}",
+				memory.total.allocationCount, memory.deviceMemoryCount, memory.total.blockCount,
+				memory.total.reservedBytes / (1024.0 * 1024.0), memory.total.usedBytes / (1024.0 * 1024.0), memory.fragmentation);
+			const UploadStats& upload = r.uploadStats;
+			fprintf(out, ", \"upload\": {\"batches\": %llu, \"uploads\": %llu, \"copy_commands\": %llu, \"mb\": %.2f, \"ms\": %.3f, \"mb_per_sec\": %.1f}",
+				(unsigned long long)upload.batches, (unsigned long long)upload.uploads, (unsigned long long)upload.copyCommands,
+				upload.bytes / (1024.0 * 1024.0), upload.totalMs, upload.averageMBps);
+			if (r.cullingStats.gpu) {
+				//visible draws stay on the GPU, GPU frame time is the cost to compare
+				fprintf(out, ", \"culling\": {\"kernel\": \"gpu\", \"tested\": %u, \"draw_indirect_count\": %s}",
+					r.cullingStats.tested, r.drawIndirectCount ? "true" : "false");
+			}
+			else if (r.cullingStats.tested > 0) {
+				fprintf(out, ", \"culling\": {\"kernel\": \"%s\", \"tested\": %u, \"visible\": %u, \"cull_ms\": %.4f}",
+					getCullingKernelName(r.cullingStats.kernel), r.cullingStats.tested, r.cullingStats.visible, r.cullingStats.cullMs);
+			}
+			if (r.meshletStats.meshletCount > 0) {
+				//per mesh shape, then the last measured frame's cluster culling
+				const MeshletStats& meshlets = r.meshletStats;
+				fprintf(out, ", \"meshlets\": {\"per_mesh\": %u, \"triangles_per_meshlet\": %.1f, \"vertices_per_meshlet\": %.1f, \"cone_cullable\": %u, \"build_ms\": %.3f",
+					meshlets.meshletCount, (double)meshlets.triangles / meshlets.meshletCount, (double)meshlets.vertices / meshlets.meshletCount,
+					meshlets.coneCullable, meshlets.buildMs);
+				if (r.cullingStats.clustersTested > 0) {
+					fprintf(out, ", \"tested\": %u, \"visible\": %u, \"draws\": %u, \"cull_ms\": %.4f", r.cullingStats.clustersTested,
+						r.cullingStats.clustersVisible, r.cullingStats.clusterDraws, r.cullingStats.clusterCullMs);
+				}
+				fprintf(out, "}");
+			}
+			if (r.lodChain.lodCount > 1) {
+				//per level: the shape built, then how often it was drawn over the measured frames
+				double seconds = r.totalMs / 1000.0;
+				fprintf(out, ", \"lods\": {\"simplify_ms\": %.3f, \"select_ms\": %.4f, \"levels\": [", r.lodChain.simplifyMs, r.lodSelectMs);
+				for (uint32_t level = 0; level < r.lodChain.lodCount; level++) {
+					fprintf(out, "%s{\"triangles\": %u, \"error\": %.6f, \"relative_error\": %.6f, \"objects_per_frame\": %.1f, \"triangles_per_sec\": %.1f}",
+						level > 0 ? ", " : "", r.lodChain.triangles[level], r.lodChain.errors[level], r.lodChain.relativeErrors[level],
+						(double)r.lodObjects[level] / options.frames, r.lodTriangles[level] / seconds);
+				}
+				fprintf(out, "]}");
+			}
+			fprintf(out, "}");
+		}
+		fprintf(out, "%s\n", i + 1 < results.size() ? "," : "");
+	}
+	fprintf(out, "  ]\n}\n");
+}
+
+int main(int argc, char** argv) {
+	BenchmarkOptions options;
+	if (!parseOptions(argc, argv, options)) {
+		fprintf(stderr, "usage: FrameBenchmark [--meshes 1,10,100] [--frames N] [--warmup N] [--segments N] [--width W] [--height H] [--recording serial|parallel] [--record-threads N] [--commands prerecorded|per-frame] [--culling cpu|gpu] [--pipeline-cache file] [--positions float32|unorm16|float16] [--colors float32|unorm8] [--position-stream shared|separate] [--lods N] [--lod-threshold pixels] [--relief H] [--meshlets off|on] [--depth-prepass off|on|both] [--depth-sort on|off] [--reverse-z off|on] [--layers N] [--pacing throughput|low-latency|vsync] [--frames-in-flight N] [--fps-limit F] [--sync timeline|fences] [--output file]\n");
+		return EXIT_FAILURE;
+	}
+
+	fprintf(stderr, "measuring startup...\n");
+	StartupResult startup = measureStartup(options);
+
+	std::string deviceName;
+	VkFormat depthFormat = VK_FORMAT_UNDEFINED;
+	std::vector<SceneResult> results;
+	for (uint32_t meshCount : options.meshCounts) {
+		for (bool depthPrepass : options.depthPrepass) {
+			fprintf(stderr, "running %u meshes%s...\n", meshCount, depthPrepass ? " with depth prepass" : "");
+			results.push_back(runScene(options, meshCount, depthPrepass, deviceName, depthFormat));
+		}
+	}
+
+	writeJson(stdout, options, deviceName, depthFormat, startup, results);
+	if (!options.outputPath.empty()) {
+		FILE* file = fopen(options.outputPath.c_str(), "w");
+		if (file == nullptr) {
+			fprintf(stderr, "failed to open %s\n", options.outputPath.c_str());
+			return EXIT_FAILURE;
+		}
+		writeJson(file, options, deviceName, depthFormat, startup, results);
+		fclose(file);
+	}
+
+	return 0;
+}
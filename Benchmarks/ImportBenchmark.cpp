@@ -0,0 +1,284 @@
+// Model import benchmark (CPU only).
+// Writes a grid model of about --triangles triangles as an indexed OBJ (with the vt / vn references exporters add)
+// and as a non indexed .glb (three vertices per triangle, so welding has to merge them back into the grid), then
+// imports both with MeshImporter at each thread count. Reports time, importer peak memory and process peak RSS as JSON.
+//
+// Usage:
+//   ImportBenchmark [--triangles 1000000] [--threads 1,2,4] [--passes 3] [--dir .] [--keep] [--output results.json]
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <sys/resource.h>
+#endif
+
+#include "MeshImporter.h"
+
+struct BenchmarkOptions {
+	uint64_t triangles = 1000000;
+	std::vector<uint32_t> threadCounts;			//powers of two up to the hardware threads when not given
+	uint32_t passes = 3;						//best pass is reported, the first one also warms the page cache
+	std::string directory = ".";
+	bool keep = false;
+	std::string outputPath;
+};
+
+struct ImportResult {
+	std::string format;
+	uint32_t threads = 0;
+	ImportStats stats;							//of the fastest pass
+	std::string error;
+};
+
+static bool parseOptions(int argc, char** argv, BenchmarkOptions& options) {
+	for (int i = 1; i < argc; i++) {
+		std::string arg = argv[i];
+		if (arg == "--keep") {
+			options.keep = true;
+			continue;
+		}
+		if (i + 1 >= argc) {
+			fprintf(stderr, "missing value for %s\n", arg.c_str());
+			return false;
+		}
+		std::string value = argv[++i];
+
+		if (arg == "--triangles") options.triangles = std::stoull(value);
+		else if (arg == "--passes") options.passes = static_cast<uint32_t>(std::stoul(value));
+		else if (arg == "--dir") options.directory = value;
+		else if (arg == "--output") options.outputPath = value;
+		else if (arg == "--threads") {
+			size_t start = 0;
+			while (start < value.size()) {
+				size_t comma = value.find(',', start);
+				if (comma == std::string::npos) comma = value.size();
+				options.threadCounts.push_back(static_cast<uint32_t>(std::stoul(value.substr(start, comma - start))));
+				start = comma + 1;
+			}
+		}
+		else {
+			fprintf(stderr, "unknown option %s\n", arg.c_str());
+			return false;
+		}
+	}
+
+	if (options.threadCounts.empty()) {
+		uint32_t hardwareThreads = std::max(1u, std::thread::hardware_concurrency());
+		for (uint32_t count = 1; count < hardwareThreads; count *= 2) {
+			options.threadCounts.push_back(count);
+		}
+		options.threadCounts.push_back(hardwareThreads);
+	}
+	return options.triangles >= 2 && options.passes > 0;
+}
+
+//largest resident set the process has had so far
+static uint64_t getPeakRss() {
+#ifdef _WIN32
+	PROCESS_MEMORY_COUNTERS counters;
+	if (!GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters))) return 0;
+	return counters.PeakWorkingSetSize;
+#else
+	rusage usage;
+	if (getrusage(RUSAGE_SELF, &usage) != 0) return 0;
+#ifdef __APPLE__
+	return usage.ru_maxrss;						//bytes on macOS
+#else
+	return static_cast<uint64_t>(usage.ru_maxrss) * 1024;
+#endif
+#endif
+}
+
+static glm::vec3 getGridPosition(uint32_t x, uint32_t y, uint32_t side) {
+	float u = x / float(side - 1), v = y / float(side - 1);
+	return glm::vec3(u - 0.5f, v - 0.5f, 0.05f * std::sin(u * 20.0f) * std::cos(v * 20.0f));
+}
+
+static glm::vec3 getGridColor(uint32_t x, uint32_t y, uint32_t side) {
+	return glm::vec3(x / float(side - 1), y / float(side - 1), 0.5f);
+}
+
+static void writeObj(const std::string& path, uint32_t side) {
+	FILE* file = fopen(path.c_str(), "wb");
+	if (file == nullptr) {
+		throw std::runtime_error("Failed to open " + path);
+	}
+	for (uint32_t y = 0; y < side; y++) {
+		for (uint32_t x = 0; x < side; x++) {
+			glm::vec3 pos = getGridPosition(x, y, side);
+			glm::vec3 col = getGridColor(x, y, side);
+			fprintf(file, "v %.6f %.6f %.6f %.4f %.4f %.4f\n", pos.x, pos.y, pos.z, col.x, col.y, col.z);
+		}
+	}
+	fprintf(file, "vt 0 0\nvn 0 0 1\n");
+	for (uint32_t y = 0; y + 1 < side; y++) {
+		for (uint32_t x = 0; x + 1 < side; x++) {
+			uint32_t topLeft = y * side + x + 1;
+			uint32_t bottomLeft = topLeft + side;
+			fprintf(file, "f %u/1/1 %u/1/1 %u/1/1 %u/1/1\n", topLeft, bottomLeft, bottomLeft + 1, topLeft + 1);
+		}
+	}
+	if (fclose(file) != 0) {
+		throw std::runtime_error("Failed to write " + path);
+	}
+}
+
+static void writeGlb(const std::string& path, uint32_t side) {
+	//two triangles per cell, every corner its own vertex
+	std::vector<glm::vec3> positions, colors;
+	for (uint32_t y = 0; y + 1 < side; y++) {
+		for (uint32_t x = 0; x + 1 < side; x++) {
+			const uint32_t corners[6][2] = { { x, y }, { x, y + 1 }, { x + 1, y + 1 }, { x + 1, y + 1 }, { x + 1, y }, { x, y } };
+			for (const auto& corner : corners) {
+				positions.push_back(getGridPosition(corner[0], corner[1], side));
+				colors.push_back(getGridColor(corner[0], corner[1], side));
+			}
+		}
+	}
+	uint64_t attributeBytes = positions.size() * sizeof(glm::vec3);
+	uint64_t count = positions.size();
+
+	std::string json = "{\"asset\":{\"version\":\"2.0\"},\"scene\":0,\"scenes\":[{\"nodes\":[0]}],\"nodes\":[{\"mesh\":0}],"
+		"\"meshes\":[{\"name\":\"grid\",\"primitives\":[{\"attributes\":{\"POSITION\":0,\"COLOR_0\":1}}]}],"
+		"\"buffers\":[{\"byteLength\":" + std::to_string(attributeBytes * 2) + "}],"
+		"\"bufferViews\":[{\"buffer\":0,\"byteLength\":" + std::to_string(attributeBytes) + "},"
+		"{\"buffer\":0,\"byteOffset\":" + std::to_string(attributeBytes) + ",\"byteLength\":" + std::to_string(attributeBytes) + "}],"
+		"\"accessors\":[{\"bufferView\":0,\"componentType\":5126,\"count\":" + std::to_string(count) + ",\"type\":\"VEC3\"},"
+		"{\"bufferView\":1,\"componentType\":5126,\"count\":" + std::to_string(count) + ",\"type\":\"VEC3\"}]}";
+	while (json.size() % 4 != 0) json += ' ';
+
+	uint32_t jsonLength = static_cast<uint32_t>(json.size());
+	uint32_t binaryLength = static_cast<uint32_t>(attributeBytes * 2);
+	uint32_t header[3] = { 0x46546C67, 2, 12 + 8 + jsonLength + 8 + binaryLength };
+	uint32_t jsonHeader[2] = { jsonLength, 0x4E4F534A };
+	uint32_t binaryHeader[2] = { binaryLength, 0x004E4942 };
+
+	std::ofstream file(path, std::ios::binary | std::ios::trunc);
+	file.write(reinterpret_cast<const char*>(header), sizeof(header));
+	file.write(reinterpret_cast<const char*>(jsonHeader), sizeof(jsonHeader));
+	file.write(json.data(), json.size());
+	file.write(reinterpret_cast<const char*>(binaryHeader), sizeof(binaryHeader));
+	file.write(reinterpret_cast<const char*>(positions.data()), attributeBytes);
+	file.write(reinterpret_cast<const char*>(colors.data()), attributeBytes);
+	if (!file) {
+		throw std::runtime_error("Failed to write " + path);
+	}
+}
+
+static ImportResult runImport(const std::string& path, const std::string& format, uint32_t threads, uint32_t passes) {
+	ImportResult result;
+	result.format = format;
+	result.threads = threads;
+
+	try {
+		MeshImporter importer;
+		importer.setThreadCount(threads);
+		for (uint32_t pass = 0; pass < passes; pass++) {
+			std::vector<ImportedMesh> meshes = importer.import(path);
+			ImportStats stats = importer.getStats();
+			if (pass == 0 || stats.totalMs < result.stats.totalMs) {
+				result.stats = stats;
+			}
+		}
+	}
+	catch (const std::runtime_error& e) {
+		result.error = e.what();
+	}
+	return result;
+}
+
+static std::string jsonEscape(const std::string& text) {
+	std::string escaped;
+	for (char c : text) {
+		if (c == '"' || c == '\\') escaped += '\\';
+		if (c == '\n') { escaped += "\\n"; continue; }
+		escaped += c;
+	}
+	return escaped;
+}
+
+static void writeJson(FILE* out, const BenchmarkOptions& options, const std::vector<ImportResult>& results, uint64_t peakRss) {
+	fprintf(out, "{\n");
+	fprintf(out, "  \"benchmark\": \"import\",\n");
+	fprintf(out, "  \"triangles\": %llu,\n  \"passes\": %u,\n", (unsigned long long)options.triangles, options.passes);
+	fprintf(out, "  \"process_peak_rss_mb\": %.1f,\n", peakRss / (1024.0 * 1024.0));
+	fprintf(out, "  \"results\": [\n");
+	for (size_t i = 0; i < results.size(); i++) {
+		const ImportResult& r = results[i];
+		fprintf(out, "    {\"format\": \"%s\", \"threads\": %u, ", r.format.c_str(), r.threads);
+		if (!r.error.empty()) {
+			fprintf(out, "\"error\": \"%s\"}", jsonEscape(r.error).c_str());
+		}
+		else {
+			const ImportStats& s = r.stats;
+			fprintf(out, "\"file_mb\": %.1f, \"source_vertices\": %llu, \"welded_vertices\": %llu, \"triangles\": %llu, "
+				"\"parse_ms\": %.2f, \"weld_ms\": %.2f, \"total_ms\": %.2f, \"mtris_per_sec\": %.2f, \"peak_mb\": %.1f}",
+				s.fileBytes / (1024.0 * 1024.0), (unsigned long long)s.sourceVertices, (unsigned long long)s.weldedVertices,
+				(unsigned long long)s.triangles, s.parseMs, s.weldMs, s.totalMs,
+				s.totalMs > 0.0 ? s.triangles / (s.totalMs * 1000.0) : 0.0, s.peakBytes / (1024.0 * 1024.0));
+		}
+		fprintf(out, "%s\n", i + 1 < results.size() ? "," : "");
+	}
+	fprintf(out, "  ]\n}\n");
+}
+
+int main(int argc, char** argv) {
+	BenchmarkOptions options;
+	if (!parseOptions(argc, argv, options)) {
+		fprintf(stderr, "usage: ImportBenchmark [--triangles N] [--threads 1,2,4] [--passes N] [--dir path] [--keep] [--output file]\n");
+		return EXIT_FAILURE;
+	}
+
+	//side * side grid has 2 * (side - 1)^2 triangles
+	uint32_t side = static_cast<uint32_t>(std::ceil(std::sqrt(options.triangles / 2.0))) + 1;
+	std::string objPath = options.directory + "/ImportBenchmark.obj";
+	std::string glbPath = options.directory + "/ImportBenchmark.glb";
+	try {
+		fprintf(stderr, "writing %s...\n", objPath.c_str());
+		writeObj(objPath, side);
+		fprintf(stderr, "writing %s...\n", glbPath.c_str());
+		writeGlb(glbPath, side);
+	}
+	catch (const std::runtime_error& e) {
+		fprintf(stderr, "ERROR: %s\n", e.what());
+		return EXIT_FAILURE;
+	}
+
+	std::vector<ImportResult> results;
+	for (uint32_t threads : options.threadCounts) {
+		fprintf(stderr, "obj, %u threads...\n", threads);
+		results.push_back(runImport(objPath, "obj", threads, options.passes));
+		fprintf(stderr, "glb, %u threads...\n", threads);
+		results.push_back(runImport(glbPath, "glb", threads, options.passes));
+	}
+	uint64_t peakRss = getPeakRss();
+
+	if (!options.keep) {
+		std::remove(objPath.c_str());
+		std::remove(glbPath.c_str());
+	}
+
+	writeJson(stdout, options, results, peakRss);
+	if (!options.outputPath.empty()) {
+		FILE* file = fopen(options.outputPath.c_str(), "w");
+		if (file == nullptr) {
+			fprintf(stderr, "failed to open %s\n", options.outputPath.c_str());
+			return EXIT_FAILURE;
+		}
+		writeJson(file, options, results, peakRss);
+		fclose(file);
+	}
+
+	return 0;
+}
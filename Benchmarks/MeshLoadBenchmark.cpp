@@ -0,0 +1,293 @@
+// Mesh load throughput benchmark.
+// Writes a set of mesh files (several GB by default), then loads every mesh in them into the renderer's geometry arena
+// both by reading each file into heap vectors first (ifstream, as readFile does) and by mapping it with MeshFile,
+// which copies straight from the mapping into staging memory. Reports MB/s per pass as JSON.
+//
+// Files are written just before loading, so unless the OS has evicted them both loaders read from the page cache
+// (drop caches between runs and pass --keep / --reuse to measure cold disk reads)
+//
+// Usage (run from the build directory so Shaders/ can be found):
+//   MeshLoadBenchmark [--total-mb 2048] [--file-mb 256] [--mesh-vertices 65536] [--passes 2]
+//                     [--dir .] [--keep] [--reuse] [--output results.json]
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include "VulkanRenderer.h"
+#include "MeshFile.h"
+
+struct BenchmarkOptions {
+	uint64_t totalMB = 2048;
+	uint64_t fileMB = 256;
+	uint32_t meshVertices = 65536;				//rounded down to a square grid
+	uint32_t passes = 2;						//each pass loads every file once with each loader
+	std::string directory = ".";
+	bool keep = false;							//leave the files behind for another run
+	bool reuse = false;							//load files left by an earlier --keep run instead of writing them
+	std::string outputPath;
+};
+
+enum class Loader {
+	Stream,										//file read into a heap buffer, meshes copied into vectors, then uploaded
+	Mapped										//MeshFile mapping handed straight to createMesh
+};
+
+struct PassResult {
+	Loader loader = Loader::Stream;
+	uint32_t pass = 0;
+	uint32_t meshes = 0;
+	uint64_t bytes = 0;							//file bytes loaded
+	double cpuMs = 0.0;							//until every createMesh returned
+	double totalMs = 0.0;						//until every upload completed
+	double mbPerSec = 0.0;
+	std::string error;
+};
+
+static bool parseOptions(int argc, char** argv, BenchmarkOptions& options) {
+	for (int i = 1; i < argc; i++) {
+		std::string arg = argv[i];
+		if (arg == "--keep") {
+			options.keep = true;
+			continue;
+		}
+		if (arg == "--reuse") {
+			options.reuse = true;
+			continue;
+		}
+		if (i + 1 >= argc) {
+			fprintf(stderr, "missing value for %s\n", arg.c_str());
+			return false;
+		}
+		std::string value = argv[++i];
+
+		if (arg == "--total-mb") options.totalMB = std::stoull(value);
+		else if (arg == "--file-mb") options.fileMB = std::stoull(value);
+		else if (arg == "--mesh-vertices") options.meshVertices = static_cast<uint32_t>(std::stoul(value));
+		else if (arg == "--passes") options.passes = static_cast<uint32_t>(std::stoul(value));
+		else if (arg == "--dir") options.directory = value;
+		else if (arg == "--output") options.outputPath = value;
+		else {
+			fprintf(stderr, "unknown option %s\n", arg.c_str());
+			return false;
+		}
+	}
+	return options.totalMB > 0 && options.fileMB > 0 && options.meshVertices >= 4 && options.passes > 0;
+}
+
+static const char* getLoaderName(Loader loader) {
+	return loader == Loader::Mapped ? "mmap" : "stream";
+}
+
+//flat grid, side * side vertices
+static void generateGrid(uint32_t side, std::vector<Vertex>& vertices, std::vector<uint32_t>& indices) {
+	vertices.clear();
+	indices.clear();
+	for (uint32_t y = 0; y < side; y++) {
+		for (uint32_t x = 0; x < side; x++) {
+			Vertex vertex;
+			vertex.pos = glm::vec3(x / float(side - 1) - 0.5f, y / float(side - 1) - 0.5f, 0.0f);
+			vertex.col = glm::vec3(x / float(side - 1), y / float(side - 1), 0.5f);
+			vertices.push_back(vertex);
+		}
+	}
+	for (uint32_t y = 0; y + 1 < side; y++) {
+		for (uint32_t x = 0; x + 1 < side; x++) {
+			uint32_t topLeft = y * side + x;
+			uint32_t bottomLeft = topLeft + side;
+			indices.insert(indices.end(), { topLeft, bottomLeft, bottomLeft + 1, bottomLeft + 1, topLeft + 1, topLeft });
+		}
+	}
+}
+
+static std::vector<std::string> writeFiles(const BenchmarkOptions& options) {
+	uint32_t side = static_cast<uint32_t>(std::sqrt((double)options.meshVertices));
+	std::vector<Vertex> vertices;
+	std::vector<uint32_t> indices;
+	generateGrid(side, vertices, indices);
+
+	MeshData mesh;
+	mesh.vertices = vertices.data();
+	mesh.vertexCount = static_cast<uint32_t>(vertices.size());
+	mesh.indices = indices.data();
+	mesh.indexCount = static_cast<uint32_t>(indices.size());
+
+	uint64_t meshBytes = vertices.size() * sizeof(Vertex) + indices.size() * sizeof(uint32_t);
+	uint64_t meshesPerFile = std::max<uint64_t>(1, options.fileMB * 1024 * 1024 / meshBytes);
+	uint64_t fileCount = (options.totalMB + options.fileMB - 1) / options.fileMB;
+
+	//every entry shares the grid, the loaders cant tell and it keeps writing the set cheap
+	std::vector<MeshData> meshes(static_cast<size_t>(meshesPerFile), mesh);
+	std::vector<std::string> paths;
+	for (uint64_t i = 0; i < fileCount; i++) {
+		std::string path = options.directory + "/MeshLoadBenchmark_" + std::to_string(i) + ".vmesh";
+		if (!options.reuse) {
+			fprintf(stderr, "writing %s...\n", path.c_str());
+			writeMeshFile(path, meshes);
+		}
+		paths.push_back(path);
+	}
+	return paths;
+}
+
+//what loading looked like before mesh files were mapped: the whole file on the heap, then a vector per mesh
+static uint32_t loadStream(VulkanRenderer& renderer, const std::string& path, std::vector<int>& meshIDs, uint64_t* bytes) {
+	std::vector<char> file = readFile(path);
+	*bytes += file.size();
+
+	MeshFileHeader header;
+	memcpy(&header, file.data(), sizeof(header));
+	std::vector<MeshFileEntry> entries(header.meshCount);
+	memcpy(entries.data(), file.data() + sizeof(header), entries.size() * sizeof(MeshFileEntry));
+
+	std::vector<Vertex> vertices;
+	std::vector<uint32_t> indices;
+	for (const MeshFileEntry& entry : entries) {
+		vertices.resize(entry.vertexCount);
+		indices.resize(entry.indexCount);
+		memcpy(vertices.data(), file.data() + entry.vertexDataOffset, vertices.size() * sizeof(Vertex));
+		memcpy(indices.data(), file.data() + entry.indexDataOffset, indices.size() * sizeof(uint32_t));
+		meshIDs.push_back(renderer.createMesh(&vertices, &indices));
+	}
+	return header.meshCount;
+}
+
+static uint32_t loadMapped(VulkanRenderer& renderer, const std::string& path, std::vector<int>& meshIDs, uint64_t* bytes) {
+	MeshFile file;
+	file.open(path);
+	*bytes += file.getFileSize();
+
+	//the mapping can be closed as soon as createMesh returns, the data is in staging by then
+	for (uint32_t i = 0; i < file.getMeshCount(); i++) {
+		meshIDs.push_back(renderer.createMesh(file.getMesh(i)));
+	}
+	return file.getMeshCount();
+}
+
+static PassResult runPass(VulkanRenderer& renderer, const std::vector<std::string>& paths, Loader loader, uint32_t pass) {
+	PassResult result;
+	result.loader = loader;
+	result.pass = pass;
+
+	try {
+		double cpuMs = 0.0;
+		auto start = std::chrono::steady_clock::now();
+		std::vector<int> meshIDs;
+		for (const std::string& path : paths) {
+			auto fileStart = std::chrono::steady_clock::now();
+			result.meshes += loader == Loader::Mapped ? loadMapped(renderer, path, meshIDs, &result.bytes) : loadStream(renderer, path, meshIDs, &result.bytes);
+			std::chrono::duration<double, std::milli> fileTime = std::chrono::steady_clock::now() - fileStart;
+			cpuMs += fileTime.count();
+
+			//the whole set wont fit in device memory, so each file's meshes are dropped once uploaded (not timed as load)
+			renderer.waitForUploads();
+			auto destroyStart = std::chrono::steady_clock::now();
+			for (int meshID : meshIDs) {
+				renderer.destroyMesh(meshID);
+			}
+			meshIDs.clear();
+			start += std::chrono::steady_clock::now() - destroyStart;
+		}
+		std::chrono::duration<double, std::milli> totalTime = std::chrono::steady_clock::now() - start;
+
+		result.cpuMs = cpuMs;
+		result.totalMs = totalTime.count();
+		result.mbPerSec = result.totalMs > 0.0 ? (result.bytes / (1024.0 * 1024.0)) / (result.totalMs / 1000.0) : 0.0;
+	}
+	catch (const std::runtime_error& e) {
+		result.error = e.what();
+	}
+	return result;
+}
+
+static std::string jsonEscape(const std::string& text) {
+	std::string escaped;
+	for (char c : text) {
+		if (c == '"' || c == '\\') escaped += '\\';
+		if (c == '\n') { escaped += "\\n"; continue; }
+		escaped += c;
+	}
+	return escaped;
+}
+
+static void writeJson(FILE* out, const BenchmarkOptions& options, const std::string& deviceName, size_t fileCount, const std::vector<PassResult>& results) {
+	fprintf(out, "{\n");
+	fprintf(out, "  \"benchmark\": \"mesh_load\",\n");
+	fprintf(out, "  \"device\": \"%s\",\n", jsonEscape(deviceName).c_str());
+	fprintf(out, "  \"files\": %zu,\n  \"file_mb\": %llu,\n  \"mesh_vertices\": %u,\n", fileCount, (unsigned long long)options.fileMB, options.meshVertices);
+	fprintf(out, "  \"results\": [\n");
+	for (size_t i = 0; i < results.size(); i++) {
+		const PassResult& r = results[i];
+		fprintf(out, "    {\"loader\": \"%s\", \"pass\": %u, ", getLoaderName(r.loader), r.pass);
+		if (!r.error.empty()) {
+			fprintf(out, "\"error\": \"%s\"}", jsonEscape(r.error).c_str());
+		}
+		else {
+			fprintf(out, "\"meshes\": %u, \"mb\": %.1f, \"cpu_ms\": %.2f, \"total_ms\": %.2f, \"mb_per_sec\": %.1f}",
+				r.meshes, r.bytes / (1024.0 * 1024.0), r.cpuMs, r.totalMs, r.mbPerSec);
+		}
+		fprintf(out, "%s\n", i + 1 < results.size() ? "," : "");
+	}
+	fprintf(out, "  ]\n}\n");
+}
+
+int main(int argc, char** argv) {
+	BenchmarkOptions options;
+	if (!parseOptions(argc, argv, options)) {
+		fprintf(stderr, "usage: MeshLoadBenchmark [--total-mb N] [--file-mb N] [--mesh-vertices N] [--passes N] [--dir path] [--keep] [--reuse] [--output file]\n");
+		return EXIT_FAILURE;
+	}
+
+	std::vector<std::string> paths;
+	try {
+		paths = writeFiles(options);
+	}
+	catch (const std::runtime_error& e) {
+		fprintf(stderr, "ERROR: %s\n", e.what());
+		return EXIT_FAILURE;
+	}
+
+	VulkanRenderer renderer;
+	if (renderer.initHeadless(64, 64) == EXIT_FAILURE) {
+		return EXIT_FAILURE;
+	}
+
+	//this measures loading, build time reordering would dominate it (16 bit index narrowing stays on for both loaders)
+	MeshOptimizeSettings optimizeSettings;
+	optimizeSettings.vertexCache = false;
+	optimizeSettings.vertexFetch = false;
+	renderer.setMeshOptimization(optimizeSettings);
+
+	//loaders alternate so neither always runs right after the files were written
+	std::vector<PassResult> results;
+	for (uint32_t pass = 0; pass < options.passes; pass++) {
+		for (Loader loader : { Loader::Stream, Loader::Mapped }) {
+			fprintf(stderr, "pass %u, %s...\n", pass, getLoaderName(loader));
+			results.push_back(runPass(renderer, paths, loader, pass));
+		}
+	}
+	std::string deviceName = renderer.getDeviceName();
+	renderer.cleanup();
+
+	if (!options.keep) {
+		for (const std::string& path : paths) {
+			std::remove(path.c_str());
+		}
+	}
+
+	writeJson(stdout, options, deviceName, paths.size(), results);
+	if (!options.outputPath.empty()) {
+		FILE* file = fopen(options.outputPath.c_str(), "w");
+		if (file == nullptr) {
+			fprintf(stderr, "failed to open %s\n", options.outputPath.c_str());
+			return EXIT_FAILURE;
+		}
+		writeJson(file, options, deviceName, paths.size(), results);
+		fclose(file);
+	}
+
+	return 0;
+}
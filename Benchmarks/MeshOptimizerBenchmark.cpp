@@ -0,0 +1,268 @@
+// Mesh optimizer benchmark (CPU only).
+// Runs each MeshOptimizer stage on generated meshes (and optionally imported models) and reports the simulated
+// post transform cache efficiency after each one as JSON: ACMR (transformed vertices per triangle, 0.5 is ideal for
+// regular meshes) and ATVR (transformed vertices per vertex, 1 is ideal) for several FIFO cache sizes, plus the time
+// each stage took and the index memory 16 bit indices save.
+//
+// Usage:
+//   MeshOptimizerBenchmark [--grid-side 512] [--threshold 1.05] [--model file.obj|gltf|glb ...] [--output results.json]
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "MeshOptimizer.h"
+#include "MeshImporter.h"
+
+struct BenchmarkOptions {
+	uint32_t gridSide = 512;					//generated meshes have about 2 * side^2 triangles
+	float threshold = 1.05f;
+	std::vector<std::string> modelPaths;
+	std::string outputPath;
+};
+
+static const uint32_t CACHE_SIZES[] = { 8, 16, 32 };
+
+//cache efficiency of one triangle order
+struct StageResult {
+	std::string stage;
+	double ms = 0.0;							//of this stage alone
+	VertexCacheStats cache[3];					//one per CACHE_SIZES entry
+	uint32_t clusters = 0;
+};
+
+struct MeshResult {
+	std::string name;
+	uint32_t vertices = 0;
+	uint32_t triangles = 0;
+	uint64_t indexBytes32 = 0;
+	uint64_t indexBytes16 = 0;					//0 if the mesh has too many vertices for 16 bit indices
+	std::vector<StageResult> stages;
+	std::string error;
+};
+
+struct TestMesh {
+	std::string name;
+	std::vector<Vertex> vertices;
+	std::vector<uint32_t> indices;
+};
+
+static bool parseOptions(int argc, char** argv, BenchmarkOptions& options) {
+	for (int i = 1; i < argc; i++) {
+		std::string arg = argv[i];
+		if (i + 1 >= argc) {
+			fprintf(stderr, "missing value for %s\n", arg.c_str());
+			return false;
+		}
+		std::string value = argv[++i];
+
+		if (arg == "--grid-side") options.gridSide = static_cast<uint32_t>(std::stoul(value));
+		else if (arg == "--threshold") options.threshold = std::stof(value);
+		else if (arg == "--model") options.modelPaths.push_back(value);
+		else if (arg == "--output") options.outputPath = value;
+		else {
+			fprintf(stderr, "unknown option %s\n", arg.c_str());
+			return false;
+		}
+	}
+	return options.gridSide >= 2 && options.threshold >= 1.0f;
+}
+
+//side * side vertices wrapped onto a sphere, triangles in row order (what a simple exporter writes)
+static TestMesh generateSphere(uint32_t side) {
+	TestMesh mesh;
+	mesh.name = "sphere_rows";
+	for (uint32_t y = 0; y < side; y++) {
+		for (uint32_t x = 0; x < side; x++) {
+			float theta = x / float(side - 1) * 6.2831853f;
+			float phi = y / float(side - 1) * 3.1415927f;
+			Vertex vertex;
+			vertex.pos = glm::vec3(std::sin(phi) * std::cos(theta), std::cos(phi), std::sin(phi) * std::sin(theta));
+			vertex.col = glm::vec3(x / float(side - 1), y / float(side - 1), 0.5f);
+			mesh.vertices.push_back(vertex);
+		}
+	}
+	for (uint32_t y = 0; y + 1 < side; y++) {
+		for (uint32_t x = 0; x + 1 < side; x++) {
+			uint32_t topLeft = y * side + x;
+			uint32_t bottomLeft = topLeft + side;
+			mesh.indices.insert(mesh.indices.end(), { topLeft, bottomLeft, bottomLeft + 1, bottomLeft + 1, topLeft + 1, topLeft });
+		}
+	}
+	return mesh;
+}
+
+//same sphere with triangles and vertices shuffled, the worst case a careless tool produces
+static TestMesh shuffleMesh(const TestMesh& source) {
+	TestMesh mesh;
+	mesh.name = "sphere_shuffled";
+	std::mt19937 rng(1234);
+
+	std::vector<uint32_t> vertexOrder(source.vertices.size());
+	for (uint32_t i = 0; i < vertexOrder.size(); i++) vertexOrder[i] = i;
+	std::shuffle(vertexOrder.begin(), vertexOrder.end(), rng);
+	std::vector<uint32_t> remap(source.vertices.size());
+	mesh.vertices.resize(source.vertices.size());
+	for (uint32_t i = 0; i < vertexOrder.size(); i++) {
+		mesh.vertices[i] = source.vertices[vertexOrder[i]];
+		remap[vertexOrder[i]] = i;
+	}
+
+	std::vector<uint32_t> triangleOrder(source.indices.size() / 3);
+	for (uint32_t i = 0; i < triangleOrder.size(); i++) triangleOrder[i] = i;
+	std::shuffle(triangleOrder.begin(), triangleOrder.end(), rng);
+	for (uint32_t triangle : triangleOrder) {
+		for (uint32_t corner = 0; corner < 3; corner++) {
+			mesh.indices.push_back(remap[source.indices[triangle * 3 + corner]]);
+		}
+	}
+	return mesh;
+}
+
+static StageResult measureStage(const std::string& stage, const std::vector<uint32_t>& indices, uint32_t vertexCount, double ms) {
+	StageResult result;
+	result.stage = stage;
+	result.ms = ms;
+	for (size_t i = 0; i < 3; i++) {
+		result.cache[i] = analyzeVertexCache(indices.data(), static_cast<uint32_t>(indices.size()), vertexCount, CACHE_SIZES[i]);
+	}
+	return result;
+}
+
+static double getElapsedMs(std::chrono::steady_clock::time_point start) {
+	std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+	return elapsed.count();
+}
+
+//each stage feeds the next, in the order optimizeMesh applies them
+static MeshResult runMesh(const TestMesh& mesh, float threshold) {
+	MeshResult result;
+	result.name = mesh.name;
+	result.vertices = static_cast<uint32_t>(mesh.vertices.size());
+	result.triangles = static_cast<uint32_t>(mesh.indices.size() / 3);
+
+	try {
+		uint32_t indexCount = result.triangles * 3;
+		std::vector<uint32_t> original(mesh.indices.begin(), mesh.indices.begin() + indexCount);
+		result.stages.push_back(measureStage("original", original, result.vertices, 0.0));
+
+		std::vector<uint32_t> cacheOrder(indexCount);
+		std::vector<uint32_t> clusterStarts;
+		auto start = std::chrono::steady_clock::now();
+		optimizeVertexCache(cacheOrder.data(), original.data(), indexCount, result.vertices, VERTEX_CACHE_SIZE, &clusterStarts);
+		result.stages.push_back(measureStage("vertex_cache", cacheOrder, result.vertices, getElapsedMs(start)));
+		result.stages.back().clusters = static_cast<uint32_t>(clusterStarts.size());
+
+		std::vector<uint32_t> overdrawOrder(indexCount);
+		start = std::chrono::steady_clock::now();
+		uint32_t clusters = optimizeOverdraw(overdrawOrder.data(), cacheOrder.data(), indexCount, mesh.vertices.data(), result.vertices,
+			clusterStarts, VERTEX_CACHE_SIZE, threshold);
+		result.stages.push_back(measureStage("overdraw", overdrawOrder, result.vertices, getElapsedMs(start)));
+		result.stages.back().clusters = clusters;
+
+		//fetch order doesnt change which vertices are transformed, only where they are read from
+		std::vector<Vertex> fetchVertices(mesh.vertices.size());
+		start = std::chrono::steady_clock::now();
+		uint32_t fetchedVertices = optimizeVertexFetch(fetchVertices.data(), overdrawOrder.data(), indexCount, mesh.vertices.data(), result.vertices);
+		result.stages.push_back(measureStage("vertex_fetch", overdrawOrder, fetchedVertices, getElapsedMs(start)));
+
+		result.indexBytes32 = static_cast<uint64_t>(indexCount) * sizeof(uint32_t);
+		result.indexBytes16 = fetchedVertices <= SHORT_INDEX_VERTEX_LIMIT ? static_cast<uint64_t>(indexCount) * sizeof(uint16_t) : 0;
+	}
+	catch (const std::runtime_error& e) {
+		result.error = e.what();
+	}
+	return result;
+}
+
+static std::string jsonEscape(const std::string& text) {
+	std::string escaped;
+	for (char c : text) {
+		if (c == '"' || c == '\\') escaped += '\\';
+		if (c == '\n') { escaped += "\\n"; continue; }
+		escaped += c;
+	}
+	return escaped;
+}
+
+static void writeJson(FILE* out, const BenchmarkOptions& options, const std::vector<MeshResult>& results) {
+	fprintf(out, "{\n");
+	fprintf(out, "  \"benchmark\": \"mesh_optimizer\",\n");
+	fprintf(out, "  \"target_cache_size\": %u,\n  \"overdraw_threshold\": %.3f,\n", VERTEX_CACHE_SIZE, options.threshold);
+	fprintf(out, "  \"results\": [\n");
+	for (size_t i = 0; i < results.size(); i++) {
+		const MeshResult& r = results[i];
+		fprintf(out, "    {\"mesh\": \"%s\", ", jsonEscape(r.name).c_str());
+		if (!r.error.empty()) {
+			fprintf(out, "\"error\": \"%s\"}", jsonEscape(r.error).c_str());
+		}
+		else {
+			fprintf(out, "\"vertices\": %u, \"triangles\": %u, \"index_bytes_32\": %llu, \"index_bytes_16\": %llu, \"stages\": [\n",
+				r.vertices, r.triangles, (unsigned long long)r.indexBytes32, (unsigned long long)r.indexBytes16);
+			for (size_t s = 0; s < r.stages.size(); s++) {
+				const StageResult& stage = r.stages[s];
+				fprintf(out, "      {\"stage\": \"%s\", \"ms\": %.2f, \"clusters\": %u", stage.stage.c_str(), stage.ms, stage.clusters);
+				for (size_t c = 0; c < 3; c++) {
+					fprintf(out, ", \"acmr_%u\": %.3f, \"atvr_%u\": %.3f", CACHE_SIZES[c], stage.cache[c].acmr, CACHE_SIZES[c], stage.cache[c].atvr);
+				}
+				fprintf(out, "}%s\n", s + 1 < r.stages.size() ? "," : "");
+			}
+			fprintf(out, "    ]}");
+		}
+		fprintf(out, "%s\n", i + 1 < results.size() ? "," : "");
+	}
+	fprintf(out, "  ]\n}\n");
+}
+
+int main(int argc, char** argv) {
+	BenchmarkOptions options;
+	if (!parseOptions(argc, argv, options)) {
+		fprintf(stderr, "usage: MeshOptimizerBenchmark [--grid-side N] [--threshold F] [--model file ...] [--output file]\n");
+		return EXIT_FAILURE;
+	}
+
+	std::vector<MeshResult> results;
+	TestMesh sphere = generateSphere(options.gridSide);
+	fprintf(stderr, "%s...\n", sphere.name.c_str());
+	results.push_back(runMesh(sphere, options.threshold));
+	TestMesh shuffled = shuffleMesh(sphere);
+	fprintf(stderr, "%s...\n", shuffled.name.c_str());
+	results.push_back(runMesh(shuffled, options.threshold));
+
+	MeshImporter importer;
+	for (const std::string& path : options.modelPaths) {
+		try {
+			for (ImportedMesh& imported : importer.import(path)) {
+				TestMesh mesh;
+				mesh.name = path + ":" + imported.name;
+				mesh.vertices.swap(imported.vertices);
+				mesh.indices.swap(imported.indices);
+				fprintf(stderr, "%s...\n", mesh.name.c_str());
+				results.push_back(runMesh(mesh, options.threshold));
+			}
+		}
+		catch (const std::runtime_error& e) {
+			MeshResult result;
+			result.name = path;
+			result.error = e.what();
+			results.push_back(result);
+		}
+	}
+
+	writeJson(stdout, options, results);
+	if (!options.outputPath.empty()) {
+		FILE* file = fopen(options.outputPath.c_str(), "w");
+		if (file == nullptr) {
+			fprintf(stderr, "failed to open %s\n", options.outputPath.c_str());
+			return EXIT_FAILURE;
+		}
+		writeJson(file, options, results);
+		fclose(file);
+	}
+
+	return 0;
+}
@@ -0,0 +1,119 @@
+// Offline mesh converter.
+// Converts OBJ and glTF 2.0 (.gltf / .glb) files into one mesh file (MeshFile.h) the renderer maps and uploads
+// without parsing. Imports go through MeshImporter: one mesh per OBJ file and per glTF mesh instance, positions and
+// colours kept, vertices welded. Meshes are then reordered for the vertex cache, overdraw and vertex fetch (MeshOptimizer)
+// so the renderer can skip that at load time, --no-optimize writes them in import order.
+//
+// Usage:
+//   MeshConverter [--color r,g,b] [--threads N] [--no-optimize] output.vmesh input.obj|gltf|glb [input2 ...]
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+#include "MeshFile.h"
+#include "MeshImporter.h"
+#include "MeshOptimizer.h"
+
+struct ConverterOptions {
+	glm::vec3 defaultColor = glm::vec3(0.8f, 0.8f, 0.8f);	//for vertices without a colour
+	uint32_t threads = 0;									//0 uses every hardware thread
+	bool optimize = true;
+	std::string outputPath;
+	std::vector<std::string> inputPaths;
+};
+
+static bool parseOptions(int argc, char** argv, ConverterOptions& options) {
+	std::vector<std::string> paths;
+	for (int i = 1; i < argc; i++) {
+		std::string arg = argv[i];
+		if (arg == "--color") {
+			if (i + 1 >= argc) {
+				fprintf(stderr, "missing value for %s\n", arg.c_str());
+				return false;
+			}
+			if (sscanf(argv[++i], "%f,%f,%f", &options.defaultColor.x, &options.defaultColor.y, &options.defaultColor.z) != 3) {
+				fprintf(stderr, "--color expects r,g,b\n");
+				return false;
+			}
+		}
+		else if (arg == "--no-optimize") {
+			options.optimize = false;
+		}
+		else if (arg == "--threads") {
+			if (i + 1 >= argc) {
+				fprintf(stderr, "missing value for %s\n", arg.c_str());
+				return false;
+			}
+			options.threads = static_cast<uint32_t>(std::stoul(argv[++i]));
+		}
+		else {
+			paths.push_back(arg);
+		}
+	}
+	if (paths.size() < 2) return false;
+
+	options.outputPath = paths[0];
+	options.inputPaths.assign(paths.begin() + 1, paths.end());
+	return true;
+}
+
+int main(int argc, char** argv) {
+	ConverterOptions options;
+	if (!parseOptions(argc, argv, options)) {
+		fprintf(stderr, "usage: MeshConverter [--color r,g,b] [--threads N] [--no-optimize] output.vmesh input.obj|gltf|glb [input2 ...]\n");
+		return EXIT_FAILURE;
+	}
+
+	try {
+		auto start = std::chrono::steady_clock::now();
+
+		MeshImporter importer;
+		importer.setThreadCount(options.threads);
+		importer.setDefaultColor(options.defaultColor);
+
+		//every input stays loaded until the file is written, the table at its start needs them all
+		std::vector<ImportedMesh> meshes;
+		for (const std::string& inputPath : options.inputPaths) {
+			std::vector<ImportedMesh> imported = importer.import(inputPath);
+			ImportStats stats = importer.getStats();
+			fprintf(stderr, "%s: %zu meshes, %llu vertices (%llu before welding), %llu triangles in %.1f ms on %u threads\n",
+				inputPath.c_str(), imported.size(), (unsigned long long)stats.weldedVertices, (unsigned long long)stats.sourceVertices,
+				(unsigned long long)stats.triangles, stats.totalMs, stats.threads);
+			for (ImportedMesh& mesh : imported) {
+				meshes.push_back(std::move(mesh));
+			}
+		}
+
+		std::vector<MeshData> meshData;
+		for (ImportedMesh& mesh : meshes) {
+			meshData.push_back(mesh.getMeshData());
+			if (!options.optimize) continue;
+
+			//ACMR / ATVR for a FIFO cache of VERTEX_CACHE_SIZE entries, lower is better
+			std::vector<Vertex> vertices;
+			std::vector<uint32_t> indices;
+			MeshOptimizeStats stats;
+			optimizeMesh(meshData.back(), MeshOptimizeSettings(), vertices, indices, &stats);
+			fprintf(stderr, "%s: ACMR %.3f -> %.3f, ATVR %.3f -> %.3f, %u overdraw clusters, %s, %.1f ms\n", mesh.name.c_str(),
+				stats.before.acmr, stats.after.acmr, stats.before.atvr, stats.after.atvr, stats.clusters, stats.shortIndices ? "fits 16 bit indices" : "needs 32 bit indices", stats.optimizeMs);
+
+			mesh.vertices.swap(vertices);
+			mesh.indices.swap(indices);
+			meshData.back() = mesh.getMeshData();
+			meshData.back().optimized = true;
+		}
+		writeMeshFile(options.outputPath, meshData);
+
+		std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+		fprintf(stderr, "wrote %zu meshes to %s in %.1f ms\n", meshes.size(), options.outputPath.c_str(), elapsed.count());
+	}
+	catch (const std::runtime_error& e) {
+		fprintf(stderr, "ERROR: %s\n", e.what());
+		return EXIT_FAILURE;
+	}
+
+	return 0;
+}
@@ -0,0 +1,229 @@
+#include "Culling.h"
+
+#include <cmath>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define CULLING_X86 1
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+#endif
+
+//GCC and Clang only emit AVX2 instructions in functions that ask for them, MSVC allows them anywhere
+#if defined(CULLING_X86) && (defined(__GNUC__) || defined(__clang__))
+#define CULLING_TARGET_AVX2 __attribute__((target("avx2")))
+#else
+#define CULLING_TARGET_AVX2
+#endif
+
+void SphereBounds::resize(size_t count)
+{
+	centerX.resize(count, 0.0f);
+	centerY.resize(count, 0.0f);
+	centerZ.resize(count, 0.0f);
+	radius.resize(count, CULLED_RADIUS);
+}
+
+void SphereBounds::set(size_t index, const glm::vec3& center, float sphereRadius)
+{
+	centerX[index] = center.x;
+	centerY[index] = center.y;
+	centerZ[index] = center.z;
+	radius[index] = sphereRadius;
+}
+
+size_t SphereBounds::size() const
+{
+	return radius.size();
+}
+
+Frustum extractFrustum(const glm::mat4& viewProjection)
+{
+	//Gribb/Hartmann: each plane is the last row of the matrix plus or minus another row (glm is column major)
+	glm::vec4 rows[4];
+	for (int i = 0; i < 4; i++) {
+		rows[i] = glm::vec4(viewProjection[0][i], viewProjection[1][i], viewProjection[2][i], viewProjection[3][i]);
+	}
+
+	Frustum frustum;
+	frustum.planes[0] = rows[3] + rows[0];
+	frustum.planes[1] = rows[3] - rows[0];
+	frustum.planes[2] = rows[3] + rows[1];
+	frustum.planes[3] = rows[3] - rows[1];
+	frustum.planes[4] = rows[3] + rows[2];					//-w <= z, conservative when the projection maps depth to [0, w]
+	frustum.planes[5] = rows[3] - rows[2];
+
+	for (auto& plane : frustum.planes) {
+		plane /= glm::length(glm::vec3(plane));
+	}
+	return frustum;
+}
+
+static uint32_t cullSpheresScalar(const Frustum& frustum, const SphereBounds& bounds, size_t first, uint32_t* visible, uint32_t count)
+{
+	for (size_t i = first; i < bounds.size(); i++) {
+		bool inside = true;
+		for (int p = 0; p < 6 && inside; p++) {
+			const glm::vec4& plane = frustum.planes[p];
+			//same association as the SIMD kernels so every kernel gives identical results
+			float distance = (plane.x * bounds.centerX[i] + plane.y * bounds.centerY[i]) + (plane.z * bounds.centerZ[i] + plane.w);
+			inside = distance + bounds.radius[i] >= 0.0f;
+		}
+
+		//branchless append, the slot is overwritten by the next sphere when this one is culled
+		visible[count] = static_cast<uint32_t>(i);
+		count += inside ? 1 : 0;
+	}
+	return count;
+}
+
+#ifdef CULLING_X86
+
+static uint32_t cullSpheresSSE(const Frustum& frustum, const SphereBounds& bounds, uint32_t* visible)
+{
+	const float* xs = bounds.centerX.data();
+	const float* ys = bounds.centerY.data();
+	const float* zs = bounds.centerZ.data();
+	const float* rs = bounds.radius.data();
+
+	__m128 planeX[6], planeY[6], planeZ[6], planeW[6];
+	for (int p = 0; p < 6; p++) {
+		planeX[p] = _mm_set1_ps(frustum.planes[p].x);
+		planeY[p] = _mm_set1_ps(frustum.planes[p].y);
+		planeZ[p] = _mm_set1_ps(frustum.planes[p].z);
+		planeW[p] = _mm_set1_ps(frustum.planes[p].w);
+	}
+	__m128 zero = _mm_setzero_ps();
+
+	uint32_t count = 0;
+	size_t simdCount = bounds.size() & ~size_t(3);
+	for (size_t i = 0; i < simdCount; i += 4) {
+		__m128 x = _mm_loadu_ps(xs + i);
+		__m128 y = _mm_loadu_ps(ys + i);
+		__m128 z = _mm_loadu_ps(zs + i);
+		__m128 r = _mm_loadu_ps(rs + i);
+
+		//sphere is inside while its signed distance plus radius is non negative for every plane
+		__m128 inside = _mm_castsi128_ps(_mm_set1_epi32(-1));
+		for (int p = 0; p < 6; p++) {
+			__m128 distance = _mm_add_ps(_mm_add_ps(_mm_mul_ps(planeX[p], x), _mm_mul_ps(planeY[p], y)), _mm_add_ps(_mm_mul_ps(planeZ[p], z), planeW[p]));
+			inside = _mm_and_ps(inside, _mm_cmpge_ps(_mm_add_ps(distance, r), zero));
+		}
+
+		int mask = _mm_movemask_ps(inside);
+		for (uint32_t lane = 0; lane < 4; lane++) {
+			visible[count] = static_cast<uint32_t>(i + lane);
+			count += (mask >> lane) & 1;
+		}
+	}
+
+	return cullSpheresScalar(frustum, bounds, simdCount, visible, count);
+}
+
+CULLING_TARGET_AVX2
+static uint32_t cullSpheresAVX2(const Frustum& frustum, const SphereBounds& bounds, uint32_t* visible)
+{
+	const float* xs = bounds.centerX.data();
+	const float* ys = bounds.centerY.data();
+	const float* zs = bounds.centerZ.data();
+	const float* rs = bounds.radius.data();
+
+	__m256 planeX[6], planeY[6], planeZ[6], planeW[6];
+	for (int p = 0; p < 6; p++) {
+		planeX[p] = _mm256_set1_ps(frustum.planes[p].x);
+		planeY[p] = _mm256_set1_ps(frustum.planes[p].y);
+		planeZ[p] = _mm256_set1_ps(frustum.planes[p].z);
+		planeW[p] = _mm256_set1_ps(frustum.planes[p].w);
+	}
+	__m256 zero = _mm256_setzero_ps();
+
+	uint32_t count = 0;
+	size_t simdCount = bounds.size() & ~size_t(7);
+	for (size_t i = 0; i < simdCount; i += 8) {
+		__m256 x = _mm256_loadu_ps(xs + i);
+		__m256 y = _mm256_loadu_ps(ys + i);
+		__m256 z = _mm256_loadu_ps(zs + i);
+		__m256 r = _mm256_loadu_ps(rs + i);
+
+		__m256 inside = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+		for (int p = 0; p < 6; p++) {
+			__m256 distance = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(planeX[p], x), _mm256_mul_ps(planeY[p], y)), _mm256_add_ps(_mm256_mul_ps(planeZ[p], z), planeW[p]));
+			inside = _mm256_and_ps(inside, _mm256_cmp_ps(_mm256_add_ps(distance, r), zero, _CMP_GE_OQ));
+		}
+
+		int mask = _mm256_movemask_ps(inside);
+		for (uint32_t lane = 0; lane < 8; lane++) {
+			visible[count] = static_cast<uint32_t>(i + lane);
+			count += (mask >> lane) & 1;
+		}
+	}
+
+	return cullSpheresScalar(frustum, bounds, simdCount, visible, count);
+}
+
+static bool cpuSupportsAVX2()
+{
+#if defined(_MSC_VER)
+	int info[4];
+	__cpuid(info, 0);
+	if (info[0] < 7) return false;
+
+	//the OS also has to save the upper halves of the ymm registers
+	__cpuid(info, 1);
+	bool osSavesYmm = (info[2] & (1 << 27)) != 0 && (_xgetbv(0) & 6) == 6;
+	__cpuidex(info, 7, 0);
+	return osSavesYmm && (info[1] & (1 << 5)) != 0;
+#else
+	return __builtin_cpu_supports("avx2");
+#endif
+}
+
+#endif
+
+bool isCullingKernelSupported(CullingKernel kernel)
+{
+	switch (kernel) {
+	case CullingKernel::Scalar:
+		return true;
+#ifdef CULLING_X86
+	case CullingKernel::SSE:
+		return true;											//baseline on every x86 target built for
+	case CullingKernel::AVX2: {
+		static const bool avx2 = cpuSupportsAVX2();
+		return avx2;
+	}
+#endif
+	default:
+		return false;
+	}
+}
+
+CullingKernel getBestCullingKernel()
+{
+	if (isCullingKernelSupported(CullingKernel::AVX2)) return CullingKernel::AVX2;
+	if (isCullingKernelSupported(CullingKernel::SSE)) return CullingKernel::SSE;
+	return CullingKernel::Scalar;
+}
+
+const char* getCullingKernelName(CullingKernel kernel)
+{
+	switch (kernel) {
+	case CullingKernel::SSE: return "sse";
+	case CullingKernel::AVX2: return "avx2";
+	default: return "scalar";
+	}
+}
+
+uint32_t cullSpheres(CullingKernel kernel, const Frustum& frustum, const SphereBounds& bounds, uint32_t* visible)
+{
+#ifdef CULLING_X86
+	if (kernel == CullingKernel::AVX2 && isCullingKernelSupported(CullingKernel::AVX2)) {
+		return cullSpheresAVX2(frustum, bounds, visible);
+	}
+	if (kernel == CullingKernel::SSE) {
+		return cullSpheresSSE(frustum, bounds, visible);
+	}
+#endif
+	return cullSpheresScalar(frustum, bounds, 0, visible, 0);
+}
@@ -0,0 +1,44 @@
+#pragma once
+
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+//implementations of the sphere/frustum test, picked at runtime from what the CPU supports
+enum class CullingKernel {
+	Scalar,
+	SSE,											//4 spheres per iteration
+	AVX2											//8 spheres per iteration
+};
+
+//six planes (left, right, bottom, top, near, far) as xyz normal pointing inwards and w distance
+struct Frustum {
+	glm::vec4 planes[6];
+};
+
+//radius that fails every plane test, for entries that must not be drawn
+const float CULLED_RADIUS = std::numeric_limits<float>::lowest();
+
+//bounding spheres as structure of arrays, so kernels load one component of several spheres at a time
+struct SphereBounds {
+	std::vector<float> centerX;
+	std::vector<float> centerY;
+	std::vector<float> centerZ;
+	std::vector<float> radius;						//CULLED_RADIUS for entries that must not be drawn
+
+	void resize(size_t count);
+	void set(size_t index, const glm::vec3& center, float sphereRadius);
+	size_t size() const;
+};
+
+//planes of the view projection's clip volume, normalised so plane distances are in world units
+Frustum extractFrustum(const glm::mat4& viewProjection);
+
+bool isCullingKernelSupported(CullingKernel kernel);
+CullingKernel getBestCullingKernel();
+const char* getCullingKernelName(CullingKernel kernel);
+
+//writes the index of every sphere at least partly inside the frustum to visible (room for bounds.size()), returns how many
+uint32_t cullSpheres(CullingKernel kernel, const Frustum& frustum, const SphereBounds& bounds, uint32_t* visible);
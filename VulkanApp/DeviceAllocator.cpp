@@ -0,0 +1,522 @@
+#include "DeviceAllocator.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+//smallest remainder worth splitting off into its own free region
+const VkDeviceSize MIN_SPLIT_SIZE = 64;
+
+//index of the highest set bit (value must be non zero)
+static uint32_t highBit(uint64_t value) {
+#ifdef _MSC_VER
+	unsigned long index;
+	_BitScanReverse64(&index, value);
+	return index;
+#else
+	return 63 - __builtin_clzll(value);
+#endif
+}
+
+//index of the lowest set bit (value must be non zero)
+static uint32_t lowBit(uint64_t value) {
+#ifdef _MSC_VER
+	unsigned long index;
+	_BitScanForward64(&index, value);
+	return index;
+#else
+	return __builtin_ctzll(value);
+#endif
+}
+
+static VkDeviceSize alignUp(VkDeviceSize value, VkDeviceSize alignment) {
+	return (value + alignment - 1) / alignment * alignment;
+}
+
+const uint32_t TlsfHeap::INVALID_NODE;
+
+TlsfHeap::TlsfHeap()
+{
+}
+
+void TlsfHeap::init(VkDeviceSize size)
+{
+	heapSize = size;
+	freeBytes = 0;
+	freeRegionCount = 0;
+	nodes.clear();
+	unusedNodes.clear();
+
+	flBitmap = 0;
+	slBitmap.fill(0);
+	for (auto& heads : freeHeads) {
+		heads.fill(INVALID_NODE);
+	}
+
+	//whole heap starts as one free region
+	uint32_t node = createNode();
+	nodes[node].offset = 0;
+	nodes[node].size = size;
+	insertFree(node);
+}
+
+bool TlsfHeap::allocate(VkDeviceSize size, VkDeviceSize alignment, VkDeviceSize* offset, VkDeviceSize* allocatedSize, uint32_t* node)
+{
+	//room for worst case alignment padding, rounded up to the next size class so any region found fits
+	VkDeviceSize searchSize = size + alignment - 1;
+	if (searchSize >= SL_COUNT) {
+		searchSize += (VkDeviceSize(1) << (highBit(searchSize) - SL_BITS)) - 1;
+	}
+
+	uint32_t fl, sl;
+	mapping(searchSize, &fl, &sl);
+	if (fl >= FL_COUNT) return false;
+
+	//first non empty list at or above the size class
+	uint32_t slMap = slBitmap[fl] & (~0u << sl);
+	if (slMap == 0) {
+		uint64_t flMap = fl + 1 < FL_COUNT ? flBitmap & (~0ULL << (fl + 1)) : 0;
+		if (flMap == 0) return false;
+
+		fl = lowBit(flMap);
+		slMap = slBitmap[fl];
+	}
+	sl = lowBit(slMap);
+
+	uint32_t index = freeHeads[fl][sl];
+	removeFree(index);
+
+	//alignment padding stays part of the node, split off whatever is left after the allocation
+	VkDeviceSize alignedOffset = alignUp(nodes[index].offset, alignment);
+	VkDeviceSize used = alignedOffset - nodes[index].offset + size;
+	VkDeviceSize remaining = nodes[index].size - used;
+	if (remaining >= MIN_SPLIT_SIZE) {
+		uint32_t split = createNode();
+		nodes[split].offset = nodes[index].offset + used;
+		nodes[split].size = remaining;
+		nodes[split].prevPhysical = index;
+		nodes[split].nextPhysical = nodes[index].nextPhysical;
+		if (nodes[split].nextPhysical != INVALID_NODE) {
+			nodes[nodes[split].nextPhysical].prevPhysical = split;
+		}
+		nodes[index].nextPhysical = split;
+		nodes[index].size = used;
+		insertFree(split);
+	}
+
+	*offset = alignedOffset;
+	*allocatedSize = nodes[index].size;
+	*node = index;
+	return true;
+}
+
+VkDeviceSize TlsfHeap::free(uint32_t node)
+{
+	VkDeviceSize freedSize = nodes[node].size;
+
+	//merge with free physical neighbours so regions dont splinter
+	uint32_t next = nodes[node].nextPhysical;
+	if (next != INVALID_NODE && nodes[next].free) {
+		removeFree(next);
+		nodes[node].size += nodes[next].size;
+		nodes[node].nextPhysical = nodes[next].nextPhysical;
+		if (nodes[node].nextPhysical != INVALID_NODE) {
+			nodes[nodes[node].nextPhysical].prevPhysical = node;
+		}
+		unusedNodes.push_back(next);
+	}
+
+	uint32_t prev = nodes[node].prevPhysical;
+	if (prev != INVALID_NODE && nodes[prev].free) {
+		removeFree(prev);
+		nodes[prev].size += nodes[node].size;
+		nodes[prev].nextPhysical = nodes[node].nextPhysical;
+		if (nodes[prev].nextPhysical != INVALID_NODE) {
+			nodes[nodes[prev].nextPhysical].prevPhysical = prev;
+		}
+		unusedNodes.push_back(node);
+		node = prev;
+	}
+
+	insertFree(node);
+	return freedSize;
+}
+
+bool TlsfHeap::isEmpty()
+{
+	return freeBytes == heapSize;
+}
+
+VkDeviceSize TlsfHeap::getFreeBytes()
+{
+	return freeBytes;
+}
+
+VkDeviceSize TlsfHeap::getLargestFreeRegion()
+{
+	if (flBitmap == 0) return 0;
+
+	//largest region is somewhere in the highest non empty list
+	uint32_t fl = highBit(flBitmap);
+	uint32_t sl = highBit(slBitmap[fl]);
+	VkDeviceSize largest = 0;
+	for (uint32_t node = freeHeads[fl][sl]; node != INVALID_NODE; node = nodes[node].nextFree) {
+		largest = std::max(largest, nodes[node].size);
+	}
+	return largest;
+}
+
+uint32_t TlsfHeap::getFreeRegionCount()
+{
+	return freeRegionCount;
+}
+
+uint32_t TlsfHeap::createNode()
+{
+	uint32_t node;
+	if (!unusedNodes.empty()) {
+		node = unusedNodes.back();
+		unusedNodes.pop_back();
+	}
+	else {
+		node = static_cast<uint32_t>(nodes.size());
+		nodes.push_back({});
+	}
+
+	nodes[node] = { 0, 0, INVALID_NODE, INVALID_NODE, INVALID_NODE, INVALID_NODE, false };
+	return node;
+}
+
+void TlsfHeap::mapping(VkDeviceSize size, uint32_t* fl, uint32_t* sl)
+{
+	//first level: power of two range, second level: SL_COUNT linear subdivisions of that range
+	if (size < SL_COUNT) {
+		*fl = 0;
+		*sl = static_cast<uint32_t>(size);
+	}
+	else {
+		uint32_t log = highBit(size);
+		*fl = log - SL_BITS + 1;
+		*sl = static_cast<uint32_t>(size >> (log - SL_BITS)) - SL_COUNT;
+	}
+}
+
+void TlsfHeap::insertFree(uint32_t node)
+{
+	uint32_t fl, sl;
+	mapping(nodes[node].size, &fl, &sl);
+
+	nodes[node].free = true;
+	nodes[node].prevFree = INVALID_NODE;
+	nodes[node].nextFree = freeHeads[fl][sl];
+	if (freeHeads[fl][sl] != INVALID_NODE) {
+		nodes[freeHeads[fl][sl]].prevFree = node;
+	}
+	freeHeads[fl][sl] = node;
+
+	flBitmap |= 1ULL << fl;
+	slBitmap[fl] |= 1u << sl;
+
+	freeBytes += nodes[node].size;
+	freeRegionCount++;
+}
+
+void TlsfHeap::removeFree(uint32_t node)
+{
+	uint32_t fl, sl;
+	mapping(nodes[node].size, &fl, &sl);
+
+	if (nodes[node].prevFree != INVALID_NODE) {
+		nodes[nodes[node].prevFree].nextFree = nodes[node].nextFree;
+	}
+	if (nodes[node].nextFree != INVALID_NODE) {
+		nodes[nodes[node].nextFree].prevFree = nodes[node].prevFree;
+	}
+	if (freeHeads[fl][sl] == node) {
+		freeHeads[fl][sl] = nodes[node].nextFree;
+
+		//clear bitmap bits once lists empty
+		if (freeHeads[fl][sl] == INVALID_NODE) {
+			slBitmap[fl] &= ~(1u << sl);
+			if (slBitmap[fl] == 0) {
+				flBitmap &= ~(1ULL << fl);
+			}
+		}
+	}
+	nodes[node].free = false;
+
+	freeBytes -= nodes[node].size;
+	freeRegionCount--;
+}
+
+DeviceAllocator::DeviceAllocator()
+{
+}
+
+void DeviceAllocator::init(VkPhysicalDevice newPhysicalDevice, VkDevice newDevice)
+{
+	physicalDevice = newPhysicalDevice;
+	device = newDevice;
+
+	vkGetPhysicalDeviceMemoryProperties(physicalDevice, &memoryProperties);
+
+	VkPhysicalDeviceProperties deviceProperties;
+	vkGetPhysicalDeviceProperties(physicalDevice, &deviceProperties);
+	maxDeviceMemoryCount = deviceProperties.limits.maxMemoryAllocationCount;
+
+	//4 pools per memory type: persistent/transient x linear/optimal
+	pools.resize(memoryProperties.memoryTypeCount * 4);
+}
+
+Allocation DeviceAllocator::allocate(const VkMemoryRequirements& requirements, VkMemoryPropertyFlags properties, MemoryLifetime lifetime, ResourceTiling tiling)
+{
+	uint32_t memoryTypeIndex = findMemoryType(requirements.memoryTypeBits, properties);
+	VkDeviceSize blockSize = getBlockSize(memoryTypeIndex);
+
+	Allocation allocation;
+	allocation.memoryTypeIndex = memoryTypeIndex;
+
+	//large resources get their own device memory rather than taking up most of a block
+	if (requirements.size > blockSize / 2) {
+		char* mapped;
+		allocation.memory = allocateDeviceMemory(requirements.size, memoryTypeIndex, &mapped);
+		allocation.size = requirements.size;
+		allocation.mapped = mapped;
+
+		dedicatedCounts[memoryTypeIndex]++;
+		dedicatedBytes[memoryTypeIndex] += requirements.size;
+		return allocation;
+	}
+
+	size_t poolIndex = getPoolIndex(memoryTypeIndex, lifetime, tiling);
+	Pool& pool = pools[poolIndex];
+	for (auto& block : pool.blocks) {
+		if (allocateFromBlock(block.get(), requirements, &allocation)) {
+			return allocation;
+		}
+	}
+
+	//no room in existing blocks, open a new one
+	std::unique_ptr<MemoryBlock> block(new MemoryBlock());
+	block->memory = allocateDeviceMemory(blockSize, memoryTypeIndex, &block->mapped);
+	block->size = blockSize;
+	block->memoryTypeIndex = memoryTypeIndex;
+	block->poolIndex = poolIndex;
+	block->linear = lifetime == MemoryLifetime::Transient;
+	if (!block->linear) {
+		block->heap.init(blockSize);
+	}
+	pool.blocks.push_back(std::move(block));
+
+	if (!allocateFromBlock(pool.blocks.back().get(), requirements, &allocation)) {
+		throw std::runtime_error("failed to sub-allocate from a new memory block");
+	}
+	return allocation;
+}
+
+void DeviceAllocator::free(Allocation& allocation)
+{
+	if (allocation.memory == VK_NULL_HANDLE) return;
+
+	MemoryBlock* block = allocation.block;
+	if (block == nullptr) {
+		dedicatedCounts[allocation.memoryTypeIndex]--;
+		dedicatedBytes[allocation.memoryTypeIndex] -= allocation.size;
+		freeDeviceMemory(allocation.memory);
+	}
+	else {
+		if (block->linear) {
+			block->usedBytes -= allocation.size;
+		}
+		else {
+			block->usedBytes -= block->heap.free(allocation.node);
+		}
+		block->liveCount--;
+
+		if (block->liveCount == 0) {
+			//a linear block only rewinds once everything in it has been freed
+			block->head = 0;
+			block->usedBytes = 0;
+
+			//release empty blocks, keeping one per pool so the next request doesnt reallocate
+			Pool& pool = pools[block->poolIndex];
+			if (pool.blocks.size() > 1) {
+				freeDeviceMemory(block->memory);
+				pool.blocks.erase(std::find_if(pool.blocks.begin(), pool.blocks.end(),
+					[block](const std::unique_ptr<MemoryBlock>& candidate) { return candidate.get() == block; }));
+			}
+		}
+	}
+
+	allocation = Allocation();
+}
+
+DeviceAllocatorStats DeviceAllocator::getStats()
+{
+	DeviceAllocatorStats stats;
+	stats.deviceMemoryCount = deviceMemoryCount;
+	stats.maxDeviceMemoryCount = maxDeviceMemoryCount;
+
+	VkDeviceSize persistentFree = 0;
+	VkDeviceSize unusableFree = 0;
+	for (auto& pool : pools) {
+		for (auto& block : pool.blocks) {
+			MemoryTypeStats& typeStats = stats.memoryTypes[block->memoryTypeIndex];
+			typeStats.blockCount++;
+			typeStats.allocationCount += block->liveCount;
+			typeStats.reservedBytes += block->size;
+			typeStats.usedBytes += block->usedBytes;
+
+			if (block->linear) {
+				//only the space past the head is usable until the block empties
+				VkDeviceSize tail = block->size - block->head;
+				typeStats.freeBytes += tail;
+				typeStats.largestFreeRegion = std::max(typeStats.largestFreeRegion, tail);
+				typeStats.freeRegionCount += tail > 0 ? 1 : 0;
+			}
+			else {
+				VkDeviceSize blockFree = block->heap.getFreeBytes();
+				VkDeviceSize blockLargest = block->heap.getLargestFreeRegion();
+				typeStats.freeBytes += blockFree;
+				typeStats.largestFreeRegion = std::max(typeStats.largestFreeRegion, blockLargest);
+				typeStats.freeRegionCount += block->heap.getFreeRegionCount();
+
+				persistentFree += blockFree;
+				unusableFree += blockFree - blockLargest;
+			}
+		}
+	}
+
+	for (uint32_t i = 0; i < memoryProperties.memoryTypeCount; i++) {
+		MemoryTypeStats& typeStats = stats.memoryTypes[i];
+		typeStats.dedicatedCount = dedicatedCounts[i];
+		typeStats.allocationCount += dedicatedCounts[i];
+		typeStats.reservedBytes += dedicatedBytes[i];
+		typeStats.usedBytes += dedicatedBytes[i];
+
+		stats.total.blockCount += typeStats.blockCount;
+		stats.total.dedicatedCount += typeStats.dedicatedCount;
+		stats.total.allocationCount += typeStats.allocationCount;
+		stats.total.reservedBytes += typeStats.reservedBytes;
+		stats.total.usedBytes += typeStats.usedBytes;
+		stats.total.freeBytes += typeStats.freeBytes;
+		stats.total.largestFreeRegion = std::max(stats.total.largestFreeRegion, typeStats.largestFreeRegion);
+		stats.total.freeRegionCount += typeStats.freeRegionCount;
+	}
+
+	//share of free memory outside the largest region of its block
+	stats.fragmentation = persistentFree > 0 ? (double)unusableFree / persistentFree : 0.0;
+	return stats;
+}
+
+void DeviceAllocator::cleanup()
+{
+	//resources must already be destroyed, dedicated allocations are freed by their owners
+	for (auto& pool : pools) {
+		for (auto& block : pool.blocks) {
+			freeDeviceMemory(block->memory);
+		}
+	}
+	pools.clear();
+}
+
+DeviceAllocator::~DeviceAllocator()
+{
+}
+
+uint32_t DeviceAllocator::findMemoryType(uint32_t allowedTypes, VkMemoryPropertyFlags properties)
+{
+	for (uint32_t i = 0; i < memoryProperties.memoryTypeCount; i++) {
+		if ((allowedTypes & (1 << i))
+			&& (memoryProperties.memoryTypes[i].propertyFlags & properties) == properties)
+		{
+			return i;
+		}
+	}
+
+	throw std::runtime_error("failed to find a suitable memory type");
+}
+
+size_t DeviceAllocator::getPoolIndex(uint32_t memoryTypeIndex, MemoryLifetime lifetime, ResourceTiling tiling)
+{
+	return memoryTypeIndex * 4
+		+ (lifetime == MemoryLifetime::Transient ? 2 : 0)
+		+ (tiling == ResourceTiling::Optimal ? 1 : 0);
+}
+
+VkDeviceSize DeviceAllocator::getBlockSize(uint32_t memoryTypeIndex)
+{
+	//dont let a single block take a large share of a small heap (e.g. 256MB BAR memory)
+	VkDeviceSize heapSize = memoryProperties.memoryHeaps[memoryProperties.memoryTypes[memoryTypeIndex].heapIndex].size;
+	return std::min(ALLOCATOR_BLOCK_SIZE, heapSize / 8);
+}
+
+VkDeviceMemory DeviceAllocator::allocateDeviceMemory(VkDeviceSize size, uint32_t memoryTypeIndex, char** mapped)
+{
+	if (deviceMemoryCount >= maxDeviceMemoryCount) {
+		throw std::runtime_error("exceeded maxMemoryAllocationCount");
+	}
+
+	VkMemoryAllocateInfo memoryAllocInfo = {};
+	memoryAllocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+	memoryAllocInfo.allocationSize = size;
+	memoryAllocInfo.memoryTypeIndex = memoryTypeIndex;
+
+	VkDeviceMemory memory;
+	VkResult result = vkAllocateMemory(device, &memoryAllocInfo, nullptr, &memory);
+	if (result != VK_SUCCESS) {
+		throw std::runtime_error("failed to allocate device memory");
+	}
+	deviceMemoryCount++;
+
+	//host visible memory stays mapped for its whole lifetime
+	*mapped = nullptr;
+	if (memoryProperties.memoryTypes[memoryTypeIndex].propertyFlags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT) {
+		void* data;
+		result = vkMapMemory(device, memory, 0, VK_WHOLE_SIZE, 0, &data);
+		if (result != VK_SUCCESS) {
+			throw std::runtime_error("failed to map device memory");
+		}
+		*mapped = static_cast<char*>(data);
+	}
+
+	return memory;
+}
+
+void DeviceAllocator::freeDeviceMemory(VkDeviceMemory memory)
+{
+	//freeing implicitly unmaps
+	vkFreeMemory(device, memory, nullptr);
+	deviceMemoryCount--;
+}
+
+bool DeviceAllocator::allocateFromBlock(MemoryBlock* block, const VkMemoryRequirements& requirements, Allocation* allocation)
+{
+	VkDeviceSize offset;
+	if (block->linear) {
+		offset = alignUp(block->head, requirements.alignment);
+		if (offset + requirements.size > block->size) return false;
+
+		block->head = offset + requirements.size;
+		block->usedBytes += requirements.size;
+		allocation->node = 0;
+	}
+	else {
+		VkDeviceSize allocatedSize;
+		if (!block->heap.allocate(requirements.size, requirements.alignment, &offset, &allocatedSize, &allocation->node)) return false;
+
+		block->usedBytes += allocatedSize;
+	}
+	block->liveCount++;
+
+	allocation->memory = block->memory;
+	allocation->offset = offset;
+	allocation->size = requirements.size;
+	allocation->mapped = block->mapped != nullptr ? block->mapped + offset : nullptr;
+	allocation->block = block;
+	allocation->memoryTypeIndex = block->memoryTypeIndex;
+	return true;
+}
@@ -0,0 +1,164 @@
+#pragma once
+
+#define GLFW_INCLUDE_VULKAN
+#include <GLFW/glfw3.h>
+
+#include <array>
+#include <memory>
+#include <vector>
+
+//size of the device memory blocks sub-allocations are carved from (smaller if the heap is small)
+const VkDeviceSize ALLOCATOR_BLOCK_SIZE = 64 * 1024 * 1024;
+
+//how long an allocation is expected to live, transient memory is bump allocated
+enum class MemoryLifetime {
+	Persistent,					//meshes, uniform buffers, images: TLSF heap
+	Transient					//staging buffers freed shortly after use: linear heap
+};
+
+//buffers/linear images and optimal images never share a block so bufferImageGranularity cant be violated
+enum class ResourceTiling {
+	Linear,
+	Optimal
+};
+
+struct MemoryBlock;
+
+//a range of device memory handed out by the allocator
+struct Allocation {
+	VkDeviceMemory memory = VK_NULL_HANDLE;
+	VkDeviceSize offset = 0;					//offset to bind the resource at
+	VkDeviceSize size = 0;
+	void* mapped = nullptr;						//persistently mapped pointer to offset, null if not host visible
+
+	MemoryBlock* block = nullptr;				//block allocated from, null for a dedicated allocation
+	uint32_t node = 0;							//heap node within the block
+	uint32_t memoryTypeIndex = 0;
+};
+
+//usage of one memory type
+struct MemoryTypeStats {
+	uint32_t blockCount = 0;
+	uint32_t dedicatedCount = 0;
+	uint32_t allocationCount = 0;
+	VkDeviceSize reservedBytes = 0;				//device memory held in blocks and dedicated allocations
+	VkDeviceSize usedBytes = 0;					//bytes handed out, including alignment padding
+	VkDeviceSize freeBytes = 0;
+	VkDeviceSize largestFreeRegion = 0;
+	uint32_t freeRegionCount = 0;
+};
+
+struct DeviceAllocatorStats {
+	std::array<MemoryTypeStats, VK_MAX_MEMORY_TYPES> memoryTypes;
+	MemoryTypeStats total;
+	uint32_t deviceMemoryCount = 0;				//live vkAllocateMemory allocations
+	uint32_t maxDeviceMemoryCount = 0;			//maxMemoryAllocationCount of the device
+	double fragmentation = 0.0;					//1 - largest free region / free bytes, over persistent blocks
+};
+
+//Two level segregated fit heap over offsets [0, size), constant time allocate and free
+class TlsfHeap
+{
+public:
+	static const uint32_t INVALID_NODE = 0xFFFFFFFF;
+
+	TlsfHeap();
+
+	void init(VkDeviceSize size);
+	bool allocate(VkDeviceSize size, VkDeviceSize alignment, VkDeviceSize* offset, VkDeviceSize* allocatedSize, uint32_t* node);
+	VkDeviceSize free(uint32_t node);
+
+	bool isEmpty();
+	VkDeviceSize getFreeBytes();
+	VkDeviceSize getLargestFreeRegion();
+	uint32_t getFreeRegionCount();
+
+private:
+	static const uint32_t SL_BITS = 4;
+	static const uint32_t SL_COUNT = 1 << SL_BITS;
+	static const uint32_t FL_COUNT = 64;
+
+	struct Node {
+		VkDeviceSize offset;
+		VkDeviceSize size;
+		uint32_t prevPhysical;
+		uint32_t nextPhysical;
+		uint32_t prevFree;
+		uint32_t nextFree;
+		bool free;
+	};
+
+	VkDeviceSize heapSize = 0;
+	VkDeviceSize freeBytes = 0;
+	uint32_t freeRegionCount = 0;
+
+	std::vector<Node> nodes;
+	std::vector<uint32_t> unusedNodes;
+
+	uint64_t flBitmap = 0;
+	std::array<uint32_t, FL_COUNT> slBitmap;
+	std::array<std::array<uint32_t, SL_COUNT>, FL_COUNT> freeHeads;
+
+	uint32_t createNode();
+	void mapping(VkDeviceSize size, uint32_t* fl, uint32_t* sl);
+	void insertFree(uint32_t node);
+	void removeFree(uint32_t node);
+};
+
+//device memory block, either a TLSF heap or a linear (bump) heap
+struct MemoryBlock {
+	VkDeviceMemory memory = VK_NULL_HANDLE;
+	VkDeviceSize size = 0;
+	uint32_t memoryTypeIndex = 0;
+	size_t poolIndex = 0;
+	char* mapped = nullptr;
+
+	bool linear = false;
+	VkDeviceSize head = 0;						//linear: next free offset, rewinds when the block empties
+	uint32_t liveCount = 0;
+	VkDeviceSize usedBytes = 0;
+	TlsfHeap heap;
+};
+
+//Sub-allocates buffers and images from large per memory type blocks instead of one vkAllocateMemory each
+class DeviceAllocator
+{
+public:
+	DeviceAllocator();
+
+	void init(VkPhysicalDevice newPhysicalDevice, VkDevice newDevice);
+
+	Allocation allocate(const VkMemoryRequirements& requirements, VkMemoryPropertyFlags properties,
+		MemoryLifetime lifetime = MemoryLifetime::Persistent, ResourceTiling tiling = ResourceTiling::Linear);
+	void free(Allocation& allocation);
+
+	DeviceAllocatorStats getStats();
+
+	void cleanup();
+
+	~DeviceAllocator();
+
+private:
+	//blocks of one memory type, lifetime and tiling
+	struct Pool {
+		std::vector<std::unique_ptr<MemoryBlock>> blocks;
+	};
+
+	VkPhysicalDevice physicalDevice = VK_NULL_HANDLE;
+	VkDevice device = VK_NULL_HANDLE;
+	VkPhysicalDeviceMemoryProperties memoryProperties = {};
+	uint32_t maxDeviceMemoryCount = 0;
+	uint32_t deviceMemoryCount = 0;
+
+	std::vector<Pool> pools;										//indexed by getPoolIndex
+	std::array<uint32_t, VK_MAX_MEMORY_TYPES> dedicatedCounts = {};
+	std::array<VkDeviceSize, VK_MAX_MEMORY_TYPES> dedicatedBytes = {};
+
+	uint32_t findMemoryType(uint32_t allowedTypes, VkMemoryPropertyFlags properties);
+	size_t getPoolIndex(uint32_t memoryTypeIndex, MemoryLifetime lifetime, ResourceTiling tiling);
+	VkDeviceSize getBlockSize(uint32_t memoryTypeIndex);
+
+	VkDeviceMemory allocateDeviceMemory(VkDeviceSize size, uint32_t memoryTypeIndex, char** mapped);
+	void freeDeviceMemory(VkDeviceMemory memory);
+	bool allocateFromBlock(MemoryBlock* block, const VkMemoryRequirements& requirements, Allocation* allocation);
+};
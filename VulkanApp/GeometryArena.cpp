@@ -0,0 +1,198 @@
+#include "GeometryArena.h"
+
+#include <algorithm>
+
+static VkDeviceSize getIndexSize(VkIndexType indexType) {
+	return indexType == VK_INDEX_TYPE_UINT16 ? sizeof(uint16_t) : sizeof(uint32_t);
+}
+
+GeometryArena::GeometryArena()
+{
+}
+
+void GeometryArena::init(DeviceAllocator* newAllocator, VkDevice newDevice, UploadService* newUploadService, const VertexLayout& newVertexLayout)
+{
+	allocator = newAllocator;
+	device = newDevice;
+	uploadService = newUploadService;
+	vertexLayout = newVertexLayout;
+}
+
+GeometryRange GeometryArena::allocate(const Vertex* vertices, uint32_t vertexCount, const PositionQuantization& quantization, const uint32_t* indices,
+	uint32_t indexCount, VkIndexType indexType, UploadTicket* ticket)
+{
+	GeometryRange range;
+
+	//first page of the right index type with room for both, otherwise a new page
+	bool found = false;
+	for (uint32_t i = 0; i < pages.size() && !found; i++) {
+		found = pages[i].indexType == indexType && allocateFromPage(i, vertexCount, indexCount, &range);
+	}
+	if (!found) {
+		createPage(std::max(vertexCount, GEOMETRY_PAGE_VERTICES), std::max(indexCount, GEOMETRY_PAGE_INDICES), indexType);
+		if (!allocateFromPage(static_cast<uint32_t>(pages.size()) - 1, vertexCount, indexCount, &range)) {
+			throw std::runtime_error("failed to allocate geometry from a new arena page");
+		}
+	}
+
+	//copies into the same page are merged by the upload service into one command
+	//the upload copies out before returning, so one set of scratch buffers serves every converted mesh
+	GeometryPage& page = pages[range.page];
+	uint32_t streamCount = getVertexStreamCount();
+	const void* vertexData[MAX_VERTEX_STREAMS] = { vertices };
+	if (!isNativeVertexLayout(vertexLayout)) {
+		unsigned char* streams[MAX_VERTEX_STREAMS] = {};
+		for (uint32_t s = 0; s < streamCount; s++) {
+			encodedVertices[s].resize(static_cast<size_t>(getVertexStreamStride(vertexLayout, s)) * vertexCount);
+			streams[s] = encodedVertices[s].data();
+			vertexData[s] = streams[s];
+		}
+		encodeVertices(vertexLayout, quantization, vertices, vertexCount, streams);
+	}
+
+	UploadTicket vertexTicket = 0;
+	for (uint32_t s = 0; s < streamCount; s++) {
+		VkDeviceSize stride = getVertexStreamStride(vertexLayout, s);
+		vertexTicket = std::max(vertexTicket, uploadService->uploadBuffer(page.vertexBuffers[s], stride * range.vertexOffset, vertexData[s],
+			stride * vertexCount, VK_PIPELINE_STAGE_VERTEX_INPUT_BIT, VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT));
+	}
+
+	const void* indexData = indices;
+	VkDeviceSize indexSize = getIndexSize(indexType);
+	if (indexType == VK_INDEX_TYPE_UINT16) {
+		shortIndices.resize(indexCount);
+		for (uint32_t i = 0; i < indexCount; i++) {
+			shortIndices[i] = static_cast<uint16_t>(indices[i]);
+		}
+		indexData = shortIndices.data();
+	}
+	UploadTicket indexTicket = uploadService->uploadBuffer(page.indexBuffer, indexSize * range.firstIndex, indexData, indexSize * indexCount,
+		VK_PIPELINE_STAGE_VERTEX_INPUT_BIT, VK_ACCESS_INDEX_READ_BIT);
+
+	//index data lands in a later batch than the vertex data if that filled a batch, so keep the later ticket
+	*ticket = std::max(vertexTicket, indexTicket);
+	return range;
+}
+
+void GeometryArena::free(const GeometryRange& range, uint64_t lastFrame)
+{
+	RetiredRange retired;
+	retired.range = range;
+	retired.lastFrame = lastFrame;
+	retiredRanges.push_back(retired);
+}
+
+void GeometryArena::releaseRetired(uint64_t completedFrame)
+{
+	size_t kept = 0;
+	for (size_t i = 0; i < retiredRanges.size(); i++) {
+		if (retiredRanges[i].lastFrame > completedFrame) {
+			retiredRanges[kept++] = retiredRanges[i];
+			continue;
+		}
+
+		const GeometryRange& range = retiredRanges[i].range;
+		if (range.vertexNode != TlsfHeap::INVALID_NODE) {
+			pages[range.page].vertexHeap.free(range.vertexNode);
+		}
+		if (range.indexNode != TlsfHeap::INVALID_NODE) {
+			pages[range.page].indexHeap.free(range.indexNode);
+		}
+	}
+	retiredRanges.resize(kept);
+}
+
+VkBuffer GeometryArena::getVertexBuffer(uint32_t page, uint32_t stream)
+{
+	return pages[page].vertexBuffers[stream];
+}
+
+uint32_t GeometryArena::getVertexStreamCount()
+{
+	return ::getVertexStreamCount(vertexLayout);
+}
+
+const VertexLayout& GeometryArena::getVertexLayout()
+{
+	return vertexLayout;
+}
+
+VkBuffer GeometryArena::getIndexBuffer(uint32_t page)
+{
+	return pages[page].indexBuffer;
+}
+
+VkIndexType GeometryArena::getIndexType(uint32_t page)
+{
+	return pages[page].indexType;
+}
+
+uint32_t GeometryArena::getPageCount()
+{
+	return static_cast<uint32_t>(pages.size());
+}
+
+void GeometryArena::cleanup()
+{
+	for (auto& page : pages) {
+		for (uint32_t s = 0; s < MAX_VERTEX_STREAMS; s++) {
+			if (page.vertexBuffers[s] != VK_NULL_HANDLE) {
+				destroyBuffer(allocator, device, page.vertexBuffers[s], &page.vertexAllocations[s]);
+			}
+		}
+		destroyBuffer(allocator, device, page.indexBuffer, &page.indexAllocation);
+	}
+	pages.clear();
+	retiredRanges.clear();
+}
+
+GeometryArena::~GeometryArena()
+{
+}
+
+bool GeometryArena::allocateFromPage(uint32_t pageIndex, uint32_t vertexCount, uint32_t indexCount, GeometryRange* range)
+{
+	GeometryPage& page = pages[pageIndex];
+
+	//heaps count elements, so offsets are usable directly as vertexOffset / firstIndex
+	VkDeviceSize vertexOffset = 0, indexOffset = 0, allocatedSize;
+	uint32_t vertexNode = TlsfHeap::INVALID_NODE, indexNode = TlsfHeap::INVALID_NODE;
+	if (vertexCount > 0 && !page.vertexHeap.allocate(vertexCount, 1, &vertexOffset, &allocatedSize, &vertexNode)) {
+		return false;
+	}
+	if (indexCount > 0 && !page.indexHeap.allocate(indexCount, 1, &indexOffset, &allocatedSize, &indexNode)) {
+		if (vertexNode != TlsfHeap::INVALID_NODE) {
+			page.vertexHeap.free(vertexNode);
+		}
+		return false;
+	}
+
+	range->page = pageIndex;
+	range->vertexOffset = static_cast<uint32_t>(vertexOffset);
+	range->vertexCount = vertexCount;
+	range->firstIndex = static_cast<uint32_t>(indexOffset);
+	range->indexCount = indexCount;
+	range->vertexNode = vertexNode;
+	range->indexNode = indexNode;
+	return true;
+}
+
+void GeometryArena::createPage(uint32_t vertexCapacity, uint32_t indexCapacity, VkIndexType indexType)
+{
+	GeometryPage page;
+	page.indexType = indexType;
+
+	// Create buffers with TRANSFER_DST_BIT to mark as recipient of transfer data, device local as the GPU only reads them
+	for (uint32_t s = 0; s < getVertexStreamCount(); s++) {
+		createBuffer(allocator, device, static_cast<VkDeviceSize>(getVertexStreamStride(vertexLayout, s)) * vertexCapacity,
+			VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &page.vertexBuffers[s],
+			&page.vertexAllocations[s]);
+	}
+	createBuffer(allocator, device, getIndexSize(indexType) * indexCapacity, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT,
+		VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &page.indexBuffer, &page.indexAllocation);
+
+	page.vertexHeap.init(vertexCapacity);
+	page.indexHeap.init(indexCapacity);
+
+	pages.push_back(std::move(page));
+}
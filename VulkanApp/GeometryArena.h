@@ -0,0 +1,89 @@
+#pragma once
+
+#define GLFW_INCLUDE_VULKAN
+#include <GLFW/glfw3.h>
+
+#include <vector>
+
+#include "Utilities.h"
+#include "UploadService.h"
+#include "VertexLayout.h"
+
+//default page capacity, in elements, meshes larger than this get a page sized to fit
+const uint32_t GEOMETRY_PAGE_VERTICES = 1024 * 1024;
+const uint32_t GEOMETRY_PAGE_INDICES = 4 * 1024 * 1024;
+
+//where a mesh's geometry lives within the arena, offsets are in vertices / indices for vkCmdDrawIndexed
+struct GeometryRange {
+	uint32_t page = 0;
+	uint32_t vertexOffset = 0;
+	uint32_t vertexCount = 0;
+	uint32_t firstIndex = 0;
+	uint32_t indexCount = 0;
+
+	uint32_t vertexNode = TlsfHeap::INVALID_NODE;
+	uint32_t indexNode = TlsfHeap::INVALID_NODE;
+};
+
+//Shared vertex and index buffers that every mesh's geometry is sub allocated from
+//draws within a page bind buffers once and differ only by firstIndex / vertexOffset
+//a page holds either 16 or 32 bit indices, so the index type is bound along with its buffers
+//vertices are stored in the arena's VertexLayout, one buffer per stream, converted from Vertex on the way into staging
+class GeometryArena
+{
+public:
+	GeometryArena();
+
+	void init(DeviceAllocator* newAllocator, VkDevice newDevice, UploadService* newUploadService, const VertexLayout& newVertexLayout);
+
+	//reserve space and queue the upload, ticket completes once the data can be drawn
+	//quantization maps positions into compact layouts, it is ignored by Float32 positions
+	//VK_INDEX_TYPE_UINT16 narrows the indices on the way into staging, every index must then be below 65536
+	GeometryRange allocate(const Vertex* vertices, uint32_t vertexCount, const PositionQuantization& quantization, const uint32_t* indices,
+		uint32_t indexCount, VkIndexType indexType, UploadTicket* ticket);
+
+	//range may still be drawn by frames up to lastFrame, it is reused only after releaseRetired passes that frame
+	void free(const GeometryRange& range, uint64_t lastFrame);
+	void releaseRetired(uint64_t completedFrame);
+
+	VkBuffer getVertexBuffer(uint32_t page, uint32_t stream);
+	uint32_t getVertexStreamCount();
+	const VertexLayout& getVertexLayout();
+	VkBuffer getIndexBuffer(uint32_t page);
+	VkIndexType getIndexType(uint32_t page);
+	uint32_t getPageCount();
+
+	void cleanup();
+
+	~GeometryArena();
+
+private:
+	struct GeometryPage {
+		VkBuffer vertexBuffers[MAX_VERTEX_STREAMS] = {};
+		Allocation vertexAllocations[MAX_VERTEX_STREAMS];
+		TlsfHeap vertexHeap;						//sized in vertices, not bytes, shared by every stream
+
+		VkBuffer indexBuffer = VK_NULL_HANDLE;
+		Allocation indexAllocation;
+		TlsfHeap indexHeap;							//sized in indices
+		VkIndexType indexType = VK_INDEX_TYPE_UINT32;
+	};
+
+	struct RetiredRange {
+		GeometryRange range;
+		uint64_t lastFrame;
+	};
+
+	DeviceAllocator* allocator = nullptr;
+	VkDevice device = VK_NULL_HANDLE;
+	UploadService* uploadService = nullptr;
+	VertexLayout vertexLayout;
+
+	std::vector<GeometryPage> pages;
+	std::vector<RetiredRange> retiredRanges;		//freed but possibly still read by frames in flight
+	std::vector<uint16_t> shortIndices;				//narrowed copy of the indices being uploaded
+	std::vector<unsigned char> encodedVertices[MAX_VERTEX_STREAMS];		//vertices being uploaded, converted to the layout
+
+	bool allocateFromPage(uint32_t pageIndex, uint32_t vertexCount, uint32_t indexCount, GeometryRange* range);
+	void createPage(uint32_t vertexCapacity, uint32_t indexCapacity, VkIndexType indexType);
+};
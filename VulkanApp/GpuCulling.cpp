@@ -0,0 +1,352 @@
+#include "GpuCulling.h"
+
+GpuCulling::GpuCulling()
+{
+}
+
+void GpuCulling::init(DeviceAllocator* newAllocator, PFN_vkCmdDrawIndexedIndirectCountKHR newDrawIndexedIndirectCount,
+	uint32_t newMaxDrawIndirectCount, VkDeviceSize newStorageAlignment)
+{
+	allocator = newAllocator;
+	drawIndexedIndirectCount = newDrawIndexedIndirectCount;
+	maxDrawIndirectCount = std::max<uint32_t>(1, newMaxDrawIndirectCount);
+	storageAlignment = newStorageAlignment;
+}
+
+void GpuCulling::cleanup()
+{
+	if (device == VK_NULL_HANDLE) return;
+
+	destroyFrameResources();
+	frames.clear();
+	if (descriptorPool != VK_NULL_HANDLE) vkDestroyDescriptorPool(device, descriptorPool, nullptr);
+	if (pipeline != VK_NULL_HANDLE) vkDestroyPipeline(device, pipeline, nullptr);
+	if (pipelineLayout != VK_NULL_HANDLE) vkDestroyPipelineLayout(device, pipelineLayout, nullptr);
+	if (descriptorSetLayout != VK_NULL_HANDLE) vkDestroyDescriptorSetLayout(device, descriptorSetLayout, nullptr);
+
+	descriptorPool = VK_NULL_HANDLE;
+	pipeline = VK_NULL_HANDLE;
+	pipelineLayout = VK_NULL_HANDLE;
+	descriptorSetLayout = VK_NULL_HANDLE;
+	device = VK_NULL_HANDLE;
+}
+
+void GpuCulling::setFrameCount(uint32_t frameCount)
+{
+	destroyFrameResources();
+	frames.clear();
+	if (descriptorPool != VK_NULL_HANDLE) vkDestroyDescriptorPool(device, descriptorPool, nullptr);
+	descriptorPool = VK_NULL_HANDLE;
+
+	createDescriptors(frameCount);
+	resize(objectCapacity, pageCapacity);
+}
+
+void GpuCulling::resize(uint32_t newObjectCapacity, uint32_t newPageCapacity)
+{
+	destroyFrameResources();
+	objectCapacity = newObjectCapacity;
+	pageCapacity = newPageCapacity;
+
+	//a count call draws at most maxDrawIndirectCount commands, so each chunk of a page that size gets its own count
+	countStride = std::max<uint32_t>(1, objectCapacity / maxDrawIndirectCount + (objectCapacity % maxDrawIndirectCount != 0 ? 1 : 0));
+
+	//input: params then draw table, indirect: countStride counts per page then objectCapacity commands per page
+	drawTableBase = alignStorage(sizeof(CullParams));
+	commandsBase = alignStorage(sizeof(uint32_t) * countStride * pageCapacity);
+	VkDeviceSize inputSize = drawTableBase + sizeof(GpuDrawInfo) * objectCapacity;
+	VkDeviceSize indirectSize = commandsBase + sizeof(VkDrawIndexedIndirectCommand) * objectCapacity * pageCapacity;
+
+	for (uint32_t i = 0; i < frames.size(); i++) {
+		FrameResources& frame = frames[i];
+
+		//host coherent and persistently mapped, rewritten before each submission that reads it
+		createBuffer(allocator, device, inputSize, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, &frame.inputBuffer, &frame.inputAllocation);
+		//only ever written by the GPU: cleared with vkCmdFillBuffer, filled by the shader, read as indirect arguments
+		createBuffer(allocator, device, indirectSize, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &frame.indirectBuffer, &frame.indirectAllocation);
+
+		//new buffer holds no draw table yet
+		frame.drawTableVersion = 0;
+		writeDescriptors(i);
+	}
+}
+
+void GpuCulling::setObjectTable(uint32_t frameIndex, VkBuffer buffer, VkDeviceSize offset, VkDeviceSize range)
+{
+	FrameResources& frame = frames[frameIndex];
+	frame.objectTableBuffer = buffer;
+	frame.objectTableOffset = offset;
+	frame.objectTableRange = range;
+	writeDescriptors(frameIndex);
+}
+
+void GpuCulling::setDraw(uint32_t object, const GpuDrawInfo& draw)
+{
+	if (object >= drawTable.size()) {
+		drawTable.resize(object + 1);
+	}
+	drawTable[object] = draw;
+	drawTableVersion++;
+}
+
+void GpuCulling::update(uint32_t frameIndex, const Frustum& frustum, uint32_t objectCount)
+{
+	if (objectCount > objectCapacity) {
+		throw std::runtime_error("GPU culling buffers are smaller than the object count");
+	}
+
+	FrameResources& frame = frames[frameIndex];
+	char* mapped = static_cast<char*>(frame.inputAllocation.mapped);
+
+	CullParams params = {};
+	for (int p = 0; p < 6; p++) {
+		params.planes[p] = frustum.planes[p];
+	}
+	params.objectCount = objectCount;
+	params.objectCapacity = objectCapacity;
+	params.compact = drawIndexedIndirectCount != nullptr ? 1 : 0;
+	params.drawChunkSize = maxDrawIndirectCount;
+	params.countStride = countStride;
+	memcpy(mapped, &params, sizeof(CullParams));
+
+	//the draw table only changes when meshes are created or destroyed, so most frames copy nothing else
+	if (frame.drawTableVersion != drawTableVersion) {
+		size_t drawCount = std::min(drawTable.size(), static_cast<size_t>(objectCount));
+		memcpy(mapped + drawTableBase, drawTable.data(), sizeof(GpuDrawInfo) * drawCount);
+		frame.drawTableVersion = drawTableVersion;
+	}
+}
+
+void GpuCulling::recordCull(VkCommandBuffer commandBuffer, uint32_t frameIndex, uint32_t objectCount)
+{
+	FrameResources& frame = frames[frameIndex];
+
+	//packed draws only need their counts cleared, slot per object draws need every culled slot zeroed
+	VkDeviceSize clearSize = drawIndexedIndirectCount != nullptr ? commandsBase : VK_WHOLE_SIZE;
+	vkCmdFillBuffer(commandBuffer, frame.indirectBuffer, 0, clearSize, 0);
+
+	VkMemoryBarrier clearBarrier = {};
+	clearBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+	clearBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+	clearBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+	vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0,
+		1, &clearBarrier, 0, nullptr, 0, nullptr);
+
+	if (objectCount > 0) {
+		vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline);
+		vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipelineLayout, 0, 1, &frame.descriptorSet, 0, nullptr);
+		vkCmdDispatch(commandBuffer, (objectCount + GPU_CULLING_GROUP_SIZE - 1) / GPU_CULLING_GROUP_SIZE, 1, 1);
+	}
+
+	//commands and counts are read by the draws that follow
+	VkMemoryBarrier cullBarrier = {};
+	cullBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+	cullBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+	cullBarrier.dstAccessMask = VK_ACCESS_INDIRECT_COMMAND_READ_BIT;
+	vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT, 0,
+		1, &cullBarrier, 0, nullptr, 0, nullptr);
+}
+
+void GpuCulling::recordDraws(VkCommandBuffer commandBuffer, uint32_t frameIndex, uint32_t page, uint32_t objectCount)
+{
+	FrameResources& frame = frames[frameIndex];
+	VkDeviceSize pageCommands = commandsBase + sizeof(VkDrawIndexedIndirectCommand) * objectCapacity * page;
+	uint32_t stride = sizeof(VkDrawIndexedIndirectCommand);
+
+	if (drawIndexedIndirectCount != nullptr) {
+		//GPU decides how many of the page's packed commands are drawn, one count per chunk the device can take in a call
+		VkDeviceSize pageCounts = sizeof(uint32_t) * countStride * page;
+		uint32_t chunk = 0;
+		for (uint32_t first = 0; first < objectCount; first += maxDrawIndirectCount, chunk++) {
+			uint32_t drawCount = std::min(objectCount - first, maxDrawIndirectCount);
+			drawIndexedIndirectCount(commandBuffer, frame.indirectBuffer, pageCommands + static_cast<VkDeviceSize>(stride) * first,
+				frame.indirectBuffer, pageCounts + sizeof(uint32_t) * chunk, drawCount, stride);
+		}
+		return;
+	}
+
+	//every slot is drawn, split when the device limits how many draws one call may take
+	for (uint32_t first = 0; first < objectCount; first += maxDrawIndirectCount) {
+		uint32_t drawCount = std::min(objectCount - first, maxDrawIndirectCount);
+		vkCmdDrawIndexedIndirect(commandBuffer, frame.indirectBuffer, pageCommands + static_cast<VkDeviceSize>(stride) * first, drawCount, stride);
+	}
+}
+
+bool GpuCulling::isDrawCountSupported()
+{
+	return drawIndexedIndirectCount != nullptr;
+}
+
+uint32_t GpuCulling::getObjectCapacity()
+{
+	return objectCapacity;
+}
+
+uint32_t GpuCulling::getPageCapacity()
+{
+	return pageCapacity;
+}
+
+GpuCulling::~GpuCulling()
+{
+}
+
+bool GpuCulling::createPipeline(VkDevice newDevice, VkPipelineCache pipelineCache)
+{
+	device = newDevice;
+
+	//the shader ships as SPIR-V next to the others, without it there is nothing to run
+	std::vector<char> shaderCode;
+	try {
+		shaderCode = readFile("Shaders/comp.spv");
+	}
+	catch (const std::runtime_error&) {
+		return false;
+	}
+
+	//object table, cull params, draw table, draw commands, draw counts
+	VkDescriptorSetLayoutBinding bindings[5] = {};
+	for (uint32_t i = 0; i < 5; i++) {
+		bindings[i].binding = i;
+		bindings[i].descriptorType = i == 1 ? VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER : VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+		bindings[i].descriptorCount = 1;
+		bindings[i].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+		bindings[i].pImmutableSamplers = nullptr;
+	}
+
+	VkDescriptorSetLayoutCreateInfo layoutCreateInfo = {};
+	layoutCreateInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+	layoutCreateInfo.bindingCount = 5;
+	layoutCreateInfo.pBindings = bindings;
+
+	VkResult result = vkCreateDescriptorSetLayout(device, &layoutCreateInfo, nullptr, &descriptorSetLayout);
+	if (result != VK_SUCCESS) {
+		throw std::runtime_error("failed to create the culling descriptor set layout");
+	}
+
+	VkPipelineLayoutCreateInfo pipelineLayoutCreateInfo = {};
+	pipelineLayoutCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+	pipelineLayoutCreateInfo.setLayoutCount = 1;
+	pipelineLayoutCreateInfo.pSetLayouts = &descriptorSetLayout;
+
+	result = vkCreatePipelineLayout(device, &pipelineLayoutCreateInfo, nullptr, &pipelineLayout);
+	if (result != VK_SUCCESS) {
+		throw std::runtime_error("failed to create the culling pipeline layout");
+	}
+
+	VkShaderModuleCreateInfo shaderCreateInfo = {};
+	shaderCreateInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+	shaderCreateInfo.codeSize = shaderCode.size();
+	shaderCreateInfo.pCode = reinterpret_cast<const uint32_t*>(shaderCode.data());
+
+	VkShaderModule shaderModule;
+	result = vkCreateShaderModule(device, &shaderCreateInfo, nullptr, &shaderModule);
+	if (result != VK_SUCCESS) {
+		throw std::runtime_error("failed to create the culling shader module");
+	}
+
+	VkComputePipelineCreateInfo pipelineCreateInfo = {};
+	pipelineCreateInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+	pipelineCreateInfo.stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+	pipelineCreateInfo.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+	pipelineCreateInfo.stage.module = shaderModule;
+	pipelineCreateInfo.stage.pName = "main";
+	pipelineCreateInfo.layout = pipelineLayout;
+	pipelineCreateInfo.basePipelineHandle = VK_NULL_HANDLE;
+	pipelineCreateInfo.basePipelineIndex = -1;
+
+	result = vkCreateComputePipelines(device, pipelineCache, 1, &pipelineCreateInfo, nullptr, &pipeline);
+	vkDestroyShaderModule(device, shaderModule, nullptr);
+	if (result != VK_SUCCESS) {
+		throw std::runtime_error("failed to create the culling pipeline");
+	}
+	return true;
+}
+
+void GpuCulling::createDescriptors(uint32_t frameCount)
+{
+	frames.resize(frameCount);
+
+	VkDescriptorPoolSize poolSizes[2] = {};
+	poolSizes[0].type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+	poolSizes[0].descriptorCount = frameCount;
+	poolSizes[1].type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+	poolSizes[1].descriptorCount = frameCount * 4;
+
+	VkDescriptorPoolCreateInfo poolCreateInfo = {};
+	poolCreateInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+	poolCreateInfo.maxSets = frameCount;
+	poolCreateInfo.poolSizeCount = 2;
+	poolCreateInfo.pPoolSizes = poolSizes;
+
+	VkResult result = vkCreateDescriptorPool(device, &poolCreateInfo, nullptr, &descriptorPool);
+	if (result != VK_SUCCESS) {
+		throw std::runtime_error("failed to create the culling descriptor pool");
+	}
+
+	std::vector<VkDescriptorSetLayout> setLayouts(frameCount, descriptorSetLayout);
+	std::vector<VkDescriptorSet> descriptorSets(frameCount);
+
+	VkDescriptorSetAllocateInfo setAllocInfo = {};
+	setAllocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+	setAllocInfo.descriptorPool = descriptorPool;
+	setAllocInfo.descriptorSetCount = frameCount;
+	setAllocInfo.pSetLayouts = setLayouts.data();
+
+	result = vkAllocateDescriptorSets(device, &setAllocInfo, descriptorSets.data());
+	if (result != VK_SUCCESS) {
+		throw std::runtime_error("failed to allocate the culling descriptor sets");
+	}
+
+	for (uint32_t i = 0; i < frameCount; i++) {
+		frames[i].descriptorSet = descriptorSets[i];
+	}
+}
+
+void GpuCulling::writeDescriptors(uint32_t frameIndex)
+{
+	//written once both the renderer's object table and our own buffers exist
+	FrameResources& frame = frames[frameIndex];
+	if (frame.objectTableBuffer == VK_NULL_HANDLE || frame.inputBuffer == VK_NULL_HANDLE) return;
+
+	VkDescriptorBufferInfo bufferInfos[5] = {};
+	bufferInfos[0] = { frame.objectTableBuffer, frame.objectTableOffset, frame.objectTableRange };
+	bufferInfos[1] = { frame.inputBuffer, 0, sizeof(CullParams) };
+	bufferInfos[2] = { frame.inputBuffer, drawTableBase, sizeof(GpuDrawInfo) * objectCapacity };
+	bufferInfos[3] = { frame.indirectBuffer, commandsBase, sizeof(VkDrawIndexedIndirectCommand) * objectCapacity * pageCapacity };
+	bufferInfos[4] = { frame.indirectBuffer, 0, sizeof(uint32_t) * countStride * pageCapacity };
+
+	VkWriteDescriptorSet setWrites[5] = {};
+	for (uint32_t i = 0; i < 5; i++) {
+		setWrites[i].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+		setWrites[i].dstSet = frame.descriptorSet;
+		setWrites[i].dstBinding = i;
+		setWrites[i].dstArrayElement = 0;
+		setWrites[i].descriptorType = i == 1 ? VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER : VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+		setWrites[i].descriptorCount = 1;
+		setWrites[i].pBufferInfo = &bufferInfos[i];
+	}
+	vkUpdateDescriptorSets(device, 5, setWrites, 0, nullptr);
+}
+
+void GpuCulling::destroyFrameResources()
+{
+	for (FrameResources& frame : frames) {
+		if (frame.inputBuffer != VK_NULL_HANDLE) {
+			destroyBuffer(allocator, device, frame.inputBuffer, &frame.inputAllocation);
+			frame.inputBuffer = VK_NULL_HANDLE;
+		}
+		if (frame.indirectBuffer != VK_NULL_HANDLE) {
+			destroyBuffer(allocator, device, frame.indirectBuffer, &frame.indirectAllocation);
+			frame.indirectBuffer = VK_NULL_HANDLE;
+		}
+	}
+}
+
+VkDeviceSize GpuCulling::alignStorage(VkDeviceSize size)
+{
+	//storage buffer offset alignment is always a power of two
+	return (size + storageAlignment - 1) & ~(storageAlignment - 1);
+}
@@ -0,0 +1,116 @@
+#pragma once
+
+#define GLFW_INCLUDE_VULKAN
+#include <GLFW/glfw3.h>
+
+#include <algorithm>
+#include <vector>
+
+#include "Utilities.h"
+#include "Culling.h"
+
+//threads per workgroup of the culling shader (local_size_x in cull.comp)
+const uint32_t GPU_CULLING_GROUP_SIZE = 64;
+
+//what the culling shader needs to know about an object's mesh, std430 layout of DrawTable in cull.comp
+struct GpuDrawInfo {
+	glm::vec4 sphere = glm::vec4(0.0f, 0.0f, 0.0f, -1.0f);	//model space bounds (xyz centre, w radius), negative radius is never drawn
+	uint32_t indexCount = 0;
+	uint32_t firstIndex = 0;
+	int32_t vertexOffset = 0;
+	uint32_t page = 0;										//geometry arena page, draws are issued per page
+};
+
+//Compute pass that frustum culls every object on the GPU and writes indirect draws for the visible ones
+//draws of each geometry page land in their own region of the indirect buffer, drawn with one indirect call per page
+//(or per maxDrawIndirectCount draws of it)
+//with VK_KHR_draw_indirect_count visible draws are packed and counted, otherwise every object keeps its own slot
+//and culled slots are left zeroed (zero index count draws nothing)
+class GpuCulling
+{
+public:
+	GpuCulling();
+
+	//false when the cull shader (Shaders/comp.spv) is missing, the renderer then keeps culling on the CPU
+	//touches nothing but the device and cache, so may run on a worker thread alongside other pipeline creation
+	bool createPipeline(VkDevice newDevice, VkPipelineCache pipelineCache);
+	//once the pipeline exists
+	void init(DeviceAllocator* newAllocator, PFN_vkCmdDrawIndexedIndirectCountKHR newDrawIndexedIndirectCount,
+		uint32_t newMaxDrawIndirectCount, VkDeviceSize newStorageAlignment);
+	void cleanup();
+
+	//GPU must be idle, recreates the buffers and descriptors of every frame in flight, whose object tables must be set again
+	void setFrameCount(uint32_t frameCount);
+	//GPU must be idle, recreates the per frame buffers
+	void resize(uint32_t newObjectCapacity, uint32_t newPageCapacity);
+	//object table (model matrices) the shader transforms bounds with, one per frame
+	void setObjectTable(uint32_t frameIndex, VkBuffer buffer, VkDeviceSize offset, VkDeviceSize range);
+
+	void setDraw(uint32_t object, const GpuDrawInfo& draw);
+	//writes the frustum and, if the draw table changed since the frame last used it, the draw table (frame must not be in use by the GPU)
+	void update(uint32_t frameIndex, const Frustum& frustum, uint32_t objectCount);
+
+	//outside a render pass: clears the frame's draws, culls, and makes the results visible to indirect draws
+	void recordCull(VkCommandBuffer commandBuffer, uint32_t frameIndex, uint32_t objectCount);
+	//inside a render pass with the page's vertex and index buffers bound
+	void recordDraws(VkCommandBuffer commandBuffer, uint32_t frameIndex, uint32_t page, uint32_t objectCount);
+
+	bool isDrawCountSupported();
+	uint32_t getObjectCapacity();
+	uint32_t getPageCapacity();
+
+	~GpuCulling();
+
+private:
+	//std140 layout of CullParams in cull.comp
+	struct CullParams {
+		glm::vec4 planes[6];
+		uint32_t objectCount;
+		uint32_t objectCapacity;							//commands reserved per page
+		uint32_t compact;									//1 when draws are packed and counted
+		uint32_t drawChunkSize;								//most draws one count call takes, maxDrawIndirectCount
+		uint32_t countStride;								//counts per page, one per chunk
+		uint32_t padding[3];
+	};
+
+	struct FrameResources {
+		VkBuffer inputBuffer = VK_NULL_HANDLE;				//host visible: cull params followed by the draw table
+		Allocation inputAllocation;
+		uint64_t drawTableVersion = 0;						//version of the draw table last copied into inputBuffer
+
+		VkBuffer indirectBuffer = VK_NULL_HANDLE;			//device local: per page chunk counts followed by per page commands
+		Allocation indirectAllocation;
+
+		VkBuffer objectTableBuffer = VK_NULL_HANDLE;		//owned by the renderer's uniform ring
+		VkDeviceSize objectTableOffset = 0;
+		VkDeviceSize objectTableRange = 0;
+
+		VkDescriptorSet descriptorSet = VK_NULL_HANDLE;
+	};
+
+	DeviceAllocator* allocator = nullptr;
+	VkDevice device = VK_NULL_HANDLE;
+	PFN_vkCmdDrawIndexedIndirectCountKHR drawIndexedIndirectCount = nullptr;	//null without VK_KHR_draw_indirect_count
+	uint32_t maxDrawIndirectCount = 1;
+	VkDeviceSize storageAlignment = 1;
+
+	VkDescriptorSetLayout descriptorSetLayout = VK_NULL_HANDLE;
+	VkDescriptorPool descriptorPool = VK_NULL_HANDLE;
+	VkPipelineLayout pipelineLayout = VK_NULL_HANDLE;
+	VkPipeline pipeline = VK_NULL_HANDLE;
+
+	std::vector<FrameResources> frames;
+	uint32_t objectCapacity = 0;
+	uint32_t pageCapacity = 0;
+	uint32_t countStride = 1;								//counts per page: the packing count, which is also the first chunk's, then later chunks'
+	VkDeviceSize drawTableBase = 0;							//offset of the draw table in each input buffer
+	VkDeviceSize commandsBase = 0;							//offset of the commands in each indirect buffer
+
+	std::vector<GpuDrawInfo> drawTable;
+	uint64_t drawTableVersion = 1;
+
+	void createDescriptors(uint32_t frameCount);
+	void writeDescriptors(uint32_t frameIndex);
+	void destroyFrameResources();
+	VkDeviceSize alignStorage(VkDeviceSize size);
+};
@@ -0,0 +1,92 @@
+#include "GpuTimeline.h"
+
+#include <algorithm>
+#include <limits>
+#include <stdexcept>
+
+GpuTimeline::GpuTimeline()
+{
+}
+
+void GpuTimeline::init(VkDevice newDevice, bool supported)
+{
+	device = newDevice;
+	if (!supported) return;
+
+	//extension entry points, looked up so the loader the app links against may be older
+	waitSemaphores = (PFN_vkWaitSemaphoresKHR)vkGetDeviceProcAddr(device, "vkWaitSemaphoresKHR");
+	getSemaphoreCounterValue = (PFN_vkGetSemaphoreCounterValueKHR)vkGetDeviceProcAddr(device, "vkGetSemaphoreCounterValueKHR");
+	if (waitSemaphores == nullptr || getSemaphoreCounterValue == nullptr) return;
+
+	VkSemaphoreTypeCreateInfoKHR typeCreateInfo = {};
+	typeCreateInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO_KHR;
+	typeCreateInfo.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE_KHR;
+	typeCreateInfo.initialValue = 0;
+
+	VkSemaphoreCreateInfo semaphoreCreateInfo = {};
+	semaphoreCreateInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+	semaphoreCreateInfo.pNext = &typeCreateInfo;
+
+	VkResult result = vkCreateSemaphore(device, &semaphoreCreateInfo, nullptr, &semaphore);
+	if (result != VK_SUCCESS) {
+		throw std::runtime_error("failed to create the timeline semaphore");
+	}
+}
+
+bool GpuTimeline::isEnabled()
+{
+	return semaphore != VK_NULL_HANDLE;
+}
+
+uint64_t GpuTimeline::nextValue()
+{
+	return ++lastValue;
+}
+
+VkSemaphore GpuTimeline::getSemaphore()
+{
+	return semaphore;
+}
+
+uint64_t GpuTimeline::getCompletedValue()
+{
+	uint64_t value;
+	if (getSemaphoreCounterValue(device, semaphore, &value) != VK_SUCCESS) {
+		throw std::runtime_error("failed to read the timeline semaphore");
+	}
+	completedValue = std::max(completedValue, value);
+	return completedValue;
+}
+
+bool GpuTimeline::isComplete(uint64_t value)
+{
+	if (value <= completedValue) return true;
+	return getCompletedValue() >= value;
+}
+
+void GpuTimeline::wait(uint64_t value)
+{
+	if (value <= completedValue) return;
+
+	VkSemaphoreWaitInfoKHR waitInfo = {};
+	waitInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO_KHR;
+	waitInfo.semaphoreCount = 1;
+	waitInfo.pSemaphores = &semaphore;
+	waitInfo.pValues = &value;
+	if (waitSemaphores(device, &waitInfo, std::numeric_limits<uint64_t>::max()) != VK_SUCCESS) {
+		throw std::runtime_error("failed to wait for the timeline semaphore");
+	}
+	completedValue = std::max(completedValue, value);
+}
+
+void GpuTimeline::cleanup()
+{
+	if (semaphore == VK_NULL_HANDLE) return;
+
+	vkDestroySemaphore(device, semaphore, nullptr);
+	semaphore = VK_NULL_HANDLE;
+}
+
+GpuTimeline::~GpuTimeline()
+{
+}
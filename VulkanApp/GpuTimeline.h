@@ -0,0 +1,41 @@
+#pragma once
+
+#define GLFW_INCLUDE_VULKAN
+#include <GLFW/glfw3.h>
+
+#include <cstdint>
+
+//One counter for every submission to the graphics queue, each submission signals the next value
+//so a single number says how far the GPU has got and anything tagged with a value can be retired once it is reached
+//backed by a timeline semaphore (VK_KHR_timeline_semaphore, core in 1.2), without one it stays disabled and its users fall back to fences
+//not thread safe, values must be taken in the order the submissions are made
+class GpuTimeline
+{
+public:
+	GpuTimeline();
+
+	//device must have VK_KHR_timeline_semaphore and its timelineSemaphore feature enabled when supported is true
+	void init(VkDevice newDevice, bool supported);
+	bool isEnabled();
+
+	//value the next submission signals, take one per submission right before making it
+	uint64_t nextValue();
+	VkSemaphore getSemaphore();
+
+	uint64_t getCompletedValue();
+	bool isComplete(uint64_t value);
+	void wait(uint64_t value);
+
+	void cleanup();
+
+	~GpuTimeline();
+
+private:
+	VkDevice device = VK_NULL_HANDLE;
+	VkSemaphore semaphore = VK_NULL_HANDLE;
+	PFN_vkWaitSemaphoresKHR waitSemaphores = nullptr;
+	PFN_vkGetSemaphoreCounterValueKHR getSemaphoreCounterValue = nullptr;
+
+	uint64_t lastValue = 0;										//most recently handed out
+	uint64_t completedValue = 0;								//highest value seen signalled, saves querying for older ones
+};
@@ -0,0 +1,102 @@
+#include "MappedFile.h"
+
+#include <stdexcept>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+MappedFile::MappedFile()
+{
+}
+
+void MappedFile::open(const std::string& path)
+{
+	close();
+
+#ifdef _WIN32
+	HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+	if (file == INVALID_HANDLE_VALUE) {
+		throw std::runtime_error("Failed to open " + path);
+	}
+	fileHandle = file;
+
+	LARGE_INTEGER fileSize;
+	if (!GetFileSizeEx(file, &fileSize)) {
+		close();
+		throw std::runtime_error("Failed to get the size of " + path);
+	}
+	//windows refuses to map an empty file
+	if (fileSize.QuadPart == 0) return;
+
+	mappingHandle = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	void* view = mappingHandle != nullptr ? MapViewOfFile(mappingHandle, FILE_MAP_READ, 0, 0, 0) : nullptr;
+	if (view == nullptr) {
+		close();
+		throw std::runtime_error("Failed to map " + path);
+	}
+	data = static_cast<const unsigned char*>(view);
+	size = static_cast<uint64_t>(fileSize.QuadPart);
+#else
+	fileDescriptor = ::open(path.c_str(), O_RDONLY);
+	if (fileDescriptor < 0) {
+		throw std::runtime_error("Failed to open " + path);
+	}
+
+	struct stat fileStatus;
+	if (fstat(fileDescriptor, &fileStatus) != 0) {
+		close();
+		throw std::runtime_error("Failed to get the size of " + path);
+	}
+	//mmap refuses a zero length
+	if (fileStatus.st_size == 0) return;
+
+	void* view = mmap(nullptr, static_cast<size_t>(fileStatus.st_size), PROT_READ, MAP_PRIVATE, fileDescriptor, 0);
+	if (view == MAP_FAILED) {
+		close();
+		throw std::runtime_error("Failed to map " + path);
+	}
+	data = static_cast<const unsigned char*>(view);
+	size = static_cast<uint64_t>(fileStatus.st_size);
+	madvise(view, static_cast<size_t>(size), MADV_SEQUENTIAL);
+#endif
+}
+
+void MappedFile::close()
+{
+#ifdef _WIN32
+	if (data != nullptr) UnmapViewOfFile(data);
+	if (mappingHandle != nullptr) CloseHandle(mappingHandle);
+	if (fileHandle != nullptr) CloseHandle(fileHandle);
+	mappingHandle = nullptr;
+	fileHandle = nullptr;
+#else
+	if (data != nullptr) munmap(const_cast<unsigned char*>(data), static_cast<size_t>(size));
+	if (fileDescriptor >= 0) ::close(fileDescriptor);
+	fileDescriptor = -1;
+#endif
+	data = nullptr;
+	size = 0;
+}
+
+const unsigned char* MappedFile::getData()
+{
+	return data;
+}
+
+uint64_t MappedFile::getSize()
+{
+	return size;
+}
+
+MappedFile::~MappedFile()
+{
+	close();
+}
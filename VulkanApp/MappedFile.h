@@ -0,0 +1,34 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+//Read only memory mapping of a whole file (mmap, MapViewOfFile on Windows)
+//hinted as read sequentially, so the OS reads ahead of whoever walks through it
+class MappedFile
+{
+public:
+	MappedFile();
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator=(const MappedFile&) = delete;
+
+	//throws if the file cant be opened or mapped, an empty file opens with no data
+	void open(const std::string& path);
+	void close();
+
+	const unsigned char* getData();
+	uint64_t getSize();
+
+	~MappedFile();
+
+private:
+	const unsigned char* data = nullptr;
+	uint64_t size = 0;
+
+#ifdef _WIN32
+	void* fileHandle = nullptr;
+	void* mappingHandle = nullptr;
+#else
+	int fileDescriptor = -1;
+#endif
+};
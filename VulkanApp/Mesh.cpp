@@ -1,18 +1,38 @@
 #include "Mesh.h"
 
+#include <algorithm>
+
 Mesh::Mesh() {
 
 }
 
-Mesh::Mesh(VkPhysicalDevice newPhysicalDevice, VkDevice newDevice, VkQueue transferQueue, VkCommandPool transferCommandPool, std::vector<Vertex>* vertices, std::vector<uint32_t>* indices) {
-	vertexCount = vertices->size();
-	indexCount = indices->size();
-	physicalDevice = newPhysicalDevice;
-	device = newDevice;
-	createVertexBuffer(transferQueue, transferCommandPool, vertices);
-	createIndexBuffer(transferQueue, transferCommandPool, indices);
-
+Mesh::Mesh(GeometryArena* newArena, const MeshData& data, VkIndexType indexType, const MeshLod* newLods, uint32_t newLodCount,
+	const Meshlet* newMeshlets, uint32_t newMeshletCount) {
+	arena = newArena;
+
+	if (newLods != nullptr && newLodCount > 0) {
+		lodCount = std::min(newLodCount, MAX_MESH_LODS);
+		std::copy(newLods, newLods + lodCount, lods);
+	}
+	else {
+		lodCount = 1;
+		lods[0].indexCount = data.indexCount;
+	}
+	if (newMeshlets != nullptr) {
+		meshlets.assign(newMeshlets, newMeshlets + newMeshletCount);
+	}
+
+	bounds = data.bounds != nullptr ? *data.bounds : computeMeshBounds(data.vertices, data.vertexCount);
+
+	//compact layouts store positions relative to the bounds, the shader undoes it with the scale and offset in the object table
+	PositionQuantization quantization = getPositionQuantization(arena->getVertexLayout().position, bounds.min, bounds.max);
 	uboModel.model = glm::mat4(1.0f);
+	uboModel.positionScale = glm::vec4(quantization.scale, 0.0f);
+	uboModel.positionOffset = glm::vec4(quantization.offset, 0.0f);
+
+	//sub allocated from the arena's shared buffers, the copies are batched rather than waited on here
+	//native layout data is copied straight from the caller's memory into staging, so a mapped file needs no intermediate copy
+	geometry = arena->allocate(data.vertices, data.vertexCount, quantization, data.indices, data.indexCount, indexType, &uploadTicket);
 }
 
 void Mesh::setModel(glm::mat4 newModel)
@@ -27,86 +47,124 @@ UboModel Mesh::getModel()
 
 int Mesh::getVertexCount()
 {
-	return vertexCount;
+	return geometry.vertexCount;
 }
 
-VkBuffer Mesh::getVertexBuffer()
+int32_t Mesh::getVertexOffset()
 {
-	return vertexBuffer;
+	return static_cast<int32_t>(geometry.vertexOffset);
+}
+
+VkBuffer Mesh::getVertexBuffer(uint32_t stream)
+{
+	return arena->getVertexBuffer(geometry.page, stream);
 }
 
 int Mesh::getIndexCount()
 {
-	return indexCount;
+	return lods[0].indexCount;
+}
+
+uint32_t Mesh::getFirstIndex()
+{
+	return geometry.firstIndex + lods[0].firstIndex;
 }
 
 VkBuffer Mesh::getIndexBuffer()
 {
-	return indexBuffer;
+	return arena->getIndexBuffer(geometry.page);
 }
 
-void Mesh::destroyBuffers()
+VkIndexType Mesh::getIndexType()
 {
-	vkDestroyBuffer(device, vertexBuffer, nullptr);
-	vkFreeMemory(device, vertexBufferMemory, nullptr);
-	vkDestroyBuffer(device, indexBuffer, nullptr);
-	vkFreeMemory(device, indexBufferMemory, nullptr);
+	return arena->getIndexType(geometry.page);
 }
 
-Mesh::~Mesh() {
+uint32_t Mesh::getLodCount()
+{
+	return lodCount;
+}
 
+MeshLod Mesh::getLod(uint32_t level)
+{
+	MeshLod lod = lods[level];
+	lod.firstIndex += geometry.firstIndex;
+	return lod;
 }
 
-void Mesh::createVertexBuffer(VkQueue transferQueue, VkCommandPool transferCommandPool, std::vector<Vertex>* vertices)
+bool Mesh::hasMeshlets()
 {
-	//get size of buffer
-	VkDeviceSize bufferSize = sizeof(Vertex) * vertices->size();
+	return !meshlets.empty();
+}
 
-	//temporary buffer to "stage" vertex data before transferring to GPU
-	VkBuffer stagingBuffer;
-	VkDeviceMemory stagingBufferMemory;
+const Meshlet* Mesh::getMeshlets()
+{
+	return meshlets.data();
+}
 
-	//create staging buffer and allocate memory
-	createBuffer(physicalDevice, device, bufferSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, &stagingBuffer, &stagingBufferMemory);
+glm::vec3 Mesh::getBoundsMin()
+{
+	return bounds.min;
+}
 
-	//map memory to vertex buffer
-	void* data;																	//1. create pointer to a point in normal memory
-	vkMapMemory(device, stagingBufferMemory, 0, bufferSize, 0, &data);			//2. map vertex buffer memory to that point
-	memcpy(data, vertices->data(), (size_t)bufferSize);							//3. copy memory from vertice vector to the point
-	vkUnmapMemory(device, stagingBufferMemory);									//4. unmap the vertex buffer memory
+glm::vec3 Mesh::getBoundsMax()
+{
+	return bounds.max;
+}
 
-	// Create buffer with TRANSFER_DST_BIT to mark as recipient of transfer data as well as vertex buffer
-	createBuffer(physicalDevice, device, bufferSize, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &vertexBuffer, &vertexBufferMemory);
+glm::vec3 Mesh::getBoundsCenter()
+{
+	return bounds.center;
+}
 
-	copyBuffer(device, transferQueue, transferCommandPool, stagingBuffer, vertexBuffer, bufferSize);
+float Mesh::getBoundsRadius()
+{
+	return bounds.radius;
+}
 
-	//clean up staging buffer
-	vkDestroyBuffer(device, stagingBuffer, nullptr);
-	vkFreeMemory(device, stagingBufferMemory, nullptr);
+uint32_t Mesh::getGeometryPage()
+{
+	return geometry.page;
 }
 
-void Mesh::createIndexBuffer(VkQueue transferQueue, VkCommandPool transferCommandPool, std::vector<uint32_t>* indices)
+bool Mesh::hasGeometry()
 {
-	//get size of indices
-	VkDeviceSize bufferSize = sizeof(uint32_t) * indices->size();
+	return arena != nullptr;
+}
 
-	//temporary buffer to "stage" index data before transferring to GPU
-	VkBuffer stagingBuffer;
-	VkDeviceMemory stagingBufferMemory;
-	createBuffer(physicalDevice, device, bufferSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, &stagingBuffer, &stagingBufferMemory);
+UploadTicket Mesh::getUploadTicket()
+{
+	return uploadTicket;
+}
 
-	void* data;																	
-	vkMapMemory(device, stagingBufferMemory, 0, bufferSize, 0, &data);			
-	memcpy(data, indices->data(), (size_t)bufferSize);							
-	vkUnmapMemory(device, stagingBufferMemory);									
+void Mesh::destroyGeometry(uint64_t lastFrame)
+{
+	if (arena == nullptr) return;
 
-	//create buffer for index data on gpu access only area
-	createBuffer(physicalDevice, device, bufferSize, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &indexBuffer, &indexBufferMemory);
+	arena->free(geometry, lastFrame);
+	arena = nullptr;
+	std::vector<Meshlet>().swap(meshlets);
+}
 
-	copyBuffer(device, transferQueue, transferCommandPool, stagingBuffer, indexBuffer, bufferSize);
+Mesh::~Mesh() {
 
-	vkDestroyBuffer(device, stagingBuffer, nullptr);
-	vkFreeMemory(device, stagingBufferMemory, nullptr);
 }
 
-
+MeshBounds computeMeshBounds(const Vertex* vertices, uint32_t vertexCount)
+{
+	MeshBounds bounds;
+	if (vertexCount == 0) return bounds;
+
+	bounds.min = bounds.max = vertices[0].pos;
+	for (uint32_t i = 0; i < vertexCount; i++) {
+		bounds.min = glm::min(bounds.min, vertices[i].pos);
+		bounds.max = glm::max(bounds.max, vertices[i].pos);
+	}
+
+	//box centre is not the tightest sphere but is cheap and never misses a vertex
+	bounds.center = (bounds.min + bounds.max) * 0.5f;
+	for (uint32_t i = 0; i < vertexCount; i++) {
+		bounds.radius = std::max(bounds.radius, glm::length(vertices[i].pos - bounds.center));
+	}
+	return bounds;
+}
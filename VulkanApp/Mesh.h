@@ -5,27 +5,101 @@
 
 #include <vector>
 #include "Utilities.h"
+#include "GeometryArena.h"
 
+//one object table entry, std430 layout shared with shader.vert and cull.comp
 struct UboModel {
 	glm::mat4 model;
+	glm::vec4 positionScale = glm::vec4(1.0f);		//stored positions are dequantized as stored * scale + offset
+	glm::vec4 positionOffset = glm::vec4(0.0f);
 };
 
+//most levels of detail a mesh keeps, the full mesh included
+const uint32_t MAX_MESH_LODS = 8;
+
+//one level of detail: a range of the mesh's indices, drawn against the same vertices as every other level
+struct MeshLod {
+	uint32_t firstIndex = 0;
+	uint32_t indexCount = 0;
+	float error = 0.0f;								//object space distance from the full mesh's surface, 0 for the full mesh
+	uint32_t firstMeshlet = 0;						//the level's clusters, none unless createMesh built them
+	uint32_t meshletCount = 0;
+};
+
+//a run of a mesh's triangles with object space bounds, drawn as its own index range
+struct Meshlet {
+	uint32_t firstIndex = 0;						//relative to the mesh's own indices, like MeshLod
+	uint32_t indexCount = 0;
+	glm::vec3 center = glm::vec3(0.0f);
+	float radius = 0.0f;
+	glm::vec3 coneAxis = glm::vec3(0.0f, 0.0f, 1.0f);	//mean of the triangle normals
+	float coneCutoff = 1.0f;						//sine of the normals' spread around the axis, 1 when the cone cant cull
+};
+
+//object space bounds of a mesh's vertices
+struct MeshBounds {
+	glm::vec3 min = glm::vec3(0.0f);
+	glm::vec3 max = glm::vec3(0.0f);
+	glm::vec3 center = glm::vec3(0.0f);				//sphere centred on the box, enclosing every vertex
+	float radius = 0.0f;
+};
+
+//geometry borrowed from the caller (a vector, a mapped file, ...), only read while the mesh is created
+struct MeshData {
+	const Vertex* vertices = nullptr;
+	uint32_t vertexCount = 0;
+	const uint32_t* indices = nullptr;
+	uint32_t indexCount = 0;
+	const MeshBounds* bounds = nullptr;				//precomputed bounds, null to compute them from the vertices
+	bool optimized = false;							//already in vertex cache / overdraw / fetch order, createMesh uploads it as is
+};
+
+MeshBounds computeMeshBounds(const Vertex* vertices, uint32_t vertexCount);
+
 class Mesh
 {
 public:
 	Mesh();
-	Mesh(VkPhysicalDevice newPhysicalDevice, VkDevice newDevice, VkQueue transferQueue, VkCommandPool transferCommandPool, std::vector<Vertex>* vertices, std::vector<uint32_t>* indices);
+	//lods index into data's indices, null for a single level covering all of them
+	//meshlets likewise, each level's firstMeshlet and meshletCount select its own
+	Mesh(GeometryArena* newArena, const MeshData& data, VkIndexType indexType, const MeshLod* newLods = nullptr, uint32_t newLodCount = 0,
+		const Meshlet* newMeshlets = nullptr, uint32_t newMeshletCount = 0);
 
 	void setModel(glm::mat4 newModel);
 	UboModel getModel();
 
 	int getVertexCount();
-	VkBuffer getVertexBuffer();
+	int32_t getVertexOffset();
+	VkBuffer getVertexBuffer(uint32_t stream);
 
+	//of the full mesh
 	int getIndexCount();
+	uint32_t getFirstIndex();
 	VkBuffer getIndexBuffer();
+	VkIndexType getIndexType();
+
+	//level 0 is the full mesh, firstIndex of the returned range is within the arena page like getFirstIndex
+	uint32_t getLodCount();
+	MeshLod getLod(uint32_t level);
+
+	//clusters of every level, firstIndex is relative to getFirstIndex
+	bool hasMeshlets();
+	const Meshlet* getMeshlets();
 
-	void destroyBuffers();
+	//object space bounds of the vertices
+	glm::vec3 getBoundsMin();
+	glm::vec3 getBoundsMax();
+	glm::vec3 getBoundsCenter();
+	float getBoundsRadius();
+
+	//arena page, draws of meshes on the same page share bound buffers
+	uint32_t getGeometryPage();
+	bool hasGeometry();
+
+	UploadTicket getUploadTicket();
+
+	//geometry may be drawn by frames up to lastFrame, the arena reuses it once they complete
+	void destroyGeometry(uint64_t lastFrame);
 
 	~Mesh();
 
@@ -33,18 +107,16 @@ private:
 
 	UboModel uboModel;
 
-	int vertexCount;
-	VkBuffer vertexBuffer;
-	VkDeviceMemory vertexBufferMemory;
+	UploadTicket uploadTicket;						//vertex and index data are usable once this completes
+
+	GeometryRange geometry;
+	GeometryArena* arena = nullptr;					//null once geometry is destroyed
 
-	int indexCount;
-	VkBuffer indexBuffer;
-	VkDeviceMemory indexBufferMemory;
+	MeshBounds bounds;
 
-	VkPhysicalDevice physicalDevice;
-	VkDevice device;
+	MeshLod lods[MAX_MESH_LODS];					//firstIndex relative to the mesh's own indices
+	uint32_t lodCount = 1;
 
-	void createVertexBuffer(VkQueue transferQueue, VkCommandPool transferCommandPool, std::vector<Vertex>* vertices);
-	void createIndexBuffer(VkQueue transferQueue, VkCommandPool transferCommandPool, std::vector<uint32_t>* indices);
+	std::vector<Meshlet> meshlets;
 };
 
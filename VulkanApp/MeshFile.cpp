@@ -0,0 +1,194 @@
+#include "MeshFile.h"
+
+#include <algorithm>
+#include <fstream>
+
+//layout is part of the format, it must not change with the compiler's padding
+static_assert(sizeof(MeshFileHeader) == 32, "mesh file header layout changed");
+static_assert(sizeof(MeshFileEntry) == 64, "mesh file entry layout changed");
+
+static uint64_t alignOffset(uint64_t offset) {
+	return (offset + MESH_FILE_ALIGNMENT - 1) / MESH_FILE_ALIGNMENT * MESH_FILE_ALIGNMENT;
+}
+
+MeshFile::MeshFile()
+{
+}
+
+void MeshFile::open(const std::string& path)
+{
+	close();
+	file.open(path);
+	try {
+		validate();
+	}
+	catch (const std::runtime_error&) {
+		close();
+		throw;
+	}
+
+	uint32_t meshCount = getMeshCount();
+	bounds.resize(meshCount);
+	for (uint32_t i = 0; i < meshCount; i++) {
+		const MeshFileEntry& entry = getEntry(i);
+		bounds[i].min = glm::vec3(entry.boundsMin[0], entry.boundsMin[1], entry.boundsMin[2]);
+		bounds[i].max = glm::vec3(entry.boundsMax[0], entry.boundsMax[1], entry.boundsMax[2]);
+		bounds[i].center = glm::vec3(entry.boundsCenter[0], entry.boundsCenter[1], entry.boundsCenter[2]);
+		bounds[i].radius = entry.boundsRadius;
+	}
+}
+
+void MeshFile::close()
+{
+	file.close();
+	bounds.clear();
+}
+
+uint32_t MeshFile::getMeshCount()
+{
+	if (file.getSize() < sizeof(MeshFileHeader)) return 0;
+
+	MeshFileHeader header;
+	memcpy(&header, file.getData(), sizeof(header));
+	return header.meshCount;
+}
+
+MeshData MeshFile::getMesh(uint32_t index)
+{
+	if (index >= getMeshCount()) {
+		throw std::runtime_error("mesh index is outside the mesh file");
+	}
+
+	//validate checked every range lies within the file and is aligned, so these are safe to hand out as typed pointers
+	const MeshFileEntry& entry = getEntry(index);
+	MeshData mesh;
+	mesh.vertices = reinterpret_cast<const Vertex*>(file.getData() + entry.vertexDataOffset);
+	mesh.vertexCount = entry.vertexCount;
+	mesh.indices = reinterpret_cast<const uint32_t*>(file.getData() + entry.indexDataOffset);
+	mesh.indexCount = entry.indexCount;
+	mesh.bounds = &bounds[index];
+
+	MeshFileHeader header;
+	memcpy(&header, file.getData(), sizeof(header));
+	mesh.optimized = (header.flags & MESH_FILE_OPTIMIZED) != 0;
+	return mesh;
+}
+
+uint64_t MeshFile::getFileSize()
+{
+	return file.getSize();
+}
+
+MeshFile::~MeshFile()
+{
+	close();
+}
+
+void MeshFile::validate()
+{
+	uint64_t size = file.getSize();
+	if (size < sizeof(MeshFileHeader)) {
+		throw std::runtime_error("mesh file is too small to hold a header");
+	}
+
+	MeshFileHeader header;
+	memcpy(&header, file.getData(), sizeof(header));
+
+	if (header.magic != MESH_FILE_MAGIC) {
+		throw std::runtime_error("not a mesh file");
+	}
+	if (header.version != MESH_FILE_VERSION) {
+		throw std::runtime_error("unsupported mesh file version");
+	}
+	if (header.vertexStride != sizeof(Vertex)) {
+		throw std::runtime_error("mesh file was written for a different vertex layout");
+	}
+	if (header.fileSize != size) {
+		throw std::runtime_error("mesh file size does not match its header, the file may be truncated");
+	}
+
+	uint64_t tableEnd = sizeof(MeshFileHeader) + static_cast<uint64_t>(header.meshCount) * sizeof(MeshFileEntry);
+	if (tableEnd > size) {
+		throw std::runtime_error("mesh file entry table runs past the end of the file");
+	}
+
+	//index values are trusted, checking them would cost a pass over every index on each load
+	for (uint32_t i = 0; i < header.meshCount; i++) {
+		const MeshFileEntry& entry = getEntry(i);
+		uint64_t vertexBytes = static_cast<uint64_t>(entry.vertexCount) * sizeof(Vertex);
+		uint64_t indexBytes = static_cast<uint64_t>(entry.indexCount) * sizeof(uint32_t);
+
+		bool aligned = entry.vertexDataOffset % MESH_FILE_ALIGNMENT == 0 && entry.indexDataOffset % MESH_FILE_ALIGNMENT == 0;
+		bool vertexInFile = entry.vertexDataOffset >= tableEnd && entry.vertexDataOffset <= size && vertexBytes <= size - entry.vertexDataOffset;
+		bool indexInFile = entry.indexDataOffset >= tableEnd && entry.indexDataOffset <= size && indexBytes <= size - entry.indexDataOffset;
+		if (!aligned || !vertexInFile || !indexInFile) {
+			throw std::runtime_error("mesh file entry points outside the file");
+		}
+	}
+}
+
+const MeshFileEntry& MeshFile::getEntry(uint32_t index)
+{
+	//header is a multiple of 8 bytes and the mapping is page aligned, so entries are naturally aligned
+	return reinterpret_cast<const MeshFileEntry*>(file.getData() + sizeof(MeshFileHeader))[index];
+}
+
+void writeMeshFile(const std::string& path, const std::vector<MeshData>& meshes)
+{
+	//lay every blob out first, the table is written ahead of the data it describes
+	std::vector<MeshFileEntry> entries(meshes.size());
+	uint64_t offset = sizeof(MeshFileHeader) + meshes.size() * sizeof(MeshFileEntry);
+	for (size_t i = 0; i < meshes.size(); i++) {
+		const MeshData& mesh = meshes[i];
+		MeshBounds meshBounds = mesh.bounds != nullptr ? *mesh.bounds : computeMeshBounds(mesh.vertices, mesh.vertexCount);
+
+		MeshFileEntry& entry = entries[i];
+		entry.vertexCount = mesh.vertexCount;
+		entry.indexCount = mesh.indexCount;
+		entry.vertexDataOffset = alignOffset(offset);
+		offset = entry.vertexDataOffset + static_cast<uint64_t>(mesh.vertexCount) * sizeof(Vertex);
+		entry.indexDataOffset = alignOffset(offset);
+		offset = entry.indexDataOffset + static_cast<uint64_t>(mesh.indexCount) * sizeof(uint32_t);
+
+		for (int axis = 0; axis < 3; axis++) {
+			entry.boundsMin[axis] = meshBounds.min[axis];
+			entry.boundsMax[axis] = meshBounds.max[axis];
+			entry.boundsCenter[axis] = meshBounds.center[axis];
+		}
+		entry.boundsRadius = meshBounds.radius;
+	}
+
+	MeshFileHeader header = {};
+	header.magic = MESH_FILE_MAGIC;
+	header.version = MESH_FILE_VERSION;
+	header.vertexStride = sizeof(Vertex);
+	header.meshCount = static_cast<uint32_t>(meshes.size());
+	header.fileSize = offset;
+	bool optimized = !meshes.empty() && std::all_of(meshes.begin(), meshes.end(), [](const MeshData& mesh) { return mesh.optimized; });
+	header.flags = optimized ? MESH_FILE_OPTIMIZED : 0;
+
+	std::ofstream file(path, std::ios::binary | std::ios::trunc);
+	if (!file.is_open()) {
+		throw std::runtime_error("Failed to create a mesh file");
+	}
+
+	file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+	file.write(reinterpret_cast<const char*>(entries.data()), entries.size() * sizeof(MeshFileEntry));
+
+	static const char padding[MESH_FILE_ALIGNMENT] = {};
+	uint64_t written = sizeof(MeshFileHeader) + entries.size() * sizeof(MeshFileEntry);
+	for (size_t i = 0; i < meshes.size(); i++) {
+		file.write(padding, static_cast<std::streamsize>(entries[i].vertexDataOffset - written));
+		file.write(reinterpret_cast<const char*>(meshes[i].vertices), static_cast<std::streamsize>(entries[i].vertexCount) * sizeof(Vertex));
+		written = entries[i].vertexDataOffset + static_cast<uint64_t>(entries[i].vertexCount) * sizeof(Vertex);
+
+		file.write(padding, static_cast<std::streamsize>(entries[i].indexDataOffset - written));
+		file.write(reinterpret_cast<const char*>(meshes[i].indices), static_cast<std::streamsize>(entries[i].indexCount) * sizeof(uint32_t));
+		written = entries[i].indexDataOffset + static_cast<uint64_t>(entries[i].indexCount) * sizeof(uint32_t);
+	}
+
+	file.flush();
+	if (!file.good()) {
+		throw std::runtime_error("Failed to write a mesh file");
+	}
+}
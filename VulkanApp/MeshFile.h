@@ -0,0 +1,76 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "Utilities.h"
+#include "Mesh.h"
+#include "MappedFile.h"
+
+//"VMSH" read as a little endian uint32
+const uint32_t MESH_FILE_MAGIC = 0x48534D56;
+const uint32_t MESH_FILE_VERSION = 1;
+
+//MeshFileHeader::flags
+const uint32_t MESH_FILE_OPTIMIZED = 1;			//every mesh is in optimized order (MeshOptimizer), createMesh skips reordering
+
+//vertex and index blobs start on a cache line, so copies out of the mapping never straddle one at the start
+const uint64_t MESH_FILE_ALIGNMENT = 64;
+
+//Layout of a mesh file (little endian, written by MeshConverter or writeMeshFile):
+//	MeshFileHeader
+//	MeshFileEntry[meshCount]
+//	per mesh, each padded to MESH_FILE_ALIGNMENT: Vertex[vertexCount], uint32_t[indexCount]
+struct MeshFileHeader {
+	uint32_t magic;
+	uint32_t version;
+	uint32_t vertexStride;							//sizeof(Vertex) when written, files for another layout are rejected
+	uint32_t meshCount;
+	uint64_t fileSize;								//catches truncated copies before anything is read past the end
+	uint32_t flags;
+	uint32_t reserved;
+};
+
+struct MeshFileEntry {
+	uint64_t vertexDataOffset;						//from the start of the file
+	uint64_t indexDataOffset;
+	uint32_t vertexCount;
+	uint32_t indexCount;
+	float boundsMin[3];
+	float boundsMax[3];
+	float boundsCenter[3];
+	float boundsRadius;
+};
+
+//Read only memory mapping of a mesh file
+//getMesh points straight into the mapping, so createMesh copies from the page cache into staging memory with
+//nothing read into a heap buffer first, pointers stay valid until close
+class MeshFile
+{
+public:
+	MeshFile();
+	MeshFile(const MeshFile&) = delete;
+	MeshFile& operator=(const MeshFile&) = delete;
+
+	//maps the file and validates the header and every entry, throws if the file cant be used
+	void open(const std::string& path);
+	void close();
+
+	uint32_t getMeshCount();
+	MeshData getMesh(uint32_t index);
+	uint64_t getFileSize();
+
+	~MeshFile();
+
+private:
+	MappedFile file;
+	std::vector<MeshBounds> bounds;					//entries' bounds converted once, MeshData points at these
+
+	void validate();
+	const MeshFileEntry& getEntry(uint32_t index);
+};
+
+//writes meshes into a new mesh file (replacing any existing one), computing bounds that arent given, throws on failure
+//the file is marked optimized only if every mesh is
+void writeMeshFile(const std::string& path, const std::vector<MeshData>& meshes);
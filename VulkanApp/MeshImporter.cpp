@@ -0,0 +1,1108 @@
+#include "MeshImporter.h"
+
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <memory>
+
+#include "MappedFile.h"
+
+static const uint32_t INVALID_INDEX = std::numeric_limits<uint32_t>::max();
+
+MeshData ImportedMesh::getMeshData()
+{
+	MeshData data;
+	data.vertices = vertices.data();
+	data.vertexCount = static_cast<uint32_t>(vertices.size());
+	data.indices = indices.data();
+	data.indexCount = static_cast<uint32_t>(indices.size());
+	return data;
+}
+
+static std::string getExtension(const std::string& path) {
+	size_t dot = path.find_last_of('.');
+	size_t slash = path.find_last_of("/\\");
+	if (dot == std::string::npos || (slash != std::string::npos && dot < slash)) return "";
+
+	std::string extension = path.substr(dot + 1);
+	std::transform(extension.begin(), extension.end(), extension.begin(), [](char c) { return static_cast<char>(std::tolower(static_cast<unsigned char>(c))); });
+	return extension;
+}
+
+//tasks of roughly chunkSize elements each, at least one
+static uint32_t getChunkCount(uint64_t elements, uint64_t chunkSize) {
+	return static_cast<uint32_t>(std::max<uint64_t>(1, (elements + chunkSize - 1) / chunkSize));
+}
+
+// -- OBJ --
+
+//text parsing that never reads past end, mapped files have no terminator
+static bool isSpace(char c) {
+	return c == ' ' || c == '\t' || c == '\r';
+}
+
+static void skipSpaces(const char*& p, const char* end) {
+	while (p < end && isSpace(*p)) p++;
+}
+
+static bool parseFloat(const char*& p, const char* end, float& value) {
+	skipSpaces(p, end);
+	const char* start = p;
+	bool negative = false;
+	if (p < end && (*p == '-' || *p == '+')) negative = *p++ == '-';
+
+	//mantissa as an integer and a power of ten, exact for the digit counts meshes are written with
+	uint64_t mantissa = 0;
+	int exponent = 0;
+	int digits = 0;
+	while (p < end && *p >= '0' && *p <= '9') {
+		if (digits++ < 18) mantissa = mantissa * 10 + (*p - '0');
+		else exponent++;
+		p++;
+	}
+	if (p < end && *p == '.') {
+		p++;
+		while (p < end && *p >= '0' && *p <= '9') {
+			if (digits++ < 18) {
+				mantissa = mantissa * 10 + (*p - '0');
+				exponent--;
+			}
+			p++;
+		}
+	}
+	if (digits == 0) {
+		p = start;
+		return false;
+	}
+	if (p < end && (*p == 'e' || *p == 'E')) {
+		const char* exponentStart = p++;
+		bool negativeExponent = false;
+		if (p < end && (*p == '-' || *p == '+')) negativeExponent = *p++ == '-';
+		if (p < end && *p >= '0' && *p <= '9') {
+			int explicitExponent = 0;
+			while (p < end && *p >= '0' && *p <= '9') {
+				explicitExponent = std::min(explicitExponent * 10 + (*p - '0'), 1000);
+				p++;
+			}
+			exponent += negativeExponent ? -explicitExponent : explicitExponent;
+		}
+		else {
+			p = exponentStart;
+		}
+	}
+
+	//powers of ten up to 1e22 are exact doubles, which covers every coordinate short of scientific notation
+	static const double powers[] = { 1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11, 1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22 };
+	double result = static_cast<double>(mantissa);
+	if (exponent >= 0 && exponent <= 22) result *= powers[exponent];
+	else if (exponent < 0 && exponent >= -22) result /= powers[-exponent];
+	else result *= std::pow(10.0, exponent);
+	value = static_cast<float>(negative ? -result : result);
+	return true;
+}
+
+static bool parseInt(const char*& p, const char* end, int64_t& value) {
+	skipSpaces(p, end);
+	bool negative = false;
+	if (p < end && (*p == '-' || *p == '+')) negative = *p++ == '-';
+	if (p >= end || *p < '0' || *p > '9') return false;
+
+	int64_t result = 0;
+	while (p < end && *p >= '0' && *p <= '9') {
+		result = std::min<int64_t>(result * 10 + (*p - '0'), std::numeric_limits<int32_t>::max());
+		p++;
+	}
+	value = negative ? -result : result;
+	return true;
+}
+
+//a chunk of whole lines, parsed independently of the others
+struct ObjChunk {
+	std::vector<Vertex> vertices;
+	std::vector<uint32_t> corners;					//position index, or INVALID_INDEX where a relative index is resolved later
+
+	//negative (relative) indices depend on how many vertices earlier chunks hold
+	struct RelativeCorner {
+		size_t corner;
+		int64_t localIndex;							//relative to this chunk's first vertex, may point into earlier chunks
+	};
+	std::vector<RelativeCorner> relativeCorners;
+};
+
+static void parseObjChunk(const char* p, const char* end, glm::vec3 defaultColor, ObjChunk& chunk) {
+	std::vector<uint32_t> face;
+	std::vector<ObjChunk::RelativeCorner> faceRelative;
+
+	while (p < end) {
+		const char* lineEnd = static_cast<const char*>(memchr(p, '\n', end - p));
+		if (lineEnd == nullptr) lineEnd = end;
+
+		skipSpaces(p, lineEnd);
+		if (lineEnd - p >= 2 && p[0] == 'v' && isSpace(p[1])) {
+			p++;
+			Vertex vertex;
+			float values[7];
+			int count = 0;
+			while (count < 7 && parseFloat(p, lineEnd, values[count])) count++;
+			if (count < 3) {
+				throw std::runtime_error("OBJ vertex has fewer than 3 coordinates");
+			}
+			vertex.pos = glm::vec3(values[0], values[1], values[2]);
+			//"v x y z r g b" is the common colour extension, "v x y z w" is a weight and not a colour
+			vertex.col = count >= 6 ? glm::vec3(values[3], values[4], values[5]) : defaultColor;
+			chunk.vertices.push_back(vertex);
+		}
+		else if (lineEnd - p >= 2 && p[0] == 'f' && isSpace(p[1])) {
+			p++;
+			face.clear();
+			faceRelative.clear();
+			int64_t index;
+			while (parseInt(p, lineEnd, index)) {
+				if (index == 0) {
+					throw std::runtime_error("OBJ face refers to vertex 0, indices start at 1");
+				}
+				if (index > 0) {
+					face.push_back(static_cast<uint32_t>(index - 1));
+				}
+				else {
+					ObjChunk::RelativeCorner relative;
+					relative.corner = face.size();
+					relative.localIndex = static_cast<int64_t>(chunk.vertices.size()) + index;
+					faceRelative.push_back(relative);
+					face.push_back(INVALID_INDEX);
+				}
+				//v/vt/vn, only the position index matters
+				while (p < lineEnd && !isSpace(*p)) p++;
+			}
+
+			//fan triangulation, relative corners are remembered by their position in the corner list
+			for (size_t i = 2; i < face.size(); i++) {
+				const size_t triangle[] = { 0, i - 1, i };
+				for (size_t corner : triangle) {
+					for (const ObjChunk::RelativeCorner& relative : faceRelative) {
+						if (relative.corner == corner) {
+							ObjChunk::RelativeCorner resolved = relative;
+							resolved.corner = chunk.corners.size();
+							chunk.relativeCorners.push_back(resolved);
+						}
+					}
+					chunk.corners.push_back(face[corner]);
+				}
+			}
+		}
+		//normals, uvs, groups and materials have nowhere to go in the vertex format
+
+		p = lineEnd < end ? lineEnd + 1 : end;
+	}
+}
+
+std::vector<ImportedMesh> MeshImporter::importObj(const std::string& path)
+{
+	auto parseStart = std::chrono::steady_clock::now();
+
+	MappedFile file;
+	file.open(path);
+	const char* text = reinterpret_cast<const char*>(file.getData());
+	uint64_t size = file.getSize();
+	stats.fileBytes = size;
+
+	//chunks start on the line after their nominal start, so each line is parsed by exactly one chunk
+	uint32_t chunkCount = getChunkCount(size, IMPORT_CHUNK_BYTES);
+	std::vector<uint64_t> chunkStarts(chunkCount + 1, size);
+	chunkStarts[0] = 0;
+	for (uint32_t i = 1; i < chunkCount; i++) {
+		uint64_t start = std::max(size * i / chunkCount, chunkStarts[i - 1]);
+		const char* newline = static_cast<const char*>(memchr(text + start, '\n', size - start));
+		chunkStarts[i] = newline != nullptr ? newline - text + 1 : size;
+	}
+
+	std::vector<ObjChunk> chunks(chunkCount);
+	threads.run(chunkCount, [&](uint32_t chunk) {
+		parseObjChunk(text + chunkStarts[chunk], text + chunkStarts[chunk + 1], defaultColor, chunks[chunk]);
+	});
+
+	//chunk sizes are only known now, offsets of each chunk within the merged arrays
+	std::vector<uint64_t> vertexBases(chunkCount + 1, 0);
+	std::vector<uint64_t> cornerBases(chunkCount + 1, 0);
+	std::vector<uint64_t> chunkBytes(chunkCount);				//what each chunk really holds, released as is once it is merged
+	for (uint32_t i = 0; i < chunkCount; i++) {
+		vertexBases[i + 1] = vertexBases[i] + chunks[i].vertices.size();
+		cornerBases[i + 1] = cornerBases[i] + chunks[i].corners.size();
+		chunkBytes[i] = chunks[i].vertices.capacity() * sizeof(Vertex) + chunks[i].corners.capacity() * sizeof(uint32_t);
+		trackAllocation(chunkBytes[i]);
+	}
+	uint64_t vertexCount = vertexBases[chunkCount];
+	uint64_t cornerCount = cornerBases[chunkCount];
+	if (vertexCount >= INVALID_INDEX || cornerCount >= INVALID_INDEX) {
+		throw std::runtime_error("OBJ file has more vertices or triangles than 32 bit indices can address");
+	}
+
+	std::vector<Vertex> source(static_cast<size_t>(vertexCount));
+	std::vector<uint32_t> corners(static_cast<size_t>(cornerCount));
+	trackAllocation(source.size() * sizeof(Vertex) + corners.size() * sizeof(uint32_t));
+
+	//every chunk is still alive when the merged arrays are allocated, so the peak holds the parsed data twice, chunks are freed as they are merged
+	threads.run(chunkCount, [&](uint32_t chunk) {
+		ObjChunk& objChunk = chunks[chunk];
+		std::copy(objChunk.vertices.begin(), objChunk.vertices.end(), source.begin() + vertexBases[chunk]);
+
+		uint32_t* chunkCorners = corners.data() + cornerBases[chunk];
+		for (size_t i = 0; i < objChunk.corners.size(); i++) {
+			chunkCorners[i] = objChunk.corners[i];
+		}
+		for (const ObjChunk::RelativeCorner& relative : objChunk.relativeCorners) {
+			int64_t index = static_cast<int64_t>(vertexBases[chunk]) + relative.localIndex;
+			chunkCorners[relative.corner] = index >= 0 ? static_cast<uint32_t>(index) : INVALID_INDEX;
+		}
+		for (size_t i = 0; i < objChunk.corners.size(); i++) {
+			if (chunkCorners[i] >= vertexCount) {
+				throw std::runtime_error("OBJ face refers to a vertex that does not exist");
+			}
+		}
+
+		std::vector<Vertex>().swap(objChunk.vertices);
+		std::vector<uint32_t>().swap(objChunk.corners);
+	});
+	for (uint32_t i = 0; i < chunkCount; i++) {
+		trackRelease(chunkBytes[i]);
+	}
+	file.close();
+
+	std::chrono::duration<double, std::milli> parseTime = std::chrono::steady_clock::now() - parseStart;
+	stats.parseMs = parseTime.count();
+
+	std::vector<ImportedMesh> meshes(1);
+	size_t nameStart = path.find_last_of("/\\");
+	meshes[0].name = nameStart == std::string::npos ? path : path.substr(nameStart + 1);
+	weld(source, corners, meshes[0]);
+	trackRelease(source.size() * sizeof(Vertex) + corners.size() * sizeof(uint32_t));
+	return meshes;
+}
+
+// -- glTF --
+
+//just enough JSON for glTF documents, which are small next to their buffers
+struct JsonValue {
+	enum class Type { Null, Bool, Number, String, Array, Object };
+
+	Type type = Type::Null;
+	bool boolean = false;
+	double number = 0.0;
+	std::string string;
+	std::vector<JsonValue> array;
+	std::vector<std::pair<std::string, JsonValue>> object;
+
+	const JsonValue* find(const char* key) const {
+		if (type != Type::Object) return nullptr;
+		for (const auto& member : object) {
+			if (member.first == key) return &member.second;
+		}
+		return nullptr;
+	}
+
+	const JsonValue& get(const char* key) const {
+		const JsonValue* value = find(key);
+		if (value == nullptr) {
+			throw std::runtime_error(std::string("glTF property \"") + key + "\" is missing");
+		}
+		return *value;
+	}
+
+	uint32_t getIndex(const char* key, uint32_t fallback = INVALID_INDEX) const {
+		const JsonValue* value = find(key);
+		if (value == nullptr) return fallback;
+		if (value->type != Type::Number || value->number < 0.0 || value->number >= INVALID_INDEX) {
+			throw std::runtime_error(std::string("glTF property \"") + key + "\" is not a valid index");
+		}
+		return static_cast<uint32_t>(value->number);
+	}
+
+	//array elements that are indices themselves, what names the kind of index in the error
+	uint32_t asIndex(const char* what) const {
+		if (type != Type::Number || number < 0.0 || number >= INVALID_INDEX) {
+			throw std::runtime_error(std::string("glTF ") + what + " index is not valid");
+		}
+		return static_cast<uint32_t>(number);
+	}
+
+	const JsonValue& at(uint32_t index) const {
+		if (type != Type::Array || index >= array.size()) {
+			throw std::runtime_error("glTF index is out of range");
+		}
+		return array[index];
+	}
+};
+
+class JsonParser
+{
+public:
+	JsonParser(const char* begin, const char* end) : p(begin), end(end) {}
+
+	JsonValue parseDocument() {
+		JsonValue value = parseValue(0);
+		skipWhitespace();
+		if (p != end) fail();
+		return value;
+	}
+
+private:
+	const char* p;
+	const char* end;
+
+	[[noreturn]] void fail() {
+		throw std::runtime_error("glTF JSON is malformed");
+	}
+
+	void skipWhitespace() {
+		while (p < end && (*p == ' ' || *p == '\t' || *p == '\n' || *p == '\r')) p++;
+	}
+
+	void expect(char c) {
+		skipWhitespace();
+		if (p >= end || *p != c) fail();
+		p++;
+	}
+
+	bool match(const char* word) {
+		size_t length = strlen(word);
+		if (static_cast<size_t>(end - p) < length || memcmp(p, word, length) != 0) return false;
+		p += length;
+		return true;
+	}
+
+	JsonValue parseValue(int depth) {
+		//glTF nests a handful of levels, anything deeper is not a glTF document
+		if (depth > 64) fail();
+		skipWhitespace();
+		if (p >= end) fail();
+
+		JsonValue value;
+		if (*p == '{') {
+			p++;
+			value.type = JsonValue::Type::Object;
+			skipWhitespace();
+			if (p < end && *p == '}') {
+				p++;
+				return value;
+			}
+			do {
+				skipWhitespace();
+				std::string key = parseString();
+				expect(':');
+				value.object.emplace_back(std::move(key), parseValue(depth + 1));
+				skipWhitespace();
+			} while (p < end && *p == ',' && ++p);
+			expect('}');
+		}
+		else if (*p == '[') {
+			p++;
+			value.type = JsonValue::Type::Array;
+			skipWhitespace();
+			if (p < end && *p == ']') {
+				p++;
+				return value;
+			}
+			do {
+				value.array.push_back(parseValue(depth + 1));
+				skipWhitespace();
+			} while (p < end && *p == ',' && ++p);
+			expect(']');
+		}
+		else if (*p == '"') {
+			value.type = JsonValue::Type::String;
+			value.string = parseString();
+		}
+		else if (match("true")) {
+			value.type = JsonValue::Type::Bool;
+			value.boolean = true;
+		}
+		else if (match("false")) {
+			value.type = JsonValue::Type::Bool;
+		}
+		else if (match("null")) {
+		}
+		else {
+			//strtod needs a terminated string, numbers are short so copy them out first
+			const char* start = p;
+			while (p < end && (strchr("+-.eE", *p) != nullptr || (*p >= '0' && *p <= '9'))) p++;
+			std::string number(start, p);
+			char* numberEnd = nullptr;
+			value.type = JsonValue::Type::Number;
+			value.number = std::strtod(number.c_str(), &numberEnd);
+			if (number.empty() || numberEnd != number.c_str() + number.size()) fail();
+		}
+		return value;
+	}
+
+	std::string parseString() {
+		if (p >= end || *p != '"') fail();
+		p++;
+
+		std::string result;
+		while (p < end && *p != '"') {
+			if (*p != '\\') {
+				result += *p++;
+				continue;
+			}
+			if (++p >= end) fail();
+			char escape = *p++;
+			switch (escape) {
+			case 'b': result += '\b'; break;
+			case 'f': result += '\f'; break;
+			case 'n': result += '\n'; break;
+			case 'r': result += '\r'; break;
+			case 't': result += '\t'; break;
+			case 'u': {
+				//code point to UTF-8, surrogate pairs are not combined (names only, never used as paths)
+				if (end - p < 4) fail();
+				uint32_t codePoint = static_cast<uint32_t>(std::strtoul(std::string(p, p + 4).c_str(), nullptr, 16));
+				p += 4;
+				if (codePoint < 0x80) {
+					result += static_cast<char>(codePoint);
+				}
+				else if (codePoint < 0x800) {
+					result += static_cast<char>(0xC0 | (codePoint >> 6));
+					result += static_cast<char>(0x80 | (codePoint & 0x3F));
+				}
+				else {
+					result += static_cast<char>(0xE0 | (codePoint >> 12));
+					result += static_cast<char>(0x80 | ((codePoint >> 6) & 0x3F));
+					result += static_cast<char>(0x80 | (codePoint & 0x3F));
+				}
+				break;
+			}
+			default: result += escape; break;
+			}
+		}
+		if (p >= end) fail();
+		p++;
+		return result;
+	}
+};
+
+static const uint32_t GLB_MAGIC = 0x46546C67;				//"glTF"
+static const uint32_t GLB_CHUNK_JSON = 0x4E4F534A;
+static const uint32_t GLB_CHUNK_BIN = 0x004E4942;
+
+static const uint32_t GLTF_BYTE = 5120;
+static const uint32_t GLTF_UNSIGNED_BYTE = 5121;
+static const uint32_t GLTF_SHORT = 5122;
+static const uint32_t GLTF_UNSIGNED_SHORT = 5123;
+static const uint32_t GLTF_UNSIGNED_INT = 5125;
+static const uint32_t GLTF_FLOAT = 5126;
+
+static const uint32_t GLTF_TRIANGLES = 4;
+static const uint32_t GLTF_TRIANGLE_STRIP = 5;
+static const uint32_t GLTF_TRIANGLE_FAN = 6;
+
+//bytes a glTF buffer occupies, owned by the importer for embedded data or pointing into a mapped file
+struct GltfBuffer {
+	const unsigned char* data = nullptr;
+	uint64_t size = 0;
+};
+
+//typed, bounds checked view of an accessor's elements
+struct GltfAccessor {
+	const unsigned char* data = nullptr;			//null for accessors without a buffer view, which read as zeros
+	uint32_t count = 0;
+	uint32_t components = 0;
+	uint32_t componentType = 0;
+	bool normalized = false;
+	uint64_t stride = 0;
+
+	float read(uint32_t element, uint32_t component) const {
+		if (data == nullptr) return 0.0f;
+		const unsigned char* value = data + element * stride;
+
+		//normalized integers map to [0,1] or [-1,1] as the spec defines
+		switch (componentType) {
+		case GLTF_FLOAT: {
+			float result;
+			memcpy(&result, value + component * 4, 4);
+			return result;
+		}
+		case GLTF_UNSIGNED_BYTE: {
+			float result = static_cast<float>(value[component]);
+			return normalized ? result / 255.0f : result;
+		}
+		case GLTF_BYTE: {
+			float result = static_cast<float>(static_cast<int8_t>(value[component]));
+			return normalized ? std::max(result / 127.0f, -1.0f) : result;
+		}
+		case GLTF_UNSIGNED_SHORT: {
+			uint16_t raw;
+			memcpy(&raw, value + component * 2, 2);
+			return normalized ? raw / 65535.0f : static_cast<float>(raw);
+		}
+		case GLTF_SHORT: {
+			int16_t raw;
+			memcpy(&raw, value + component * 2, 2);
+			return normalized ? std::max(raw / 32767.0f, -1.0f) : static_cast<float>(raw);
+		}
+		default:
+			return 0.0f;
+		}
+	}
+
+	uint32_t readIndex(uint32_t element) const {
+		if (data == nullptr) return 0;
+		const unsigned char* value = data + element * stride;
+		switch (componentType) {
+		case GLTF_UNSIGNED_BYTE: return value[0];
+		case GLTF_UNSIGNED_SHORT: {
+			uint16_t index;
+			memcpy(&index, value, 2);
+			return index;
+		}
+		default: {
+			uint32_t index;
+			memcpy(&index, value, 4);
+			return index;
+		}
+		}
+	}
+};
+
+static uint32_t getComponentSize(uint32_t componentType) {
+	switch (componentType) {
+	case GLTF_BYTE:
+	case GLTF_UNSIGNED_BYTE: return 1;
+	case GLTF_SHORT:
+	case GLTF_UNSIGNED_SHORT: return 2;
+	case GLTF_UNSIGNED_INT:
+	case GLTF_FLOAT: return 4;
+	default: throw std::runtime_error("glTF accessor has an unknown component type");
+	}
+}
+
+static uint32_t getComponentCount(const std::string& type) {
+	if (type == "SCALAR") return 1;
+	if (type == "VEC2") return 2;
+	if (type == "VEC3") return 3;
+	if (type == "VEC4") return 4;
+	throw std::runtime_error("glTF accessor type " + type + " is not a vertex attribute or index type");
+}
+
+static GltfAccessor getAccessor(const JsonValue& document, const std::vector<GltfBuffer>& buffers, uint32_t accessorIndex) {
+	const JsonValue& accessor = document.get("accessors").at(accessorIndex);
+	if (accessor.find("sparse") != nullptr) {
+		throw std::runtime_error("glTF sparse accessors are not supported");
+	}
+
+	GltfAccessor view;
+	view.count = accessor.getIndex("count");
+	view.componentType = accessor.getIndex("componentType");
+	view.components = getComponentCount(accessor.get("type").string);
+	const JsonValue* normalized = accessor.find("normalized");
+	view.normalized = normalized != nullptr && normalized->boolean;
+
+	uint64_t elementSize = static_cast<uint64_t>(getComponentSize(view.componentType)) * view.components;
+	uint32_t bufferViewIndex = accessor.getIndex("bufferView");
+	if (bufferViewIndex == INVALID_INDEX) return view;
+
+	const JsonValue& bufferView = document.get("bufferViews").at(bufferViewIndex);
+	uint32_t bufferIndex = bufferView.getIndex("buffer");
+	if (bufferIndex >= buffers.size()) {
+		throw std::runtime_error("glTF buffer view refers to a buffer that does not exist");
+	}
+	const GltfBuffer& buffer = buffers[bufferIndex];
+
+	uint64_t viewOffset = bufferView.getIndex("byteOffset", 0);
+	uint64_t viewLength = bufferView.getIndex("byteLength");
+	uint64_t accessorOffset = accessor.getIndex("byteOffset", 0);
+	view.stride = bufferView.getIndex("byteStride", 0);
+	if (view.stride == 0) view.stride = elementSize;
+
+	//every element has to lie within the view, and the view within the buffer
+	bool viewInBuffer = viewOffset <= buffer.size && viewLength <= buffer.size - viewOffset;
+	uint64_t accessorEnd = view.count > 0 ? accessorOffset + (view.count - 1) * view.stride + elementSize : accessorOffset;
+	if (!viewInBuffer || view.stride < elementSize || accessorEnd > viewLength) {
+		throw std::runtime_error("glTF accessor reads outside its buffer");
+	}
+	view.data = buffer.data + viewOffset + accessorOffset;
+	return view;
+}
+
+//a file cant be read correctly without its required extensions, compressed geometry (Draco, meshopt) included
+//quantized attributes are read through their accessor's component type, and materials and textures are never read here
+static void checkRequiredExtensions(const JsonValue& document) {
+	const JsonValue* required = document.find("extensionsRequired");
+	if (required == nullptr) return;
+
+	for (const JsonValue& extension : required->array) {
+		const std::string& name = extension.string;
+		bool supported = name == "KHR_mesh_quantization" || name.compare(0, 14, "KHR_materials_") == 0
+			|| name.compare(0, 12, "KHR_texture_") == 0 || name.compare(0, 12, "EXT_texture_") == 0;
+		if (!supported) {
+			throw std::runtime_error("glTF file requires the unsupported extension " + name);
+		}
+	}
+}
+
+static std::vector<unsigned char> decodeBase64(const std::string& text, size_t start) {
+	std::vector<unsigned char> bytes;
+	bytes.reserve((text.size() - start) * 3 / 4);
+
+	uint32_t bits = 0;
+	int bitCount = 0;
+	for (size_t i = start; i < text.size() && text[i] != '='; i++) {
+		char c = text[i];
+		int value;
+		if (c >= 'A' && c <= 'Z') value = c - 'A';
+		else if (c >= 'a' && c <= 'z') value = c - 'a' + 26;
+		else if (c >= '0' && c <= '9') value = c - '0' + 52;
+		else if (c == '+') value = 62;
+		else if (c == '/') value = 63;
+		else throw std::runtime_error("glTF data URI is not valid base64");
+
+		bits = (bits << 6) | static_cast<uint32_t>(value);
+		bitCount += 6;
+		if (bitCount >= 8) {
+			bitCount -= 8;
+			bytes.push_back(static_cast<unsigned char>((bits >> bitCount) & 0xFF));
+		}
+	}
+	return bytes;
+}
+
+static std::string decodeUri(const std::string& uri) {
+	std::string decoded;
+	for (size_t i = 0; i < uri.size(); i++) {
+		if (uri[i] == '%' && i + 2 < uri.size()) {
+			decoded += static_cast<char>(std::strtoul(uri.substr(i + 1, 2).c_str(), nullptr, 16));
+			i += 2;
+		}
+		else {
+			decoded += uri[i];
+		}
+	}
+	return decoded;
+}
+
+//node's local transform, either a matrix or translation * rotation * scale
+static glm::mat4 getNodeTransform(const JsonValue& node) {
+	glm::mat4 transform(1.0f);
+
+	const JsonValue* matrix = node.find("matrix");
+	if (matrix != nullptr) {
+		for (uint32_t i = 0; i < 16; i++) {
+			transform[i / 4][i % 4] = static_cast<float>(matrix->at(i).number);
+		}
+		return transform;
+	}
+
+	glm::vec3 translation(0.0f), scale(1.0f);
+	float rotation[4] = { 0.0f, 0.0f, 0.0f, 1.0f };			//x, y, z, w
+	if (const JsonValue* value = node.find("translation")) {
+		translation = glm::vec3(value->at(0).number, value->at(1).number, value->at(2).number);
+	}
+	if (const JsonValue* value = node.find("scale")) {
+		scale = glm::vec3(value->at(0).number, value->at(1).number, value->at(2).number);
+	}
+	if (const JsonValue* value = node.find("rotation")) {
+		for (uint32_t i = 0; i < 4; i++) rotation[i] = static_cast<float>(value->at(i).number);
+	}
+
+	//unit quaternion to rotation matrix, columns scaled
+	float x = rotation[0], y = rotation[1], z = rotation[2], w = rotation[3];
+	transform[0] = glm::vec4(1.0f - 2.0f * (y * y + z * z), 2.0f * (x * y + z * w), 2.0f * (x * z - y * w), 0.0f) * scale.x;
+	transform[1] = glm::vec4(2.0f * (x * y - z * w), 1.0f - 2.0f * (x * x + z * z), 2.0f * (y * z + x * w), 0.0f) * scale.y;
+	transform[2] = glm::vec4(2.0f * (x * z + y * w), 2.0f * (y * z - x * w), 1.0f - 2.0f * (x * x + y * y), 0.0f) * scale.z;
+	transform[3] = glm::vec4(translation, 1.0f);
+	return transform;
+}
+
+struct GltfInstance {
+	uint32_t mesh;
+	glm::mat4 transform;
+};
+
+static void collectInstances(const JsonValue& document, uint32_t nodeIndex, const glm::mat4& parent, uint32_t depth, std::vector<GltfInstance>& instances) {
+	const JsonValue& nodes = document.get("nodes");
+	//a tree can be no deeper than its node count, anything deeper has a cycle
+	if (depth > nodes.array.size()) {
+		throw std::runtime_error("glTF node hierarchy has a cycle");
+	}
+
+	const JsonValue& node = nodes.at(nodeIndex);
+	glm::mat4 transform = parent * getNodeTransform(node);
+	uint32_t mesh = node.getIndex("mesh");
+	if (mesh != INVALID_INDEX) {
+		GltfInstance instance;
+		instance.mesh = mesh;
+		instance.transform = transform;
+		instances.push_back(instance);
+	}
+	if (const JsonValue* children = node.find("children")) {
+		for (const JsonValue& child : children->array) {
+			collectInstances(document, child.asIndex("node"), transform, depth + 1, instances);
+		}
+	}
+}
+
+std::vector<ImportedMesh> MeshImporter::importGltf(const std::string& path)
+{
+	auto parseStart = std::chrono::steady_clock::now();
+
+	MappedFile file;
+	file.open(path);
+	const unsigned char* bytes = file.getData();
+	uint64_t size = file.getSize();
+	stats.fileBytes = size;
+
+	//.glb: 12 byte header then a JSON chunk and an optional binary chunk, .gltf: the JSON alone
+	const char* jsonBegin = reinterpret_cast<const char*>(bytes);
+	const char* jsonEnd = jsonBegin + size;
+	GltfBuffer binaryChunk;
+	uint32_t magic = 0;
+	if (size >= 4) memcpy(&magic, bytes, 4);
+	if (magic == GLB_MAGIC) {
+		uint32_t header[3], chunkHeader[2];
+		if (size < 20) {
+			throw std::runtime_error("glb file is truncated");
+		}
+		memcpy(header, bytes, 12);
+		memcpy(chunkHeader, bytes + 12, 8);
+		if (header[1] != 2 || chunkHeader[1] != GLB_CHUNK_JSON || chunkHeader[0] > size - 20) {
+			throw std::runtime_error("glb file is not a glTF 2.0 binary");
+		}
+		jsonBegin = reinterpret_cast<const char*>(bytes + 20);
+		jsonEnd = jsonBegin + chunkHeader[0];
+
+		uint64_t binaryStart = 20 + static_cast<uint64_t>(chunkHeader[0]);
+		if (binaryStart + 8 <= size) {
+			memcpy(chunkHeader, bytes + binaryStart, 8);
+			if (chunkHeader[1] == GLB_CHUNK_BIN && chunkHeader[0] <= size - binaryStart - 8) {
+				binaryChunk.data = bytes + binaryStart + 8;
+				binaryChunk.size = chunkHeader[0];
+			}
+		}
+	}
+	JsonValue document = JsonParser(jsonBegin, jsonEnd).parseDocument();
+	checkRequiredExtensions(document);
+
+	//external buffers are mapped like the file itself, embedded ones decoded onto the heap
+	std::vector<GltfBuffer> buffers;
+	std::vector<std::unique_ptr<MappedFile>> bufferFiles;
+	std::vector<std::vector<unsigned char>> embeddedBuffers;
+	size_t directoryEnd = path.find_last_of("/\\");
+	std::string directory = directoryEnd == std::string::npos ? "" : path.substr(0, directoryEnd + 1);
+	if (const JsonValue* bufferList = document.find("buffers")) {
+		for (const JsonValue& bufferDesc : bufferList->array) {
+			GltfBuffer buffer;
+			const JsonValue* uri = bufferDesc.find("uri");
+			if (uri == nullptr) {
+				//only the first buffer of a glb may leave out its uri, it is the binary chunk
+				if (!buffers.empty() || binaryChunk.data == nullptr) {
+					throw std::runtime_error("glTF buffer has no data");
+				}
+				buffer = binaryChunk;
+			}
+			else if (uri->string.compare(0, 5, "data:") == 0) {
+				size_t comma = uri->string.find(',');
+				if (comma == std::string::npos || uri->string.rfind(";base64", comma) == std::string::npos) {
+					throw std::runtime_error("glTF data URI is not base64");
+				}
+				embeddedBuffers.push_back(decodeBase64(uri->string, comma + 1));
+				trackAllocation(embeddedBuffers.back().size());
+				buffer.data = embeddedBuffers.back().data();
+				buffer.size = embeddedBuffers.back().size();
+			}
+			else {
+				bufferFiles.emplace_back(new MappedFile());
+				bufferFiles.back()->open(directory + decodeUri(uri->string));
+				buffer.data = bufferFiles.back()->getData();
+				buffer.size = bufferFiles.back()->getSize();
+			}
+
+			uint64_t declaredLength = bufferDesc.getIndex("byteLength");
+			if (declaredLength > buffer.size) {
+				throw std::runtime_error("glTF buffer is shorter than its byteLength");
+			}
+			buffer.size = declaredLength;
+			buffers.push_back(buffer);
+		}
+	}
+
+	//meshes placed by the default scene's nodes, or every mesh once if the file has no scene
+	std::vector<GltfInstance> instances;
+	const JsonValue* scenes = document.find("scenes");
+	if (scenes != nullptr && !scenes->array.empty()) {
+		const JsonValue& scene = scenes->at(document.getIndex("scene", 0));
+		if (const JsonValue* rootNodes = scene.find("nodes")) {
+			for (const JsonValue& node : rootNodes->array) {
+				collectInstances(document, node.asIndex("node"), glm::mat4(1.0f), 0, instances);
+			}
+		}
+	}
+	else if (const JsonValue* meshList = document.find("meshes")) {
+		for (uint32_t i = 0; i < meshList->array.size(); i++) {
+			GltfInstance instance;
+			instance.mesh = i;
+			instance.transform = glm::mat4(1.0f);
+			instances.push_back(instance);
+		}
+	}
+
+	std::vector<ImportedMesh> meshes(instances.size());
+	for (size_t instanceIndex = 0; instanceIndex < instances.size(); instanceIndex++) {
+		const GltfInstance& instance = instances[instanceIndex];
+		const JsonValue& meshDesc = document.get("meshes").at(instance.mesh);
+		ImportedMesh& mesh = meshes[instanceIndex];
+		const JsonValue* name = meshDesc.find("name");
+		mesh.name = name != nullptr ? name->string : "mesh " + std::to_string(instance.mesh);
+
+		//mirroring transforms turn counter clockwise triangles clockwise, swapping two corners turns them back
+		const glm::mat4& transform = instance.transform;
+		bool flipWinding = glm::dot(glm::cross(glm::vec3(transform[0]), glm::vec3(transform[1])), glm::vec3(transform[2])) < 0.0f;
+
+		//every primitive of a mesh lands in the one vertex format, so they merge into one mesh
+		std::vector<Vertex> source;
+		std::vector<uint32_t> corners;
+		for (const JsonValue& primitive : meshDesc.get("primitives").array) {
+			uint32_t mode = primitive.getIndex("mode", GLTF_TRIANGLES);
+			if (mode != GLTF_TRIANGLES && mode != GLTF_TRIANGLE_STRIP && mode != GLTF_TRIANGLE_FAN) continue;
+
+			const JsonValue& attributes = primitive.get("attributes");
+			GltfAccessor positions = getAccessor(document, buffers, attributes.getIndex("POSITION"));
+			if (positions.components != 3) {
+				throw std::runtime_error("glTF POSITION must be a VEC3");
+			}
+			GltfAccessor colors;
+			uint32_t colorAccessor = attributes.getIndex("COLOR_0");
+			if (colorAccessor != INVALID_INDEX) {
+				colors = getAccessor(document, buffers, colorAccessor);
+				if (colors.count != positions.count || colors.components < 3) {
+					throw std::runtime_error("glTF COLOR_0 does not match POSITION");
+				}
+			}
+
+			//vertices decoded in parallel chunks straight into place
+			size_t vertexBase = source.size();
+			if (vertexBase + positions.count >= INVALID_INDEX) {
+				throw std::runtime_error("glTF mesh has more vertices than 32 bit indices can address");
+			}
+			source.resize(vertexBase + positions.count);
+			trackAllocation(static_cast<uint64_t>(positions.count) * sizeof(Vertex));
+			uint32_t vertexChunks = getChunkCount(positions.count, IMPORT_CHUNK_ELEMENTS);
+			threads.run(vertexChunks, [&](uint32_t chunk) {
+				uint32_t first = static_cast<uint32_t>(static_cast<uint64_t>(positions.count) * chunk / vertexChunks);
+				uint32_t last = static_cast<uint32_t>(static_cast<uint64_t>(positions.count) * (chunk + 1) / vertexChunks);
+				for (uint32_t i = first; i < last; i++) {
+					glm::vec4 position = transform * glm::vec4(positions.read(i, 0), positions.read(i, 1), positions.read(i, 2), 1.0f);
+					Vertex& vertex = source[vertexBase + i];
+					vertex.pos = glm::vec3(position);
+					vertex.col = colors.count > 0 ? glm::vec3(colors.read(i, 0), colors.read(i, 1), colors.read(i, 2)) : defaultColor;
+				}
+			});
+
+			//non indexed primitives draw their vertices in order
+			uint32_t indexAccessor = primitive.getIndex("indices");
+			GltfAccessor indexView;
+			if (indexAccessor != INVALID_INDEX) {
+				indexView = getAccessor(document, buffers, indexAccessor);
+				if (indexView.components != 1 || (indexView.componentType != GLTF_UNSIGNED_BYTE
+					&& indexView.componentType != GLTF_UNSIGNED_SHORT && indexView.componentType != GLTF_UNSIGNED_INT)) {
+					throw std::runtime_error("glTF indices must be unsigned integer scalars");
+				}
+			}
+			uint32_t indexCount = indexAccessor != INVALID_INDEX ? indexView.count : positions.count;
+
+			std::vector<uint32_t> primitiveIndices(indexCount);
+			trackAllocation(static_cast<uint64_t>(indexCount) * sizeof(uint32_t));
+			uint32_t indexChunks = getChunkCount(indexCount, IMPORT_CHUNK_ELEMENTS);
+			threads.run(indexChunks, [&](uint32_t chunk) {
+				uint32_t first = static_cast<uint32_t>(static_cast<uint64_t>(indexCount) * chunk / indexChunks);
+				uint32_t last = static_cast<uint32_t>(static_cast<uint64_t>(indexCount) * (chunk + 1) / indexChunks);
+				for (uint32_t i = first; i < last; i++) {
+					uint32_t index = indexAccessor != INVALID_INDEX ? indexView.readIndex(i) : i;
+					if (index >= positions.count) {
+						throw std::runtime_error("glTF index refers to a vertex that does not exist");
+					}
+					primitiveIndices[i] = static_cast<uint32_t>(vertexBase) + index;
+				}
+			});
+
+			//strips and fans are rare, unrolled serially into a list
+			size_t cornerBase = corners.size();
+			if (mode == GLTF_TRIANGLES) {
+				corners.insert(corners.end(), primitiveIndices.begin(), primitiveIndices.end() - indexCount % 3);
+			}
+			for (uint32_t i = 2; mode != GLTF_TRIANGLES && i < indexCount; i++) {
+				if (mode == GLTF_TRIANGLE_FAN) {
+					corners.insert(corners.end(), { primitiveIndices[0], primitiveIndices[i - 1], primitiveIndices[i] });
+				}
+				else if (i % 2 == 0) {
+					corners.insert(corners.end(), { primitiveIndices[i - 2], primitiveIndices[i - 1], primitiveIndices[i] });
+				}
+				else {
+					corners.insert(corners.end(), { primitiveIndices[i - 1], primitiveIndices[i - 2], primitiveIndices[i] });
+				}
+			}
+			if (flipWinding) {
+				for (size_t i = cornerBase; i + 2 < corners.size(); i += 3) {
+					std::swap(corners[i + 1], corners[i + 2]);
+				}
+			}
+			trackRelease(static_cast<uint64_t>(indexCount) * sizeof(uint32_t));
+			trackAllocation(static_cast<uint64_t>(corners.size() - cornerBase) * sizeof(uint32_t));
+		}
+
+		weld(source, corners, mesh);
+		trackRelease(static_cast<uint64_t>(source.size()) * sizeof(Vertex) + corners.size() * sizeof(uint32_t));
+	}
+
+	for (const std::vector<unsigned char>& embedded : embeddedBuffers) {
+		trackRelease(embedded.size());
+	}
+
+	//welding happens per mesh in between, everything else counts as parsing
+	std::chrono::duration<double, std::milli> totalTime = std::chrono::steady_clock::now() - parseStart;
+	stats.parseMs = totalTime.count() - stats.weldMs;
+	return meshes;
+}
+
+// -- Importer --
+
+MeshImporter::MeshImporter()
+{
+}
+
+void MeshImporter::setThreadCount(uint32_t count)
+{
+	threadCount = count;
+	threads.stop();
+}
+
+void MeshImporter::setDefaultColor(glm::vec3 color)
+{
+	defaultColor = color;
+}
+
+std::vector<ImportedMesh> MeshImporter::import(const std::string& path)
+{
+	auto importStart = std::chrono::steady_clock::now();
+	stats = ImportStats();
+	liveBytes = 0;
+
+	if (threads.getThreadCount() == 0) {
+		threads.start(threadCount);
+	}
+	stats.threads = threads.getThreadCount();
+
+	std::string extension = getExtension(path);
+	std::vector<ImportedMesh> meshes;
+	if (extension == "obj") {
+		meshes = importObj(path);
+	}
+	else if (extension == "gltf" || extension == "glb") {
+		meshes = importGltf(path);
+	}
+	else {
+		throw std::runtime_error("cant import " + path + ", only .obj, .gltf and .glb are supported");
+	}
+
+	for (const ImportedMesh& mesh : meshes) {
+		stats.weldedVertices += mesh.vertices.size();
+		stats.triangles += mesh.indices.size() / 3;
+	}
+	std::chrono::duration<double, std::milli> importTime = std::chrono::steady_clock::now() - importStart;
+	stats.totalMs = importTime.count();
+	return meshes;
+}
+
+ImportStats MeshImporter::getStats()
+{
+	return stats;
+}
+
+MeshImporter::~MeshImporter()
+{
+}
+
+//bits of a vertex, with -0 folded into +0 so the two weld like == says they should
+static uint32_t hashVertex(const Vertex& vertex) {
+	const float values[] = { vertex.pos.x + 0.0f, vertex.pos.y + 0.0f, vertex.pos.z + 0.0f, vertex.col.x + 0.0f, vertex.col.y + 0.0f, vertex.col.z + 0.0f };
+	uint32_t hash = 2166136261u;
+	for (float value : values) {
+		uint32_t bits;
+		memcpy(&bits, &value, sizeof(bits));
+		hash = (hash ^ bits) * 16777619u;
+		hash ^= hash >> 15;
+	}
+	return hash;
+}
+
+void MeshImporter::weld(const std::vector<Vertex>& source, std::vector<uint32_t>& corners, ImportedMesh& mesh)
+{
+	auto weldStart = std::chrono::steady_clock::now();
+	stats.sourceVertices += source.size();
+	uint32_t sourceCount = static_cast<uint32_t>(source.size());
+
+	//hashing is the expensive part and independent per vertex
+	std::vector<uint32_t> hashes(sourceCount);
+	uint32_t chunks = getChunkCount(sourceCount, IMPORT_CHUNK_ELEMENTS);
+	threads.run(chunks, [&](uint32_t chunk) {
+		uint32_t first = static_cast<uint32_t>(static_cast<uint64_t>(sourceCount) * chunk / chunks);
+		uint32_t last = static_cast<uint32_t>(static_cast<uint64_t>(sourceCount) * (chunk + 1) / chunks);
+		for (uint32_t i = first; i < last; i++) {
+			hashes[i] = hashVertex(source[i]);
+		}
+	});
+
+	//open addressing table of source indices, at most half full so probes stay short
+	uint32_t tableSize = 16;
+	while (tableSize < sourceCount * 2ull && tableSize < (1u << 31)) tableSize *= 2;
+	std::vector<uint32_t> table(tableSize, INVALID_INDEX);
+	std::vector<uint32_t> canonical(sourceCount);
+	trackAllocation((static_cast<uint64_t>(sourceCount) * 2 + tableSize) * sizeof(uint32_t));
+
+	//first source vertex with each value stands for all of them
+	uint32_t mask = tableSize - 1;
+	for (uint32_t i = 0; i < sourceCount; i++) {
+		uint32_t slot = hashes[i] & mask;
+		while (table[slot] != INVALID_INDEX) {
+			const Vertex& existing = source[table[slot]];
+			if (hashes[table[slot]] == hashes[i] && existing.pos == source[i].pos && existing.col == source[i].col) break;
+			slot = (slot + 1) & mask;
+		}
+		if (table[slot] == INVALID_INDEX) table[slot] = i;
+		canonical[i] = table[slot];
+	}
+	trackRelease(static_cast<uint64_t>(tableSize) * sizeof(uint32_t));
+	std::vector<uint32_t>().swap(table);
+
+	//number vertices in the order triangles first use them, unreferenced ones are never emitted
+	std::vector<uint32_t>& outputIndex = hashes;
+	std::fill(outputIndex.begin(), outputIndex.end(), INVALID_INDEX);
+	mesh.vertices.clear();
+	for (uint32_t& corner : corners) {
+		uint32_t representative = canonical[corner];
+		if (outputIndex[representative] == INVALID_INDEX) {
+			outputIndex[representative] = static_cast<uint32_t>(mesh.vertices.size());
+			mesh.vertices.push_back(source[representative]);
+		}
+		corner = outputIndex[representative];
+	}
+	mesh.vertices.shrink_to_fit();
+	mesh.indices.swap(corners);
+	trackAllocation(mesh.vertices.size() * sizeof(Vertex));
+	trackRelease(static_cast<uint64_t>(sourceCount) * 2 * sizeof(uint32_t));
+
+	std::chrono::duration<double, std::milli> weldTime = std::chrono::steady_clock::now() - weldStart;
+	stats.weldMs += weldTime.count();
+}
+
+void MeshImporter::trackAllocation(uint64_t bytes)
+{
+	liveBytes += bytes;
+	stats.peakBytes = std::max(stats.peakBytes, liveBytes);
+}
+
+void MeshImporter::trackRelease(uint64_t bytes)
+{
+	liveBytes -= std::min(liveBytes, bytes);
+}
@@ -0,0 +1,72 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "Utilities.h"
+#include "Mesh.h"
+#include "ThreadPool.h"
+
+//smallest share of an OBJ file or a glTF accessor worth parsing on its own thread
+const uint64_t IMPORT_CHUNK_BYTES = 4 * 1024 * 1024;
+const uint32_t IMPORT_CHUNK_ELEMENTS = 256 * 1024;
+
+//welded geometry, ready for Mesh / createMesh
+struct ImportedMesh {
+	std::string name;
+	std::vector<Vertex> vertices;
+	std::vector<uint32_t> indices;					//triangle list
+
+	MeshData getMeshData();
+};
+
+struct ImportStats {
+	uint32_t threads = 0;
+	uint64_t fileBytes = 0;
+	uint64_t sourceVertices = 0;					//vertices as read, before welding
+	uint64_t weldedVertices = 0;
+	uint64_t triangles = 0;
+	double parseMs = 0.0;							//file to source vertices and triangles
+	double weldMs = 0.0;
+	double totalMs = 0.0;
+	uint64_t peakBytes = 0;							//largest total of the importer's own buffers at once (file mapping excluded)
+};
+
+//Imports OBJ and glTF 2.0 (.gltf with external or embedded buffers, .glb) into the engine's Vertex{pos,col}
+//OBJ keeps positions and "v x y z r g b" colours, glTF keeps POSITION and COLOR_0 with node transforms baked in,
+//everything else (normals, uvs, materials) has nowhere to go in the vertex format and is dropped, which is also why
+//vertices are welded afterwards: corners that only differed by a dropped attribute become one vertex
+//parsing and welding are split across a thread pool, files are memory mapped rather than read onto the heap
+class MeshImporter
+{
+public:
+	MeshImporter();
+
+	void setThreadCount(uint32_t count);			//0 uses one thread per hardware thread
+	void setDefaultColor(glm::vec3 color);			//for vertices without one
+
+	//picks the format by extension, one mesh per OBJ file and per glTF mesh instance, throws on malformed files
+	std::vector<ImportedMesh> import(const std::string& path);
+
+	ImportStats getStats();
+
+	~MeshImporter();
+
+private:
+	ThreadPool threads;
+	uint32_t threadCount = 0;
+	glm::vec3 defaultColor = glm::vec3(0.8f, 0.8f, 0.8f);
+	ImportStats stats;
+
+	uint64_t liveBytes = 0;							//feeds stats.peakBytes
+
+	std::vector<ImportedMesh> importObj(const std::string& path);
+	std::vector<ImportedMesh> importGltf(const std::string& path);
+
+	//merges identical vertices and drops unreferenced ones, first use order, corners index source
+	void weld(const std::vector<Vertex>& source, std::vector<uint32_t>& corners, ImportedMesh& mesh);
+
+	void trackAllocation(uint64_t bytes);
+	void trackRelease(uint64_t bytes);
+};
@@ -0,0 +1,292 @@
+#include "MeshOptimizer.h"
+
+#include <algorithm>
+#include <chrono>
+#include <limits>
+
+static const uint32_t INVALID_VERTEX = std::numeric_limits<uint32_t>::max();
+
+//FIFO cache as timestamps: a vertex is cached while fewer than cacheSize misses happened since it was loaded
+//so a lookup is one subtraction and clearing the cache is moving the clock cacheSize + 1 ahead
+class CacheSimulation
+{
+public:
+	CacheSimulation(uint32_t vertexCount, uint32_t newCacheSize) : loadTime(vertexCount, 0), cacheSize(newCacheSize), time(newCacheSize + 1) {}
+
+	bool isCached(uint32_t vertex) {
+		return time - loadTime[vertex] <= cacheSize;
+	}
+
+	//true on a miss
+	bool access(uint32_t vertex) {
+		if (isCached(vertex)) return false;
+		loadTime[vertex] = time++;
+		return true;
+	}
+
+	uint32_t getAge(uint32_t vertex) {
+		return time - loadTime[vertex];
+	}
+
+	void clear() {
+		time += cacheSize + 1;
+	}
+
+private:
+	std::vector<uint32_t> loadTime;
+	uint32_t cacheSize;
+	uint32_t time;
+};
+
+VertexCacheStats analyzeVertexCache(const uint32_t* indices, uint32_t indexCount, uint32_t vertexCount, uint32_t cacheSize)
+{
+	VertexCacheStats stats;
+	uint32_t triangleCount = indexCount / 3;
+	if (triangleCount == 0) return stats;
+
+	CacheSimulation cache(vertexCount, cacheSize);
+	std::vector<bool> referenced(vertexCount, false);
+	uint32_t referencedCount = 0;
+	for (uint32_t i = 0; i < triangleCount * 3; i++) {
+		if (cache.access(indices[i])) stats.transformedVertices++;
+		if (!referenced[indices[i]]) {
+			referenced[indices[i]] = true;
+			referencedCount++;
+		}
+	}
+
+	stats.acmr = static_cast<float>(stats.transformedVertices) / triangleCount;
+	stats.atvr = static_cast<float>(stats.transformedVertices) / referencedCount;
+	return stats;
+}
+
+void optimizeVertexCache(uint32_t* destination, const uint32_t* indices, uint32_t indexCount, uint32_t vertexCount, uint32_t cacheSize,
+	std::vector<uint32_t>* clusterStarts)
+{
+	uint32_t triangleCount = indexCount / 3;
+	if (clusterStarts != nullptr) clusterStarts->clear();
+	if (triangleCount == 0) return;
+
+	//triangles around each vertex, flattened, and how many of them are still to be emitted
+	std::vector<uint32_t> liveTriangles(vertexCount, 0);
+	for (uint32_t i = 0; i < triangleCount * 3; i++) {
+		liveTriangles[indices[i]]++;
+	}
+	std::vector<uint32_t> adjacencyOffsets(vertexCount + 1, 0);
+	for (uint32_t v = 0; v < vertexCount; v++) {
+		adjacencyOffsets[v + 1] = adjacencyOffsets[v] + liveTriangles[v];
+	}
+	std::vector<uint32_t> adjacency(triangleCount * 3);
+	std::vector<uint32_t> adjacencyFill(adjacencyOffsets.begin(), adjacencyOffsets.end() - 1);
+	for (uint32_t i = 0; i < triangleCount * 3; i++) {
+		adjacency[adjacencyFill[indices[i]]++] = i / 3;
+	}
+
+	CacheSimulation cache(vertexCount, cacheSize);
+	std::vector<bool> emitted(triangleCount, false);
+	std::vector<uint32_t> deadEnds;							//recently used vertices, the first place to look once a fan runs dry
+	std::vector<uint32_t> candidates;
+	uint32_t inputCursor = 0;								//vertices before this have no live triangles left
+	uint32_t emittedCount = 0;
+
+	//restart after a dead end: the most recent vertex with triangles left, or failing that the next one in input order
+	auto skipDeadEnd = [&]() {
+		while (!deadEnds.empty()) {
+			uint32_t vertex = deadEnds.back();
+			deadEnds.pop_back();
+			if (liveTriangles[vertex] > 0) return vertex;
+		}
+		for (; inputCursor < vertexCount; inputCursor++) {
+			if (liveTriangles[inputCursor] > 0) return inputCursor;
+		}
+		return INVALID_VERTEX;
+	};
+
+	uint32_t fanVertex = skipDeadEnd();
+	if (clusterStarts != nullptr) clusterStarts->push_back(0);
+	while (fanVertex != INVALID_VERTEX) {
+		//every remaining triangle around the fan vertex, in input order
+		candidates.clear();
+		for (uint32_t a = adjacencyOffsets[fanVertex]; a < adjacencyOffsets[fanVertex + 1]; a++) {
+			uint32_t triangle = adjacency[a];
+			if (emitted[triangle]) continue;
+
+			for (uint32_t corner = 0; corner < 3; corner++) {
+				uint32_t vertex = indices[triangle * 3 + corner];
+				destination[emittedCount * 3 + corner] = vertex;
+				deadEnds.push_back(vertex);
+				candidates.push_back(vertex);
+				liveTriangles[vertex]--;
+				cache.access(vertex);
+			}
+			emitted[triangle] = true;
+			emittedCount++;
+		}
+
+		//next fan: the oldest candidate that stays cached while its own triangles are emitted (2 new vertices per triangle at worst)
+		uint32_t next = INVALID_VERTEX;
+		int64_t bestPriority = -1;
+		for (uint32_t vertex : candidates) {
+			if (liveTriangles[vertex] == 0) continue;
+
+			int64_t priority = 0;
+			if (cache.getAge(vertex) + 2 * liveTriangles[vertex] <= cacheSize) {
+				priority = cache.getAge(vertex);
+			}
+			if (priority > bestPriority) {
+				bestPriority = priority;
+				next = vertex;
+			}
+		}
+		if (next == INVALID_VERTEX) {
+			next = skipDeadEnd();
+			if (next != INVALID_VERTEX && clusterStarts != nullptr) clusterStarts->push_back(emittedCount);
+		}
+		fanVertex = next;
+	}
+}
+
+uint32_t optimizeOverdraw(uint32_t* destination, const uint32_t* indices, uint32_t indexCount, const Vertex* vertices, uint32_t vertexCount,
+	const std::vector<uint32_t>& clusterStarts, uint32_t cacheSize, float threshold)
+{
+	uint32_t triangleCount = indexCount / 3;
+	if (triangleCount == 0) return 0;
+
+	//Tipsify's clusters are few and long, split each one wherever its ACMR so far is already within threshold of the whole cluster's
+	CacheSimulation cache(vertexCount, cacheSize);
+	std::vector<uint32_t> starts;
+	for (size_t c = 0; c < clusterStarts.size(); c++) {
+		uint32_t start = clusterStarts[c];
+		uint32_t end = c + 1 < clusterStarts.size() ? clusterStarts[c + 1] : triangleCount;
+		if (start >= end) continue;
+
+		cache.clear();
+		uint32_t clusterMisses = 0;
+		for (uint32_t i = start * 3; i < end * 3; i++) {
+			clusterMisses += cache.access(indices[i]) ? 1 : 0;
+		}
+		float clusterThreshold = threshold * clusterMisses / (end - start);
+
+		starts.push_back(start);
+		cache.clear();
+		uint32_t runMisses = 0, runTriangles = 0;
+		for (uint32_t t = start; t + 1 < end; t++) {
+			for (uint32_t corner = 0; corner < 3; corner++) {
+				runMisses += cache.access(indices[t * 3 + corner]) ? 1 : 0;
+			}
+			runTriangles++;
+			if (runMisses <= clusterThreshold * runTriangles) {
+				starts.push_back(t + 1);
+				cache.clear();
+				runMisses = runTriangles = 0;
+			}
+		}
+	}
+
+	//area weighted centroid and normal per cluster, and the centroid of the whole mesh
+	struct Cluster {
+		uint32_t start;
+		uint32_t end;
+		float sortKey;
+	};
+	std::vector<Cluster> clusters(starts.size());
+	std::vector<glm::vec3> centroids(starts.size()), normals(starts.size());
+	glm::vec3 meshCentroid(0.0f);
+	float meshArea = 0.0f;
+	for (size_t c = 0; c < starts.size(); c++) {
+		clusters[c].start = starts[c];
+		clusters[c].end = c + 1 < starts.size() ? starts[c + 1] : triangleCount;
+
+		glm::vec3 centroid(0.0f), normal(0.0f);
+		float area = 0.0f;
+		for (uint32_t t = clusters[c].start; t < clusters[c].end; t++) {
+			const glm::vec3& a = vertices[indices[t * 3 + 0]].pos;
+			const glm::vec3& b = vertices[indices[t * 3 + 1]].pos;
+			const glm::vec3& d = vertices[indices[t * 3 + 2]].pos;
+			glm::vec3 cross = glm::cross(b - a, d - a);
+			float triangleArea = glm::length(cross);
+			centroid += (a + b + d) * (triangleArea / 3.0f);
+			normal += cross;
+			area += triangleArea;
+		}
+		meshCentroid += centroid;
+		meshArea += area;
+		centroids[c] = area > 0.0f ? centroid / area : centroid;
+		normals[c] = normal;
+	}
+	if (meshArea > 0.0f) meshCentroid /= meshArea;
+
+	//clusters facing away from the middle are on the outside, drawn first they hide the ones behind them from most views
+	for (size_t c = 0; c < clusters.size(); c++) {
+		float normalLength = glm::length(normals[c]);
+		clusters[c].sortKey = normalLength > 0.0f ? glm::dot(centroids[c] - meshCentroid, normals[c] / normalLength) : 0.0f;
+	}
+	std::stable_sort(clusters.begin(), clusters.end(), [](const Cluster& a, const Cluster& b) { return a.sortKey > b.sortKey; });
+
+	uint32_t written = 0;
+	for (const Cluster& cluster : clusters) {
+		std::copy(indices + cluster.start * 3, indices + cluster.end * 3, destination + written);
+		written += (cluster.end - cluster.start) * 3;
+	}
+	return static_cast<uint32_t>(clusters.size());
+}
+
+uint32_t optimizeVertexFetch(Vertex* destination, uint32_t* indices, uint32_t indexCount, const Vertex* vertices, uint32_t vertexCount)
+{
+	std::vector<uint32_t> remap(vertexCount, INVALID_VERTEX);
+	uint32_t nextVertex = 0;
+	for (uint32_t i = 0; i < indexCount; i++) {
+		uint32_t& newIndex = remap[indices[i]];
+		if (newIndex == INVALID_VERTEX) {
+			newIndex = nextVertex++;
+			destination[newIndex] = vertices[indices[i]];
+		}
+		indices[i] = newIndex;
+	}
+	return nextVertex;
+}
+
+void optimizeMesh(const MeshData& data, const MeshOptimizeSettings& settings, std::vector<Vertex>& vertices, std::vector<uint32_t>& indices,
+	MeshOptimizeStats* stats)
+{
+	auto optimizeStart = std::chrono::steady_clock::now();
+	*stats = MeshOptimizeStats();
+
+	uint32_t indexCount = data.indexCount - data.indexCount % 3;
+	for (uint32_t i = 0; i < indexCount; i++) {
+		if (data.indices[i] >= data.vertexCount) {
+			throw std::runtime_error("mesh index refers to a vertex that does not exist");
+		}
+	}
+	stats->before = analyzeVertexCache(data.indices, indexCount, data.vertexCount);
+
+	indices.resize(indexCount);
+	if (settings.vertexCache) {
+		std::vector<uint32_t> clusterStarts;
+		optimizeVertexCache(indices.data(), data.indices, indexCount, data.vertexCount, VERTEX_CACHE_SIZE, &clusterStarts);
+
+		if (settings.overdraw) {
+			std::vector<uint32_t> cacheOrder(indices);
+			stats->clusters = optimizeOverdraw(indices.data(), cacheOrder.data(), indexCount, data.vertices, data.vertexCount,
+				clusterStarts, VERTEX_CACHE_SIZE, settings.overdrawThreshold);
+		}
+	}
+	else {
+		std::copy(data.indices, data.indices + indexCount, indices.begin());
+	}
+
+	//fetch order last, it follows whatever order the triangles ended up in
+	if (settings.vertexFetch) {
+		vertices.resize(data.vertexCount);
+		vertices.resize(optimizeVertexFetch(vertices.data(), indices.data(), indexCount, data.vertices, data.vertexCount));
+	}
+	else {
+		vertices.assign(data.vertices, data.vertices + data.vertexCount);
+	}
+
+	stats->after = analyzeVertexCache(indices.data(), indexCount, static_cast<uint32_t>(vertices.size()));
+	stats->shortIndices = settings.shortIndices && vertices.size() <= SHORT_INDEX_VERTEX_LIMIT;
+
+	std::chrono::duration<double, std::milli> optimizeTime = std::chrono::steady_clock::now() - optimizeStart;
+	stats->optimizeMs = optimizeTime.count();
+}
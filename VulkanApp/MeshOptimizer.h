@@ -0,0 +1,58 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "Utilities.h"
+#include "Mesh.h"
+
+//FIFO post transform cache the reordering targets and the statistics simulate
+//real GPUs batch rather than FIFO, but an order good for 16 entries is good for their caches too
+const uint32_t VERTEX_CACHE_SIZE = 16;
+
+//most vertices a mesh can have and still be drawn with 16 bit indices
+const uint32_t SHORT_INDEX_VERTEX_LIMIT = 65536;
+
+struct VertexCacheStats {
+	uint32_t transformedVertices = 0;				//cache misses, i.e. vertex shader invocations
+	float acmr = 0.0f;								//average cache miss ratio: transformed vertices per triangle, 0.5 to 3
+	float atvr = 0.0f;								//average transform to vertex ratio: transformed per referenced vertex, 1 is ideal
+};
+
+//what build time optimization did to one mesh
+struct MeshOptimizeStats {
+	VertexCacheStats before;
+	VertexCacheStats after;
+	uint32_t clusters = 0;							//triangle runs sorted for overdraw
+	bool shortIndices = false;						//uploaded with 16 bit indices
+	double optimizeMs = 0.0;
+};
+
+//optimizations createMesh applies to geometry that isnt marked optimized
+struct MeshOptimizeSettings {
+	bool vertexCache = true;
+	bool overdraw = true;							//reorders the vertex cache order's clusters, ignored without vertexCache
+	bool vertexFetch = true;
+	bool shortIndices = true;						//16 bit indices whenever the vertex count allows
+	float overdrawThreshold = 1.05f;				//ACMR the overdraw order may lose against the vertex cache order
+};
+
+//simulates a FIFO cache of cacheSize entries over a triangle list
+VertexCacheStats analyzeVertexCache(const uint32_t* indices, uint32_t indexCount, uint32_t vertexCount, uint32_t cacheSize = VERTEX_CACHE_SIZE);
+
+//Tipsify (Sander et al. 2007): triangles fanned around recently used vertices, linear time
+//clusterStarts (optional) receives the first triangle of each run that had to restart at a dead end
+void optimizeVertexCache(uint32_t* destination, const uint32_t* indices, uint32_t indexCount, uint32_t vertexCount, uint32_t cacheSize,
+	std::vector<uint32_t>* clusterStarts);
+
+//splits the vertex cache order's clusters wherever the cache allows, then draws outward facing clusters first so they occlude the rest
+//indices must be in vertex cache order with the clusterStarts optimizeVertexCache produced, returns the cluster count
+uint32_t optimizeOverdraw(uint32_t* destination, const uint32_t* indices, uint32_t indexCount, const Vertex* vertices, uint32_t vertexCount,
+	const std::vector<uint32_t>& clusterStarts, uint32_t cacheSize, float threshold);
+
+//vertices into the order indices first use them, indices remapped, unreferenced vertices dropped, returns the new vertex count
+uint32_t optimizeVertexFetch(Vertex* destination, uint32_t* indices, uint32_t indexCount, const Vertex* vertices, uint32_t vertexCount);
+
+//copies data into vertices / indices with settings' optimizations applied, a trailing partial triangle is dropped
+void optimizeMesh(const MeshData& data, const MeshOptimizeSettings& settings, std::vector<Vertex>& vertices, std::vector<uint32_t>& indices,
+	MeshOptimizeStats* stats);
@@ -0,0 +1,393 @@
+#include "MeshSimplifier.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+
+#include "MeshOptimizer.h"
+
+//planes through open borders count this much more than the surface, so outlines hold their shape
+static const double BORDER_WEIGHT = 10.0;
+
+//collapses that turn a triangle's normal further than about 75 degrees are refused as folds
+static const double MAX_FLIP_COSINE = 0.25;
+
+//a level has to drop at least this share of the previous level's triangles to be kept
+static const float MIN_LOD_REDUCTION = 0.1f;
+
+enum class VertexKind : uint8_t {
+	Manifold,										//every edge shared by two triangles, collapses anywhere
+	Border,											//on one open border, collapses only along it
+	Locked											//seam, corner or non manifold, never moves
+};
+
+//symmetric 4x4 plane quadric as its 10 distinct terms, weighted by the area (or border length) it was built from
+struct Quadric {
+	double a00 = 0.0, a11 = 0.0, a22 = 0.0, a01 = 0.0, a02 = 0.0, a12 = 0.0;
+	double b0 = 0.0, b1 = 0.0, b2 = 0.0;
+	double c = 0.0;
+	double weight = 0.0;
+};
+
+struct Collapse {
+	uint32_t from;
+	uint32_t to;
+	double cost;									//squared distance
+};
+
+static void addPlane(Quadric& quadric, const glm::vec3& normal, float distance, double weight) {
+	double x = normal.x, y = normal.y, z = normal.z, d = distance;
+	quadric.a00 += weight * x * x;
+	quadric.a11 += weight * y * y;
+	quadric.a22 += weight * z * z;
+	quadric.a01 += weight * x * y;
+	quadric.a02 += weight * x * z;
+	quadric.a12 += weight * y * z;
+	quadric.b0 += weight * x * d;
+	quadric.b1 += weight * y * d;
+	quadric.b2 += weight * z * d;
+	quadric.c += weight * d * d;
+	quadric.weight += weight;
+}
+
+static void addQuadric(Quadric& quadric, const Quadric& other) {
+	quadric.a00 += other.a00;
+	quadric.a11 += other.a11;
+	quadric.a22 += other.a22;
+	quadric.a01 += other.a01;
+	quadric.a02 += other.a02;
+	quadric.a12 += other.a12;
+	quadric.b0 += other.b0;
+	quadric.b1 += other.b1;
+	quadric.b2 += other.b2;
+	quadric.c += other.c;
+	quadric.weight += other.weight;
+}
+
+//weighted sum of squared distances from position to the quadric's planes
+static double evaluateQuadric(const Quadric& quadric, const glm::vec3& position) {
+	double x = position.x, y = position.y, z = position.z;
+	double value = quadric.a00 * x * x + quadric.a11 * y * y + quadric.a22 * z * z
+		+ 2.0 * (quadric.a01 * x * y + quadric.a02 * x * z + quadric.a12 * y * z)
+		+ 2.0 * (quadric.b0 * x + quadric.b1 * y + quadric.b2 * z) + quadric.c;
+	return std::fabs(value);						//rounding can take an exact fit slightly negative
+}
+
+static uint64_t getEdgeKey(uint32_t a, uint32_t b) {
+	return a < b ? (static_cast<uint64_t>(a) << 32) | b : (static_cast<uint64_t>(b) << 32) | a;
+}
+
+//every distinct edge of the triangles, sorted, with how many triangles use it
+static void collectEdges(const std::vector<uint32_t>& indices, std::vector<uint64_t>& edges, std::vector<uint32_t>& edgeUses) {
+	edges.clear();
+	edgeUses.clear();
+	std::vector<uint64_t> keys(indices.size());
+	for (size_t t = 0; t < indices.size(); t += 3) {
+		keys[t + 0] = getEdgeKey(indices[t + 0], indices[t + 1]);
+		keys[t + 1] = getEdgeKey(indices[t + 1], indices[t + 2]);
+		keys[t + 2] = getEdgeKey(indices[t + 2], indices[t + 0]);
+	}
+	std::sort(keys.begin(), keys.end());
+	for (size_t i = 0; i < keys.size(); i++) {
+		if (edges.empty() || edges.back() != keys[i]) {
+			edges.push_back(keys[i]);
+			edgeUses.push_back(0);
+		}
+		edgeUses.back()++;
+	}
+}
+
+static bool isBorderEdge(const std::vector<uint64_t>& edges, const std::vector<uint32_t>& edgeUses, uint32_t a, uint32_t b) {
+	auto edge = std::lower_bound(edges.begin(), edges.end(), getEdgeKey(a, b));
+	return edge != edges.end() && *edge == getEdgeKey(a, b) && edgeUses[edge - edges.begin()] == 1;
+}
+
+static void classifyVertices(const Vertex* vertices, uint32_t vertexCount, const std::vector<uint64_t>& edges, const std::vector<uint32_t>& edgeUses,
+	std::vector<VertexKind>& kinds) {
+	kinds.assign(vertexCount, VertexKind::Manifold);
+
+	//vertices split for their colour share a position, moving one alone would tear the surface
+	std::vector<uint32_t> byPosition(vertexCount);
+	for (uint32_t v = 0; v < vertexCount; v++) byPosition[v] = v;
+	auto positionLess = [vertices](uint32_t a, uint32_t b) {
+		const glm::vec3& pa = vertices[a].pos;
+		const glm::vec3& pb = vertices[b].pos;
+		if (pa.x != pb.x) return pa.x < pb.x;
+		if (pa.y != pb.y) return pa.y < pb.y;
+		return pa.z < pb.z;
+	};
+	std::sort(byPosition.begin(), byPosition.end(), positionLess);
+	for (uint32_t i = 1; i < vertexCount; i++) {
+		if (!positionLess(byPosition[i - 1], byPosition[i])) {
+			kinds[byPosition[i - 1]] = VertexKind::Locked;
+			kinds[byPosition[i]] = VertexKind::Locked;
+		}
+	}
+
+	//a border vertex has exactly two open edges, anything else where borders meet or edges are shared three ways stays put
+	std::vector<uint8_t> borderEdges(vertexCount, 0);
+	for (size_t e = 0; e < edges.size(); e++) {
+		uint32_t a = static_cast<uint32_t>(edges[e] >> 32);
+		uint32_t b = static_cast<uint32_t>(edges[e] & 0xFFFFFFFF);
+		if (edgeUses[e] == 1) {
+			borderEdges[a] = static_cast<uint8_t>(std::min(borderEdges[a] + 1, 255));
+			borderEdges[b] = static_cast<uint8_t>(std::min(borderEdges[b] + 1, 255));
+		}
+		else if (edgeUses[e] > 2) {
+			kinds[a] = VertexKind::Locked;
+			kinds[b] = VertexKind::Locked;
+		}
+	}
+	for (uint32_t v = 0; v < vertexCount; v++) {
+		if (kinds[v] != VertexKind::Manifold || borderEdges[v] == 0) continue;
+		kinds[v] = borderEdges[v] == 2 ? VertexKind::Border : VertexKind::Locked;
+	}
+}
+
+static void buildQuadrics(const std::vector<uint32_t>& indices, const Vertex* vertices, uint32_t vertexCount, const std::vector<uint64_t>& edges,
+	const std::vector<uint32_t>& edgeUses, std::vector<Quadric>& quadrics) {
+	quadrics.assign(vertexCount, Quadric());
+	for (size_t t = 0; t < indices.size(); t += 3) {
+		const glm::vec3& p0 = vertices[indices[t + 0]].pos;
+		const glm::vec3& p1 = vertices[indices[t + 1]].pos;
+		const glm::vec3& p2 = vertices[indices[t + 2]].pos;
+		glm::vec3 normal = glm::cross(p1 - p0, p2 - p0);
+		float length = glm::length(normal);
+		if (length == 0.0f) continue;
+		normal /= length;
+
+		//each corner remembers the plane of every triangle it belonged to
+		for (size_t corner = 0; corner < 3; corner++) {
+			addPlane(quadrics[indices[t + corner]], normal, -glm::dot(normal, p0), length * 0.5);
+		}
+
+		//open edges add a plane standing on them, perpendicular to the surface, which keeps border vertices on the outline
+		for (size_t corner = 0; corner < 3; corner++) {
+			uint32_t a = indices[t + corner];
+			uint32_t b = indices[t + (corner + 1) % 3];
+			if (!isBorderEdge(edges, edgeUses, a, b)) continue;
+
+			glm::vec3 edge = vertices[b].pos - vertices[a].pos;
+			glm::vec3 borderNormal = glm::cross(edge, normal);
+			float borderLength = glm::length(borderNormal);
+			if (borderLength == 0.0f) continue;
+			borderNormal /= borderLength;
+			double weight = glm::dot(edge, edge) * BORDER_WEIGHT;
+			addPlane(quadrics[a], borderNormal, -glm::dot(borderNormal, vertices[a].pos), weight);
+			addPlane(quadrics[b], borderNormal, -glm::dot(borderNormal, vertices[a].pos), weight);
+		}
+	}
+}
+
+//collapse state of one mesh, simplify can be called again with a smaller target to carry on from where the last call stopped
+//quadrics keep accumulating across calls, so errors stay measured against the original surface
+class EdgeCollapser
+{
+public:
+	EdgeCollapser(const uint32_t* indices, uint32_t indexCount, const Vertex* newVertices, uint32_t newVertexCount);
+
+	void simplify(uint32_t targetIndexCount, double maxCost);
+
+	const std::vector<uint32_t>& getIndices() { return current; }
+	float getError() { return static_cast<float>(std::sqrt(resultCost)); }
+
+private:
+	const Vertex* vertices;
+	uint32_t vertexCount;
+
+	std::vector<uint32_t> current;					//triangles left
+	std::vector<VertexKind> kinds;
+	std::vector<Quadric> quadrics;
+	std::vector<uint32_t> collapseTo;				//where each vertex went, itself if it hasnt moved
+	double resultCost = 0.0;
+
+	//rebuilt every pass
+	std::vector<uint64_t> edges;
+	std::vector<uint32_t> edgeUses;
+	std::vector<uint32_t> adjacencyOffsets;
+	std::vector<uint32_t> adjacency;
+	std::vector<uint32_t> adjacencyFill;
+	std::vector<Collapse> collapses;
+	std::vector<uint8_t> touched;
+
+	bool isFold(const Collapse& collapse);
+};
+
+EdgeCollapser::EdgeCollapser(const uint32_t* indices, uint32_t indexCount, const Vertex* newVertices, uint32_t newVertexCount)
+	: vertices(newVertices), vertexCount(newVertexCount), current(indices, indices + indexCount - indexCount % 3)
+{
+	for (uint32_t index : current) {
+		if (index >= vertexCount) {
+			throw std::runtime_error("mesh index refers to a vertex that does not exist");
+		}
+	}
+
+	collectEdges(current, edges, edgeUses);
+	classifyVertices(vertices, vertexCount, edges, edgeUses, kinds);
+	buildQuadrics(current, vertices, vertexCount, edges, edgeUses, quadrics);
+
+	collapseTo.resize(vertexCount);
+	for (uint32_t v = 0; v < vertexCount; v++) collapseTo[v] = v;
+	adjacencyOffsets.resize(vertexCount + 1);
+	touched.resize(vertexCount);
+}
+
+void EdgeCollapser::simplify(uint32_t targetIndexCount, double maxCost)
+{
+	//cheapest disjoint collapses first, in passes, each pass rebuilding the triangles it changed
+	while (current.size() > targetIndexCount) {
+		uint32_t triangleCount = static_cast<uint32_t>(current.size() / 3);
+
+		//triangles around each vertex, to check collapses for folds
+		std::fill(adjacencyOffsets.begin(), adjacencyOffsets.end(), 0);
+		for (uint32_t index : current) adjacencyOffsets[index + 1]++;
+		for (uint32_t v = 0; v < vertexCount; v++) adjacencyOffsets[v + 1] += adjacencyOffsets[v];
+		adjacency.resize(current.size());
+		adjacencyFill.assign(adjacencyOffsets.begin(), adjacencyOffsets.end() - 1);
+		for (uint32_t i = 0; i < current.size(); i++) {
+			adjacency[adjacencyFill[current[i]]++] = i / 3;
+		}
+
+		//each edge in whichever allowed direction costs less
+		collectEdges(current, edges, edgeUses);
+		collapses.clear();
+		for (size_t e = 0; e < edges.size(); e++) {
+			if (edgeUses[e] > 2) continue;
+			bool border = edgeUses[e] == 1;
+			uint32_t ends[2] = { static_cast<uint32_t>(edges[e] >> 32), static_cast<uint32_t>(edges[e] & 0xFFFFFFFF) };
+
+			Collapse best = { 0, 0, -1.0 };
+			for (int direction = 0; direction < 2; direction++) {
+				uint32_t from = ends[direction], to = ends[1 - direction];
+				bool allowed = border ? kinds[from] == VertexKind::Border : kinds[from] == VertexKind::Manifold;
+				if (!allowed) continue;
+
+				double weight = quadrics[from].weight + quadrics[to].weight;
+				double cost = evaluateQuadric(quadrics[from], vertices[to].pos) + evaluateQuadric(quadrics[to], vertices[to].pos);
+				cost = weight > 0.0 ? cost / weight : 0.0;
+				if (best.cost < 0.0 || cost < best.cost) {
+					best = { from, to, cost };
+				}
+			}
+			if (best.cost >= 0.0 && best.cost <= maxCost) {
+				collapses.push_back(best);
+			}
+		}
+		std::sort(collapses.begin(), collapses.end(), [](const Collapse& a, const Collapse& b) { return a.cost < b.cost; });
+
+		//a collapse removes about two triangles, and neighbourhoods it changed wait for the next pass so fold checks stay exact
+		uint32_t budget = std::max<uint32_t>(1, (triangleCount - targetIndexCount / 3) / 2);
+		uint32_t performed = 0;
+		std::fill(touched.begin(), touched.end(), 0);
+		for (const Collapse& collapse : collapses) {
+			if (performed >= budget) break;
+			if (touched[collapse.from] || touched[collapse.to] || isFold(collapse)) continue;
+
+			collapseTo[collapse.from] = collapse.to;
+			addQuadric(quadrics[collapse.to], quadrics[collapse.from]);
+			resultCost = std::max(resultCost, collapse.cost);
+			performed++;
+
+			for (uint32_t end : { collapse.from, collapse.to }) {
+				for (uint32_t a = adjacencyOffsets[end]; a < adjacencyOffsets[end + 1]; a++) {
+					const uint32_t* triangle = &current[adjacency[a] * 3];
+					touched[triangle[0]] = touched[triangle[1]] = touched[triangle[2]] = 1;
+				}
+			}
+		}
+		if (performed == 0) break;
+
+		//targets never move in the pass they are collapsed onto, so one lookup is enough
+		size_t kept = 0;
+		for (size_t t = 0; t < current.size(); t += 3) {
+			uint32_t a = collapseTo[current[t + 0]], b = collapseTo[current[t + 1]], c = collapseTo[current[t + 2]];
+			if (a == b || b == c || c == a) continue;
+			current[kept++] = a;
+			current[kept++] = b;
+			current[kept++] = c;
+		}
+		current.resize(kept);
+	}
+}
+
+bool EdgeCollapser::isFold(const Collapse& collapse)
+{
+	const glm::vec3& target = vertices[collapse.to].pos;
+	for (uint32_t a = adjacencyOffsets[collapse.from]; a < adjacencyOffsets[collapse.from + 1]; a++) {
+		const uint32_t* triangle = &current[adjacency[a] * 3];
+		if (triangle[0] == collapse.to || triangle[1] == collapse.to || triangle[2] == collapse.to) continue;		//degenerates and goes
+
+		glm::vec3 before[3], after[3];
+		for (int corner = 0; corner < 3; corner++) {
+			before[corner] = vertices[triangle[corner]].pos;
+			after[corner] = triangle[corner] == collapse.from ? target : before[corner];
+		}
+		glm::vec3 normalBefore = glm::cross(before[1] - before[0], before[2] - before[0]);
+		glm::vec3 normalAfter = glm::cross(after[1] - after[0], after[2] - after[0]);
+		if (glm::dot(normalBefore, normalAfter) <= MAX_FLIP_COSINE * glm::length(normalBefore) * glm::length(normalAfter)) {
+			return true;
+		}
+	}
+	return false;
+}
+
+uint32_t simplifyMesh(uint32_t* destination, const uint32_t* indices, uint32_t indexCount, const Vertex* vertices, uint32_t vertexCount,
+	uint32_t targetIndexCount, float maxError, float* error)
+{
+	EdgeCollapser collapser(indices, indexCount, vertices, vertexCount);
+	collapser.simplify(targetIndexCount, static_cast<double>(maxError) * maxError);
+
+	const std::vector<uint32_t>& result = collapser.getIndices();
+	std::copy(result.begin(), result.end(), destination);
+	*error = collapser.getError();
+	return static_cast<uint32_t>(result.size());
+}
+
+void buildMeshLods(const Vertex* vertices, uint32_t vertexCount, const uint32_t* indices, uint32_t indexCount, const MeshLodSettings& settings,
+	std::vector<uint32_t>& lodIndices, std::vector<MeshLod>& lods, MeshLodStats* stats)
+{
+	auto simplifyStart = std::chrono::steady_clock::now();
+	*stats = MeshLodStats();
+
+	indexCount -= indexCount % 3;
+	lodIndices.assign(indices, indices + indexCount);
+	lods.assign(1, MeshLod());
+	lods[0].indexCount = indexCount;
+	stats->triangles[0] = indexCount / 3;
+
+	uint32_t levelCount = std::min(settings.lodCount, MAX_MESH_LODS);
+	if (levelCount < 2) return;
+
+	//one collapse sequence, each level is where it passed that level's target, so every error is against the full mesh's surface
+	float radius = computeMeshBounds(vertices, vertexCount).radius;
+	double maxCost = static_cast<double>(settings.maxError * radius) * (settings.maxError * radius);
+	EdgeCollapser collapser(indices, indexCount, vertices, vertexCount);
+	std::vector<uint32_t> ordered(indexCount);
+	for (uint32_t level = 1; level < levelCount; level++) {
+		uint32_t previousCount = lods.back().indexCount;
+		collapser.simplify(static_cast<uint32_t>(previousCount / 3 * settings.reduction) * 3, maxCost);
+
+		const std::vector<uint32_t>& simplified = collapser.getIndices();
+		uint32_t count = static_cast<uint32_t>(simplified.size());
+		float error = collapser.getError();
+		if (count == 0 || count > previousCount * (1.0f - MIN_LOD_REDUCTION)) break;
+
+		//simplification leaves triangles in input order, which is no longer a good one for the cache
+		optimizeVertexCache(ordered.data(), simplified.data(), count, vertexCount, VERTEX_CACHE_SIZE, nullptr);
+
+		MeshLod lod;
+		lod.firstIndex = static_cast<uint32_t>(lodIndices.size());
+		lod.indexCount = count;
+		lod.error = error;
+		lods.push_back(lod);
+		lodIndices.insert(lodIndices.end(), ordered.begin(), ordered.begin() + count);
+
+		stats->triangles[level] = count / 3;
+		stats->errors[level] = error;
+		stats->relativeErrors[level] = radius > 0.0f ? error / radius : 0.0f;
+	}
+	stats->lodCount = static_cast<uint32_t>(lods.size());
+
+	std::chrono::duration<double, std::milli> simplifyTime = std::chrono::steady_clock::now() - simplifyStart;
+	stats->simplifyMs = simplifyTime.count();
+}
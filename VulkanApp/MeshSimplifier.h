@@ -0,0 +1,35 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "Utilities.h"
+#include "Mesh.h"
+
+//levels of detail createMesh builds
+struct MeshLodSettings {
+	uint32_t lodCount = 1;							//levels including the full mesh, 1 builds none, at most MAX_MESH_LODS
+	float reduction = 0.5f;							//share of the previous level's triangles each level aims for
+	float maxError = 0.05f;							//relative to the mesh's bounding radius, the chain ends early rather than exceed it
+};
+
+//what level of detail generation did to one mesh, level 0 is the full mesh
+struct MeshLodStats {
+	uint32_t lodCount = 1;
+	uint32_t triangles[MAX_MESH_LODS] = {};
+	float errors[MAX_MESH_LODS] = {};				//object space
+	float relativeErrors[MAX_MESH_LODS] = {};		//errors over the bounding radius
+	double simplifyMs = 0.0;
+};
+
+//quadric error metric edge collapse (Garland & Heckbert 1997) onto existing vertices, so every level can share one vertex buffer
+//open borders only collapse along themselves and vertices sharing a position with another (attribute seams) never move
+//stops at targetIndexCount or once the next collapse would exceed maxError (object space), returns the indices written to destination
+//error receives the largest collapse error: area weighted RMS distance to the original triangles' planes
+uint32_t simplifyMesh(uint32_t* destination, const uint32_t* indices, uint32_t indexCount, const Vertex* vertices, uint32_t vertexCount,
+	uint32_t targetIndexCount, float maxError, float* error);
+
+//the full mesh's indices followed by each coarser level's into lodIndices, every level simplified from the full mesh and vertex cache ordered
+//the chain ends early once a level cant get meaningfully smaller within settings.maxError, lods receives each level's range
+void buildMeshLods(const Vertex* vertices, uint32_t vertexCount, const uint32_t* indices, uint32_t indexCount, const MeshLodSettings& settings,
+	std::vector<uint32_t>& lodIndices, std::vector<MeshLod>& lods, MeshLodStats* stats);
@@ -0,0 +1,137 @@
+#include "Meshlets.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+
+//sphere around the meshlet's vertices and the cone holding its triangle normals
+static void computeMeshletBounds(const Vertex* vertices, const uint32_t* indices, Meshlet& meshlet) {
+	glm::vec3 min = vertices[indices[0]].pos, max = min;
+	for (uint32_t i = 0; i < meshlet.indexCount; i++) {
+		min = glm::min(min, vertices[indices[i]].pos);
+		max = glm::max(max, vertices[indices[i]].pos);
+	}
+	meshlet.center = (min + max) * 0.5f;
+	meshlet.radius = 0.0f;
+	for (uint32_t i = 0; i < meshlet.indexCount; i++) {
+		meshlet.radius = std::max(meshlet.radius, glm::length(vertices[indices[i]].pos - meshlet.center));
+	}
+
+	//unit normals so a few large triangles cant hide a differently facing small one
+	auto triangleNormal = [&](uint32_t i) {
+		const glm::vec3& a = vertices[indices[i]].pos;
+		glm::vec3 normal = glm::cross(vertices[indices[i + 1]].pos - a, vertices[indices[i + 2]].pos - a);
+		float length = glm::length(normal);
+		return length > 0.0f ? normal / length : glm::vec3(0.0f);			//degenerate triangles are never rasterised
+	};
+	glm::vec3 axis(0.0f);
+	for (uint32_t i = 0; i + 2 < meshlet.indexCount; i += 3) {
+		axis += triangleNormal(i);
+	}
+
+	meshlet.coneAxis = glm::vec3(0.0f, 0.0f, 1.0f);
+	meshlet.coneCutoff = 1.0f;
+	float axisLength = glm::length(axis);
+	if (axisLength <= 0.0f) return;
+	meshlet.coneAxis = axis / axisLength;
+
+	//cosine of the widest normal, a spread of a hemisphere or more leaves the cone unable to cull
+	float minDot = 1.0f;
+	for (uint32_t i = 0; i + 2 < meshlet.indexCount; i += 3) {
+		glm::vec3 normal = triangleNormal(i);
+		if (normal != glm::vec3(0.0f)) minDot = std::min(minDot, glm::dot(normal, meshlet.coneAxis));
+	}
+	if (minDot > 0.0f) {
+		meshlet.coneCutoff = std::sqrt(1.0f - minDot * minDot);
+	}
+}
+
+void buildMeshlets(const Vertex* vertices, uint32_t vertexCount, const uint32_t* indices, MeshLod* lods, uint32_t lodCount,
+	const MeshletSettings& settings, std::vector<Meshlet>& meshlets, MeshletStats* stats)
+{
+	auto buildStart = std::chrono::steady_clock::now();
+	*stats = MeshletStats();
+
+	uint32_t maxVertices = std::max(settings.maxVertices, 3u);
+	uint32_t maxTriangles = std::max(settings.maxTriangles, 1u);
+
+	//vertices already in the meshlet being built carry its number, so counting new ones needs no search
+	std::vector<uint32_t> vertexMeshlet(vertexCount, ~0u);
+	for (uint32_t level = 0; level < lodCount; level++) {
+		MeshLod& lod = lods[level];
+		lod.firstMeshlet = static_cast<uint32_t>(meshlets.size());
+
+		Meshlet meshlet;
+		meshlet.firstIndex = lod.firstIndex;
+		uint32_t meshletVertices = 0;
+		uint32_t stamp = static_cast<uint32_t>(meshlets.size());
+		for (uint32_t i = lod.firstIndex; i + 2 < lod.firstIndex + lod.indexCount; i += 3) {
+			uint32_t added = 0;
+			for (uint32_t k = 0; k < 3; k++) {
+				//repeated corners of a degenerate triangle count once
+				bool repeated = (k > 0 && indices[i + k] == indices[i]) || (k > 1 && indices[i + k] == indices[i + 1]);
+				if (vertexMeshlet[indices[i + k]] != stamp && !repeated) added++;
+			}
+
+			if (meshlet.indexCount > 0 && (meshletVertices + added > maxVertices || meshlet.indexCount / 3 + 1 > maxTriangles)) {
+				computeMeshletBounds(vertices, indices + meshlet.firstIndex, meshlet);
+				stats->vertices += meshletVertices;
+				meshlets.push_back(meshlet);
+
+				meshlet = Meshlet();
+				meshlet.firstIndex = i;
+				meshletVertices = 0;
+				stamp = static_cast<uint32_t>(meshlets.size());
+			}
+
+			for (uint32_t k = 0; k < 3; k++) {
+				if (vertexMeshlet[indices[i + k]] != stamp) {
+					vertexMeshlet[indices[i + k]] = stamp;
+					meshletVertices++;
+				}
+			}
+			meshlet.indexCount += 3;
+		}
+		if (meshlet.indexCount > 0) {
+			computeMeshletBounds(vertices, indices + meshlet.firstIndex, meshlet);
+			stats->vertices += meshletVertices;
+			meshlets.push_back(meshlet);
+		}
+
+		lod.meshletCount = static_cast<uint32_t>(meshlets.size()) - lod.firstMeshlet;
+		stats->triangles += lod.indexCount / 3;
+	}
+
+	for (const Meshlet& meshlet : meshlets) {
+		if (meshlet.coneCutoff < 1.0f) stats->coneCullable++;
+	}
+	stats->meshletCount = static_cast<uint32_t>(meshlets.size());
+
+	std::chrono::duration<double, std::milli> buildTime = std::chrono::steady_clock::now() - buildStart;
+	stats->buildMs = buildTime.count();
+}
+
+bool isMeshletBackfacing(const Meshlet& meshlet, const glm::vec3& cameraPosition)
+{
+	//a view direction closer to the axis than 90 degrees minus the cone's spread sees every normal from behind,
+	//the radius widens the test so it holds for every point of the sphere, not just the centre
+	glm::vec3 toCenter = meshlet.center - cameraPosition;
+	return glm::dot(toCenter, meshlet.coneAxis) >= meshlet.coneCutoff * glm::length(toCenter) + meshlet.radius;
+}
+
+uint32_t cullMeshlets(const Meshlet* meshlets, uint32_t count, const Frustum& frustum, const glm::vec3& cameraPosition, bool coneCulling,
+	uint32_t* visible)
+{
+	uint32_t visibleCount = 0;
+	for (uint32_t i = 0; i < count; i++) {
+		const Meshlet& meshlet = meshlets[i];
+		bool inside = true;
+		for (int p = 0; p < 6 && inside; p++) {
+			inside = glm::dot(glm::vec3(frustum.planes[p]), meshlet.center) + frustum.planes[p].w >= -meshlet.radius;
+		}
+		if (!inside || (coneCulling && isMeshletBackfacing(meshlet, cameraPosition))) continue;
+
+		visible[visibleCount++] = i;
+	}
+	return visibleCount;
+}
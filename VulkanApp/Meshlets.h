@@ -0,0 +1,42 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "Utilities.h"
+#include "Mesh.h"
+#include "Culling.h"
+
+//limits of one cluster, the sizes mesh shader pipelines settled on so the clusters would carry over to them
+const uint32_t MESHLET_MAX_VERTICES = 64;
+const uint32_t MESHLET_MAX_TRIANGLES = 124;
+
+//clusters createMesh splits meshes into
+struct MeshletSettings {
+	bool enabled = false;
+	uint32_t maxVertices = MESHLET_MAX_VERTICES;
+	uint32_t maxTriangles = MESHLET_MAX_TRIANGLES;
+};
+
+//what clustering did to one mesh, every level of detail included
+struct MeshletStats {
+	uint32_t meshletCount = 0;
+	uint32_t triangles = 0;
+	uint32_t vertices = 0;							//unique per meshlet, shared vertices counted once per meshlet they appear in
+	uint32_t coneCullable = 0;						//meshlets whose normals fit in a cone narrower than a hemisphere
+	double buildMs = 0.0;
+};
+
+//splits each level's index range into meshlets of consecutive triangles, so every meshlet is a contiguous index range and the
+//indices keep their vertex cache order, a meshlet ends when the next triangle would exceed either limit
+//appends to meshlets and sets each level's firstMeshlet and meshletCount
+void buildMeshlets(const Vertex* vertices, uint32_t vertexCount, const uint32_t* indices, MeshLod* lods, uint32_t lodCount,
+	const MeshletSettings& settings, std::vector<Meshlet>& meshlets, MeshletStats* stats);
+
+//every triangle of the meshlet faces away from the camera (object space, counter clockwise front faces)
+//conservative over the whole bounding sphere, so any camera position the test passes for sees only back faces
+bool isMeshletBackfacing(const Meshlet& meshlet, const glm::vec3& cameraPosition);
+
+//writes the index of every meshlet inside the object space frustum and not backfacing to visible (room for count), returns how many
+uint32_t cullMeshlets(const Meshlet* meshlets, uint32_t count, const Frustum& frustum, const glm::vec3& cameraPosition, bool coneCulling,
+	uint32_t* visible);
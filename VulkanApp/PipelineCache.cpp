@@ -0,0 +1,155 @@
+#include "PipelineCache.h"
+
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#endif
+
+PipelineCache::PipelineCache()
+{
+}
+
+void PipelineCache::create(VkPhysicalDevice physicalDevice, VkDevice newDevice, const std::string& newPath)
+{
+	device = newDevice;
+	path = newPath;
+	stats = PipelineCacheStats();
+
+	VkPhysicalDeviceProperties deviceProperties;
+	vkGetPhysicalDeviceProperties(physicalDevice, &deviceProperties);
+	deviceHeader.headerSize = sizeof(VkPipelineCacheHeaderVersionOne);
+	deviceHeader.headerVersion = VK_PIPELINE_CACHE_HEADER_VERSION_ONE;
+	deviceHeader.vendorID = deviceProperties.vendorID;
+	deviceHeader.deviceID = deviceProperties.deviceID;
+	memcpy(deviceHeader.pipelineCacheUUID, deviceProperties.pipelineCacheUUID, VK_UUID_SIZE);
+
+	//data from another device or driver would be ignored by most drivers anyway, but not all of them
+	std::vector<char> data;
+	if (!readCacheFile(data)) {
+		stats.loadResult = path.empty() ? "disabled" : "missing";
+	}
+	else {
+		const char* rejection = validateHeader(data);
+		stats.loadResult = rejection != nullptr ? rejection : "loaded";
+		if (rejection != nullptr) {
+			data.clear();
+		}
+	}
+
+	VkPipelineCacheCreateInfo cacheCreateInfo = {};
+	cacheCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+	cacheCreateInfo.initialDataSize = data.size();
+	cacheCreateInfo.pInitialData = data.empty() ? nullptr : data.data();
+
+	VkResult result = vkCreatePipelineCache(device, &cacheCreateInfo, nullptr, &cache);
+	if (result != VK_SUCCESS && !data.empty()) {
+		//driver still refused the data, start cold rather than fail
+		stats.loadResult = "rejected by driver";
+		data.clear();
+		cacheCreateInfo.initialDataSize = 0;
+		cacheCreateInfo.pInitialData = nullptr;
+		result = vkCreatePipelineCache(device, &cacheCreateInfo, nullptr, &cache);
+	}
+	if (result != VK_SUCCESS) {
+		throw std::runtime_error("failed to create a pipeline cache");
+	}
+
+	stats.loaded = !data.empty();
+	stats.loadedBytes = data.size();
+}
+
+void PipelineCache::save()
+{
+	if (cache == VK_NULL_HANDLE || path.empty()) return;
+
+	size_t dataSize = 0;
+	VkResult result = vkGetPipelineCacheData(device, cache, &dataSize, nullptr);
+	if (result != VK_SUCCESS || dataSize == 0) return;
+
+	std::vector<char> data(dataSize);
+	result = vkGetPipelineCacheData(device, cache, &dataSize, data.data());
+	if (result != VK_SUCCESS) return;
+
+	//write everything to a temporary file first, the old cache is only replaced by a complete one
+	std::string tempPath = path + ".tmp";
+	{
+		std::ofstream file(tempPath, std::ios::binary | std::ios::trunc);
+		if (!file.is_open()) return;
+		file.write(data.data(), dataSize);
+		file.flush();
+		if (!file.good()) {
+			file.close();
+			std::remove(tempPath.c_str());
+			return;
+		}
+	}
+
+	//both replace the target in one step, so a crash leaves either the old cache or the new one
+#ifdef _WIN32
+	bool replaced = MoveFileExA(tempPath.c_str(), path.c_str(), MOVEFILE_REPLACE_EXISTING) != 0;
+#else
+	bool replaced = std::rename(tempPath.c_str(), path.c_str()) == 0;
+#endif
+	if (!replaced) {
+		std::remove(tempPath.c_str());
+		return;
+	}
+	stats.savedBytes = dataSize;
+}
+
+void PipelineCache::destroy()
+{
+	if (cache == VK_NULL_HANDLE) return;
+
+	vkDestroyPipelineCache(device, cache, nullptr);
+	cache = VK_NULL_HANDLE;
+}
+
+VkPipelineCache PipelineCache::getCache()
+{
+	return cache;
+}
+
+PipelineCacheStats& PipelineCache::getStats()
+{
+	return stats;
+}
+
+PipelineCache::~PipelineCache()
+{
+}
+
+bool PipelineCache::readCacheFile(std::vector<char>& data)
+{
+	if (path.empty()) return false;
+
+	std::ifstream file(path, std::ios::binary | std::ios::ate);
+	if (!file.is_open()) return false;
+
+	size_t fileSize = static_cast<size_t>(file.tellg());
+	data.resize(fileSize);
+	file.seekg(0);
+	file.read(data.data(), fileSize);
+	return file.good();
+}
+
+const char* PipelineCache::validateHeader(const std::vector<char>& data)
+{
+	//returns why the data cant be used, null if it can
+	if (data.size() < sizeof(VkPipelineCacheHeaderVersionOne)) return "truncated";
+
+	VkPipelineCacheHeaderVersionOne header;
+	memcpy(&header, data.data(), sizeof(header));
+
+	if (header.headerSize < sizeof(VkPipelineCacheHeaderVersionOne) || header.headerSize > data.size()) return "bad header size";
+	if (header.headerVersion != VK_PIPELINE_CACHE_HEADER_VERSION_ONE) return "unknown header version";
+	if (header.vendorID != deviceHeader.vendorID || header.deviceID != deviceHeader.deviceID) return "device mismatch";
+	if (memcmp(header.pipelineCacheUUID, deviceHeader.pipelineCacheUUID, VK_UUID_SIZE) != 0) return "cache UUID mismatch";
+	return nullptr;
+}
@@ -0,0 +1,50 @@
+#pragma once
+
+#define GLFW_INCLUDE_VULKAN
+#include <GLFW/glfw3.h>
+
+#include <string>
+#include <vector>
+
+//file the renderer keeps compiled pipelines in, relative to the working directory
+const char* const DEFAULT_PIPELINE_CACHE_PATH = "pipeline_cache.bin";
+
+struct PipelineCacheStats {
+	bool loaded = false;							//valid data for this device was read at startup (warm start)
+	std::string loadResult;							//why data was or wasnt used: "loaded", "missing", "device mismatch", ...
+	size_t loadedBytes = 0;
+	size_t savedBytes = 0;							//written by the last save, 0 if not saved yet
+	double pipelineCreateMs = 0.0;					//CPU time creating every pipeline at startup
+};
+
+//VkPipelineCache persisted between runs
+//data read from disk is only handed to the driver if its header matches this device (vendor, device, cache UUID),
+//pipelines compiled on other threads go straight into it, the driver synchronizes access to a pipeline cache,
+//and saving writes a temporary file that then replaces the old cache, so a crash never leaves a half written file
+class PipelineCache
+{
+public:
+	PipelineCache();
+
+	//empty path keeps the cache in memory only
+	void create(VkPhysicalDevice physicalDevice, VkDevice newDevice, const std::string& newPath);
+	void save();
+	void destroy();
+
+	VkPipelineCache getCache();
+
+	PipelineCacheStats& getStats();
+
+	~PipelineCache();
+
+private:
+	VkDevice device = VK_NULL_HANDLE;
+	VkPipelineCache cache = VK_NULL_HANDLE;
+	std::string path;
+
+	VkPipelineCacheHeaderVersionOne deviceHeader = {};	//what a header must match to be loaded
+	PipelineCacheStats stats;
+
+	bool readCacheFile(std::vector<char>& data);
+	const char* validateHeader(const std::vector<char>& data);
+};
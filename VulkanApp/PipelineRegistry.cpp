@@ -0,0 +1,488 @@
+#include "PipelineRegistry.h"
+
+#include <algorithm>
+#include <chrono>
+
+//FNV-1a, only used to key pipelines so doesnt need to be cryptographic
+static uint64_t hashBytes(const void* data, size_t size, uint64_t hash = 14695981039346656037ULL)
+{
+	const unsigned char* bytes = static_cast<const unsigned char*>(data);
+	for (size_t i = 0; i < size; i++) {
+		hash ^= bytes[i];
+		hash *= 1099511628211ULL;
+	}
+	return hash;
+}
+
+bool PipelineRegistry::PipelineKey::operator==(const PipelineKey& other) const
+{
+	return vertexShader == other.vertexShader && fragmentShader == other.fragmentShader
+		&& topology == other.topology && polygonMode == other.polygonMode && cullMode == other.cullMode
+		&& frontFace == other.frontFace && blendEnable == other.blendEnable && colorWrite == other.colorWrite
+		&& depthTest == other.depthTest && depthWrite == other.depthWrite && positionOnly == other.positionOnly;
+}
+
+PipelineRegistry::PipelineRegistry()
+{
+	finishedCount = 0;
+}
+
+void PipelineRegistry::init(VkDevice newDevice, PipelineCache* newPipelineCache, VkPipelineLayout newPipelineLayout, VkRenderPass newRenderPass,
+	VkExtent2D newExtent, const VertexLayout& newVertexLayout, bool newReverseDepth, uint32_t threadCount)
+{
+	device = newDevice;
+	pipelineCache = newPipelineCache;
+	pipelineLayout = newPipelineLayout;
+	renderPass = newRenderPass;
+	extent = newExtent;
+	vertexLayout = newVertexLayout;
+	reverseDepth = newReverseDepth;
+
+	stopping = false;
+	for (uint32_t i = 0; i < threadCount; i++) {
+		workers.emplace_back(&PipelineRegistry::workerLoop, this);
+	}
+}
+
+void PipelineRegistry::cleanup()
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		stopping = true;
+		queue.clear();
+	}
+	workAvailable.notify_all();
+	for (std::thread& worker : workers) {
+		worker.join();
+	}
+	workers.clear();
+
+	for (PipelineEntry& entry : entries) {
+		VkPipeline pipeline = entry.pipeline.load();
+		if (pipeline != VK_NULL_HANDLE) {
+			vkDestroyPipeline(device, pipeline, nullptr);
+		}
+	}
+	entries.clear();
+	handlesByHash.clear();
+}
+
+PipelineHandle PipelineRegistry::request(const PipelineDesc& desc)
+{
+	bool added = false;
+	PipelineHandle handle = findOrAdd(desc, &added);
+	if (!added) return handle;
+
+	//no workers means compiling here rather than never
+	if (workers.empty()) {
+		compile(&entries[handle]);
+		return handle;
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		queue.push_back(&entries[handle]);
+	}
+	workAvailable.notify_one();
+	return handle;
+}
+
+PipelineHandle PipelineRegistry::build(const PipelineDesc& desc, VkPipelineCache cache)
+{
+	bool added = false;
+	PipelineHandle handle = findOrAdd(desc, &added);
+	if (!added) {
+		//already requested, wait for it rather than compiling twice
+		waitIdle();
+		if (!isReady(handle)) {
+			throw std::runtime_error("failed to create a graphics pipeline");
+		}
+		return handle;
+	}
+
+	auto compileStart = std::chrono::steady_clock::now();
+	VkPipeline pipeline = VK_NULL_HANDLE;
+	try {
+		pipeline = buildPipeline(desc, cache);
+	}
+	catch (const std::runtime_error&) {
+		finish(&entries[handle], VK_NULL_HANDLE, 0.0);
+		throw;
+	}
+	std::chrono::duration<double, std::milli> compileTime = std::chrono::steady_clock::now() - compileStart;
+	finish(&entries[handle], pipeline, compileTime.count());
+	return handle;
+}
+
+VkPipeline PipelineRegistry::getPipeline(PipelineHandle handle)
+{
+	return entries[handle].pipeline.load(std::memory_order_acquire);
+}
+
+const PipelineDesc& PipelineRegistry::getDesc(PipelineHandle handle)
+{
+	return entries[handle].desc;
+}
+
+bool PipelineRegistry::isReady(PipelineHandle handle)
+{
+	return entries[handle].state.load(std::memory_order_acquire) == PipelineState::Ready;
+}
+
+bool PipelineRegistry::isPending(PipelineHandle handle)
+{
+	return entries[handle].state.load(std::memory_order_acquire) == PipelineState::Pending;
+}
+
+uint32_t PipelineRegistry::getPipelineCount()
+{
+	return static_cast<uint32_t>(entries.size());
+}
+
+uint64_t PipelineRegistry::getFinishedCount()
+{
+	return finishedCount.load(std::memory_order_acquire);
+}
+
+void PipelineRegistry::waitIdle()
+{
+	std::unique_lock<std::mutex> lock(mutex);
+	workFinished.wait(lock, [this] { return queue.empty() && activeCompiles == 0; });
+}
+
+PipelineRegistryStats PipelineRegistry::getStats()
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	return stats;
+}
+
+PipelineRegistry::~PipelineRegistry()
+{
+}
+
+PipelineHandle PipelineRegistry::findOrAdd(const PipelineDesc& desc, bool* added)
+{
+	PipelineKey key;
+	key.vertexShader = desc.vertexShader;
+	key.fragmentShader = desc.fragmentShader;
+	key.topology = desc.topology;
+	key.polygonMode = desc.polygonMode;
+	key.cullMode = desc.cullMode;
+	key.frontFace = desc.frontFace;
+	key.blendEnable = desc.blendEnable;
+	key.colorWrite = desc.colorWrite;
+	key.depthTest = desc.depthTest;
+	key.depthWrite = desc.depthWrite;
+	key.positionOnly = desc.positionOnly;
+
+	//hash each field on its own, the struct has padding bytes
+	uint64_t hash = hashBytes(key.vertexShader.data(), key.vertexShader.size());
+	hash = hashBytes(key.fragmentShader.data(), key.fragmentShader.size(), hash);
+	hash = hashBytes(&key.topology, sizeof(key.topology), hash);
+	hash = hashBytes(&key.polygonMode, sizeof(key.polygonMode), hash);
+	hash = hashBytes(&key.cullMode, sizeof(key.cullMode), hash);
+	hash = hashBytes(&key.frontFace, sizeof(key.frontFace), hash);
+	hash = hashBytes(&key.blendEnable, sizeof(key.blendEnable), hash);
+	hash = hashBytes(&key.colorWrite, sizeof(key.colorWrite), hash);
+	hash = hashBytes(&key.depthTest, sizeof(key.depthTest), hash);
+	hash = hashBytes(&key.depthWrite, sizeof(key.depthWrite), hash);
+	hash = hashBytes(&key.positionOnly, sizeof(key.positionOnly), hash);
+
+	std::vector<PipelineHandle>& candidates = handlesByHash[hash];
+	for (PipelineHandle handle : candidates) {
+		if (entries[handle].key == key) {
+			std::lock_guard<std::mutex> lock(mutex);
+			stats.reused++;
+			*added = false;
+			return handle;
+		}
+	}
+
+	PipelineHandle handle = static_cast<PipelineHandle>(entries.size());
+	entries.emplace_back();
+	PipelineEntry& entry = entries.back();
+	entry.key = key;
+	entry.desc = desc;
+	entry.pipeline = VK_NULL_HANDLE;
+	entry.state = PipelineState::Pending;
+	candidates.push_back(handle);
+
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		stats.requested++;
+		stats.pending++;
+	}
+	*added = true;
+	return handle;
+}
+
+void PipelineRegistry::workerLoop()
+{
+	std::unique_lock<std::mutex> lock(mutex);
+	while (true) {
+		workAvailable.wait(lock, [this] { return stopping || !queue.empty(); });
+		if (stopping) return;
+
+		PipelineEntry* entry = queue.front();
+		queue.pop_front();
+		activeCompiles++;
+		lock.unlock();
+
+		compile(entry);
+
+		lock.lock();
+		activeCompiles--;
+		if (queue.empty() && activeCompiles == 0) {
+			workFinished.notify_all();
+		}
+	}
+}
+
+void PipelineRegistry::compile(PipelineEntry* entry)
+{
+	//straight into the persistent cache, so pipelines it loaded from disk are hit
+	VkPipeline pipeline = VK_NULL_HANDLE;
+	auto compileStart = std::chrono::steady_clock::now();
+	try {
+		pipeline = buildPipeline(entry->desc, pipelineCache->getCache());
+	}
+	catch (const std::runtime_error&) {
+		//missing or broken shaders, the entry is marked failed and callers keep their fallback
+	}
+	std::chrono::duration<double, std::milli> compileTime = std::chrono::steady_clock::now() - compileStart;
+	finish(entry, pipeline, compileTime.count());
+}
+
+void PipelineRegistry::finish(PipelineEntry* entry, VkPipeline pipeline, double compileMs)
+{
+	//pipeline is published before the state, readers that see Ready also see the pipeline
+	entry->pipeline.store(pipeline, std::memory_order_release);
+	entry->state.store(pipeline != VK_NULL_HANDLE ? PipelineState::Ready : PipelineState::Failed, std::memory_order_release);
+
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		stats.pending--;
+		if (pipeline != VK_NULL_HANDLE) {
+			stats.compiled++;
+			stats.compileMs += compileMs;
+		}
+		else {
+			stats.failed++;
+		}
+	}
+	finishedCount.fetch_add(1, std::memory_order_acq_rel);
+}
+
+VkShaderModule PipelineRegistry::createShaderModule(const std::vector<char>& code)
+{
+	VkShaderModuleCreateInfo shaderModuleCreateInfo = {};
+	shaderModuleCreateInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+	shaderModuleCreateInfo.codeSize = code.size();
+	shaderModuleCreateInfo.pCode = reinterpret_cast<const uint32_t *> (code.data());
+
+
+	VkShaderModule shaderModule;
+	VkResult result = vkCreateShaderModule(device, &shaderModuleCreateInfo, nullptr, &shaderModule);
+	if (result != VK_SUCCESS) {
+		throw std::runtime_error("failed to create a shader module");
+	}
+
+	return shaderModule;
+}
+
+VkPipeline PipelineRegistry::buildPipeline(const PipelineDesc& desc, VkPipelineCache cache)
+{
+
+	//read in SPIR-V code of shaders, depth only pipelines have no fragment stage
+	bool hasFragmentShader = !desc.fragmentShader.empty();
+	auto vertexShaderCode = readFile(desc.vertexShader);
+	std::vector<char> fragmentShaderCode;
+	if (hasFragmentShader) {
+		fragmentShaderCode = readFile(desc.fragmentShader);
+	}
+
+
+	//build shader modules to link to graphics pipeline
+	VkShaderModule vertexShaderModule = createShaderModule(vertexShaderCode);
+	VkShaderModule fragmentShaderModule = VK_NULL_HANDLE;
+	if (hasFragmentShader) {
+		try {
+			fragmentShaderModule = createShaderModule(fragmentShaderCode);
+		}
+		catch (const std::runtime_error&) {
+			//the vertex module would otherwise leak with every failed compile
+			vkDestroyShaderModule(device, vertexShaderModule, nullptr);
+			throw;
+		}
+	}
+
+	// -- shader stage creation information --
+
+	//Vertex Stage creation information
+	VkPipelineShaderStageCreateInfo vertexShaderCreateInfo = {};
+	vertexShaderCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+	vertexShaderCreateInfo.stage = VK_SHADER_STAGE_VERTEX_BIT;								//Shader stage name
+	vertexShaderCreateInfo.module = vertexShaderModule;										//shader module to be used by stage
+	vertexShaderCreateInfo.pName = "main";													//entry point into shader
+
+	//Fragment stage creation information
+	VkPipelineShaderStageCreateInfo fragmentShaderCreateInfo = {};
+	fragmentShaderCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+	fragmentShaderCreateInfo.stage = VK_SHADER_STAGE_FRAGMENT_BIT;							//Shader stage name
+	fragmentShaderCreateInfo.module = fragmentShaderModule;									//shader module to be used by stage
+	fragmentShaderCreateInfo.pName = "main";												//entry point into shader
+
+	//put shader stage creation info into array
+	//graphics piel;ine creation info requires array of shader stage creates
+	VkPipelineShaderStageCreateInfo shaderStages[] = { vertexShaderCreateInfo, fragmentShaderCreateInfo };
+
+	// how the data for a single vertex (including info such as position, color, texture, coords, normals) is as a whole
+	//one binding per stream and the attribute formats both come from the vertex layout, so compact layouts need no pipeline changes
+	std::vector<VkVertexInputBindingDescription> bindingDescriptions = getVertexBindings(vertexLayout);
+	std::vector<VkVertexInputAttributeDescription> attributeDescriptions = getVertexAttributes(vertexLayout);
+	if (desc.positionOnly) {
+		//position is location 0 in the first stream, a separate position stream is then all that gets fetched
+		bindingDescriptions.resize(1);
+		attributeDescriptions.erase(std::remove_if(attributeDescriptions.begin(), attributeDescriptions.end(),
+			[](const VkVertexInputAttributeDescription& attribute) { return attribute.location != 0; }), attributeDescriptions.end());
+	}
+
+	//--vertex input-- 
+	VkPipelineVertexInputStateCreateInfo vertexInputCreateInfo = {};
+	vertexInputCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
+	vertexInputCreateInfo.vertexBindingDescriptionCount = static_cast<uint32_t>(bindingDescriptions.size());
+	vertexInputCreateInfo.pVertexBindingDescriptions = bindingDescriptions.data();								//list of vertex binding descriptions (data spacing/stride info)
+	vertexInputCreateInfo.vertexAttributeDescriptionCount = static_cast<uint32_t>(attributeDescriptions.size());
+	vertexInputCreateInfo.pVertexAttributeDescriptions = attributeDescriptions.data();							//list of vertex attribute descriptions (data format and where to bind to/from)
+
+	//--input assembly --
+	VkPipelineInputAssemblyStateCreateInfo inputAssembly = {};
+	inputAssembly.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
+	inputAssembly.topology = desc.topology;							//Primitive type to assemble vertices as
+	inputAssembly.primitiveRestartEnable = VK_FALSE;										//Allow overrideing of strip tobology to start new primitives
+
+	//--viewport and scissor--
+	//create a viewport info struct
+	VkViewport viewport = {};
+	viewport.x = 0.0f;																		//x start coordinate
+	viewport.y = 0.0f;																		//y start coordinate
+	viewport.width = (float)extent.width;											//width of viewport
+	viewport.height = (float)extent.height;										//height of viewport
+	viewport.minDepth = 0.0f;																//min frame buffer depth
+	viewport.maxDepth = 1.0f;																//max frame buffer depth
+
+	//create a scissor info struct
+	VkRect2D scissor = {};
+	scissor.offset = { 0,0 };																//offset to use region from
+	scissor.extent = extent;														//extent to descrive region to use, starting at offset
+
+	VkPipelineViewportStateCreateInfo viewportStateCreateInfo = {};
+	viewportStateCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
+	viewportStateCreateInfo.viewportCount = 1;
+	viewportStateCreateInfo.pViewports = &viewport;
+	viewportStateCreateInfo.scissorCount = 1;
+	viewportStateCreateInfo.pScissors = &scissor;
+
+	//--Dynamic state--
+	//dynamic states to enable
+	//std::vector<VkDynamicState> dynamicStateEnables;
+	//dynamicStateEnables.push_back(VK_DYNAMIC_STATE_VIEWPORT);
+	//dynamicStateEnables.push_back(VK_DYNAMIC_STATE_SCISSOR);
+
+	//dynamic state creation info
+	//VkPipelineDynamicStateCreateInfo dynamicStateCreateInfo = {};
+	//dynamicStateCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
+	//dynamicStateCreateInfo.dynamicStateCount = static_cast<uint32_t>(dynamicStateEnables.size());
+	//dynamicStateCreateInfo.pDynamicStates = dynamicStateEnables.data();
+
+	//--rasterizer--
+	VkPipelineRasterizationStateCreateInfo rasterizerCreateInfo = {};
+	rasterizerCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
+	rasterizerCreateInfo.depthClampEnable = VK_FALSE;												//clips fragments past a far plane(need to enable a device feature)
+	rasterizerCreateInfo.rasterizerDiscardEnable = VK_FALSE;										//whether to discard data and skip rasterizer. never creates framnets, oinly suitable for pipline without framebuffer output
+	rasterizerCreateInfo.polygonMode = desc.polygonMode;										//how polygons are filled(change for wireframe or points)(other than fill needs a gpu feature)
+	rasterizerCreateInfo.lineWidth = 1.0f;															//how thick lines should be when drawn(gpu feature)
+	rasterizerCreateInfo.cullMode = desc.cullMode;											//which face of a trianlge to cull
+	rasterizerCreateInfo.frontFace = desc.frontFace;								//winding to determine which side is front
+	rasterizerCreateInfo.depthBiasEnable = VK_FALSE;												//whether to add depth bias to fragments
+
+	//--multisampling--
+	VkPipelineMultisampleStateCreateInfo multisamplingCreateInfo = {};
+	multisamplingCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
+	multisamplingCreateInfo.sampleShadingEnable = VK_FALSE;											//enable multisampling or not
+	multisamplingCreateInfo.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;							//number of samples per fragment
+
+	//--blending--
+	//Blending decides how to belnd a new color being written to a fragment, with the old value
+
+	//blend attatchment state (how blending is handled)]
+	VkPipelineColorBlendAttachmentState colorState = {};
+	colorState.colorWriteMask = desc.colorWrite ? VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT	//colors to apply blending to
+		| VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT : 0;
+	colorState.blendEnable = desc.blendEnable ? VK_TRUE : VK_FALSE;																//enable blending
+
+	//blending uses equation: (srcColorBlendFactor * newColor) colorBlendOp (dstColorBlendFactor * oldColor)
+	colorState.srcColorBlendFactor = VK_BLEND_FACTOR_SRC_ALPHA;
+	colorState.dstColorBlendFactor = VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA;
+	colorState.colorBlendOp = VK_BLEND_OP_ADD;
+
+	//summarised: (VK_BLEND_FACTOR_SRC_ALPHA * new color) + (VK_BLEND_FACTOR * old color)
+
+	colorState.srcAlphaBlendFactor = VK_BLEND_FACTOR_ONE;
+	colorState.dstAlphaBlendFactor = VK_BLEND_FACTOR_ZERO;
+	colorState.alphaBlendOp = VK_BLEND_OP_ADD;
+	//summarised: 1*newalpha + 0*oldalpha = newalpha
+
+	VkPipelineColorBlendStateCreateInfo colorBlendingCreateInfo = {};
+	colorBlendingCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
+	colorBlendingCreateInfo.logicOpEnable = VK_FALSE;												//alternative to calculations is to use logical operations
+	colorBlendingCreateInfo.attachmentCount = 1;
+	colorBlendingCreateInfo.pAttachments = &colorState;
+
+	//--depth stencil testing--
+	//or equal, so after a depth prepass the nearest surface passes against its own depth and nothing behind it is shaded
+	VkPipelineDepthStencilStateCreateInfo depthStencilCreateInfo = {};
+	depthStencilCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO;
+	depthStencilCreateInfo.depthTestEnable = desc.depthTest ? VK_TRUE : VK_FALSE;						//compare against the depth buffer
+	depthStencilCreateInfo.depthWriteEnable = desc.depthWrite ? VK_TRUE : VK_FALSE;						//write passing depths
+	depthStencilCreateInfo.depthCompareOp = reverseDepth ? VK_COMPARE_OP_GREATER_OR_EQUAL : VK_COMPARE_OP_LESS_OR_EQUAL;
+	depthStencilCreateInfo.depthBoundsTestEnable = VK_FALSE;											//whether to also check depth lies between two values
+	depthStencilCreateInfo.stencilTestEnable = VK_FALSE;
+
+	//--graphics pipeline creation--
+
+	VkGraphicsPipelineCreateInfo pipelineCreateInfo = {};
+	pipelineCreateInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
+	pipelineCreateInfo.stageCount = hasFragmentShader ? 2 : 1;
+	pipelineCreateInfo.pStages = shaderStages;
+	pipelineCreateInfo.pVertexInputState = &vertexInputCreateInfo;
+	pipelineCreateInfo.pInputAssemblyState = &inputAssembly;
+	pipelineCreateInfo.pViewportState = &viewportStateCreateInfo;
+	pipelineCreateInfo.pDynamicState = nullptr;
+	pipelineCreateInfo.pRasterizationState = &rasterizerCreateInfo;
+	pipelineCreateInfo.pMultisampleState = &multisamplingCreateInfo;
+	pipelineCreateInfo.pColorBlendState = &colorBlendingCreateInfo;
+	pipelineCreateInfo.pDepthStencilState = &depthStencilCreateInfo;
+	pipelineCreateInfo.layout = pipelineLayout;												//pipeline layout pipeline should use
+	pipelineCreateInfo.renderPass = renderPass;												//rener pass description the pipline should use
+	pipelineCreateInfo.subpass = 0;															//subpass of render pass to use with the pipeline
+
+	//pipeline derivatives : can create multiple pipelines that derive from on another for optimization
+	pipelineCreateInfo.basePipelineHandle = VK_NULL_HANDLE;									//existing pipeline to derive from
+	pipelineCreateInfo.basePipelineIndex = -1;												//or index of pipeline being created to derive in case creating multiple at once
+
+	//create graphics pipeline
+	VkPipeline pipeline;
+	VkResult result = vkCreateGraphicsPipelines(device, cache, 1, &pipelineCreateInfo, nullptr, &pipeline);
+
+	//Destroy shader modules, no longer needed after pipeline created (or failed to be)
+	if (hasFragmentShader) {
+		vkDestroyShaderModule(device, fragmentShaderModule, nullptr);
+	}
+	vkDestroyShaderModule(device, vertexShaderModule, nullptr);
+
+	if (result != VK_SUCCESS) {
+		throw std::runtime_error("failed to create a graphics pipeline");
+	}
+	return pipeline;
+}
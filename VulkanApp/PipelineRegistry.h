@@ -0,0 +1,140 @@
+#pragma once
+
+#define GLFW_INCLUDE_VULKAN
+#include <GLFW/glfw3.h>
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "Utilities.h"
+#include "PipelineCache.h"
+#include "VertexLayout.h"
+
+//background threads compiling requested pipelines
+const uint32_t PIPELINE_COMPILE_THREADS = 2;
+
+//shaders and fixed function state of a graphics pipeline, everything else (layout, render pass, vertex layout, depth direction) is shared
+struct PipelineDesc {
+	std::string vertexShader = "Shaders/vert.spv";
+	std::string fragmentShader = "Shaders/frag.spv";		//empty for a depth only pipeline
+	VkPrimitiveTopology topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
+	VkPolygonMode polygonMode = VK_POLYGON_MODE_FILL;
+	VkCullModeFlags cullMode = VK_CULL_MODE_BACK_BIT;
+	VkFrontFace frontFace = VK_FRONT_FACE_COUNTER_CLOCKWISE;
+	bool blendEnable = true;
+	bool colorWrite = true;
+	bool depthTest = true;							//less or equal, greater or equal with reversed depth, so draws after a depth prepass still pass
+	bool depthWrite = true;
+	bool positionOnly = false;						//reads only the position attribute, from the first vertex stream
+};
+
+//index of a pipeline within the registry, valid for the registry's lifetime
+typedef uint32_t PipelineHandle;
+
+struct PipelineRegistryStats {
+	uint32_t requested = 0;							//distinct pipelines
+	uint32_t reused = 0;							//requests answered with an existing pipeline
+	uint32_t compiled = 0;
+	uint32_t failed = 0;
+	uint32_t pending = 0;
+	double compileMs = 0.0;							//summed over compiles, on whichever thread ran them
+};
+
+//Graphics pipelines keyed by their shader files and fixed function state
+//request() returns a handle straight away and compiles on background threads (into the persistent cache, which the
+//driver synchronizes), so the frame loop never waits on a compile or a shader read, callers draw with a fallback until
+//getPipeline is non null
+class PipelineRegistry
+{
+public:
+	PipelineRegistry();
+
+	void init(VkDevice newDevice, PipelineCache* newPipelineCache, VkPipelineLayout newPipelineLayout, VkRenderPass newRenderPass,
+		VkExtent2D newExtent, const VertexLayout& newVertexLayout, bool newReverseDepth, uint32_t threadCount);
+	//waits for compiles in progress, drops queued ones, destroys every pipeline
+	void cleanup();
+
+	PipelineHandle request(const PipelineDesc& desc);
+	//compiles on the calling thread into cache and throws on failure, for pipelines that must exist before the first frame
+	PipelineHandle build(const PipelineDesc& desc, VkPipelineCache cache);
+
+	VkPipeline getPipeline(PipelineHandle handle);		//VK_NULL_HANDLE until compiled, or if compiling failed
+	const PipelineDesc& getDesc(PipelineHandle handle);
+	bool isReady(PipelineHandle handle);
+	bool isPending(PipelineHandle handle);				//false once compiled or failed, a failed pipeline never becomes ready
+	uint32_t getPipelineCount();
+	uint64_t getFinishedCount();							//compiles finished (or failed) so far, changes whenever a pipeline becomes ready
+	void waitIdle();
+
+	PipelineRegistryStats getStats();
+
+	~PipelineRegistry();
+
+private:
+	enum class PipelineState {
+		Pending,
+		Ready,
+		Failed
+	};
+
+	//what the hash covers, compared on lookup so a hash collision cant return the wrong pipeline
+	//shaders are keyed by path, their files are only read by whichever thread compiles the pipeline
+	struct PipelineKey {
+		std::string vertexShader;
+		std::string fragmentShader;
+		VkPrimitiveTopology topology;
+		VkPolygonMode polygonMode;
+		VkCullModeFlags cullMode;
+		VkFrontFace frontFace;
+		bool blendEnable;
+		bool colorWrite;
+		bool depthTest;
+		bool depthWrite;
+		bool positionOnly;
+
+		bool operator==(const PipelineKey& other) const;
+	};
+
+	struct PipelineEntry {
+		PipelineKey key;
+		PipelineDesc desc;
+		std::atomic<VkPipeline> pipeline;
+		std::atomic<PipelineState> state;
+	};
+
+	VkDevice device = VK_NULL_HANDLE;
+	PipelineCache* pipelineCache = nullptr;
+	VkPipelineLayout pipelineLayout = VK_NULL_HANDLE;
+	VkRenderPass renderPass = VK_NULL_HANDLE;
+	VkExtent2D extent = {};
+	VertexLayout vertexLayout;
+	bool reverseDepth = false;						//nearer fragments have greater depth
+
+	//only the thread that calls request/build adds entries, workers only touch the entry they were handed
+	std::deque<PipelineEntry> entries;
+	std::unordered_map<uint64_t, std::vector<PipelineHandle>> handlesByHash;
+
+	std::vector<std::thread> workers;
+	std::mutex mutex;
+	std::condition_variable workAvailable;
+	std::condition_variable workFinished;
+	std::deque<PipelineEntry*> queue;
+	uint32_t activeCompiles = 0;
+	bool stopping = false;
+
+	std::atomic<uint64_t> finishedCount;
+	PipelineRegistryStats stats;					//guarded by mutex
+
+	PipelineHandle findOrAdd(const PipelineDesc& desc, bool* added);
+	void workerLoop();
+	void compile(PipelineEntry* entry);
+	VkPipeline buildPipeline(const PipelineDesc& desc, VkPipelineCache cache);
+	VkShaderModule createShaderModule(const std::vector<char>& code);
+	void finish(PipelineEntry* entry, VkPipeline pipeline, double compileMs);
+};
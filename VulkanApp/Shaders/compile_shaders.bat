@@ -1,3 +1,5 @@
 C:/VulkanSDK/1.1.130.0/Bin32/glslangValidator.exe -V shader.vert
 C:/VulkanSDK/1.1.130.0/Bin32/glslangValidator.exe -V shader.frag
+C:/VulkanSDK/1.1.130.0/Bin32/glslangValidator.exe -V cull.comp
+C:/VulkanSDK/1.1.130.0/Bin32/glslangValidator.exe -V depth.vert -o depth.spv
 pause
\ No newline at end of file
@@ -0,0 +1,29 @@
+#version 450 		// Use GLSL 4.5
+
+//position only vertex shader of the depth prepass, no fragment stage follows
+layout(location = 0) in vec3 pos;
+
+layout(binding = 0) uniform UboViewProjection {
+	mat4 projection;
+	mat4 view;
+} uboViewProjection;
+
+//same object table as shader.vert
+struct ObjectData {
+	mat4 model;
+	vec4 positionScale;
+	vec4 positionOffset;
+};
+
+layout(std430, binding = 1) readonly buffer ObjectTable {
+	ObjectData objects[];
+} objectTable;
+
+//computed exactly as shader.vert does, so the colour pass passes an equal depth test against these depths
+invariant gl_Position;
+
+void main() {
+	ObjectData object = objectTable.objects[gl_InstanceIndex];
+	vec3 position = pos * object.positionScale.xyz + object.positionOffset.xyz;
+	gl_Position = uboViewProjection.projection * uboViewProjection.view * object.model * vec4(position, 1.0);
+}
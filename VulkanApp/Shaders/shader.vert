@@ -8,14 +8,27 @@ layout(binding = 0) uniform UboViewProjection {
 	mat4 view;
 } uboViewProjection;
 
-layout(binding = 1) uniform UboModel {
+//one entry per object, draws select theirs through firstInstance
+//compact vertex layouts store positions relative to the mesh bounds, positionScale / positionOffset map them back
+struct ObjectData {
 	mat4 model;
-} uboModel;
+	vec4 positionScale;
+	vec4 positionOffset;
+};
+
+layout(std430, binding = 1) readonly buffer ObjectTable {
+	ObjectData objects[];
+} objectTable;
 
 layout(location = 0) out vec3 fragCol;
 
+//computed exactly as depth.vert does, so fragments of the depth prepass and this pass get identical depths
+invariant gl_Position;
+
 void main() {
-	gl_Position = uboViewProjection.projection * uboViewProjection.view * uboModel.model * vec4(pos, 1.0);
+	ObjectData object = objectTable.objects[gl_InstanceIndex];
+	vec3 position = pos * object.positionScale.xyz + object.positionOffset.xyz;
+	gl_Position = uboViewProjection.projection * uboViewProjection.view * object.model * vec4(position, 1.0);
 
 	fragCol = col;
 }
\ No newline at end of file
@@ -0,0 +1,78 @@
+#include "StagingRing.h"
+
+StagingRing::StagingRing()
+{
+}
+
+void StagingRing::create(DeviceAllocator* newAllocator, VkDevice newDevice, VkDeviceSize newSize)
+{
+	allocator = newAllocator;
+	device = newDevice;
+	size = newSize;
+	head = 0;
+	used = 0;
+
+	//host coherent so writes need no flush, stays mapped for the ring's lifetime
+	createBuffer(allocator, device, size, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+		&buffer, &bufferAllocation);
+}
+
+void StagingRing::destroy()
+{
+	if (buffer == VK_NULL_HANDLE) return;
+
+	destroyBuffer(allocator, device, buffer, &bufferAllocation);
+	buffer = VK_NULL_HANDLE;
+}
+
+bool StagingRing::allocate(VkDeviceSize allocSize, VkDeviceSize alignment, VkDeviceSize* offset, void** data, VkDeviceSize* consumed)
+{
+	//an empty ring can start again from the beginning, avoiding a wrap
+	if (used == 0) {
+		head = 0;
+	}
+
+	VkDeviceSize start = (head + alignment - 1) / alignment * alignment;
+	if (start + allocSize > size) {
+		//doesnt fit before the end, skip the tail of the ring and wrap around
+		start = 0;
+		*consumed = (size - head) + allocSize;
+	}
+	else {
+		*consumed = (start - head) + allocSize;
+	}
+
+	//everything between the oldest unreleased reservation and head is in use
+	if (used + *consumed > size) return false;
+
+	used += *consumed;
+	head = start + allocSize;
+
+	*offset = start;
+	*data = static_cast<char*>(bufferAllocation.mapped) + start;
+	return true;
+}
+
+void StagingRing::release(VkDeviceSize consumed)
+{
+	used -= consumed;
+}
+
+VkBuffer StagingRing::getBuffer()
+{
+	return buffer;
+}
+
+VkDeviceSize StagingRing::getSize()
+{
+	return size;
+}
+
+VkDeviceSize StagingRing::getUsed()
+{
+	return used;
+}
+
+StagingRing::~StagingRing()
+{
+}
@@ -0,0 +1,39 @@
+#pragma once
+
+#define GLFW_INCLUDE_VULKAN
+#include <GLFW/glfw3.h>
+
+#include "Utilities.h"
+
+//Persistently mapped host visible buffer that staging data is packed into back to back
+//space is handed out circularly and given back in the same order once the GPU has copied it out
+class StagingRing
+{
+public:
+	StagingRing();
+
+	void create(DeviceAllocator* newAllocator, VkDevice newDevice, VkDeviceSize newSize);
+	void destroy();
+
+	//reserve size bytes, false if not enough space is free until earlier reservations are released
+	//consumed is the ring space used including alignment and wrap padding, pass it back to release
+	bool allocate(VkDeviceSize size, VkDeviceSize alignment, VkDeviceSize* offset, void** data, VkDeviceSize* consumed);
+	void release(VkDeviceSize consumed);
+
+	VkBuffer getBuffer();
+	VkDeviceSize getSize();
+	VkDeviceSize getUsed();
+
+	~StagingRing();
+
+private:
+	DeviceAllocator* allocator = nullptr;
+	VkDevice device = VK_NULL_HANDLE;
+
+	VkBuffer buffer = VK_NULL_HANDLE;
+	Allocation bufferAllocation;
+	VkDeviceSize size = 0;
+
+	VkDeviceSize head = 0;							//next offset to allocate from
+	VkDeviceSize used = 0;							//space reserved and not yet released
+};
@@ -0,0 +1,104 @@
+#include "ThreadPool.h"
+
+#include <algorithm>
+
+ThreadPool::ThreadPool()
+{
+}
+
+void ThreadPool::start(uint32_t threadCount)
+{
+	stop();
+
+	if (threadCount == 0) {
+		threadCount = std::max(1u, std::thread::hardware_concurrency());
+	}
+
+	stopping = false;
+	for (uint32_t i = 0; i < threadCount; i++) {
+		workers.emplace_back(&ThreadPool::workerLoop, this);
+	}
+}
+
+void ThreadPool::stop()
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		stopping = true;
+	}
+	workAvailable.notify_all();
+
+	for (auto& worker : workers) {
+		worker.join();
+	}
+	workers.clear();
+}
+
+void ThreadPool::run(uint32_t newTaskCount, const std::function<void(uint32_t)>& task)
+{
+	if (newTaskCount == 0) return;
+
+	//no workers, run inline
+	if (workers.empty()) {
+		for (uint32_t i = 0; i < newTaskCount; i++) {
+			task(i);
+		}
+		return;
+	}
+
+	std::unique_lock<std::mutex> lock(mutex);
+	currentTask = &task;
+	taskCount = newTaskCount;
+	nextTask = 0;
+	finishedTasks = 0;
+	failure = nullptr;
+	workAvailable.notify_all();
+
+	workFinished.wait(lock, [this] { return finishedTasks == taskCount; });
+	currentTask = nullptr;
+	taskCount = 0;
+
+	if (failure) {
+		std::rethrow_exception(failure);
+	}
+}
+
+uint32_t ThreadPool::getThreadCount()
+{
+	return static_cast<uint32_t>(workers.size());
+}
+
+ThreadPool::~ThreadPool()
+{
+	stop();
+}
+
+void ThreadPool::workerLoop()
+{
+	std::unique_lock<std::mutex> lock(mutex);
+	while (true) {
+		workAvailable.wait(lock, [this] { return stopping || nextTask < taskCount; });
+		if (stopping) return;
+
+		uint32_t index = nextTask++;
+		const std::function<void(uint32_t)>& task = *currentTask;
+
+		//run without the lock so other workers can take tasks meanwhile
+		lock.unlock();
+		std::exception_ptr taskFailure;
+		try {
+			task(index);
+		}
+		catch (...) {
+			taskFailure = std::current_exception();
+		}
+		lock.lock();
+
+		if (taskFailure && !failure) {
+			failure = taskFailure;
+		}
+		if (++finishedTasks == taskCount) {
+			workFinished.notify_one();
+		}
+	}
+}
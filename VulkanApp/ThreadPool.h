@@ -0,0 +1,43 @@
+#pragma once
+
+#include <condition_variable>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+//Fixed set of worker threads that run a batch of indexed tasks and wait for all of them
+//task indices are handed out once each, so per task resources (e.g. command pools) need no locking
+class ThreadPool
+{
+public:
+	ThreadPool();
+
+	//0 uses one thread per hardware thread
+	void start(uint32_t threadCount);
+	void stop();
+
+	//runs task(i) for every i below taskCount, returns once all have finished, rethrows the first failure
+	void run(uint32_t taskCount, const std::function<void(uint32_t)>& task);
+
+	uint32_t getThreadCount();
+
+	~ThreadPool();
+
+private:
+	std::vector<std::thread> workers;
+
+	std::mutex mutex;
+	std::condition_variable workAvailable;
+	std::condition_variable workFinished;
+
+	const std::function<void(uint32_t)>* currentTask = nullptr;
+	uint32_t taskCount = 0;
+	uint32_t nextTask = 0;
+	uint32_t finishedTasks = 0;
+	std::exception_ptr failure;
+	bool stopping = false;
+
+	void workerLoop();
+};
@@ -0,0 +1,78 @@
+#include "UniformRing.h"
+
+UniformRing::UniformRing()
+{
+}
+
+void UniformRing::create(DeviceAllocator* newAllocator, VkDevice newDevice, VkBufferUsageFlags usage, VkDeviceSize newAlignment, VkDeviceSize newSegmentSize, uint32_t newSegmentCount)
+{
+	allocator = newAllocator;
+	device = newDevice;
+	alignment = newAlignment;
+	segmentCount = newSegmentCount;
+
+	//segments start on aligned offsets so every range within them is aligned too
+	segmentSize = alignSize(newSegmentSize);
+
+	//host visible and coherent: writes need no flush, memory stays mapped for the ring's lifetime
+	createBuffer(allocator, device, segmentSize * segmentCount, usage,
+		VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, &buffer, &bufferAllocation);
+
+	beginSegment(0);
+}
+
+void UniformRing::destroy()
+{
+	if (buffer == VK_NULL_HANDLE) return;
+
+	destroyBuffer(allocator, device, buffer, &bufferAllocation);
+	buffer = VK_NULL_HANDLE;
+	segmentData = nullptr;
+}
+
+void UniformRing::beginSegment(uint32_t segment)
+{
+	segmentData = static_cast<char*>(bufferAllocation.mapped) + getSegmentOffset(segment);
+	head = 0;
+}
+
+UniformRange UniformRing::allocate(VkDeviceSize size)
+{
+	VkDeviceSize alignedSize = alignSize(size);
+	if (head + alignedSize > segmentSize) {
+		throw std::runtime_error("uniform ring segment is full");
+	}
+
+	UniformRange range;
+	range.data = segmentData + head;
+	range.offset = head;
+	range.size = alignedSize;
+
+	head += alignedSize;
+	return range;
+}
+
+VkDeviceSize UniformRing::alignSize(VkDeviceSize size)
+{
+	//alignment is always a power of two
+	return (size + alignment - 1) & ~(alignment - 1);
+}
+
+VkBuffer UniformRing::getBuffer()
+{
+	return buffer;
+}
+
+VkDeviceSize UniformRing::getSegmentOffset(uint32_t segment)
+{
+	return segmentSize * segment;
+}
+
+VkDeviceSize UniformRing::getSegmentSize()
+{
+	return segmentSize;
+}
+
+UniformRing::~UniformRing()
+{
+}
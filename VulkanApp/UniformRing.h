@@ -0,0 +1,49 @@
+#pragma once
+
+#define GLFW_INCLUDE_VULKAN
+#include <GLFW/glfw3.h>
+
+#include "Utilities.h"
+
+//range of the ring handed out for the current frame
+struct UniformRange {
+	void* data = nullptr;						//persistently mapped, write directly
+	VkDeviceSize offset = 0;					//from the start of the segment, usable as a dynamic offset
+	VkDeviceSize size = 0;
+};
+
+//Persistently mapped uniform (and storage) buffer split into one segment per frame in flight
+//callers bump allocate aligned ranges from the current segment each frame and write straight into them
+class UniformRing
+{
+public:
+	UniformRing();
+
+	void create(DeviceAllocator* newAllocator, VkDevice newDevice, VkBufferUsageFlags usage, VkDeviceSize newAlignment, VkDeviceSize newSegmentSize, uint32_t newSegmentCount);
+	void destroy();
+
+	//segment must no longer be read by the GPU
+	void beginSegment(uint32_t segment);
+	UniformRange allocate(VkDeviceSize size);
+	VkDeviceSize alignSize(VkDeviceSize size);
+
+	VkBuffer getBuffer();
+	VkDeviceSize getSegmentOffset(uint32_t segment);
+	VkDeviceSize getSegmentSize();
+
+	~UniformRing();
+
+private:
+	DeviceAllocator* allocator = nullptr;
+	VkDevice device = VK_NULL_HANDLE;
+
+	VkBuffer buffer = VK_NULL_HANDLE;
+	Allocation bufferAllocation;
+
+	VkDeviceSize alignment = 1;					//offset alignment of every descriptor type read from the ring
+	VkDeviceSize segmentSize = 0;
+	uint32_t segmentCount = 0;
+
+	char* segmentData = nullptr;				//mapped start of the current segment
+	VkDeviceSize head = 0;						//next free offset within the current segment
+};
@@ -0,0 +1,455 @@
+#include "UploadService.h"
+
+#include <algorithm>
+#include <limits>
+
+UploadService::UploadService()
+{
+}
+
+void UploadService::init(DeviceAllocator* newAllocator, VkDevice newDevice, VkQueue newTransferQueue, uint32_t newTransferFamily,
+	VkQueue newGraphicsQueue, uint32_t newGraphicsFamily, GpuTimeline* newTimeline)
+{
+	allocator = newAllocator;
+	device = newDevice;
+	transferQueue = newTransferQueue;
+	transferFamily = newTransferFamily;
+	graphicsQueue = newGraphicsQueue;
+	graphicsFamily = newGraphicsFamily;
+	timeline = newTimeline;
+
+	//command buffers are reused by batches, so must be individually resettable
+	VkCommandPoolCreateInfo poolInfo = {};
+	poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+	poolInfo.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
+	poolInfo.queueFamilyIndex = transferFamily;
+
+	VkResult result = vkCreateCommandPool(device, &poolInfo, nullptr, &transferCommandPool);
+	if (result != VK_SUCCESS) {
+		throw std::runtime_error("Failed to create the upload command pool");
+	}
+
+	//acquire barriers have to be executed by the graphics queue family
+	if (hasDedicatedTransferQueue()) {
+		poolInfo.queueFamilyIndex = graphicsFamily;
+		result = vkCreateCommandPool(device, &poolInfo, nullptr, &acquireCommandPool);
+		if (result != VK_SUCCESS) {
+			throw std::runtime_error("Failed to create the upload acquire command pool");
+		}
+	}
+
+	stagingRing.create(allocator, device, STAGING_RING_SIZE);
+}
+
+UploadTicket UploadService::uploadBuffer(VkBuffer dstBuffer, VkDeviceSize dstOffset, const void* data, VkDeviceSize size,
+	VkPipelineStageFlags dstStage, VkAccessFlags dstAccess)
+{
+	//nothing to copy, already "complete"
+	if (size == 0) return completedTicket;
+
+	VkBuffer srcBuffer;
+	VkDeviceSize srcOffset;
+	void* staging = allocateStaging(size, &srcBuffer, &srcOffset);
+	memcpy(staging, data, (size_t)size);
+
+	//regen of data to copy from and to
+	PendingCopy copy;
+	copy.src = srcBuffer;
+	copy.dst = dstBuffer;
+	copy.region.srcOffset = srcOffset;
+	copy.region.dstOffset = dstOffset;
+	copy.region.size = size;
+	openBatch.copies.push_back(copy);
+
+	//graphics side barrier, with a dedicated transfer queue it also acquires ownership of the buffer
+	VkBufferMemoryBarrier barrier = {};
+	barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+	barrier.dstAccessMask = dstAccess;
+	barrier.buffer = dstBuffer;
+	barrier.offset = dstOffset;
+	barrier.size = size;
+	if (hasDedicatedTransferQueue()) {
+		barrier.srcAccessMask = 0;												//writes were made available by the release barrier
+		barrier.srcQueueFamilyIndex = transferFamily;
+		barrier.dstQueueFamilyIndex = graphicsFamily;
+	}
+	else {
+		barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	}
+	openBatch.acquireBarriers.push_back(barrier);
+	openBatch.dstStages |= dstStage;
+	openBatch.bytes += size;
+
+	UploadTicket ticket = openBatch.ticket;
+	if (openBatch.bytes >= UPLOAD_BATCH_BYTES) {
+		flush();
+	}
+	return ticket;
+}
+
+void UploadService::flush()
+{
+	retireBatches();
+	if (!batchOpen) return;
+
+	UploadBatch& batch = openBatch;
+	recordCopies(batch);
+
+	uint32_t barrierCount = static_cast<uint32_t>(batch.acquireBarriers.size());
+	VkResult result;
+
+	//the graphics queue submission marks the batch complete, by signalling the next timeline value when there is a timeline
+	VkSemaphore timelineSemaphore = VK_NULL_HANDLE;
+	VkTimelineSemaphoreSubmitInfoKHR timelineInfo = {};
+	timelineInfo.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO_KHR;
+	if (timeline->isEnabled()) {
+		timelineSemaphore = timeline->getSemaphore();
+		batch.timelineValue = timeline->nextValue();
+		timelineInfo.signalSemaphoreValueCount = 1;
+		timelineInfo.pSignalSemaphoreValues = &batch.timelineValue;
+	}
+
+	if (hasDedicatedTransferQueue()) {
+		//release ownership on the transfer queue, making the copies available
+		std::vector<VkBufferMemoryBarrier> releaseBarriers = batch.acquireBarriers;
+		for (auto& releaseBarrier : releaseBarriers) {
+			releaseBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+			releaseBarrier.dstAccessMask = 0;
+		}
+		vkCmdPipelineBarrier(batch.transferCommands, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0,
+			0, nullptr, barrierCount, releaseBarriers.data(), 0, nullptr);
+		vkEndCommandBuffer(batch.transferCommands);
+
+		VkSubmitInfo transferSubmit = {};
+		transferSubmit.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+		transferSubmit.commandBufferCount = 1;
+		transferSubmit.pCommandBuffers = &batch.transferCommands;
+		transferSubmit.signalSemaphoreCount = 1;
+		transferSubmit.pSignalSemaphores = &batch.transferComplete;
+
+		result = vkQueueSubmit(transferQueue, 1, &transferSubmit, VK_NULL_HANDLE);
+		if (result != VK_SUCCESS) {
+			throw std::runtime_error("failed to submit uploads to the transfer queue");
+		}
+
+		//acquire ownership on the graphics queue once the copies finish, later graphics submissions are ordered after it
+		VkCommandBufferBeginInfo beginInfo = {};
+		beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+		beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+		vkBeginCommandBuffer(batch.acquireCommands, &beginInfo);
+		vkCmdPipelineBarrier(batch.acquireCommands, batch.dstStages, batch.dstStages, 0,
+			0, nullptr, barrierCount, batch.acquireBarriers.data(), 0, nullptr);
+		vkEndCommandBuffer(batch.acquireCommands);
+
+		VkSubmitInfo acquireSubmit = {};
+		acquireSubmit.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+		acquireSubmit.waitSemaphoreCount = 1;
+		acquireSubmit.pWaitSemaphores = &batch.transferComplete;
+		acquireSubmit.pWaitDstStageMask = &batch.dstStages;
+		acquireSubmit.commandBufferCount = 1;
+		acquireSubmit.pCommandBuffers = &batch.acquireCommands;
+		if (timeline->isEnabled()) {
+			acquireSubmit.pNext = &timelineInfo;
+			acquireSubmit.signalSemaphoreCount = 1;
+			acquireSubmit.pSignalSemaphores = &timelineSemaphore;
+		}
+
+		result = vkQueueSubmit(graphicsQueue, 1, &acquireSubmit, batch.fence);
+	}
+	else {
+		//same queue family: one barrier from the copies to the stages that read the data
+		vkCmdPipelineBarrier(batch.transferCommands, VK_PIPELINE_STAGE_TRANSFER_BIT, batch.dstStages, 0,
+			0, nullptr, barrierCount, batch.acquireBarriers.data(), 0, nullptr);
+		vkEndCommandBuffer(batch.transferCommands);
+
+		VkSubmitInfo submitInfo = {};
+		submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+		submitInfo.commandBufferCount = 1;
+		submitInfo.pCommandBuffers = &batch.transferCommands;
+		if (timeline->isEnabled()) {
+			submitInfo.pNext = &timelineInfo;
+			submitInfo.signalSemaphoreCount = 1;
+			submitInfo.pSignalSemaphores = &timelineSemaphore;
+		}
+
+		result = vkQueueSubmit(graphicsQueue, 1, &submitInfo, batch.fence);
+	}
+	if (result != VK_SUCCESS) {
+		throw std::runtime_error("failed to submit uploads to the graphics queue");
+	}
+	batch.submitTime = std::chrono::steady_clock::now();
+
+	inFlightBatches.push_back(std::move(openBatch));
+	openBatch = UploadBatch();
+	batchOpen = false;
+}
+
+bool UploadService::isComplete(UploadTicket ticket)
+{
+	if (ticket <= completedTicket) return true;
+
+	retireBatches();
+	return ticket <= completedTicket;
+}
+
+void UploadService::wait(UploadTicket ticket)
+{
+	if (ticket <= completedTicket) return;
+
+	//uploads still being recorded have to be submitted before they can finish
+	if (batchOpen && ticket >= openBatch.ticket) {
+		flush();
+	}
+
+	//batches finish in submission order, so the last one up to the ticket is the one to wait for
+	UploadBatch* lastBatch = nullptr;
+	for (auto& batch : inFlightBatches) {
+		if (batch.ticket > ticket) break;
+		lastBatch = &batch;
+	}
+	if (lastBatch != nullptr) {
+		waitForBatch(*lastBatch);
+	}
+	retireBatches();
+}
+
+void UploadService::waitAll()
+{
+	wait(nextTicket - 1);
+}
+
+bool UploadService::hasDedicatedTransferQueue()
+{
+	return transferFamily != graphicsFamily;
+}
+
+UploadStats UploadService::getStats()
+{
+	retireBatches();
+	return stats;
+}
+
+void UploadService::cleanup()
+{
+	if (device == VK_NULL_HANDLE) return;
+
+	waitAll();
+	for (auto& batch : freeBatches) {
+		destroyBatch(batch);
+	}
+	freeBatches.clear();
+	stagingRing.destroy();
+
+	//destroying pools frees their command buffers
+	vkDestroyCommandPool(device, transferCommandPool, nullptr);
+	if (acquireCommandPool != VK_NULL_HANDLE) {
+		vkDestroyCommandPool(device, acquireCommandPool, nullptr);
+	}
+	device = VK_NULL_HANDLE;
+}
+
+UploadService::~UploadService()
+{
+}
+
+void UploadService::beginBatch()
+{
+	//reuse a retired batch's command buffers and sync objects if there is one
+	if (!freeBatches.empty()) {
+		openBatch = std::move(freeBatches.back());
+		freeBatches.pop_back();
+	}
+	else {
+		openBatch = UploadBatch();
+
+		VkCommandBufferAllocateInfo allocInfo = {};
+		allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+		allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+		allocInfo.commandPool = transferCommandPool;
+		allocInfo.commandBufferCount = 1;
+		VkResult result = vkAllocateCommandBuffers(device, &allocInfo, &openBatch.transferCommands);
+		if (result != VK_SUCCESS) {
+			throw std::runtime_error("failed to allocate an upload command buffer");
+		}
+
+		if (hasDedicatedTransferQueue()) {
+			allocInfo.commandPool = acquireCommandPool;
+			result = vkAllocateCommandBuffers(device, &allocInfo, &openBatch.acquireCommands);
+			if (result != VK_SUCCESS) {
+				throw std::runtime_error("failed to allocate an upload acquire command buffer");
+			}
+
+			VkSemaphoreCreateInfo semaphoreCreateInfo = {};
+			semaphoreCreateInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+			result = vkCreateSemaphore(device, &semaphoreCreateInfo, nullptr, &openBatch.transferComplete);
+			if (result != VK_SUCCESS) {
+				throw std::runtime_error("failed to create an upload semaphore");
+			}
+		}
+
+		//on the timeline the batch is tracked by the value its submission signals instead
+		if (!timeline->isEnabled()) {
+			VkFenceCreateInfo fenceCreateInfo = {};
+			fenceCreateInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+			result = vkCreateFence(device, &fenceCreateInfo, nullptr, &openBatch.fence);
+			if (result != VK_SUCCESS) {
+				throw std::runtime_error("failed to create an upload fence");
+			}
+		}
+	}
+
+	openBatch.ticket = nextTicket++;
+	batchOpen = true;
+}
+
+void* UploadService::allocateStaging(VkDeviceSize size, VkBuffer* srcBuffer, VkDeviceSize* srcOffset)
+{
+	//too big to ever fit the ring: temporary buffer to "stage" data, freed once the batch retires
+	if (size > stagingRing.getSize()) {
+		if (!batchOpen) {
+			beginBatch();
+		}
+
+		Allocation stagingAllocation;
+		createBuffer(allocator, device, size, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+			srcBuffer, &stagingAllocation, MemoryLifetime::Transient);
+		openBatch.stagingBuffers.push_back(*srcBuffer);
+		openBatch.stagingAllocations.push_back(stagingAllocation);
+
+		*srcOffset = 0;
+		return stagingAllocation.mapped;
+	}
+
+	void* data;
+	VkDeviceSize consumed;
+	while (!stagingRing.allocate(size, STAGING_ALIGNMENT, srcOffset, &data, &consumed)) {
+		//ring is full of data not yet copied out: submit what is recorded, then wait for the oldest batch to give space back
+		if (batchOpen) {
+			flush();
+			continue;
+		}
+		if (inFlightBatches.empty()) {
+			throw std::runtime_error("staging ring exhausted with no uploads in flight");
+		}
+		waitForBatch(inFlightBatches.front());
+		retireBatches();
+	}
+
+	//may have flushed above, so the batch is opened after space is found
+	if (!batchOpen) {
+		beginBatch();
+	}
+	openBatch.stagingConsumed += consumed;
+
+	*srcBuffer = stagingRing.getBuffer();
+	return data;
+}
+
+void UploadService::recordCopies(UploadBatch& batch)
+{
+	//only submitted once, re-recorded when the batch is reused
+	VkCommandBufferBeginInfo beginInfo = {};
+	beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+	beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+	vkBeginCommandBuffer(batch.transferCommands, &beginInfo);
+
+	//group by source and destination so each pair is a single copy command with many regions
+	std::stable_sort(batch.copies.begin(), batch.copies.end(), [](const PendingCopy& a, const PendingCopy& b) {
+		if (a.src != b.src) return a.src < b.src;
+		return a.dst < b.dst;
+	});
+
+	std::vector<VkBufferCopy> regions;
+	size_t first = 0;
+	while (first < batch.copies.size()) {
+		size_t last = first;
+		regions.clear();
+		while (last < batch.copies.size() && batch.copies[last].src == batch.copies[first].src && batch.copies[last].dst == batch.copies[first].dst) {
+			regions.push_back(batch.copies[last].region);
+			last++;
+		}
+
+		vkCmdCopyBuffer(batch.transferCommands, batch.copies[first].src, batch.copies[first].dst, static_cast<uint32_t>(regions.size()), regions.data());
+		batch.copyCommands++;
+		first = last;
+	}
+}
+
+bool UploadService::isBatchComplete(UploadBatch& batch)
+{
+	if (timeline->isEnabled()) {
+		return timeline->isComplete(batch.timelineValue);
+	}
+	return vkGetFenceStatus(device, batch.fence) == VK_SUCCESS;
+}
+
+void UploadService::waitForBatch(UploadBatch& batch)
+{
+	if (timeline->isEnabled()) {
+		timeline->wait(batch.timelineValue);
+		return;
+	}
+	vkWaitForFences(device, 1, &batch.fence, VK_TRUE, std::numeric_limits<uint64_t>::max());
+}
+
+void UploadService::retireBatches()
+{
+	//batches finish in submission order, stop at the first still running
+	while (!inFlightBatches.empty() && isBatchComplete(inFlightBatches.front())) {
+		UploadBatch batch = std::move(inFlightBatches.front());
+		inFlightBatches.pop_front();
+
+		completedTicket = batch.ticket;
+
+		std::chrono::duration<double, std::milli> batchTime = std::chrono::steady_clock::now() - batch.submitTime;
+		stats.batches++;
+		stats.uploads += batch.copies.size();
+		stats.copyCommands += batch.copyCommands;
+		stats.bytes += batch.bytes;
+		stats.totalMs += batchTime.count();
+		stats.averageMBps = stats.totalMs > 0.0 ? (stats.bytes / (1024.0 * 1024.0)) / (stats.totalMs / 1000.0) : 0.0;
+		stats.lastBatchUploads = batch.copies.size();
+		stats.lastBatchCopyCommands = batch.copyCommands;
+		stats.lastBatchBytes = batch.bytes;
+		stats.lastBatchMs = batchTime.count();
+		stats.lastBatchMBps = batchTime.count() > 0.0 ? (batch.bytes / (1024.0 * 1024.0)) / (batchTime.count() / 1000.0) : 0.0;
+
+		releaseStaging(batch);
+		if (batch.fence != VK_NULL_HANDLE) {
+			vkResetFences(device, 1, &batch.fence);
+		}
+		batch.copies.clear();
+		batch.acquireBarriers.clear();
+		batch.dstStages = 0;
+		batch.bytes = 0;
+		batch.copyCommands = 0;
+
+		freeBatches.push_back(std::move(batch));
+	}
+}
+
+void UploadService::releaseStaging(UploadBatch& batch)
+{
+	//batches retire in submission order, matching the order ring space was handed out
+	stagingRing.release(batch.stagingConsumed);
+	batch.stagingConsumed = 0;
+
+	for (size_t i = 0; i < batch.stagingBuffers.size(); i++) {
+		destroyBuffer(allocator, device, batch.stagingBuffers[i], &batch.stagingAllocations[i]);
+	}
+	batch.stagingBuffers.clear();
+	batch.stagingAllocations.clear();
+}
+
+void UploadService::destroyBatch(UploadBatch& batch)
+{
+	releaseStaging(batch);
+	if (batch.transferComplete != VK_NULL_HANDLE) {
+		vkDestroySemaphore(device, batch.transferComplete, nullptr);
+	}
+	if (batch.fence != VK_NULL_HANDLE) {
+		vkDestroyFence(device, batch.fence, nullptr);
+	}
+}
@@ -0,0 +1,130 @@
+#pragma once
+
+#define GLFW_INCLUDE_VULKAN
+#include <GLFW/glfw3.h>
+
+#include <chrono>
+#include <deque>
+#include <vector>
+
+#include "Utilities.h"
+#include "StagingRing.h"
+#include "GpuTimeline.h"
+
+//open batch is submitted once it holds this much data, or on flush
+const VkDeviceSize UPLOAD_BATCH_BYTES = 32 * 1024 * 1024;
+
+//shared staging memory, uploads larger than this get their own staging buffer
+const VkDeviceSize STAGING_RING_SIZE = 64 * 1024 * 1024;
+const VkDeviceSize STAGING_ALIGNMENT = 16;
+
+struct UploadStats {
+	uint64_t batches = 0;
+	uint64_t uploads = 0;
+	uint64_t copyCommands = 0;						//vkCmdCopyBuffer calls, each covering one or more regions
+	VkDeviceSize bytes = 0;
+	double totalMs = 0.0;							//submit until completion was seen, summed over batches
+	double averageMBps = 0.0;
+
+	//most recently completed batch
+	uint64_t lastBatchUploads = 0;
+	uint64_t lastBatchCopyCommands = 0;
+	VkDeviceSize lastBatchBytes = 0;
+	double lastBatchMs = 0.0;
+	double lastBatchMBps = 0.0;
+};
+
+//identifies the batch an upload was recorded into, completes when that batch's copies are visible to rendering
+typedef uint64_t UploadTicket;
+
+//Copies data into device local buffers without stalling the caller or the graphics queue
+//uploads are batched into one submit, run on a dedicated transfer queue when the device has one,
+//and handed over to the graphics queue family with release/acquire barriers
+//a batch's graphics queue submission signals the shared timeline when it is enabled, otherwise the batch's own fence
+//not thread safe, it submits to the graphics queue so must be used from the rendering thread
+class UploadService
+{
+public:
+	UploadService();
+
+	void init(DeviceAllocator* newAllocator, VkDevice newDevice, VkQueue newTransferQueue, uint32_t newTransferFamily,
+		VkQueue newGraphicsQueue, uint32_t newGraphicsFamily, GpuTimeline* newTimeline);
+
+	//copy data into dstBuffer, which is then read at dstStage with dstAccess (e.g. vertex input / vertex attribute read)
+	UploadTicket uploadBuffer(VkBuffer dstBuffer, VkDeviceSize dstOffset, const void* data, VkDeviceSize size,
+		VkPipelineStageFlags dstStage, VkAccessFlags dstAccess);
+
+	//submit the open batch, graphics work submitted afterwards sees its data without a CPU wait
+	void flush();
+
+	bool isComplete(UploadTicket ticket);
+	void wait(UploadTicket ticket);
+	void waitAll();
+
+	bool hasDedicatedTransferQueue();
+
+	//throughput is timed from submit until the CPU sees completion, so it reads low when completion is only polled
+	UploadStats getStats();
+
+	void cleanup();
+
+	~UploadService();
+
+private:
+	struct PendingCopy {
+		VkBuffer src;
+		VkBuffer dst;
+		VkBufferCopy region;
+	};
+
+	struct UploadBatch {
+		UploadTicket ticket = 0;
+		VkCommandBuffer transferCommands = VK_NULL_HANDLE;
+		VkCommandBuffer acquireCommands = VK_NULL_HANDLE;			//graphics family side of the ownership transfer
+		VkSemaphore transferComplete = VK_NULL_HANDLE;
+		VkFence fence = VK_NULL_HANDLE;								//signals once data is visible to the graphics queue, null on the timeline
+		uint64_t timelineValue = 0;									//timeline equivalent of the fence
+
+		//copies are recorded at flush so regions sharing a source and destination go in one command
+		std::vector<PendingCopy> copies;
+		std::vector<VkBufferMemoryBarrier> acquireBarriers;
+		VkPipelineStageFlags dstStages = 0;
+		VkDeviceSize stagingConsumed = 0;							//ring space to release on retire
+		std::vector<VkBuffer> stagingBuffers;						//oversized uploads that bypassed the ring
+		std::vector<Allocation> stagingAllocations;
+		VkDeviceSize bytes = 0;
+		uint32_t copyCommands = 0;
+		std::chrono::steady_clock::time_point submitTime;
+	};
+
+	DeviceAllocator* allocator = nullptr;
+	VkDevice device = VK_NULL_HANDLE;
+	VkQueue transferQueue = VK_NULL_HANDLE;
+	VkQueue graphicsQueue = VK_NULL_HANDLE;
+	uint32_t transferFamily = 0;
+	uint32_t graphicsFamily = 0;
+	GpuTimeline* timeline = nullptr;
+
+	VkCommandPool transferCommandPool = VK_NULL_HANDLE;
+	VkCommandPool acquireCommandPool = VK_NULL_HANDLE;
+
+	StagingRing stagingRing;
+	UploadStats stats;
+
+	UploadTicket nextTicket = 1;
+	UploadTicket completedTicket = 0;								//every ticket up to here is complete
+
+	bool batchOpen = false;
+	UploadBatch openBatch;
+	std::deque<UploadBatch> inFlightBatches;						//submitted, in ticket order
+	std::vector<UploadBatch> freeBatches;							//retired, command buffers and sync objects reused
+
+	void beginBatch();
+	void* allocateStaging(VkDeviceSize size, VkBuffer* srcBuffer, VkDeviceSize* srcOffset);
+	void recordCopies(UploadBatch& batch);
+	bool isBatchComplete(UploadBatch& batch);
+	void waitForBatch(UploadBatch& batch);
+	void retireBatches();
+	void releaseStaging(UploadBatch& batch);
+	void destroyBatch(UploadBatch& batch);
+};
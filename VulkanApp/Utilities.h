@@ -1,11 +1,38 @@
 #pragma once
 #include <fstream>
+#include <cstring>
+#include <cstdlib>
+#include <stdexcept>
+#include <string>
+#include <vector>
 
 #define GLFW_INCLUDE_VULKAN
 #include<GLFW/glfw3.h>
-#include <glm/glm.hpp>>
-const int MAX_FRAME_DRAWS = 2;
-const int MAX_OBJECTS = 2;
+#include <glm/glm.hpp>
+
+#include "DeviceAllocator.h"
+
+//most frames the CPU may have in flight, the renderer creates one frame context per frame and uses DEFAULT_FRAMES_IN_FLIGHT unless told otherwise
+const int MAX_FRAME_DRAWS = 3;
+const int DEFAULT_FRAMES_IN_FLIGHT = 2;
+const int INITIAL_OBJECT_CAPACITY = 1024;		//object table slots allocated up front, doubles as meshes are created
+
+//most draw batches timed with their own GPU timestamps per frame, larger scenes are split evenly
+const int MAX_TIMESTAMP_BATCHES = 32;
+
+//fewest draws worth handing to a separate recording thread, smaller scenes record on fewer threads
+const int MIN_DRAWS_PER_RECORDING_TASK = 512;
+
+//submitted frames whose latency is kept for getFrameLatencyHistory
+const int FRAME_LATENCY_HISTORY = 256;
+
+//screen space error, in pixels, a level of detail may have where it is drawn
+const float DEFAULT_LOD_THRESHOLD = 1.0f;
+//fraction of the threshold a coarser level must fit under before it replaces the current one, so objects near a boundary dont flicker
+const float LOD_COARSEN_FACTOR = 0.8f;
+
+//format of the offscreen colour images used when running without a window
+const VkFormat OFFSCREEN_IMAGE_FORMAT = VK_FORMAT_R8G8B8A8_UNORM;
 
 const std::vector<const char*> deviceExtensions = {
 	VK_KHR_SWAPCHAIN_EXTENSION_NAME
@@ -21,6 +48,7 @@ struct Vertex {
 struct QueueFamilyIndices {
 	int graphicsFamily = -1;				//Location of Graphics Queue Family
 	int presentationFamily = -1;			//Location of Presentation Family
+	int transferFamily = -1;				//Location of Transfer Family, a transfer only family if there is one, otherwise graphics
 	//Check if Queue families are valid
 	bool isValid() {
 		return graphicsFamily >= 0 && presentationFamily >= 0;
@@ -66,23 +94,7 @@ static std::vector<char> readFile(const std::string& filename) {
 	return fileBuffer;
 }
 
-static uint32_t findMemoryTypeIndex(VkPhysicalDevice physicalDevice, uint32_t allowedTypes, VkMemoryPropertyFlags properties)
-{
-	//get properties of physical device memory
-	VkPhysicalDeviceMemoryProperties memoryProperties;
-	vkGetPhysicalDeviceMemoryProperties(physicalDevice, &memoryProperties);
-
-	for (uint32_t i = 0; i < memoryProperties.memoryTypeCount; i++) {
-		if ((allowedTypes & (1 << i))
-			&& (memoryProperties.memoryTypes[i].propertyFlags & properties) == properties)
-		{
-			//this memory type is valid, return index
-			return i;
-		}
-	}
-}
-
-static void createBuffer(VkPhysicalDevice physicalDevice, VkDevice device, VkDeviceSize bufferSize, VkBufferUsageFlags bufferUsage, VkMemoryPropertyFlags bufferProperties, VkBuffer* buffer, VkDeviceMemory* bufferMemory) {
+static void createBuffer(DeviceAllocator* allocator, VkDevice device, VkDeviceSize bufferSize, VkBufferUsageFlags bufferUsage, VkMemoryPropertyFlags bufferProperties, VkBuffer* buffer, Allocation* bufferAllocation, MemoryLifetime lifetime = MemoryLifetime::Persistent) {
 	//information to create a buffer, doenst include assignming memory
 	VkBufferCreateInfo bufferInfo = {};
 	bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
@@ -99,68 +111,16 @@ static void createBuffer(VkPhysicalDevice physicalDevice, VkDevice device, VkDev
 	VkMemoryRequirements memRequirements;
 	vkGetBufferMemoryRequirements(device, *buffer, &memRequirements);
 
-	//allocate memory to buffer
-	VkMemoryAllocateInfo memoryAllocInfo = {};
-	memoryAllocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-	memoryAllocInfo.allocationSize = memRequirements.size;
-	memoryAllocInfo.memoryTypeIndex = findMemoryTypeIndex(physicalDevice, memRequirements.memoryTypeBits, bufferProperties);																//index of memory type on physical device that has required bit flags
-																																															//host visible bit: CPU can interact with memory, host coherent bit: allows placement of data straight into buffer after mapping othterwise would have to specify manually
-	//allocate memory to vkdevicememory
-	result = vkAllocateMemory(device, &memoryAllocInfo, nullptr, bufferMemory);
-	if (result != VK_SUCCESS) {
-		throw std::runtime_error("failed to allocate vertex buffer memory");
-	}
+	//sub-allocate from a shared block of a memory type that has the required bit flags
+	//host visible bit: CPU can interact with memory (stays mapped), host coherent bit: allows placement of data straight into buffer othterwise would have to flush manually
+	*bufferAllocation = allocator->allocate(memRequirements, bufferProperties, lifetime, ResourceTiling::Linear);
 
-	//allocate memory to given vertex buffer
-	vkBindBufferMemory(device, *buffer, *bufferMemory, 0);
+	//bind buffer to its range of the block
+	vkBindBufferMemory(device, *buffer, bufferAllocation->memory, bufferAllocation->offset);
 
 }
 
-static void copyBuffer(VkDevice device, VkQueue transferQueue, VkCommandPool transferCommandPool, VkBuffer srcBuffer, VkBuffer dstBuffer, VkDeviceSize bufferSize) {
-
-	//command buffer to hold transfer commands
-	VkCommandBuffer transferCommandBuffer;
-
-	//command buffer details
-	VkCommandBufferAllocateInfo allocInfo = {};
-	allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
-	allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
-	allocInfo.commandPool = transferCommandPool;
-	allocInfo.commandBufferCount = 1;
-
-	//allocate command buffer from pool
-	vkAllocateCommandBuffers(device, &allocInfo, &transferCommandBuffer);
-
-	//information to begin the command buffer record
-	VkCommandBufferBeginInfo beginInfo = { };
-	beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
-	beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;				//only using the command buffer once
-
-	//begin recording transfer commands
-	vkBeginCommandBuffer(transferCommandBuffer, &beginInfo);
-
-	//regen of data to copy from and to
-	VkBufferCopy bufferCopyRegion = {};
-	bufferCopyRegion.srcOffset = 0;
-	bufferCopyRegion.dstOffset = 0;
-	bufferCopyRegion.size = bufferSize;
-
-	//Command to copy src buffer to dst buffer
-	vkCmdCopyBuffer(transferCommandBuffer, srcBuffer, dstBuffer, 1, &bufferCopyRegion);
-
-	//end commands
-	vkEndCommandBuffer(transferCommandBuffer);
-
-	//queue submission information
-	VkSubmitInfo submitInfo = {};
-	submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
-	submitInfo.commandBufferCount = 1;
-	submitInfo.pCommandBuffers = &transferCommandBuffer;
-
-	//submit transfer command to transfer queue and wait until it finishes
-	vkQueueSubmit(transferQueue, 1, &submitInfo, VK_NULL_HANDLE);
-	vkQueueWaitIdle(transferQueue);
-
-	//free temporary command buffer back to pool
-	vkFreeCommandBuffers(device, transferCommandPool, 1, &transferCommandBuffer);
-}
\ No newline at end of file
+static void destroyBuffer(DeviceAllocator* allocator, VkDevice device, VkBuffer buffer, Allocation* bufferAllocation) {
+	vkDestroyBuffer(device, buffer, nullptr);
+	allocator->free(*bufferAllocation);
+}
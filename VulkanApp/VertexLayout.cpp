@@ -0,0 +1,177 @@
+#include "VertexLayout.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+static uint32_t getPositionSize(PositionFormat format) {
+	return format == PositionFormat::Float32 ? 3 * sizeof(float) : 4 * sizeof(uint16_t);
+}
+
+static uint32_t getColorSize(ColorFormat format) {
+	return format == ColorFormat::Float32 ? 3 * sizeof(float) : 4 * sizeof(uint8_t);
+}
+
+static VkFormat getPositionVkFormat(PositionFormat format) {
+	switch (format) {
+	case PositionFormat::Unorm16: return VK_FORMAT_R16G16B16A16_UNORM;
+	case PositionFormat::Float16: return VK_FORMAT_R16G16B16A16_SFLOAT;
+	default: return VK_FORMAT_R32G32B32_SFLOAT;
+	}
+}
+
+static VkFormat getColorVkFormat(ColorFormat format) {
+	return format == ColorFormat::Unorm8 ? VK_FORMAT_R8G8B8A8_UNORM : VK_FORMAT_R32G32B32_SFLOAT;
+}
+
+uint32_t getVertexStreamCount(const VertexLayout& layout)
+{
+	return layout.separatePositions ? 2 : 1;
+}
+
+uint32_t getVertexStreamStride(const VertexLayout& layout, uint32_t stream)
+{
+	if (!layout.separatePositions) {
+		return getPositionSize(layout.position) + getColorSize(layout.color);
+	}
+	return stream == 0 ? getPositionSize(layout.position) : getColorSize(layout.color);
+}
+
+uint32_t getVertexSize(const VertexLayout& layout)
+{
+	return getPositionSize(layout.position) + getColorSize(layout.color);
+}
+
+bool isNativeVertexLayout(const VertexLayout& layout)
+{
+	return layout.position == PositionFormat::Float32 && layout.color == ColorFormat::Float32 && !layout.separatePositions
+		&& getVertexSize(layout) == sizeof(Vertex);
+}
+
+std::vector<VkVertexInputBindingDescription> getVertexBindings(const VertexLayout& layout)
+{
+	std::vector<VkVertexInputBindingDescription> bindings(getVertexStreamCount(layout));
+	for (uint32_t i = 0; i < bindings.size(); i++) {
+		bindings[i].binding = i;
+		bindings[i].stride = getVertexStreamStride(layout, i);
+		bindings[i].inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
+	}
+	return bindings;
+}
+
+std::vector<VkVertexInputAttributeDescription> getVertexAttributes(const VertexLayout& layout)
+{
+	//formats with a fourth component feed the shader's vec3 inputs fine, the extra one is dropped
+	std::vector<VkVertexInputAttributeDescription> attributes(2);
+	attributes[0].binding = 0;
+	attributes[0].location = 0;
+	attributes[0].format = getPositionVkFormat(layout.position);
+	attributes[0].offset = 0;
+
+	attributes[1].binding = layout.separatePositions ? 1 : 0;
+	attributes[1].location = 1;
+	attributes[1].format = getColorVkFormat(layout.color);
+	attributes[1].offset = layout.separatePositions ? 0 : getPositionSize(layout.position);
+	return attributes;
+}
+
+PositionQuantization getPositionQuantization(PositionFormat format, glm::vec3 boundsMin, glm::vec3 boundsMax)
+{
+	PositionQuantization quantization;
+	if (format == PositionFormat::Unorm16) {
+		quantization.scale = boundsMax - boundsMin;
+		quantization.offset = boundsMin;
+	}
+	else if (format == PositionFormat::Float16) {
+		//halves run out at 65504, so store [-1,1] around the centre rather than raw coordinates
+		quantization.scale = (boundsMax - boundsMin) * 0.5f;
+		quantization.offset = (boundsMin + boundsMax) * 0.5f;
+	}
+	return quantization;
+}
+
+//position relative to the quantization box, 0 on axes the mesh is flat along
+static float normalizePosition(float value, float scale, float offset) {
+	return scale > 0.0f ? (value - offset) / scale : 0.0f;
+}
+
+void encodeVertices(const VertexLayout& layout, const PositionQuantization& quantization, const Vertex* vertices, uint32_t count,
+	unsigned char* const* streams)
+{
+	uint32_t positionStride = getVertexStreamStride(layout, 0);
+	uint32_t colorStride = getVertexStreamStride(layout, layout.separatePositions ? 1 : 0);
+	unsigned char* positions = streams[0];
+	unsigned char* colors = layout.separatePositions ? streams[1] : streams[0] + getPositionSize(layout.position);
+
+	for (uint32_t i = 0; i < count; i++) {
+		const Vertex& vertex = vertices[i];
+		unsigned char* position = positions + static_cast<size_t>(i) * positionStride;
+		unsigned char* color = colors + static_cast<size_t>(i) * colorStride;
+
+		if (layout.position == PositionFormat::Float32) {
+			memcpy(position, &vertex.pos, 3 * sizeof(float));
+		}
+		else {
+			uint16_t stored[4];
+			for (int axis = 0; axis < 3; axis++) {
+				float normalized = normalizePosition(vertex.pos[axis], quantization.scale[axis], quantization.offset[axis]);
+				if (layout.position == PositionFormat::Unorm16) {
+					stored[axis] = static_cast<uint16_t>(std::lround(std::min(std::max(normalized, 0.0f), 1.0f) * 65535.0f));
+				}
+				else {
+					stored[axis] = floatToHalf(normalized);
+				}
+			}
+			stored[3] = layout.position == PositionFormat::Unorm16 ? 65535 : floatToHalf(1.0f);
+			memcpy(position, stored, sizeof(stored));
+		}
+
+		if (layout.color == ColorFormat::Float32) {
+			memcpy(color, &vertex.col, 3 * sizeof(float));
+		}
+		else {
+			for (int channel = 0; channel < 3; channel++) {
+				color[channel] = static_cast<uint8_t>(std::lround(std::min(std::max(vertex.col[channel], 0.0f), 1.0f) * 255.0f));
+			}
+			color[3] = 255;
+		}
+	}
+}
+
+uint16_t floatToHalf(float value)
+{
+	uint32_t bits;
+	memcpy(&bits, &value, sizeof(bits));
+	uint32_t sign = (bits >> 16) & 0x8000;
+	uint32_t floatExponent = (bits >> 23) & 0xFF;
+	uint32_t mantissa = bits & 0x7FFFFF;
+
+	if (floatExponent == 0xFF) {
+		return static_cast<uint16_t>(sign | 0x7C00 | (mantissa != 0 ? 0x200 : 0));			//infinity or NaN
+	}
+
+	int32_t exponent = static_cast<int32_t>(floatExponent) - 127 + 15;
+	if (exponent >= 31) {
+		return static_cast<uint16_t>(sign | 0x7C00);										//too large, infinity
+	}
+
+	uint32_t half, remainder, halfway;
+	if (exponent <= 0) {
+		//subnormal half, the implicit leading bit becomes explicit and shifts down with the rest
+		if (exponent < -10) return static_cast<uint16_t>(sign);
+		mantissa |= 0x800000;
+		uint32_t shift = static_cast<uint32_t>(14 - exponent);
+		half = mantissa >> shift;
+		remainder = mantissa & ((1u << shift) - 1);
+		halfway = 1u << (shift - 1);
+	}
+	else {
+		half = (static_cast<uint32_t>(exponent) << 10) | (mantissa >> 13);
+		remainder = mantissa & 0x1FFF;
+		halfway = 0x1000;
+	}
+
+	//a carry out of the mantissa rolls into the exponent, which is the correctly rounded result
+	if (remainder > halfway || (remainder == halfway && (half & 1) != 0)) half++;
+	return static_cast<uint16_t>(sign | half);
+}
@@ -0,0 +1,54 @@
+#pragma once
+
+#define GLFW_INCLUDE_VULKAN
+#include <GLFW/glfw3.h>
+
+#include <cstdint>
+#include <vector>
+
+#include "Utilities.h"
+
+//how positions are stored in vertex buffers, the compact formats are relative to each mesh's bounds
+enum class PositionFormat {
+	Float32,										//R32G32B32_SFLOAT, 12 bytes
+	Unorm16,										//R16G16B16A16_UNORM across the bounding box, 8 bytes, error at most extent / 131070
+	Float16											//R16G16B16A16_SFLOAT around the box centre scaled to [-1,1], 8 bytes, 11 significant bits
+};
+
+enum class ColorFormat {
+	Float32,										//R32G32B32_SFLOAT, 12 bytes
+	Unorm8											//R8G8B8A8_UNORM, 4 bytes, clamped to [0,1]
+};
+
+//how every mesh of a renderer is stored on the GPU, Vertex stays the format meshes are created from
+struct VertexLayout {
+	PositionFormat position = PositionFormat::Float32;
+	ColorFormat color = ColorFormat::Float32;
+	bool separatePositions = false;					//positions alone in binding 0 and colours in binding 1, for passes that only read positions
+};
+
+const uint32_t MAX_VERTEX_STREAMS = 2;
+
+//stored positions are rebuilt as stored * scale + offset by the vertex shader, which reads both from the object table
+struct PositionQuantization {
+	glm::vec3 scale = glm::vec3(1.0f);
+	glm::vec3 offset = glm::vec3(0.0f);
+};
+
+uint32_t getVertexStreamCount(const VertexLayout& layout);
+uint32_t getVertexStreamStride(const VertexLayout& layout, uint32_t stream);
+uint32_t getVertexSize(const VertexLayout& layout);				//bytes per vertex across every stream
+bool isNativeVertexLayout(const VertexLayout& layout);			//stored exactly as Vertex, so uploads need no conversion
+
+//vertex input state for pipelines, location 0 is the position and location 1 the colour whatever the layout
+std::vector<VkVertexInputBindingDescription> getVertexBindings(const VertexLayout& layout);
+std::vector<VkVertexInputAttributeDescription> getVertexAttributes(const VertexLayout& layout);
+
+PositionQuantization getPositionQuantization(PositionFormat format, glm::vec3 boundsMin, glm::vec3 boundsMax);
+
+//writes count vertices into each of layout's streams, streams[i] must hold count * getVertexStreamStride(layout, i) bytes
+void encodeVertices(const VertexLayout& layout, const PositionQuantization& quantization, const Vertex* vertices, uint32_t count,
+	unsigned char* const* streams);
+
+//IEEE half precision, rounded to nearest even
+uint16_t floatToHalf(float value);
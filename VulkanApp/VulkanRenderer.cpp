@@ -4,9 +4,35 @@ VulkanRenderer::VulkanRenderer()
 {
 }
 
+void VulkanRenderer::setPipelineCachePath(const std::string& path)
+{
+	pipelineCachePath = path;
+}
+
+void VulkanRenderer::setVertexLayout(const VertexLayout& layout)
+{
+	vertexLayout = layout;
+}
+
+void VulkanRenderer::setReverseDepth(bool enabled)
+{
+	reverseDepth = enabled;
+}
+
+void VulkanRenderer::setTimelineSemaphores(bool enabled)
+{
+	timelineSemaphoresRequested = enabled;
+}
+
+bool VulkanRenderer::isTimelineSemaphoreEnabled()
+{
+	return gpuTimeline.isEnabled();
+}
+
 int VulkanRenderer::init(GLFWwindow* newWindow)
 {
 	window = newWindow;
+	headless = false;
 
 	try {
 		createInstance();
@@ -15,108 +41,387 @@ int VulkanRenderer::init(GLFWwindow* newWindow)
 		getPhysicalDevice();
 		createLogicalDevice();
 		createSwapChain();
-		createRenderPass();
-		createDescriptorSetLayout();
-		createGraphicsPipeline();
-		createFrameBuffers();
-		createCommandPool();
-		//Create a mesh
-		//vertex data
+		createRenderResources();
+	}
+	catch (const std::runtime_error& e) {
+		printf("ERROR: %s\n", e.what());
+		return EXIT_FAILURE;
+	}
 
+	return 0;
+}
 
-		uboViewProjection.projection = glm::perspective(glm::radians(45.0f), (float)swapChainExtent.width / (float)swapChainExtent.height, 0.1f, 100.0f);
-		uboViewProjection.view = glm::lookAt(glm::vec3(0.0f, 0.0f, 2.0f), glm::vec3(0.0f, 0.0f, 0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+int VulkanRenderer::initHeadless(uint32_t width, uint32_t height)
+{
+	window = nullptr;
+	headless = true;
 
-		uboViewProjection.projection[1][1] *= -1;
+	try {
+		createInstance();
+		setupDebugMessenger();
+		getPhysicalDevice();
+		createLogicalDevice();
+		createOffscreenImages(width, height);
+		createRenderResources();
+	}
+	catch (const std::runtime_error& e) {
+		printf("ERROR: %s\n", e.what());
+		return EXIT_FAILURE;
+	}
 
-		std::vector<Vertex> meshVertices1 = {
-			{{-0.4,  0.4, 0.0}, {1.0, 0.0, 0.0}},			//0
-			{{-0.4, -0.4, 0.0}, {0.0, 1.0, 0.0}},			//1
-			{{ 0.4, -0.4, 0.0}, {0.0, 0.0, 1.0}},			//2
-			{{ 0.4,  0.4, 0.0}, {1.0, 1.0, 0.0}},			//3
-		};
+	return 0;
+}
 
-		std::vector<Vertex> meshVertices2 = {
-			{{-0.25,  0.6, 0.0}, {1.0, 0.0, 0.0}},			//0
-			{{-0.25, -0.6, 0.0}, {0.0, 1.0, 0.0}},			//1
-			{{ 0.25, -0.6, 0.0}, {0.0, 0.0, 1.0}},			//2
-			{{ 0.25,  0.6, 0.0}, {1.0, 1.0, 0.0}},			//3
-		};
+void VulkanRenderer::createRenderResources()
+{
+	createRenderPass();
+	createDepthBufferImages();
+	createDescriptorSetLayout();
+	createPipelines();
+	createFrameBuffers();
+	createCommandPool();
+
+	//Vulkan clips depth to [0, w], an OpenGL style [-w, w] projection would lose everything nearer than about twice the near plane
+	//reversed depth swaps the planes, so the far plane maps to 0 where float depth is most precise
+	float aspect = (float)swapChainExtent.width / (float)swapChainExtent.height;
+	uboViewProjection.projection = reverseDepth ? glm::perspectiveRH_ZO(glm::radians(45.0f), aspect, 100.0f, 0.1f)
+		: glm::perspectiveRH_ZO(glm::radians(45.0f), aspect, 0.1f, 100.0f);
+	uboViewProjection.view = glm::lookAt(glm::vec3(0.0f, 0.0f, 2.0f), glm::vec3(0.0f, 0.0f, 0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+
+	uboViewProjection.projection[1][1] *= -1;
+
+	createGpuCulling();
+	createFrameContexts();
+	recordCommands();
+}
 
-		//index data
-		std::vector<uint32_t> meshIndices = {
-			0,1,2,
-			2,3,0
-		};
+int VulkanRenderer::createMesh(std::vector<Vertex>* vertices, std::vector<uint32_t>* indices)
+{
+	MeshData data;
+	data.vertices = vertices->data();
+	data.vertexCount = static_cast<uint32_t>(vertices->size());
+	data.indices = indices->data();
+	data.indexCount = static_cast<uint32_t>(indices->size());
+	return createMesh(data);
+}
 
-		Mesh firstMesh = Mesh(mainDevice.physicalDevice, mainDevice.logicalDevice, graphicsQueue, graphicsCommandPool, &meshVertices1, &meshIndices);
-		Mesh secondMesh = Mesh(mainDevice.physicalDevice, mainDevice.logicalDevice, graphicsQueue, graphicsCommandPool, &meshVertices2, &meshIndices);
+int VulkanRenderer::createMesh(const MeshData& data)
+{
+	//geometry of meshes destroyed in frames that have since finished can be reused
+	pollCompletedFrames();
+	geometryArena.releaseRetired(completedFrames);
+
+	//reordering works on copies, geometry that was optimized offline goes straight from the caller's memory to staging
+	MeshData source = data;
+	bool reorder = meshOptimizeSettings.vertexCache || meshOptimizeSettings.vertexFetch;
+	if (!data.optimized && reorder) {
+		optimizeMesh(data, meshOptimizeSettings, optimizedVertices, optimizedIndices, &meshOptimizeStats);
+		source.vertices = optimizedVertices.data();
+		source.vertexCount = static_cast<uint32_t>(optimizedVertices.size());
+		source.indices = optimizedIndices.data();
+		source.indexCount = static_cast<uint32_t>(optimizedIndices.size());
+		source.optimized = true;
+	}
+	else {
+		meshOptimizeStats = MeshOptimizeStats();
+		meshOptimizeStats.shortIndices = meshOptimizeSettings.shortIndices && data.vertexCount <= SHORT_INDEX_VERTEX_LIMIT;
+	}
 
-		meshList.push_back(firstMesh);
-		meshList.push_back(secondMesh);
+	//coarser levels follow the full mesh's indices in the same allocation and reuse its vertices
+	const MeshLod* lods = nullptr;
+	uint32_t lodCount = 0;
+	if (meshLodSettings.lodCount > 1) {
+		buildMeshLods(source.vertices, source.vertexCount, source.indices, source.indexCount, meshLodSettings, lodIndices, lodRanges, &meshLodStats);
+		source.indices = lodIndices.data();
+		source.indexCount = static_cast<uint32_t>(lodIndices.size());
+		lods = lodRanges.data();
+		lodCount = static_cast<uint32_t>(lodRanges.size());
+	}
+	else {
+		meshLodStats = MeshLodStats();
+		meshLodStats.triangles[0] = source.indexCount / 3;
+	}
 
-		createCommandBuffers();
-		allocateDynamicBufferTransferSpace();
-		createUniformBuffers();
-		createDescriptorPool();
-		createDescriptorSets();
-		recordCommands();
-		createSynchronization();
+	//every level is split into its own meshlets, recorded in its range
+	const Meshlet* meshlets = nullptr;
+	uint32_t meshletCount = 0;
+	if (meshletSettings.enabled) {
+		if (lods == nullptr) {
+			lodRanges.assign(1, MeshLod());
+			lodRanges[0].indexCount = source.indexCount;
+			lodCount = 1;
+		}
+		meshletBuffer.clear();
+		buildMeshlets(source.vertices, source.vertexCount, source.indices, lodRanges.data(), lodCount, meshletSettings, meshletBuffer, &meshletStats);
+		lods = lodRanges.data();
+		meshlets = meshletBuffer.data();
+		meshletCount = static_cast<uint32_t>(meshletBuffer.size());
 	}
-	catch (const std::runtime_error& e) {
-		printf("ERROR: %s\n", e.what());
-		return EXIT_FAILURE;
+	else {
+		meshletStats = MeshletStats();
 	}
 
+	Mesh mesh = Mesh(&geometryArena, source, meshOptimizeStats.shortIndices ? VK_INDEX_TYPE_UINT16 : VK_INDEX_TYPE_UINT32, lods, lodCount,
+		meshlets, meshletCount);
+	if (mesh.getLodCount() > 1) lodMeshCount++;
+	if (mesh.hasMeshlets()) meshletMeshCount++;
 
-	return 0;
+	//command buffers draw a fixed list, so must be re-recorded before the next draw
+	commandsDirty = true;
+
+	//indirect draws reserve room per geometry page, a new page needs bigger buffers
+	if (gpuCullingSupported && geometryArena.getPageCount() > gpuCulling.getPageCapacity()) {
+		resizeGpuCulling();
+	}
+
+	if (!freeMeshIDs.empty()) {
+		int meshID = freeMeshIDs.back();
+		freeMeshIDs.pop_back();
+		meshList[meshID] = mesh;
+		meshPipelines[meshID] = defaultPipeline;
+		selectedLods[meshID] = 0;
+		updateObjectBounds(meshID);
+		updateGpuDraw(meshID);
+		return meshID;
+	}
+
+	meshList.push_back(mesh);
+	meshPipelines.push_back(defaultPipeline);
+	selectedLods.push_back(0);
+	objectBounds.resize(meshList.size());
+	updateObjectBounds(static_cast<int>(meshList.size()) - 1);
+	updateGpuDraw(static_cast<int>(meshList.size()) - 1);
+
+	//grow the object table geometrically so large scenes dont resize per mesh
+	if (meshList.size() > objectCapacity) {
+		resizeUniformBuffers(std::max(objectCapacity * 2, meshList.size()));
+	}
+
+	return static_cast<int>(meshList.size()) - 1;
+}
+
+void VulkanRenderer::destroyMesh(int meshID)
+{
+	if (meshID < 0 || meshID >= static_cast<int>(meshList.size()) || !meshList[meshID].hasGeometry()) {
+		throw std::runtime_error("mesh ID does not refer to a created mesh");
+	}
+
+	//frames already submitted may still draw it, command buffers are re-recorded without it before the next one
+	if (meshList[meshID].getLodCount() > 1) lodMeshCount--;
+	if (meshList[meshID].hasMeshlets()) meshletMeshCount--;
+	meshList[meshID].destroyGeometry(submittedFrames);
+	objectBounds.set(meshID, glm::vec3(0.0f), CULLED_RADIUS);
+	updateGpuDraw(meshID);
+	freeMeshIDs.push_back(meshID);
+	commandsDirty = true;
+}
+
+void VulkanRenderer::setMeshOptimization(const MeshOptimizeSettings& settings)
+{
+	meshOptimizeSettings = settings;
+}
+
+MeshOptimizeStats VulkanRenderer::getMeshOptimizeStats()
+{
+	return meshOptimizeStats;
+}
+
+void VulkanRenderer::setMeshLods(const MeshLodSettings& settings)
+{
+	meshLodSettings = settings;
+}
+
+MeshLodStats VulkanRenderer::getMeshLodStats()
+{
+	return meshLodStats;
+}
+
+void VulkanRenderer::setLodThreshold(float pixels)
+{
+	lodThreshold = pixels;
+}
+
+LodStats VulkanRenderer::getLodStats()
+{
+	return lodStats;
+}
+
+void VulkanRenderer::setMeshlets(const MeshletSettings& settings)
+{
+	meshletSettings = settings;
+}
+
+MeshletStats VulkanRenderer::getMeshletStats()
+{
+	return meshletStats;
+}
+
+VkFormat VulkanRenderer::getDepthFormat()
+{
+	return depthFormat;
+}
+
+bool VulkanRenderer::isDepthPrepassSupported()
+{
+	return depthPrepassPipeline != VK_NULL_HANDLE;
+}
+
+void VulkanRenderer::setDepthPrepass(bool enabled)
+{
+	if (enabled && !isDepthPrepassSupported()) {
+		throw std::runtime_error("depth prepass is not supported (Shaders/depth.spv missing)");
+	}
+	depthPrepassEnabled = enabled;
+	commandsDirty = true;
+}
+
+bool VulkanRenderer::isDepthPrepassEnabled()
+{
+	return depthPrepassEnabled;
+}
+
+void VulkanRenderer::setDepthSort(bool enabled)
+{
+	depthSortEnabled = enabled;
+	commandsDirty = true;
 }
 
 void VulkanRenderer::updateModel(int modelID, glm::mat4 newModel)
 {
-	if (modelID >= meshList.size()) return;
+	if (modelID < 0 || modelID >= static_cast<int>(meshList.size()) || !meshList[modelID].hasGeometry()) {
+		throw std::runtime_error("model ID does not refer to a created mesh");
+	}
 
 	meshList[modelID].setModel(newModel);
+	updateObjectBounds(modelID);
+}
+
+bool VulkanRenderer::isMeshUploaded(int meshID)
+{
+	if (meshID < 0 || meshID >= static_cast<int>(meshList.size()) || !meshList[meshID].hasGeometry()) {
+		throw std::runtime_error("mesh ID does not refer to a created mesh");
+	}
+
+	return uploadService.isComplete(meshList[meshID].getUploadTicket());
+}
+
+void VulkanRenderer::waitForUploads()
+{
+	uploadService.waitAll();
 }
 
 void VulkanRenderer::draw()
 {
+	auto drawStart = std::chrono::steady_clock::now();
+
+	//uploads recorded since the last frame must be submitted ahead of any draw that reads them (GPU side ordering, no CPU wait)
+	uploadService.flush();
+
+	//levels follow the objects' current screen size, a change re-records prerecorded commands below
+	selectLods();
+
+	//draws recorded with a stand in pipeline are re-recorded once another compile finishes, it may have been theirs
+	if (recordedWithPending && pipelineRegistry.getFinishedCount() != recordedFinishedCount) {
+		commandsDirty = true;
+	}
+
+	//per frame recording picks up scene changes on its own
+	if (commandsDirty && commandBufferMode == CommandBufferMode::Prerecorded) {
+		//command buffers may still be executing, cant re-record until GPU is done with them
+		vkDeviceWaitIdle(mainDevice.logicalDevice);
+		collectAllQueryResults();
+		recordCommands();
+		commandsDirty = false;
+	}
+
 	// --Get next image--
-	vkWaitForFences(mainDevice.logicalDevice, 1, &drawFences[currentFrame], VK_TRUE, std::numeric_limits<uint64_t>::max());
-	vkResetFences(mainDevice.logicalDevice, 1, &drawFences[currentFrame]);
+	beginFrame();
+	frameBegun = false;
+	FrameContext& context = frameContexts[currentFrame];
+
 	//1. get the next available image to draw to and set something to signal when wer're finished with the image (semaphore)
 	uint32_t imageIndex;
-	vkAcquireNextImageKHR(mainDevice.logicalDevice, swapchain, std::numeric_limits<uint64_t>::max(), imageAvailable[currentFrame], VK_NULL_HANDLE, &imageIndex);
+	if (headless) {
+		//each frame context owns one offscreen image, which waiting for the context protects
+		imageIndex = currentFrame;
+	}
+	else {
+		vkAcquireNextImageKHR(mainDevice.logicalDevice, swapchain, std::numeric_limits<uint64_t>::max(), context.imageAvailable, VK_NULL_HANDLE, &imageIndex);
+
+		//images come back in any order, the one acquired may still be drawn (and its depth buffer written) by another context's frame
+		if (imageFrames[imageIndex] != 0) {
+			waitForFrame(imageFrames[imageIndex]);
+		}
+	}
 
-	updateUniformBuffers(imageIndex);
+	//everything the frame writes or records belongs to its context, only the framebuffer depends on the image
+	updateUniformBuffers(currentFrame);
+	if (gpuCullingEnabled) {
+		//read by the cull pass from the context's own buffer, so prerecorded commands cull against the current view too
+		gpuCulling.update(currentFrame, extractFrustum(uboViewProjection.projection * uboViewProjection.view), static_cast<uint32_t>(meshList.size()));
+	}
+
+	recordFrame(currentFrame, imageIndex);
+	countLodDraws();
 
 	//--submit command buffer to render--
 	//2. submit command buffer to queue to be executed, make sure it waits for the image to be signlaed as available before drawing
 	VkSubmitInfo submitInfo = {};
 	submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
-	submitInfo.waitSemaphoreCount = 1;
-	submitInfo.pWaitSemaphores = &imageAvailable[currentFrame];
+	submitInfo.waitSemaphoreCount = headless ? 0 : 1;							//offscreen images are never acquired or presented
+	submitInfo.pWaitSemaphores = &context.imageAvailable;
 	VkPipelineStageFlags waitStages[] = {
 		VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT
 	};
 	submitInfo.pWaitDstStageMask = waitStages;									//stages to check semaphore at
 	submitInfo.commandBufferCount = 1;
-	submitInfo.pCommandBuffers = &commandBuffers[imageIndex];					//command buffer to submit
-	submitInfo.signalSemaphoreCount = 1;
-	submitInfo.pSignalSemaphores = &renderFinished[currentFrame];								//sempahore to signale when command buffer finsishes
+	submitInfo.pCommandBuffers = &context.commandBuffer;						//command buffer to submit
+	submitInfo.signalSemaphoreCount = headless ? 0 : 1;
+	submitInfo.pSignalSemaphores = &context.renderFinished;								//sempahore to signale when command buffer finsishes
+
+	//on the timeline the frame signals its value alongside the binary semaphore presentation waits on, and needs no fence
+	std::array<VkSemaphore, 2> signalSemaphores = { context.renderFinished, gpuTimeline.getSemaphore() };
+	std::array<uint64_t, 2> signalValues = { 0, 0 };												//binary semaphores ignore their value
+	VkTimelineSemaphoreSubmitInfoKHR timelineInfo = {};
+	timelineInfo.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO_KHR;
+	if (gpuTimeline.isEnabled()) {
+		context.timelineValue = gpuTimeline.nextValue();
+		signalValues[1] = context.timelineValue;
+
+		uint32_t first = headless ? 1 : 0;
+		submitInfo.signalSemaphoreCount = 2 - first;
+		submitInfo.pSignalSemaphores = signalSemaphores.data() + first;
+		timelineInfo.signalSemaphoreValueCount = 2 - first;
+		timelineInfo.pSignalSemaphoreValues = signalValues.data() + first;
+		submitInfo.pNext = &timelineInfo;
+	}
 
 	//submit command buffer to queue
-	VkResult result = vkQueueSubmit(graphicsQueue, 1, &submitInfo, drawFences[currentFrame]);
+	VkResult result = vkQueueSubmit(graphicsQueue, 1, &submitInfo, context.fence);
 	if (result != VK_SUCCESS) {
 		throw std::runtime_error("failed to submit command buffer to queue");
 	}
+	context.frameNumber = ++submittedFrames;
+	context.queryFrame = submittedFrames;
+	imageFrames[imageIndex] = submittedFrames;
+
+	//frames drawn without an input sample count from the call, everything draw() did is latency the caller sees
+	std::chrono::steady_clock::time_point inputTime = inputSampled ? inputSampleTime : drawStart;
+	pendingLatency.frameNumber = submittedFrames;
+	pendingLatency.inputToSubmitMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - inputTime).count();
+
+	if (headless) {
+		recordFrameLatency();
+		currentFrame = (currentFrame + 1) % framesInFlight;
+		return;
+	}
 
 	//--Present rendered image to screen
 	//3. present image to screen when it has signalled finsished rendering
 	VkPresentInfoKHR presentInfo = {};
 	presentInfo.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
 	presentInfo.waitSemaphoreCount = 1;
-	presentInfo.pWaitSemaphores = &renderFinished[currentFrame];
+	presentInfo.pWaitSemaphores = &context.renderFinished;
 	presentInfo.swapchainCount = 1;
 	presentInfo.pSwapchains = &swapchain;
 	presentInfo.pImageIndices = &imageIndex;
@@ -125,49 +430,411 @@ void VulkanRenderer::draw()
 	if (result != VK_SUCCESS) {
 		throw std::runtime_error("Failed to present the image");
 	}
+	pendingLatency.inputToPresentMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - inputTime).count();
+	recordFrameLatency();
 
-	currentFrame = (currentFrame + 1) % MAX_FRAME_DRAWS;
+	currentFrame = (currentFrame + 1) % framesInFlight;
 }
 
-void VulkanRenderer::cleanup()
+void VulkanRenderer::setFramePacing(FramePacingMode mode)
 {
-	//wait until no actions being run before destroying
+	//goes through setFramesInFlight so the count is checked and the contexts rebuilt, the mode only changes once that succeeded
+	setFramesInFlight(mode == FramePacingMode::LowLatency ? 1 : DEFAULT_FRAMES_IN_FLIGHT);
+	framePacing = mode;
+}
+
+FramePacingMode VulkanRenderer::getFramePacing()
+{
+	return framePacing;
+}
+
+void VulkanRenderer::setFramesInFlight(uint32_t count)
+{
+	if (count < 1 || count > static_cast<uint32_t>(MAX_FRAME_DRAWS)) {
+		throw std::runtime_error("frames in flight must be between 1 and MAX_FRAME_DRAWS");
+	}
+	if (frameBegun) {
+		throw std::runtime_error("cannot change frames in flight between beginFrame and draw");
+	}
+
+	framesInFlight = count;
+	if (frameContexts.empty()) return;
+
+	//contexts are rebuilt for the new count, so drain everything and start again from the first one
 	vkDeviceWaitIdle(mainDevice.logicalDevice);
+	collectAllQueryResults();
+	completedFrames = submittedFrames;
+	destroyFrameContexts();
+	createFrameContexts();
+
+	//parallel secondaries are allocated per context too
+	if (!recordingCommandPools.empty()) {
+		uint32_t taskCount = static_cast<uint32_t>(recordingCommandPools.size());
+		destroyRecordingPools();
+		createRecordingPools(taskCount);
+	}
+	commandsDirty = true;
+}
 
-	_aligned_free(modelTrnasferSpace);
+uint32_t VulkanRenderer::getFramesInFlight()
+{
+	return framesInFlight;
+}
 
-	vkDestroyDescriptorPool(mainDevice.logicalDevice, descriptorPool, nullptr);
-	vkDestroyDescriptorSetLayout(mainDevice.logicalDevice, descriptorSetLayout, nullptr);
-	for (size_t i = 0; i < swapChainImages.size(); i++) {
-		vkDestroyBuffer(mainDevice.logicalDevice, vpUniformBuffer[i], nullptr);
-		vkFreeMemory(mainDevice.logicalDevice, vpUniformBufferMemory[i], nullptr);
-		vkDestroyBuffer(mainDevice.logicalDevice, modelDUniformBuffer[i], nullptr);
-		vkFreeMemory(mainDevice.logicalDevice, modelDUniformBufferMemory[i], nullptr);
+void VulkanRenderer::setFrameRateLimit(float framesPerSecond)
+{
+	frameInterval = std::chrono::steady_clock::duration::zero();
+	if (framesPerSecond > 0.0f) {
+		frameInterval = std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(1.0 / framesPerSecond));
 	}
-	for (size_t i = 0; i < meshList.size(); i++) {
-		meshList[i].destroyBuffers();
+	nextFrameStart = std::chrono::steady_clock::now();
+}
+
+void VulkanRenderer::beginFrame()
+{
+	if (frameBegun) return;
+	pendingLatency = FrameLatency();
+
+	//limit first, so the fence wait and the input sampled after this return are as late as possible
+	auto limiterStart = std::chrono::steady_clock::now();
+	if (frameInterval > std::chrono::steady_clock::duration::zero()) {
+		if (limiterStart < nextFrameStart) {
+			std::this_thread::sleep_until(nextFrameStart);
+		}
+		//a frame that ran over restarts the schedule instead of rushing the ones after it
+		nextFrameStart = std::max(nextFrameStart, limiterStart) + frameInterval;
 	}
 
-	for (size_t i = 0; i < MAX_FRAME_DRAWS; i++) {
-		vkDestroySemaphore(mainDevice.logicalDevice, renderFinished[i], nullptr);
-		vkDestroySemaphore(mainDevice.logicalDevice, imageAvailable[i], nullptr);
-		vkDestroyFence(mainDevice.logicalDevice, drawFences[i], nullptr);
+	auto slotWaitStart = std::chrono::steady_clock::now();
+	FrameContext& context = frameContexts[currentFrame];
+	waitForFrameSlot(currentFrame);
+	completedFrames = std::max(completedFrames, context.frameNumber);					//frame last submitted from this context has finished
+	if (!gpuTimeline.isEnabled()) {
+		vkResetFences(mainDevice.logicalDevice, 1, &context.fence);
+	}
+	pollCompletedFrames();
+	geometryArena.releaseRetired(completedFrames);
+
+	//that frame's queries are now available, read them without waiting
+	collectQueryResults(currentFrame);
+
+	auto slotWaitEnd = std::chrono::steady_clock::now();
+	pendingLatency.limiterWaitMs = std::chrono::duration<double, std::milli>(slotWaitStart - limiterStart).count();
+	pendingLatency.slotWaitMs = std::chrono::duration<double, std::milli>(slotWaitEnd - slotWaitStart).count();
+	frameBegun = true;
+}
+
+void VulkanRenderer::markInputSampled()
+{
+	inputSampleTime = std::chrono::steady_clock::now();
+	inputSampled = true;
+}
+
+FrameLatency VulkanRenderer::getFrameLatency()
+{
+	if (frameLatencyCount == 0) return FrameLatency();
+	return frameLatencies[(frameLatencyCount - 1) % FRAME_LATENCY_HISTORY];
+}
+
+std::vector<FrameLatency> VulkanRenderer::getFrameLatencyHistory()
+{
+	std::vector<FrameLatency> history;
+	uint64_t first = frameLatencyCount > FRAME_LATENCY_HISTORY ? frameLatencyCount - FRAME_LATENCY_HISTORY : 0;
+	for (uint64_t i = first; i < frameLatencyCount; i++) {
+		history.push_back(frameLatencies[i % FRAME_LATENCY_HISTORY]);
+	}
+	return history;
+}
+
+void VulkanRenderer::recordFrameLatency()
+{
+	if (frameLatencies.empty()) {
+		frameLatencies.resize(FRAME_LATENCY_HISTORY);
+	}
+	frameLatencies[frameLatencyCount % FRAME_LATENCY_HISTORY] = pendingLatency;
+	frameLatencyCount++;
+
+	//the next frame needs its own sample
+	inputSampled = false;
+}
+
+int VulkanRenderer::findFrameSlot(uint64_t frameNumber)
+{
+	for (uint32_t i = 0; i < frameContexts.size(); i++) {
+		if (frameContexts[i].frameNumber == frameNumber) return static_cast<int>(i);
+	}
+	return -1;
+}
+
+bool VulkanRenderer::isFrameSlotComplete(int frameSlot)
+{
+	if (gpuTimeline.isEnabled()) {
+		return gpuTimeline.isComplete(frameContexts[frameSlot].timelineValue);
+	}
+	return vkGetFenceStatus(mainDevice.logicalDevice, frameContexts[frameSlot].fence) == VK_SUCCESS;
+}
+
+void VulkanRenderer::waitForFrameSlot(int frameSlot)
+{
+	if (gpuTimeline.isEnabled()) {
+		gpuTimeline.wait(frameContexts[frameSlot].timelineValue);
+		return;
+	}
+	vkWaitForFences(mainDevice.logicalDevice, 1, &frameContexts[frameSlot].fence, VK_TRUE, std::numeric_limits<uint64_t>::max());
+}
+
+void VulkanRenderer::pollCompletedFrames()
+{
+	//on the timeline this is one counter read, with fences one status query per context still running
+	for (uint32_t i = 0; i < frameContexts.size(); i++) {
+		if (frameContexts[i].frameNumber > completedFrames && isFrameSlotComplete(static_cast<int>(i))) {
+			completedFrames = frameContexts[i].frameNumber;
+		}
+	}
+}
+
+void VulkanRenderer::setRecordingMode(RecordingMode mode, uint32_t threadCount)
+{
+	//primaries may still be executing the old secondary buffers, cant free their pools until GPU is done with them
+	vkDeviceWaitIdle(mainDevice.logicalDevice);
+	recordingThreads.stop();
+	destroyRecordingPools();
+
+	recordingMode = mode;
+	if (recordingMode == RecordingMode::Parallel) {
+		recordingThreads.start(threadCount);
+		createRecordingPools(recordingThreads.getThreadCount());
 	}
+
+	//primaries reference the freed secondaries, re-record before the next draw
+	commandsDirty = true;
+}
+
+RecordingMode VulkanRenderer::getRecordingMode()
+{
+	return recordingMode;
+}
+
+void VulkanRenderer::setCommandBufferMode(CommandBufferMode mode)
+{
+	//prerecorded buffers went stale while recording per frame
+	commandBufferMode = mode;
+	commandsDirty = true;
+}
+
+CommandBufferMode VulkanRenderer::getCommandBufferMode()
+{
+	return commandBufferMode;
+}
+
+void VulkanRenderer::setFrustumCulling(bool enabled)
+{
+	frustumCullingEnabled = enabled;
+}
+
+void VulkanRenderer::setClusterCulling(bool enabled)
+{
+	clusterCullingEnabled = enabled;
+}
+
+void VulkanRenderer::setCullingKernel(CullingKernel kernel)
+{
+	if (!isCullingKernelSupported(kernel)) {
+		throw std::runtime_error("culling kernel is not supported by this CPU");
+	}
+	cullingKernel = kernel;
+}
+
+CullingStats VulkanRenderer::getCullingStats()
+{
+	return cullingStats;
+}
+
+bool VulkanRenderer::isGpuCullingSupported()
+{
+	return gpuCullingSupported;
+}
+
+bool VulkanRenderer::isDrawIndirectCountSupported()
+{
+	return drawIndexedIndirectCount != nullptr;
+}
+
+void VulkanRenderer::setGpuCulling(bool enabled)
+{
+	if (enabled && !gpuCullingSupported) {
+		throw std::runtime_error("GPU culling is not supported by this device");
+	}
+	gpuCullingEnabled = enabled;
+
+	//recorded commands hold either direct or indirect draws
+	commandsDirty = true;
+}
+
+bool VulkanRenderer::isGpuCullingEnabled()
+{
+	return gpuCullingEnabled;
+}
+
+PipelineHandle VulkanRenderer::requestPipeline(const PipelineDesc& desc)
+{
+	return pipelineRegistry.request(desc);
+}
+
+void VulkanRenderer::setMeshPipeline(int meshID, PipelineHandle pipeline)
+{
+	if (meshID < 0 || meshID >= static_cast<int>(meshList.size()) || !meshList[meshID].hasGeometry()) {
+		throw std::runtime_error("mesh ID does not refer to a created mesh");
+	}
+	if (pipeline >= pipelineRegistry.getPipelineCount()) {
+		throw std::runtime_error("pipeline handle does not refer to a requested pipeline");
+	}
+
+	meshPipelines[meshID] = pipeline;
+	commandsDirty = true;
+}
+
+bool VulkanRenderer::isPipelineReady(PipelineHandle pipeline)
+{
+	if (pipeline >= pipelineRegistry.getPipelineCount()) {
+		throw std::runtime_error("pipeline handle does not refer to a requested pipeline");
+	}
+
+	return pipelineRegistry.isReady(pipeline);
+}
+
+void VulkanRenderer::setPendingPipelineMode(PendingPipelineMode mode)
+{
+	pendingPipelineMode = mode;
+	commandsDirty = true;
+}
+
+PipelineRegistryStats VulkanRenderer::getPipelineStats()
+{
+	return pipelineRegistry.getStats();
+}
+
+double VulkanRenderer::getLastRecordMs()
+{
+	return lastRecordMs;
+}
+
+uint64_t VulkanRenderer::getSubmittedFrameCount()
+{
+	return submittedFrames;
+}
+
+bool VulkanRenderer::isFrameComplete(uint64_t frameNumber)
+{
+	if (frameNumber <= completedFrames) return true;
+	if (frameNumber > submittedFrames) return false;
+
+	//the frames in flight can change, so find the slot rather than derive it from the frame number
+	int frameSlot = findFrameSlot(frameNumber);
+	if (frameSlot >= 0 && !isFrameSlotComplete(frameSlot)) {
+		return false;
+	}
+
+	//slot was either signalled or already reused (which waited on its fence), frames finish in submission order
+	completedFrames = frameNumber;
+	return true;
+}
+
+void VulkanRenderer::waitForFrame(uint64_t frameNumber)
+{
+	if (frameNumber > submittedFrames) {
+		throw std::runtime_error("cannot wait for a frame that has not been submitted");
+	}
+	if (isFrameComplete(frameNumber)) return;
+
+	//not complete, so still in its slot
+	waitForFrameSlot(findFrameSlot(frameNumber));
+	completedFrames = frameNumber;
+}
+
+const std::string& VulkanRenderer::getDeviceName()
+{
+	return deviceName;
+}
+
+bool VulkanRenderer::isGpuTimingSupported()
+{
+	return timestampsSupported;
+}
+
+bool VulkanRenderer::isPipelineStatisticsSupported()
+{
+	return pipelineStatisticsSupported;
+}
+
+GpuFrameStats VulkanRenderer::getGpuFrameStats()
+{
+	return gpuFrameStats;
+}
+
+DeviceAllocatorStats VulkanRenderer::getMemoryStats()
+{
+	return allocator.getStats();
+}
+
+UploadStats VulkanRenderer::getUploadStats()
+{
+	return uploadService.getStats();
+}
+
+PipelineCacheStats VulkanRenderer::getPipelineCacheStats()
+{
+	return pipelineCache.getStats();
+}
+
+void VulkanRenderer::cleanup()
+{
+	//wait until no actions being run before destroying
+	vkDeviceWaitIdle(mainDevice.logicalDevice);
+	uploadService.cleanup();
+
+	destroyFrameContexts();
+	vkDestroyDescriptorSetLayout(mainDevice.logicalDevice, descriptorSetLayout, nullptr);
+	gpuCulling.cleanup();
+	geometryArena.cleanup();
+
+	gpuTimeline.cleanup();
+	recordingThreads.stop();
+	destroyRecordingPools();
 	vkDestroyCommandPool(mainDevice.logicalDevice, graphicsCommandPool, nullptr);
 	for (auto framebuffer : swapChainFramebuffers) {
 		vkDestroyFramebuffer(mainDevice.logicalDevice, framebuffer, nullptr);
 	}
-	vkDestroyPipeline(mainDevice.logicalDevice, graphicsPipeline, nullptr);
+	for (size_t i = 0; i < depthBufferImages.size(); i++) {
+		vkDestroyImageView(mainDevice.logicalDevice, depthBufferImageViews[i], nullptr);
+		vkDestroyImage(mainDevice.logicalDevice, depthBufferImages[i], nullptr);
+		allocator.free(depthBufferImageAllocations[i]);
+	}
+	//joins the compile threads before their pipelines are destroyed
+	pipelineRegistry.cleanup();
 	vkDestroyPipelineLayout(mainDevice.logicalDevice, pipelineLayout, nullptr);
+	//next launch starts warm
+	pipelineCache.save();
+	pipelineCache.destroy();
 	vkDestroyRenderPass(mainDevice.logicalDevice, renderPass, nullptr);
 	for (auto image : swapChainImages) {
 		vkDestroyImageView(mainDevice.logicalDevice, image.imageView, nullptr);
 	}
-	vkDestroySwapchainKHR(mainDevice.logicalDevice, swapchain, nullptr);
-	vkDestroySurfaceKHR(instance, surface, nullptr);
+	if (headless) {
+		//offscreen images are owned by us rather than a swapchain
+		for (size_t i = 0; i < swapChainImages.size(); i++) {
+			vkDestroyImage(mainDevice.logicalDevice, swapChainImages[i].image, nullptr);
+			allocator.free(offscreenImageAllocations[i]);
+		}
+	}
+	else {
+		vkDestroySwapchainKHR(mainDevice.logicalDevice, swapchain, nullptr);
+		vkDestroySurfaceKHR(instance, surface, nullptr);
+	}
 	if (enableValidationLayers) {
 		DestroyDebugUtilsMessengerEXT(instance, debugMessenger, nullptr);
 	}
+	allocator.cleanup();
 	vkDestroyDevice(mainDevice.logicalDevice, nullptr); 
 	vkDestroyInstance(instance, nullptr);
 }
@@ -186,7 +853,15 @@ void VulkanRenderer::createInstance()
 	appInfo.applicationVersion = VK_MAKE_VERSION(1, 0, 0);			//Custom version of app
 	appInfo.pEngineName = "No Engine";								//Custom engine name
 	appInfo.engineVersion = VK_MAKE_VERSION(1, 0, 0);				//Custom engine version
-	appInfo.apiVersion = VK_API_VERSION_1_0;						//Vulkan version
+	//timeline semaphore support is queried with 1.1's vkGetPhysicalDeviceFeatures2, ask for 1.1 when the loader has it
+	//since a 1.0 loader rejects anything newer
+	instanceApiVersion = VK_API_VERSION_1_0;
+	PFN_vkEnumerateInstanceVersion enumerateInstanceVersion = (PFN_vkEnumerateInstanceVersion)vkGetInstanceProcAddr(VK_NULL_HANDLE, "vkEnumerateInstanceVersion");
+	uint32_t loaderVersion = VK_API_VERSION_1_0;
+	if (enumerateInstanceVersion != nullptr && enumerateInstanceVersion(&loaderVersion) == VK_SUCCESS && loaderVersion >= VK_API_VERSION_1_1) {
+		instanceApiVersion = VK_API_VERSION_1_1;
+	}
+	appInfo.apiVersion = instanceApiVersion;						//Vulkan version
 
 	//Creation information for a VkInstance
 	VkInstanceCreateInfo createInfo = {};
@@ -197,15 +872,18 @@ void VulkanRenderer::createInstance()
 	//Create list to hold instance extensions
 	std::vector<const char*> instanceExtensions = std::vector<const char*>();
 
-	uint32_t glfwExtensionCount = 0;								//GLFW may require multiple extensions
-	const char** glfwExtensions;									//Extensions passes as array of cstrings, so need pointer (the array) to pointer (cstring)
+	//headless rendering needs no surface extensions, so GLFW is never initialised
+	if (!headless) {
+		uint32_t glfwExtensionCount = 0;								//GLFW may require multiple extensions
+		const char** glfwExtensions;									//Extensions passes as array of cstrings, so need pointer (the array) to pointer (cstring)
 
-	//Get GLFW extensions
-	glfwExtensions = glfwGetRequiredInstanceExtensions(&glfwExtensionCount);
+		//Get GLFW extensions
+		glfwExtensions = glfwGetRequiredInstanceExtensions(&glfwExtensionCount);
 
-	//Add GLFW extensions to list of extensions
-	for (size_t i = 0; i < glfwExtensionCount; i++) {
-		instanceExtensions.push_back(glfwExtensions[i]);
+		//Add GLFW extensions to list of extensions
+		for (size_t i = 0; i < glfwExtensionCount; i++) {
+			instanceExtensions.push_back(glfwExtensions[i]);
+		}
 	}
 
 	if (enableValidationLayers) {
@@ -293,7 +971,7 @@ void VulkanRenderer::createLogicalDevice()
 
 	//Vector for queue creation information and set for family indices
 	std::vector<VkDeviceQueueCreateInfo> queueCreateInfos;
-	std::set<int> queueFamilyIndices = { indices.graphicsFamily, indices.presentationFamily };
+	std::set<int> queueFamilyIndices = { indices.graphicsFamily, indices.presentationFamily, indices.transferFamily };
 
 	//Queues the logical device needs to create and info to do so
 	for (int queueFamilyIndex : queueFamilyIndices) {
@@ -312,14 +990,54 @@ void VulkanRenderer::createLogicalDevice()
 	deviceCreateInfo.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
 	deviceCreateInfo.queueCreateInfoCount = static_cast<uint32_t>(queueCreateInfos.size());					//Number of Queue Create Infos
 	deviceCreateInfo.pQueueCreateInfos = queueCreateInfos.data();											//List of queue create infos so device can create queues
-	deviceCreateInfo.enabledExtensionCount = static_cast<uint32_t>(deviceExtensions.size());				//Number of enabled logical device extensions
-	deviceCreateInfo.ppEnabledExtensionNames = deviceExtensions.data();										//List of enabled logical device extensions
-	
+	//offscreen rendering never presents, so doesnt need the swapchain extension
+	std::vector<const char*> enabledExtensions;
+	if (!headless) {
+		enabledExtensions = deviceExtensions;
+	}
+	//lets the cull pass decide how many indirect draws run, optional (lavapipe and older drivers go without)
+	bool drawIndirectCountAvailable = checkDeviceExtensionAvailable(mainDevice.physicalDevice, VK_KHR_DRAW_INDIRECT_COUNT_EXTENSION_NAME);
+	if (drawIndirectCountAvailable) {
+		enabledExtensions.push_back(VK_KHR_DRAW_INDIRECT_COUNT_EXTENSION_NAME);
+	}
 	//physical device features the logical device will be using
+	VkPhysicalDeviceFeatures supportedFeatures;
+	vkGetPhysicalDeviceFeatures(mainDevice.physicalDevice, &supportedFeatures);
+
 	VkPhysicalDeviceFeatures deviceFeatures = {};
+	deviceFeatures.pipelineStatisticsQuery = supportedFeatures.pipelineStatisticsQuery;					//per frame vertex/primitive/fragment counters, optional
+	deviceFeatures.inheritedQueries = supportedFeatures.inheritedQueries;									//prerecorded draws are secondaries executed inside the query
+	pipelineStatisticsSupported = supportedFeatures.pipelineStatisticsQuery == VK_TRUE && supportedFeatures.inheritedQueries == VK_TRUE;
+	deviceFeatures.multiDrawIndirect = supportedFeatures.multiDrawIndirect;								//a page's indirect draws in one call, needed for GPU culling
+	deviceFeatures.drawIndirectFirstInstance = supportedFeatures.drawIndirectFirstInstance;				//indirect draws select their object by first instance
+	multiDrawIndirectSupported = supportedFeatures.multiDrawIndirect == VK_TRUE && supportedFeatures.drawIndirectFirstInstance == VK_TRUE;
 
 	deviceCreateInfo.pEnabledFeatures = &deviceFeatures;													//Physical Device features logical device will use
 
+	//timeline semaphores need VK_KHR_timeline_semaphore (1.2 drivers still expose it), the instance and device on 1.1 to query
+	//the feature, and the feature reported, otherwise frames keep their fences
+	VkPhysicalDeviceProperties deviceProperties;
+	vkGetPhysicalDeviceProperties(mainDevice.physicalDevice, &deviceProperties);
+	VkPhysicalDeviceTimelineSemaphoreFeaturesKHR timelineFeatures = {};
+	timelineFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_TIMELINE_SEMAPHORE_FEATURES_KHR;
+	PFN_vkGetPhysicalDeviceFeatures2 getFeatures2 = (PFN_vkGetPhysicalDeviceFeatures2)vkGetInstanceProcAddr(instance, "vkGetPhysicalDeviceFeatures2");
+	bool timelineExtensionAvailable = checkDeviceExtensionAvailable(mainDevice.physicalDevice, VK_KHR_TIMELINE_SEMAPHORE_EXTENSION_NAME);
+	if (timelineSemaphoresRequested && timelineExtensionAvailable && instanceApiVersion >= VK_API_VERSION_1_1
+		&& deviceProperties.apiVersion >= VK_API_VERSION_1_1 && getFeatures2 != nullptr) {
+		VkPhysicalDeviceFeatures2 features2 = {};
+		features2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+		features2.pNext = &timelineFeatures;
+		getFeatures2(mainDevice.physicalDevice, &features2);
+	}
+	bool timelineSupported = timelineFeatures.timelineSemaphore == VK_TRUE;
+	if (timelineSupported) {
+		enabledExtensions.push_back(VK_KHR_TIMELINE_SEMAPHORE_EXTENSION_NAME);
+		timelineFeatures.pNext = nullptr;
+		deviceCreateInfo.pNext = &timelineFeatures;
+	}
+	deviceCreateInfo.enabledExtensionCount = static_cast<uint32_t>(enabledExtensions.size());				//Number of enabled logical device extensions
+	deviceCreateInfo.ppEnabledExtensionNames = enabledExtensions.data();									//List of enabled logical device extensions
+
 	//Create the logical device for the given physical device
 	VkResult result = vkCreateDevice(mainDevice.physicalDevice, &deviceCreateInfo, nullptr, &mainDevice.logicalDevice);
 	if (result != VK_SUCCESS) {
@@ -331,6 +1049,19 @@ void VulkanRenderer::createLogicalDevice()
 	//From given logical device, of given queue family, of given queue index, (0 since only one queue), place reference in given  VkQueue
 	vkGetDeviceQueue(mainDevice.logicalDevice, indices.graphicsFamily, 0, &graphicsQueue);
 	vkGetDeviceQueue(mainDevice.logicalDevice, indices.presentationFamily, 0, &presentationQueue);
+	vkGetDeviceQueue(mainDevice.logicalDevice, indices.transferFamily, 0, &transferQueue);
+
+	if (drawIndirectCountAvailable) {
+		drawIndexedIndirectCount = (PFN_vkCmdDrawIndexedIndirectCountKHR)vkGetDeviceProcAddr(mainDevice.logicalDevice, "vkCmdDrawIndexedIndirectCountKHR");
+	}
+
+	//all buffer and image memory is sub-allocated from here
+	allocator.init(mainDevice.physicalDevice, mainDevice.logicalDevice);
+
+	//mesh data is copied through the transfer queue and handed to the graphics queue, whose submissions all signal the timeline
+	gpuTimeline.init(mainDevice.logicalDevice, timelineSupported);
+	uploadService.init(&allocator, mainDevice.logicalDevice, transferQueue, indices.transferFamily, graphicsQueue, indices.graphicsFamily, &gpuTimeline);
+	geometryArena.init(&allocator, mainDevice.logicalDevice, &uploadService, vertexLayout);
 
 }
 
@@ -429,6 +1160,23 @@ void VulkanRenderer::createSwapChain()
 	}
 }
 
+void VulkanRenderer::createOffscreenImages(uint32_t width, uint32_t height)
+{
+	swapChainImageFormat = OFFSCREEN_IMAGE_FORMAT;
+	swapChainExtent = { width, height };
+
+	//one image per frame slot, reuse is protected by that slot's fence so no acquire is needed
+	offscreenImageAllocations.resize(MAX_FRAME_DRAWS);
+	for (size_t i = 0; i < MAX_FRAME_DRAWS; i++) {
+		SwapChainImage offscreenImage = {};
+		offscreenImage.image = createImage(width, height, swapChainImageFormat, VK_IMAGE_TILING_OPTIMAL,
+			VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &offscreenImageAllocations[i]);
+		offscreenImage.imageView = createImageView(offscreenImage.image, swapChainImageFormat, VK_IMAGE_ASPECT_COLOR_BIT);
+
+		swapChainImages.push_back(offscreenImage);
+	}
+}
+
 void VulkanRenderer::createRenderPass()
 {
 
@@ -443,34 +1191,60 @@ void VulkanRenderer::createRenderPass()
 
 	//framebuffer data will be store as an image, but images can be given different data layouts to give optimal use for certain operations
 	colorAttachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;							//Image data layout before render pass starts
-	colorAttachment.finalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;						//Image data layout after render pass (to change to)
+	colorAttachment.finalLayout = headless ? VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL			//Image data layout after render pass (to change to)
+		: VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;													//offscreen images are left ready to be read back
+
+	//Depth attachment of render pass, 32 bit float where supported as reversed depth relies on it
+	depthFormat = chooseSupportedFormat({ VK_FORMAT_D32_SFLOAT, VK_FORMAT_D32_SFLOAT_S8_UINT, VK_FORMAT_D24_UNORM_S8_UINT, VK_FORMAT_D16_UNORM },
+		VK_IMAGE_TILING_OPTIMAL, VK_FORMAT_FEATURE_DEPTH_STENCIL_ATTACHMENT_BIT);
+
+	VkAttachmentDescription depthAttachment = {};
+	depthAttachment.format = depthFormat;
+	depthAttachment.samples = VK_SAMPLE_COUNT_1_BIT;
+	depthAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+	depthAttachment.storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;							//only needed while the pass runs
+	depthAttachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+	depthAttachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+	depthAttachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+	depthAttachment.finalLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
 
 	//attachment reference uses an attachment index that refers to index the attachment list passed to renderpasscreateinfo
 	VkAttachmentReference colorAttachmentReference = {};
 	colorAttachmentReference.attachment = 0;
 	colorAttachmentReference.layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
 
+	VkAttachmentReference depthAttachmentReference = {};
+	depthAttachmentReference.attachment = 1;
+	depthAttachmentReference.layout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+
 
 	//Information about a particular subpass the render pass is using
 	VkSubpassDescription subpass = {};
 	subpass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;						//pipeline type subpass is to be bound to
 	subpass.colorAttachmentCount = 1;
 	subpass.pColorAttachments = &colorAttachmentReference;
+	subpass.pDepthStencilAttachment = &depthAttachmentReference;
 
 	//Need to determine when layout transitions occur using subpass dependcies
 	std::array<VkSubpassDependency, 2> subpassDependencies;
 
 	//coonversion from VK_IMAGE_IMAGE_UNDEFINDED to VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL
 	//transistion must happen after...
+	//the depth buffer's clear also waits for the image's previous render pass to finish its depth tests
 	subpassDependencies[0].srcSubpass = VK_SUBPASS_EXTERNAL;							//Subpass index (VK_SUBPASS_EXTERNAL = special value meaning outside of renderpass)
-	subpassDependencies[0].srcStageMask = VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT;			//pipelinme stage
-	subpassDependencies[0].srcAccessMask = VK_ACCESS_MEMORY_READ_BIT;					//stage access mask (memoryt access)
+	subpassDependencies[0].srcStageMask = VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT			//pipelinme stage
+										| VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+	subpassDependencies[0].srcAccessMask = VK_ACCESS_MEMORY_READ_BIT					//stage access mask (memoryt access)
+										 | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
 
 	//but must happen before...
 	subpassDependencies[0].dstSubpass = 0;
-	subpassDependencies[0].dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+	subpassDependencies[0].dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT
+										| VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT;
 	subpassDependencies[0].dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_READ_BIT 
-										 | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+										 | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT
+										 | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT
+										 | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
 	subpassDependencies[0].dependencyFlags = 0;
 
 	//coonversion from VK_IMAGE_IMAGE_UNDEFINDED to VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL
@@ -487,10 +1261,11 @@ void VulkanRenderer::createRenderPass()
 	subpassDependencies[1].dependencyFlags = 0;
 
 	//create info for render pass
+	std::array<VkAttachmentDescription, 2> attachments = { colorAttachment, depthAttachment };
 	VkRenderPassCreateInfo renderPassCreateInfo = {};
 	renderPassCreateInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
-	renderPassCreateInfo.attachmentCount = 1;
-	renderPassCreateInfo.pAttachments = &colorAttachment;
+	renderPassCreateInfo.attachmentCount = static_cast<uint32_t>(attachments.size());
+	renderPassCreateInfo.pAttachments = attachments.data();
 	renderPassCreateInfo.subpassCount = 1;
 	renderPassCreateInfo.pSubpasses = &subpass;
 	renderPassCreateInfo.dependencyCount = static_cast<uint32_t>(subpassDependencies.size());
@@ -502,6 +1277,19 @@ void VulkanRenderer::createRenderPass()
 	}
 }
 
+void VulkanRenderer::createDepthBufferImages()
+{
+	//depth aspect only, the stencil of a combined format is never used
+	depthBufferImages.resize(swapChainImages.size());
+	depthBufferImageAllocations.resize(swapChainImages.size());
+	depthBufferImageViews.resize(swapChainImages.size());
+	for (size_t i = 0; i < swapChainImages.size(); i++) {
+		depthBufferImages[i] = createImage(swapChainExtent.width, swapChainExtent.height, depthFormat, VK_IMAGE_TILING_OPTIMAL,
+			VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &depthBufferImageAllocations[i]);
+		depthBufferImageViews[i] = createImageView(depthBufferImages[i], depthFormat, VK_IMAGE_ASPECT_DEPTH_BIT);
+	}
+}
+
 void VulkanRenderer::createDescriptorSetLayout()
 {
 	// MVP Binding Info
@@ -512,9 +1300,10 @@ void VulkanRenderer::createDescriptorSetLayout()
 	vpLayoutBinding.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;								//shader stage to bind to
 	vpLayoutBinding.pImmutableSamplers = nullptr;											//for textures can make sampler data unchangeable
 
+	//object table binding info
 	VkDescriptorSetLayoutBinding modelLayoutBinding = {};
 	modelLayoutBinding.binding = 1;
-	modelLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
+	modelLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
 	modelLayoutBinding.descriptorCount = 1;
 	modelLayoutBinding.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
 	modelLayoutBinding.pImmutableSamplers = nullptr;
@@ -535,152 +1324,61 @@ void VulkanRenderer::createDescriptorSetLayout()
 
 }
 
-void VulkanRenderer::createGraphicsPipeline()
-{
-
-	//read in SPIR-V code of shaders
-	auto vertexShaderCode = readFile("Shaders/vert.spv");
-	auto fragmentShaderCode = readFile("Shaders/frag.spv");
-
-
-	//build shader modules to link to graphics pipeline
-	VkShaderModule vertexShaderModule = createShaderModule(vertexShaderCode);
-	VkShaderModule fragmentShaderModule = createShaderModule(fragmentShaderCode);
-
-	// -- shader stage creation information --
-
-	//Vertex Stage creation information
-	VkPipelineShaderStageCreateInfo vertexShaderCreateInfo = {};
-	vertexShaderCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
-	vertexShaderCreateInfo.stage = VK_SHADER_STAGE_VERTEX_BIT;								//Shader stage name
-	vertexShaderCreateInfo.module = vertexShaderModule;										//shader module to be used by stage
-	vertexShaderCreateInfo.pName = "main";													//entry point into shader
-
-	//Fragment stage creation information
-	VkPipelineShaderStageCreateInfo fragmentShaderCreateInfo = {};
-	fragmentShaderCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
-	fragmentShaderCreateInfo.stage = VK_SHADER_STAGE_FRAGMENT_BIT;							//Shader stage name
-	fragmentShaderCreateInfo.module = fragmentShaderModule;									//shader module to be used by stage
-	fragmentShaderCreateInfo.pName = "main";												//entry point into shader
-
-	//put shader stage creation info into array
-	//graphics piel;ine creation info requires array of shader stage creates
-	VkPipelineShaderStageCreateInfo shaderStages[] = { vertexShaderCreateInfo, fragmentShaderCreateInfo };
-
-	// how the data for a single vertex (including info such as position, color, texture, coords, normals) is as a whole
-	VkVertexInputBindingDescription bindingDescription = {};
-	bindingDescription.binding = 0;															//can bind multiple streams of data, this defines which one
-	bindingDescription.stride = sizeof(Vertex);												//size of singe vertex object
-	bindingDescription.inputRate = VK_VERTEX_INPUT_RATE_VERTEX;								//how to move between data after each vertex
-
-	//how the data for an attribute is defined within a vertex
-	std::array<VkVertexInputAttributeDescription, 2> attributeDescriptions;
-
-	//positions attribute
-	attributeDescriptions[0].binding = 0;													//which binding the data is at (should be same as above)
-	attributeDescriptions[0].location = 0;													//location in shader where data will be read from
-	attributeDescriptions[0].format = VK_FORMAT_R32G32B32_SFLOAT;							//format the data will take (helps define the size of the data)
-	attributeDescriptions[0].offset = offsetof(Vertex, pos);									//where this attribute is defined in the data for a single vertex
-
-	//color attribute
-	attributeDescriptions[1].binding = 0;													
-	attributeDescriptions[1].location = 1;													
-	attributeDescriptions[1].format = VK_FORMAT_R32G32B32_SFLOAT;							
-	attributeDescriptions[1].offset = offsetof(Vertex, col);									
-
-
-	//--vertex input-- 
-	VkPipelineVertexInputStateCreateInfo vertexInputCreateInfo = {};
-	vertexInputCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
-	vertexInputCreateInfo.vertexBindingDescriptionCount = 1;
-	vertexInputCreateInfo.pVertexBindingDescriptions = &bindingDescription;								//list of vertex binding descriptions (data spacing/stride info)
-	vertexInputCreateInfo.vertexAttributeDescriptionCount = static_cast<uint32_t>(attributeDescriptions.size());
-	vertexInputCreateInfo.pVertexAttributeDescriptions = attributeDescriptions.data();							//list of vertex attribute descriptions (data format and where to bind to/from)
-
-	//--input assembly --
-	VkPipelineInputAssemblyStateCreateInfo inputAssembly = {};
-	inputAssembly.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
-	inputAssembly.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;							//Primitive type to assemble vertices as
-	inputAssembly.primitiveRestartEnable = VK_FALSE;										//Allow overrideing of strip tobology to start new primitives
-
-	//--viewport and scissor--
-	//create a viewport info struct
-	VkViewport viewport = {};
-	viewport.x = 0.0f;																		//x start coordinate
-	viewport.y = 0.0f;																		//y start coordinate
-	viewport.width = (float)swapChainExtent.width;											//width of viewport
-	viewport.height = (float)swapChainExtent.height;										//height of viewport
-	viewport.minDepth = 0.0f;																//min frame buffer depth
-	viewport.maxDepth = 1.0f;																//max frame buffer depth
-
-	//create a scissor info struct
-	VkRect2D scissor = {};
-	scissor.offset = { 0,0 };																//offset to use region from
-	scissor.extent = swapChainExtent;														//extent to descrive region to use, starting at offset
-
-	VkPipelineViewportStateCreateInfo viewportStateCreateInfo = {};
-	viewportStateCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
-	viewportStateCreateInfo.viewportCount = 1;
-	viewportStateCreateInfo.pViewports = &viewport;
-	viewportStateCreateInfo.scissorCount = 1;
-	viewportStateCreateInfo.pScissors = &scissor;
-
-	//--Dynamic state--
-	//dynamic states to enable
-	//std::vector<VkDynamicState> dynamicStateEnables;
-	//dynamicStateEnables.push_back(VK_DYNAMIC_STATE_VIEWPORT);
-	//dynamicStateEnables.push_back(VK_DYNAMIC_STATE_SCISSOR);
-
-	//dynamic state creation info
-	//VkPipelineDynamicStateCreateInfo dynamicStateCreateInfo = {};
-	//dynamicStateCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
-	//dynamicStateCreateInfo.dynamicStateCount = static_cast<uint32_t>(dynamicStateEnables.size());
-	//dynamicStateCreateInfo.pDynamicStates = dynamicStateEnables.data();
-
-	//--rasterizer--
-	VkPipelineRasterizationStateCreateInfo rasterizerCreateInfo = {};
-	rasterizerCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
-	rasterizerCreateInfo.depthClampEnable = VK_FALSE;												//clips fragments past a far plane(need to enable a device feature)
-	rasterizerCreateInfo.rasterizerDiscardEnable = VK_FALSE;										//whether to discard data and skip rasterizer. never creates framnets, oinly suitable for pipline without framebuffer output
-	rasterizerCreateInfo.polygonMode = VK_POLYGON_MODE_FILL;										//how polygons are filled(change for wireframe or points)(other than fill needs a gpu feature)
-	rasterizerCreateInfo.lineWidth = 1.0f;															//how thick lines should be when drawn(gpu feature)
-	rasterizerCreateInfo.cullMode = VK_CULL_MODE_BACK_BIT;											//which face of a trianlge to cull
-	rasterizerCreateInfo.frontFace = VK_FRONT_FACE_COUNTER_CLOCKWISE;								//winding to determine which side is front
-	rasterizerCreateInfo.depthBiasEnable = VK_FALSE;												//whether to add depth bias to fragments
-
-	//--multisampling--
-	VkPipelineMultisampleStateCreateInfo multisamplingCreateInfo = {};
-	multisamplingCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
-	multisamplingCreateInfo.sampleShadingEnable = VK_FALSE;											//enable multisampling or not
-	multisamplingCreateInfo.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;							//number of samples per fragment
-
-	//--blending--
-	//Blending decides how to belnd a new color being written to a fragment, with the old value
-
-	//blend attatchment state (how blending is handled)]
-	VkPipelineColorBlendAttachmentState colorState = {};
-	colorState.colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT					//colors to apply blending to
-		| VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
-	colorState.blendEnable = VK_TRUE;																//enable blending
-
-	//blending uses equation: (srcColorBlendFactor * newColor) colorBlendOp (dstColorBlendFactor * oldColor)
-	colorState.srcColorBlendFactor = VK_BLEND_FACTOR_SRC_ALPHA;
-	colorState.dstColorBlendFactor = VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA;
-	colorState.colorBlendOp = VK_BLEND_OP_ADD;
-
-	//summarised: (VK_BLEND_FACTOR_SRC_ALPHA * new color) + (VK_BLEND_FACTOR * old color)
-
-	colorState.srcAlphaBlendFactor = VK_BLEND_FACTOR_ONE;
-	colorState.dstAlphaBlendFactor = VK_BLEND_FACTOR_ZERO;
-	colorState.alphaBlendOp = VK_BLEND_OP_ADD;
-	//summarised: 1*newalpha + 0*oldalpha = newalpha
-
-	VkPipelineColorBlendStateCreateInfo colorBlendingCreateInfo = {};
-	colorBlendingCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
-	colorBlendingCreateInfo.logicOpEnable = VK_FALSE;												//alternative to calculations is to use logical operations
-	colorBlendingCreateInfo.attachmentCount = 1;
-	colorBlendingCreateInfo.pAttachments = &colorState;
+void VulkanRenderer::createPipelines()
+{
+	auto createStart = std::chrono::steady_clock::now();
+	pipelineCache.create(mainDevice.physicalDevice, mainDevice.logicalDevice, pipelineCachePath);
+	createPipelineLayout();
+	pipelineRegistry.init(mainDevice.logicalDevice, &pipelineCache, pipelineLayout, renderPass, swapChainExtent, vertexLayout, reverseDepth,
+		PIPELINE_COMPILE_THREADS);
+
+	//each pipeline compiles on its own thread straight into the persistent cache, which the driver synchronizes,
+	//so whatever was loaded from disk is hit rather than only merged into
+	VkPipelineCache cache = pipelineCache.getCache();
+	ThreadPool pipelineThreads;
+	pipelineThreads.start(2);
+	try {
+		pipelineThreads.run(2, [this, cache](uint32_t task) {
+			if (task == 0) {
+				//default pipeline every mesh starts with and draws with while its own is compiling
+				defaultPipeline = pipelineRegistry.build(PipelineDesc(), cache);
+				graphicsPipeline = pipelineRegistry.getPipeline(defaultPipeline);
+
+				//the registry is filled from one thread at a time, so the prepass pipeline follows on this one
+				PipelineDesc prepassDesc;
+				prepassDesc.vertexShader = "Shaders/depth.spv";
+				prepassDesc.fragmentShader = "";
+				prepassDesc.colorWrite = false;
+				prepassDesc.positionOnly = true;
+				bool prepassShaderFound = true;
+				try {
+					readFile(prepassDesc.vertexShader);
+				}
+				catch (const std::runtime_error&) {
+					prepassShaderFound = false;
+				}
+				if (prepassShaderFound) {
+					depthPrepassPipeline = pipelineRegistry.getPipeline(pipelineRegistry.build(prepassDesc, cache));
+				}
+			}
+			else {
+				//indirect draws need these, no point compiling the cull shader without them
+				cullPipelineCreated = multiDrawIndirectSupported && gpuCulling.createPipeline(mainDevice.logicalDevice, cache);
+			}
+		});
+	}
+	catch (...) {
+		pipelineThreads.stop();
+		throw;
+	}
+	pipelineThreads.stop();
 
+	std::chrono::duration<double, std::milli> createTime = std::chrono::steady_clock::now() - createStart;
+	pipelineCache.getStats().pipelineCreateMs = createTime.count();
+}
+
+void VulkanRenderer::createPipelineLayout()
+{
 	// --pipelinhe layout--
 	VkPipelineLayoutCreateInfo pipelineLayoutCreateInfo = {};
 	pipelineLayoutCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
@@ -694,41 +1392,6 @@ void VulkanRenderer::createGraphicsPipeline()
 	if (result != VK_SUCCESS) {
 		throw std::runtime_error("failed to create pipeline layout");
 	}
-
-	//--depth stencil testing--
-	//TODO set up depth stencil testing
-
-	//--graphics pipeline creation--
-
-	VkGraphicsPipelineCreateInfo pipelineCreateInfo = {};
-	pipelineCreateInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
-	pipelineCreateInfo.stageCount = 2;
-	pipelineCreateInfo.pStages = shaderStages;
-	pipelineCreateInfo.pVertexInputState = &vertexInputCreateInfo;
-	pipelineCreateInfo.pInputAssemblyState = &inputAssembly;
-	pipelineCreateInfo.pViewportState = &viewportStateCreateInfo;
-	pipelineCreateInfo.pDynamicState = nullptr;
-	pipelineCreateInfo.pRasterizationState = &rasterizerCreateInfo;
-	pipelineCreateInfo.pMultisampleState = &multisamplingCreateInfo;
-	pipelineCreateInfo.pColorBlendState = &colorBlendingCreateInfo;
-	pipelineCreateInfo.pDepthStencilState = nullptr;
-	pipelineCreateInfo.layout = pipelineLayout;												//pipeline layout pipeline should use
-	pipelineCreateInfo.renderPass = renderPass;												//rener pass description the pipline should use
-	pipelineCreateInfo.subpass = 0;															//subpass of render pass to use with the pipeline
-
-	//pipeline derivatives : can create multiple pipelines that derive from on another for optimization
-	pipelineCreateInfo.basePipelineHandle = VK_NULL_HANDLE;									//existing pipeline to derive from
-	pipelineCreateInfo.basePipelineIndex = -1;												//or index of pipeline being created to derive in case creating multiple at once
-
-	//create graphics pipeline
-	result = vkCreateGraphicsPipelines(mainDevice.logicalDevice, VK_NULL_HANDLE, 1, &pipelineCreateInfo, nullptr, &graphicsPipeline);
-	if (result != VK_SUCCESS) {
-		throw std::runtime_error("failed to create a graphics pipeline");
-	}
-	//Destroy shader modules, no longer needed after pipeline created
-	vkDestroyShaderModule(mainDevice.logicalDevice, fragmentShaderModule, nullptr);
-	vkDestroyShaderModule(mainDevice.logicalDevice, vertexShaderModule, nullptr);
-
 }
 
 void VulkanRenderer::createFrameBuffers()
@@ -739,8 +1402,9 @@ void VulkanRenderer::createFrameBuffers()
 	//create a framebuffer for each swapchain image
 	for (size_t i = 0; i < swapChainFramebuffers.size(); i++) {
 
-		std::array<VkImageView, 1> attachments = {
-			swapChainImages[i].imageView
+		std::array<VkImageView, 2> attachments = {
+			swapChainImages[i].imageView,
+			depthBufferImageViews[i]
 		};
 
 		VkFramebufferCreateInfo frambebufferCreateInfo = {};
@@ -769,6 +1433,8 @@ void VulkanRenderer::createCommandPool()
 	poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
 	poolInfo.queueFamilyIndex = queueFamilyIndices.graphicsFamily; // queue family type that buffers from this command pool will use
 
+	poolInfo.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;		//allow command buffers to be re-recorded when the scene changes
+
 	//create a graphics framily command pool
 	VkResult result = vkCreateCommandPool(mainDevice.logicalDevice, &poolInfo, nullptr, &graphicsCommandPool);
 	if (result != VK_SUCCESS) {
@@ -776,30 +1442,84 @@ void VulkanRenderer::createCommandPool()
 	}
 }
 
+void VulkanRenderer::createFrameContexts()
+{
+	//one per frame in flight, swapchain images keep nothing but their framebuffer and depth buffer
+	frameContexts.resize(framesInFlight);
+	currentFrame = 0;
+
+	createCommandBuffers();
+	createSynchronization();
+	createUniformBuffers();
+	createDescriptorPool();
+	createDescriptorSets();
+	createQueryPools();
+
+	//cull pass keeps its buffers per context as well, and reads each context's object table
+	if (gpuCullingSupported) {
+		gpuCulling.setFrameCount(framesInFlight);
+	}
+	writeUniformDescriptors();
+
+	imageFrames.assign(swapChainImages.size(), 0);
+}
+
+void VulkanRenderer::destroyFrameContexts()
+{
+	//GPU must be idle, destroying pools frees what was allocated from them
+	for (FrameContext& context : frameContexts) {
+		vkDestroyQueryPool(mainDevice.logicalDevice, context.timestampQueryPool, nullptr);
+		vkDestroyQueryPool(mainDevice.logicalDevice, context.statisticsQueryPool, nullptr);
+		vkDestroyDescriptorPool(mainDevice.logicalDevice, context.descriptorPool, nullptr);
+		vkFreeCommandBuffers(mainDevice.logicalDevice, graphicsCommandPool, 1, &context.drawCommands);
+		vkDestroyCommandPool(mainDevice.logicalDevice, context.commandPool, nullptr);
+		vkDestroySemaphore(mainDevice.logicalDevice, context.renderFinished, nullptr);
+		vkDestroySemaphore(mainDevice.logicalDevice, context.imageAvailable, nullptr);
+		vkDestroyFence(mainDevice.logicalDevice, context.fence, nullptr);
+	}
+	frameContexts.clear();
+	uniformRing.destroy();
+}
+
 void VulkanRenderer::createCommandBuffers()
 {
-	//resize command buffer count to have one for each framebuffer
-	commandBuffers.resize(swapChainFramebuffers.size());
+	//one transient pool per frame context, reset as a whole instead of freeing buffers
+	QueueFamilyIndices queueFamilyIndices = getQueueFamilies(mainDevice.physicalDevice);
+
+	VkCommandPoolCreateInfo poolInfo = {};
+	poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+	poolInfo.queueFamilyIndex = queueFamilyIndices.graphicsFamily;
+	poolInfo.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
 
 	VkCommandBufferAllocateInfo cbAllocInfo = {};
 	cbAllocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
-	cbAllocInfo.commandPool = graphicsCommandPool;
-	cbAllocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+	cbAllocInfo.commandBufferCount = 1;
 
-	cbAllocInfo.commandBufferCount = static_cast<uint32_t>(commandBuffers.size());
+	for (FrameContext& context : frameContexts) {
+		VkResult result = vkCreateCommandPool(mainDevice.logicalDevice, &poolInfo, nullptr, &context.commandPool);
+		if (result != VK_SUCCESS) {
+			throw std::runtime_error("Failed to create a frame command pool");
+		}
 
-	VkResult result = vkAllocateCommandBuffers(mainDevice.logicalDevice, &cbAllocInfo, commandBuffers.data());
-	if (result != VK_SUCCESS) {
-		throw std::runtime_error("Failed to allocate Command Buffers!");
+		cbAllocInfo.commandPool = context.commandPool;
+		cbAllocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+		result = vkAllocateCommandBuffers(mainDevice.logicalDevice, &cbAllocInfo, &context.commandBuffer);
+		if (result != VK_SUCCESS) {
+			throw std::runtime_error("Failed to allocate a frame command buffer");
+		}
+
+		//prerecorded draws outlive the frame's pool reset, so come from the pool that allows re-recording single buffers
+		cbAllocInfo.commandPool = graphicsCommandPool;
+		cbAllocInfo.level = VK_COMMAND_BUFFER_LEVEL_SECONDARY;
+		result = vkAllocateCommandBuffers(mainDevice.logicalDevice, &cbAllocInfo, &context.drawCommands);
+		if (result != VK_SUCCESS) {
+			throw std::runtime_error("Failed to allocate Command Buffers!");
+		}
 	}
 }
 
 void VulkanRenderer::createSynchronization()
 {
-	imageAvailable.resize(MAX_FRAME_DRAWS);
-	renderFinished.resize(MAX_FRAME_DRAWS);
-	drawFences.resize(MAX_FRAME_DRAWS);
-
 	// semaphore creation information
 	VkSemaphoreCreateInfo semaphoreCreateInfo = {};
 	semaphoreCreateInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
@@ -809,37 +1529,141 @@ void VulkanRenderer::createSynchronization()
 	fenceCreateInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
 	fenceCreateInfo.flags = VK_FENCE_CREATE_SIGNALED_BIT;
 
-	for (size_t i = 0; i < MAX_FRAME_DRAWS; i++) {
-		if (vkCreateSemaphore(mainDevice.logicalDevice, &semaphoreCreateInfo, nullptr, &imageAvailable[i]) != VK_SUCCESS ||
-			vkCreateSemaphore(mainDevice.logicalDevice, &semaphoreCreateInfo, nullptr, &renderFinished[i]) != VK_SUCCESS ||
-			vkCreateFence(mainDevice.logicalDevice, &fenceCreateInfo, nullptr, &drawFences[i]) != VK_SUCCESS) {
+	//timeline frames are waited on by value, so only the fallback needs fences
+	for (FrameContext& context : frameContexts) {
+		if (vkCreateSemaphore(mainDevice.logicalDevice, &semaphoreCreateInfo, nullptr, &context.imageAvailable) != VK_SUCCESS ||
+			vkCreateSemaphore(mainDevice.logicalDevice, &semaphoreCreateInfo, nullptr, &context.renderFinished) != VK_SUCCESS ||
+			(!gpuTimeline.isEnabled() && vkCreateFence(mainDevice.logicalDevice, &fenceCreateInfo, nullptr, &context.fence) != VK_SUCCESS)) {
 		
 			throw std::runtime_error("failed to create a semaphore or fence");
 		}
 	}
 }
 
+void VulkanRenderer::createRecordingPools(uint32_t taskCount)
+{
+	//command pools are externally synchronised, so each recording task gets its own
+	QueueFamilyIndices queueFamilyIndices = getQueueFamilies(mainDevice.physicalDevice);
+
+	VkCommandPoolCreateInfo poolInfo = {};
+	poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+	poolInfo.queueFamilyIndex = queueFamilyIndices.graphicsFamily;
+	poolInfo.flags = 0;																//whole pool is reset before re-recording
+
+	recordingCommandPools.resize(taskCount);
+	secondaryCommandBuffers.resize(taskCount);
+	for (uint32_t task = 0; task < taskCount; task++) {
+		VkResult result = vkCreateCommandPool(mainDevice.logicalDevice, &poolInfo, nullptr, &recordingCommandPools[task]);
+		if (result != VK_SUCCESS) {
+			throw std::runtime_error("Failed to create a recording command pool");
+		}
+
+		//one secondary per frame context, and another for the context's depth prepass
+		secondaryCommandBuffers[task].resize(frameContexts.size() * 2);
+
+		VkCommandBufferAllocateInfo cbAllocInfo = {};
+		cbAllocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+		cbAllocInfo.commandPool = recordingCommandPools[task];
+		cbAllocInfo.level = VK_COMMAND_BUFFER_LEVEL_SECONDARY;
+		cbAllocInfo.commandBufferCount = static_cast<uint32_t>(secondaryCommandBuffers[task].size());
+
+		result = vkAllocateCommandBuffers(mainDevice.logicalDevice, &cbAllocInfo, secondaryCommandBuffers[task].data());
+		if (result != VK_SUCCESS) {
+			throw std::runtime_error("Failed to allocate secondary command buffers");
+		}
+	}
+}
+
+void VulkanRenderer::destroyRecordingPools()
+{
+	//destroying pools frees their command buffers
+	for (auto pool : recordingCommandPools) {
+		vkDestroyCommandPool(mainDevice.logicalDevice, pool, nullptr);
+	}
+	recordingCommandPools.clear();
+	secondaryCommandBuffers.clear();
+}
+
+void VulkanRenderer::createQueryPools()
+{
+	//timestamps are only usable if the graphics queue family writes valid bits
+	QueueFamilyIndices indices = getQueueFamilies(mainDevice.physicalDevice);
+	uint32_t queueFamilyCount = 0;
+	vkGetPhysicalDeviceQueueFamilyProperties(mainDevice.physicalDevice, &queueFamilyCount, nullptr);
+	std::vector<VkQueueFamilyProperties> queueFamilyList(queueFamilyCount);
+	vkGetPhysicalDeviceQueueFamilyProperties(mainDevice.physicalDevice, &queueFamilyCount, queueFamilyList.data());
+
+	uint32_t timestampValidBits = queueFamilyList[indices.graphicsFamily].timestampValidBits;
+	timestampsSupported = timestampValidBits > 0;
+	timestampMask = timestampValidBits >= 64 ? ~0ULL : ((1ULL << timestampValidBits) - 1);
+
+	//one set of pools for each frame context
+	if (timestampsSupported) {
+		//frame start, render pass start, end of each batch, frame end
+		VkQueryPoolCreateInfo timestampPoolInfo = {};
+		timestampPoolInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+		timestampPoolInfo.queryType = VK_QUERY_TYPE_TIMESTAMP;
+		timestampPoolInfo.queryCount = MAX_TIMESTAMP_BATCHES + 3;
+
+		for (FrameContext& context : frameContexts) {
+			VkResult result = vkCreateQueryPool(mainDevice.logicalDevice, &timestampPoolInfo, nullptr, &context.timestampQueryPool);
+			if (result != VK_SUCCESS) {
+				throw std::runtime_error("failed to create a timestamp query pool");
+			}
+		}
+	}
+
+	if (pipelineStatisticsSupported) {
+		//results come back in bit order of the statistics requested
+		VkQueryPoolCreateInfo statisticsPoolInfo = {};
+		statisticsPoolInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+		statisticsPoolInfo.queryType = VK_QUERY_TYPE_PIPELINE_STATISTICS;
+		statisticsPoolInfo.queryCount = 1;
+		pipelineStatisticsFlags = VK_QUERY_PIPELINE_STATISTIC_INPUT_ASSEMBLY_VERTICES_BIT
+			| VK_QUERY_PIPELINE_STATISTIC_INPUT_ASSEMBLY_PRIMITIVES_BIT
+			| VK_QUERY_PIPELINE_STATISTIC_VERTEX_SHADER_INVOCATIONS_BIT
+			| VK_QUERY_PIPELINE_STATISTIC_CLIPPING_PRIMITIVES_BIT
+			| VK_QUERY_PIPELINE_STATISTIC_FRAGMENT_SHADER_INVOCATIONS_BIT;
+		statisticsPoolInfo.pipelineStatistics = pipelineStatisticsFlags;
+
+		for (FrameContext& context : frameContexts) {
+			VkResult result = vkCreateQueryPool(mainDevice.logicalDevice, &statisticsPoolInfo, nullptr, &context.statisticsQueryPool);
+			if (result != VK_SUCCESS) {
+				throw std::runtime_error("failed to create a pipeline statistics query pool");
+			}
+		}
+	}
+}
+
+void VulkanRenderer::createGpuCulling()
+{
+	//only compiled when the device has multi draw indirect and the shader was found
+	if (!cullPipelineCreated) return;
+
+	//per frame buffers follow once the frame contexts exist
+	gpuCulling.init(&allocator, drawIndexedIndirectCount, maxDrawIndirectCount, std::max(minUniformBufferOffset, minStorageBufferOffset));
+	gpuCulling.resize(static_cast<uint32_t>(objectCapacity), std::max<uint32_t>(1, geometryArena.getPageCount()));
+	gpuCullingSupported = true;
+}
+
+void VulkanRenderer::resizeGpuCulling()
+{
+	//indirect buffers may be in use by frames in flight
+	vkDeviceWaitIdle(mainDevice.logicalDevice);
+	gpuCulling.resize(static_cast<uint32_t>(objectCapacity), std::max<uint32_t>(1, geometryArena.getPageCount()));
+	commandsDirty = true;
+}
+
 void VulkanRenderer::createUniformBuffers()
 {
-	//view projection buffer size
-	VkDeviceSize vpBufferSize = sizeof(UboViewProjection);
-
-	//model buffer size
-	VkDeviceSize modelBufferSize = modelUniformAlignment * MAX_OBJECTS;
-
-	// one uniform buffer for each images (and by extension command buffer)
-	vpUniformBuffer.resize(swapChainImages.size());
-	vpUniformBufferMemory.resize(swapChainImages.size());
-
-	modelDUniformBuffer.resize(swapChainImages.size());
-	modelDUniformBufferMemory.resize(swapChainImages.size());
-
-	//create unfiform buffers
-	for (size_t i = 0; i < swapChainImages.size(); i++) {
-		createBuffer(mainDevice.physicalDevice, mainDevice.logicalDevice, vpBufferSize, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, &vpUniformBuffer[i], &vpUniformBufferMemory[i]);
-		createBuffer(mainDevice.physicalDevice, mainDevice.logicalDevice, modelBufferSize, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, &modelDUniformBuffer[i], &modelDUniformBufferMemory[i]);
-
-	}
+	//descriptor offsets into the ring must satisfy both uniform and storage buffer alignment
+	VkDeviceSize ringAlignment = std::max(minUniformBufferOffset, minStorageBufferOffset);
+	objectTableBase = (sizeof(UboViewProjection) + ringAlignment - 1) & ~(ringAlignment - 1);
+
+	//one segment for each frame context: view projection uniform followed by the object table
+	VkDeviceSize segmentSize = objectTableBase + sizeof(UboModel) * objectCapacity;
+	uniformRing.create(&allocator, mainDevice.logicalDevice, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+		ringAlignment, segmentSize, static_cast<uint32_t>(frameContexts.size()));
 }
 
 void VulkanRenderer::createDescriptorPool()
@@ -847,120 +1671,474 @@ void VulkanRenderer::createDescriptorPool()
 	//type of descriptors + how many Descriptors, not descriptor sets (combined makes the pool size)
 	VkDescriptorPoolSize vpPoolSize = {};
 	vpPoolSize.type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-	vpPoolSize.descriptorCount = static_cast<uint32_t>(vpUniformBuffer.size());
+	vpPoolSize.descriptorCount = 1;
 
 	VkDescriptorPoolSize modelPoolSize = {};
-	modelPoolSize.type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
-	modelPoolSize.descriptorCount = static_cast<uint32_t>(modelDUniformBuffer.size());
+	modelPoolSize.type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+	modelPoolSize.descriptorCount = 1;
 
 	//list of pool sizes
 	std::vector<VkDescriptorPoolSize> descriptorPoolSizes = { vpPoolSize, modelPoolSize };
 
-	//data to create Descriptor Pool
+	//data to create Descriptor Pool, each frame context owns a pool holding just its own set
 	VkDescriptorPoolCreateInfo poolCreateInfo = {};
 	poolCreateInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
-	poolCreateInfo.maxSets = static_cast<uint32_t>(swapChainImages.size());									//max number of descriptor sets that can be created from poo;l
+	poolCreateInfo.maxSets = 1;																				//max number of descriptor sets that can be created from poo;l
 	poolCreateInfo.poolSizeCount = static_cast<uint32_t>(descriptorPoolSizes.size());						// amount of pool sizes being passed
 	poolCreateInfo.pPoolSizes = descriptorPoolSizes.data();													//pool siuzes to create pool with
 
-	//create descriptor pool
-	VkResult result = vkCreateDescriptorPool(mainDevice.logicalDevice, &poolCreateInfo, nullptr, &descriptorPool);
-	if (result != VK_SUCCESS) {
-		throw std::runtime_error("failed to create a descriptor pool");
+	//create descriptor pools
+	for (FrameContext& context : frameContexts) {
+		VkResult result = vkCreateDescriptorPool(mainDevice.logicalDevice, &poolCreateInfo, nullptr, &context.descriptorPool);
+		if (result != VK_SUCCESS) {
+			throw std::runtime_error("failed to create a descriptor pool");
+		}
 	}
 }
 
 void VulkanRenderer::createDescriptorSets()
 {
-	//resize descriptor set list so one for every buffer
-	descriptorSets.resize(swapChainImages.size());
-
-	std::vector<VkDescriptorSetLayout> setLayouts(swapChainImages.size(), descriptorSetLayout);
-
 	//Descriptor Set Allocation Info
 	VkDescriptorSetAllocateInfo setAllocInfo = {};
 	setAllocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
-	setAllocInfo.descriptorPool = descriptorPool;											//pool to allocate descriptor set from
-	setAllocInfo.descriptorSetCount = static_cast<uint32_t>(swapChainImages.size());			//number of sets to allocate
-	setAllocInfo.pSetLayouts = setLayouts.data();											//layouts to use to allocate sets
+	setAllocInfo.descriptorSetCount = 1;													//number of sets to allocate
+	setAllocInfo.pSetLayouts = &descriptorSetLayout;										//layouts to use to allocate sets
 
-	//allocate descriptor sets (multiple)
-	VkResult result = vkAllocateDescriptorSets(mainDevice.logicalDevice, &setAllocInfo, descriptorSets.data());
-	if (result != VK_SUCCESS) {
-		throw std::runtime_error("failed to allocate descriptor sets");
+	//allocate one descriptor set per frame context, written once the uniform ring exists
+	for (FrameContext& context : frameContexts) {
+		setAllocInfo.descriptorPool = context.descriptorPool;								//pool to allocate descriptor set from
+		VkResult result = vkAllocateDescriptorSets(mainDevice.logicalDevice, &setAllocInfo, &context.descriptorSet);
+		if (result != VK_SUCCESS) {
+			throw std::runtime_error("failed to allocate descriptor sets");
+		}
 	}
+}
 
-	//update all of descriptor set buffer bindings
-	for (size_t i = 0; i < swapChainImages.size(); i++) {
+void VulkanRenderer::writeUniformDescriptors()
+{
+	//update all of descriptor set buffer bindings, each context's set reads its own segment of the uniform ring
+	for (size_t i = 0; i < frameContexts.size(); i++) {
+		VkDeviceSize segmentOffset = uniformRing.getSegmentOffset(static_cast<uint32_t>(i));
 
 		//view projection descriptor
 		//buffer info adn data offset info
 		VkDescriptorBufferInfo vpBufferInfo = {};
-		vpBufferInfo.buffer = vpUniformBuffer[i];											//buffer to get data from
-		vpBufferInfo.offset = 0;															//position of start of data
+		vpBufferInfo.buffer = uniformRing.getBuffer();										//buffer to get data from
+		vpBufferInfo.offset = segmentOffset;												//position of start of data
 		vpBufferInfo.range = sizeof(UboViewProjection);										//size of data
 
 		VkWriteDescriptorSet vpSetWrite = {};
 		vpSetWrite.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-		vpSetWrite.dstSet = descriptorSets[i];												//descriptor set to update
+		vpSetWrite.dstSet = frameContexts[i].descriptorSet;									//descriptor set to update
 		vpSetWrite.dstBinding = 0;															// binding to update
 		vpSetWrite.dstArrayElement = 0;														//index in array to update
 		vpSetWrite.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;						//type of descriptor
 		vpSetWrite.descriptorCount = 1;
 		vpSetWrite.pBufferInfo = &vpBufferInfo;												//information about buffer data to bind
 
-		//model descriptor
-		//model buffer binding info
+		//object table descriptor
+		//covers every object slot in the segment, shader indexes it by instance
 		VkDescriptorBufferInfo modelBufferInfo = {};
-		modelBufferInfo.buffer = modelDUniformBuffer[i];
-		modelBufferInfo.offset = 0;
-		modelBufferInfo.range = modelUniformAlignment;
+		modelBufferInfo.buffer = uniformRing.getBuffer();
+		modelBufferInfo.offset = segmentOffset + objectTableBase;
+		modelBufferInfo.range = sizeof(UboModel) * objectCapacity;
 
 		VkWriteDescriptorSet modelSetWrite = {};
 		modelSetWrite.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-		modelSetWrite.dstSet = descriptorSets[i];
+		modelSetWrite.dstSet = frameContexts[i].descriptorSet;
 		modelSetWrite.dstBinding = 1;
 		modelSetWrite.dstArrayElement = 0;
-		modelSetWrite.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
+		modelSetWrite.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
 		modelSetWrite.descriptorCount = 1;
 		modelSetWrite.pBufferInfo = &modelBufferInfo;
 
-		//list of descriptor set writes
-		std::vector<VkWriteDescriptorSet> setWrites = { vpSetWrite, modelSetWrite };
-
-
 		//update the descriptor sets wioth new buffer/binding info
+		std::array<VkWriteDescriptorSet, 2> setWrites = { vpSetWrite, modelSetWrite };
 		vkUpdateDescriptorSets(mainDevice.logicalDevice, static_cast<uint32_t>(setWrites.size()), setWrites.data(), 0, nullptr);
+
+		//cull pass reads the same model matrices
+		if (gpuCullingSupported) {
+			gpuCulling.setObjectTable(static_cast<uint32_t>(i), modelBufferInfo.buffer, modelBufferInfo.offset, modelBufferInfo.range);
+		}
+	}
+}
+
+void VulkanRenderer::resizeUniformBuffers(size_t newCapacity)
+{
+	//ring and descriptor sets may be in use by frames still in flight
+	vkDeviceWaitIdle(mainDevice.logicalDevice);
+
+	if (sizeof(UboModel) * newCapacity > maxStorageBufferRange) {
+		throw std::runtime_error("object table exceeds maxStorageBufferRange");
+	}
+
+	uniformRing.destroy();
+	objectCapacity = newCapacity;
+	createUniformBuffers();
+
+	//point descriptor sets at the new ring (invalidates recorded command buffers)
+	writeUniformDescriptors();
+	if (gpuCullingSupported) {
+		resizeGpuCulling();
+	}
+	commandsDirty = true;
+}
+
+void VulkanRenderer::updateUniformBuffers(uint32_t frameIndex)
+{
+	//ranges come out in the order descriptors expect: view projection, then the object table from objectTableBase
+	uniformRing.beginSegment(frameIndex);
+
+	UniformRange vpRange = uniformRing.allocate(sizeof(UboViewProjection));
+	memcpy(vpRange.data, &uboViewProjection, sizeof(UboViewProjection));
+
+	//nothing to copy for an empty scene
+	if (meshList.empty()) return;
+
+	//write model data straight into mapped memory, tightly packed (std430 stride of mat4 + 2 vec4)
+	UniformRange objectRange = uniformRing.allocate(sizeof(UboModel) * meshList.size());
+	UboModel* objects = static_cast<UboModel*>(objectRange.data);
+	for (size_t i = 0; i < meshList.size(); i++) {
+		objects[i] = meshList[i].getModel();
+	}
+}
+
+void VulkanRenderer::updateObjectBounds(int meshID)
+{
+	//sphere moves with the model matrix and grows with its largest axis scale
+	Mesh& mesh = meshList[meshID];
+	glm::mat4 model = mesh.getModel().model;
+	glm::vec3 center = glm::vec3(model * glm::vec4(mesh.getBoundsCenter(), 1.0f));
+	float scale = std::max(glm::length(glm::vec3(model[0])), std::max(glm::length(glm::vec3(model[1])), glm::length(glm::vec3(model[2]))));
+
+	objectBounds.set(meshID, center, mesh.getBoundsRadius() * scale);
+}
+
+void VulkanRenderer::updateGpuDraw(int meshID)
+{
+	if (!gpuCullingSupported) return;
+
+	//model space bounds, the cull pass applies the model matrix itself, destroyed meshes keep the default never drawn entry
+	GpuDrawInfo draw;
+	Mesh& mesh = meshList[meshID];
+	if (mesh.hasGeometry()) {
+		MeshLod lod = mesh.getLod(selectedLods[meshID]);
+		draw.sphere = glm::vec4(mesh.getBoundsCenter(), mesh.getBoundsRadius());
+		draw.indexCount = lod.indexCount;
+		draw.firstIndex = lod.firstIndex;
+		draw.vertexOffset = mesh.getVertexOffset();
+		draw.page = mesh.getGeometryPage();
+	}
+	gpuCulling.setDraw(static_cast<uint32_t>(meshID), draw);
+}
+
+void VulkanRenderer::selectLods()
+{
+	if (lodMeshCount == 0) return;
+	auto selectStart = std::chrono::steady_clock::now();
+
+	//pixels a world unit covers one unit in front of the camera, an error e at depth d then covers e * pixelsPerUnit / d pixels
+	float pixelsPerUnit = std::fabs(uboViewProjection.projection[1][1]) * swapChainExtent.height * 0.5f;
+	bool changed = false;
+	for (size_t i = 0; i < meshList.size(); i++) {
+		Mesh& mesh = meshList[i];
+		if (!mesh.hasGeometry() || mesh.getLodCount() < 2) continue;
+
+		//nearest depth of the world space bounds, anything reaching the camera plane gets the full mesh
+		glm::vec3 center(objectBounds.centerX[i], objectBounds.centerY[i], objectBounds.centerZ[i]);
+		float radius = objectBounds.radius[i];
+		float depth = -(uboViewProjection.view * glm::vec4(center, 1.0f)).z - radius;
+
+		//coarsest level whose error, scaled like the bounds and projected at that depth, stays under the threshold
+		//levels coarser than the current one have to stay under a reduced threshold, refining happens straight away
+		uint32_t level = 0;
+		if (depth > 0.0f) {
+			float scale = mesh.getBoundsRadius() > 0.0f ? radius / mesh.getBoundsRadius() : 1.0f;
+			float maxError = lodThreshold * depth / (pixelsPerUnit * scale);
+			float coarsenError = maxError * LOD_COARSEN_FACTOR;
+			while (level + 1 < mesh.getLodCount() && mesh.getLod(level + 1).error <= maxError) {
+				if (level + 1 > selectedLods[i] && mesh.getLod(level + 1).error > coarsenError) break;
+				level++;
+			}
+		}
+
+		if (level != selectedLods[i]) {
+			selectedLods[i] = level;
+			updateGpuDraw(static_cast<int>(i));
+			changed = true;
+		}
+	}
+
+	//indirect draws read their ranges from the draw table each frame, direct ones have them recorded in
+	if (changed && !gpuCullingEnabled) {
+		commandsDirty = true;
+	}
+
+	std::chrono::duration<double, std::milli> selectTime = std::chrono::steady_clock::now() - selectStart;
+	lodStats.selectMs = selectTime.count();
+}
+
+void VulkanRenderer::countLodDraws()
+{
+	if (lodMeshCount == 0) {
+		lodStats = LodStats();
+		return;
+	}
+
+	double selectMs = lodStats.selectMs;
+	lodStats = LodStats();
+	lodStats.selectMs = selectMs;
+	auto count = [this](uint32_t meshID) {
+		uint32_t level = selectedLods[meshID];
+		lodStats.objects[level]++;
+		lodStats.triangles[level] += meshList[meshID].getLod(level).indexCount / 3;
+	};
+
+	//the draw list is what the current command buffers hold, the cull pass chooses from every live object
+	if (gpuCullingEnabled) {
+		for (size_t i = 0; i < meshList.size(); i++) {
+			if (meshList[i].hasGeometry()) count(static_cast<uint32_t>(i));
+		}
+	}
+	else {
+		for (uint32_t meshID : drawList) {
+			count(meshID);
+		}
 	}
 }
 
-void VulkanRenderer::updateUniformBuffers(uint32_t imageIndex)
+void VulkanRenderer::buildDrawList()
 {
-	//copy vp data	
-	void* data;
-	vkMapMemory(mainDevice.logicalDevice, vpUniformBufferMemory[imageIndex], 0, sizeof(UboViewProjection), 0, &data);
-	memcpy(data, &uboViewProjection, sizeof(UboViewProjection));
-	vkUnmapMemory(mainDevice.logicalDevice, vpUniformBufferMemory[imageIndex]);
+	//the cull pass picks the draws on the GPU, nothing to build
+	if (gpuCullingEnabled) {
+		drawList.clear();
+		cullingStats = CullingStats();
+		cullingStats.gpu = true;
+		cullingStats.tested = static_cast<uint32_t>(meshList.size());
+		return;
+	}
+
+	//prerecorded buffers are replayed whatever the view, so only per frame recording can leave objects out
+	if (commandBufferMode == CommandBufferMode::PerFrame && frustumCullingEnabled) {
+		auto cullStart = std::chrono::steady_clock::now();
+
+		//destroyed meshes have a radius that never passes
+		Frustum frustum = extractFrustum(uboViewProjection.projection * uboViewProjection.view);
+		drawList.resize(meshList.size());
+		drawList.resize(cullSpheres(cullingKernel, frustum, objectBounds, drawList.data()));
+
+		std::chrono::duration<double, std::milli> cullTime = std::chrono::steady_clock::now() - cullStart;
+		cullingStats.kernel = cullingKernel;
+		cullingStats.tested = static_cast<uint32_t>(meshList.size());
+		cullingStats.visible = static_cast<uint32_t>(drawList.size());
+		cullingStats.cullMs = cullTime.count();
+		sortDrawList();
+		cullClusters();
+		return;
+	}
 
-	//copy model data
+	//destroyed meshes keep their slot (and object table entry) until reused, but are not drawn
+	drawList.clear();
 	for (size_t i = 0; i < meshList.size(); i++) {
-		UboModel* thisModel = (UboModel*)((uint64_t)modelTrnasferSpace + (i * modelUniformAlignment));
-		*thisModel = meshList[i].getModel();
+		if (meshList[i].hasGeometry()) {
+			drawList.push_back(static_cast<uint32_t>(i));
+		}
+	}
+	sortDrawList();
+	cullClusters();
+}
+
+void VulkanRenderer::sortDrawList()
+{
+	if (!depthSortEnabled) return;
+
+	//nearest first, so depth tests reject what is behind before it is shaded
+	//this gives up the draw list's page and pipeline runs, each change between neighbours costs a rebind
+	depthSortKeys.resize(drawList.size());
+	for (size_t j = 0; j < drawList.size(); j++) {
+		uint32_t meshID = drawList[j];
+		glm::vec3 center(objectBounds.centerX[meshID], objectBounds.centerY[meshID], objectBounds.centerZ[meshID]);
+		float depth = std::max(0.0f, -(uboViewProjection.view * glm::vec4(center, 1.0f)).z - objectBounds.radius[meshID]);
+
+		//non negative floats order like their bit patterns
+		uint32_t depthBits;
+		memcpy(&depthBits, &depth, sizeof(depthBits));
+		depthSortKeys[j] = (static_cast<uint64_t>(depthBits) << 32) | meshID;
+	}
+	std::sort(depthSortKeys.begin(), depthSortKeys.end());
+	for (size_t j = 0; j < drawList.size(); j++) {
+		drawList[j] = static_cast<uint32_t>(depthSortKeys[j]);
+	}
+}
+
+void VulkanRenderer::cullClusters()
+{
+	clusterDraws.clear();
+	clusterDrawOffsets.clear();
+	cullingStats.clustersTested = 0;
+	cullingStats.clustersVisible = 0;
+	cullingStats.clusterDraws = 0;
+	cullingStats.clusterCullMs = 0.0;
+	if (commandBufferMode != CommandBufferMode::PerFrame || !clusterCullingEnabled || meshletMeshCount == 0) return;
+	auto cullStart = std::chrono::steady_clock::now();
+
+	//objects without meshlets keep their level's whole range, objects with none left are dropped from the draw list
+	glm::mat4 viewProjection = uboViewProjection.projection * uboViewProjection.view;
+	size_t kept = 0;
+	for (size_t j = 0; j < drawList.size(); j++) {
+		uint32_t meshID = drawList[j];
+		Mesh& mesh = meshList[meshID];
+		MeshLod lod = mesh.getLod(selectedLods[meshID]);
+		uint32_t offset = static_cast<uint32_t>(clusterDraws.size());
+
+		if (!mesh.hasMeshlets() || lod.meshletCount == 0) {
+			clusterDraws.push_back({ lod.firstIndex, lod.indexCount });
+		}
+		else {
+			//tested in object space, so each object transforms the frustum and camera once rather than every meshlet's bounds
+			glm::mat4 model = mesh.getModel().model;
+			Frustum frustum = extractFrustum(viewProjection * model);
+			glm::vec3 camera = glm::vec3(glm::inverse(uboViewProjection.view * model)[3]);
+			//cones only say which side faces away for counter clockwise front faces with back faces culled,
+			//and mirroring turns the winding, and every cone, around
+			const PipelineDesc& pipelineDesc = pipelineRegistry.getDesc(meshPipelines[meshID]);
+			bool coneCulling = pipelineDesc.cullMode == VK_CULL_MODE_BACK_BIT && pipelineDesc.frontFace == VK_FRONT_FACE_COUNTER_CLOCKWISE
+				&& glm::determinant(glm::mat3(model)) > 0.0f;
+
+			const Meshlet* meshlets = mesh.getMeshlets() + lod.firstMeshlet;
+			visibleMeshlets.resize(lod.meshletCount);
+			uint32_t visibleCount = cullMeshlets(meshlets, lod.meshletCount, frustum, camera, coneCulling, visibleMeshlets.data());
+			cullingStats.clustersTested += lod.meshletCount;
+			cullingStats.clustersVisible += visibleCount;
+
+			//meshlets are consecutive index ranges, so a run of visible ones is one draw
+			for (uint32_t v = 0; v < visibleCount; v++) {
+				const Meshlet& meshlet = meshlets[visibleMeshlets[v]];
+				uint32_t firstIndex = mesh.getFirstIndex() + meshlet.firstIndex;
+				if (clusterDraws.size() > offset && clusterDraws.back().firstIndex + clusterDraws.back().indexCount == firstIndex) {
+					clusterDraws.back().indexCount += meshlet.indexCount;
+				}
+				else {
+					clusterDraws.push_back({ firstIndex, meshlet.indexCount });
+				}
+			}
+			cullingStats.clusterDraws += static_cast<uint32_t>(clusterDraws.size()) - offset;
+		}
+
+		if (clusterDraws.size() == offset) continue;
+		drawList[kept++] = meshID;
+		clusterDrawOffsets.push_back(offset);
+	}
+	drawList.resize(kept);
+	clusterDrawOffsets.push_back(static_cast<uint32_t>(clusterDraws.size()));
+
+	std::chrono::duration<double, std::milli> cullTime = std::chrono::steady_clock::now() - cullStart;
+	cullingStats.clusterCullMs = cullTime.count();
+}
+
+void VulkanRenderer::resolvePipelines()
+{
+	//one snapshot per recording, so every draw (and every recording thread) sees the same set of ready pipelines
+	recordedFinishedCount = pipelineRegistry.getFinishedCount();
+	VkPipeline standIn = pendingPipelineMode == PendingPipelineMode::Fallback ? graphicsPipeline : VK_NULL_HANDLE;
+	resolvedPipelines.resize(pipelineRegistry.getPipelineCount());
+	for (PipelineHandle handle = 0; handle < resolvedPipelines.size(); handle++) {
+		resolvedPipelines[handle] = pipelineRegistry.isReady(handle) ? pipelineRegistry.getPipeline(handle) : standIn;
 	}
 
-	//map the list of model data
-	vkMapMemory(mainDevice.logicalDevice, modelDUniformBufferMemory[imageIndex], 0, modelUniformAlignment * meshList.size(), 0, &data);
-	memcpy(data, modelTrnasferSpace, modelUniformAlignment * meshList.size());
-	vkUnmapMemory(mainDevice.logicalDevice, modelDUniformBufferMemory[imageIndex]);
+	//a failed pipeline never becomes ready and keeps its stand in, only compiles still in flight warrant a re-record
+	recordedWithPending = false;
+	for (uint32_t meshID : drawList) {
+		if (pipelineRegistry.isPending(meshPipelines[meshID])) {
+			recordedWithPending = true;
+			break;
+		}
+	}
+}
 
+size_t VulkanRenderer::getRecordedDrawCount()
+{
+	//indirect draws are issued (and timed) once per geometry page
+	return gpuCullingEnabled ? geometryArena.getPageCount() : drawList.size();
+}
+
+size_t VulkanRenderer::getDrawBatchSize()
+{
+	//split draws into at most MAX_TIMESTAMP_BATCHES even batches, each timed separately
+	return std::max<size_t>(1, (getRecordedDrawCount() + MAX_TIMESTAMP_BATCHES - 1) / MAX_TIMESTAMP_BATCHES);
 }
 
 void VulkanRenderer::recordCommands()
 {
+	auto recordStart = std::chrono::steady_clock::now();
+	buildDrawList();
+	resolvePipelines();
+
+	//only worth splitting when every task gets a reasonable share of the draws
+	uint32_t taskCount = 0;
+	if (recordingMode == RecordingMode::Parallel) {
+		size_t usefulTasks = drawList.size() / MIN_DRAWS_PER_RECORDING_TASK;
+		taskCount = static_cast<uint32_t>(std::min<size_t>(recordingCommandPools.size(), usefulTasks));
+	}
+	if (taskCount > 1) {
+		size_t batchSize = getDrawBatchSize();
+		recordingThreads.run(taskCount, [this, taskCount, batchSize](uint32_t task) {
+			recordSecondaryCommands(task, taskCount, batchSize);
+		});
+	}
+	else {
+		//one copy of the draws per frame context, each binds its own descriptor set and writes its own queries
+		taskCount = 0;
+		for (uint32_t i = 0; i < frameContexts.size(); i++) {
+			VkCommandBuffer commandBuffer = frameContexts[i].drawCommands;
+			beginDrawCommands(commandBuffer);
+			recordSceneDraws(commandBuffer, i);
+
+			VkResult result = vkEndCommandBuffer(commandBuffer);
+			if (result != VK_SUCCESS) {
+				throw std::runtime_error("Failed to stop recording a secondary command buffer");
+			}
+		}
+	}
+	prerecordedTaskCount = taskCount;
+
+	std::chrono::duration<double, std::milli> recordTime = std::chrono::steady_clock::now() - recordStart;
+	lastRecordMs = recordTime.count();
+}
+
+void VulkanRenderer::recordFrame(uint32_t frameIndex, uint32_t imageIndex)
+{
+	auto recordStart = std::chrono::steady_clock::now();
+
+	//context's frame has finished, so everything allocated from its pool is free to reuse
+	VkResult result = vkResetCommandPool(mainDevice.logicalDevice, frameContexts[frameIndex].commandPool, 0);
+	if (result != VK_SUCCESS) {
+		throw std::runtime_error("Failed to reset a frame command pool");
+	}
+
+	//prerecorded draws only need wrapping in the acquired image's render pass, per frame recording builds them here as well
+	bool perFrame = commandBufferMode == CommandBufferMode::PerFrame;
+	if (perFrame) {
+		buildDrawList();
+		resolvePipelines();
+	}
+	recordFrameCommands(frameIndex, imageIndex);
+
+	if (perFrame) {
+		std::chrono::duration<double, std::milli> recordTime = std::chrono::steady_clock::now() - recordStart;
+		lastRecordMs = recordTime.count();
+	}
+}
+
+void VulkanRenderer::recordFrameCommands(uint32_t frameIndex, uint32_t imageIndex)
+{
+	FrameContext& context = frameContexts[frameIndex];
+	VkCommandBuffer commandBuffer = context.commandBuffer;
+
 	//information about how to begin each command buffer
 	VkCommandBufferBeginInfo bufferBeginInfo = {};
 	bufferBeginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
-	bufferBeginInfo.flags = VK_COMMAND_BUFFER_USAGE_SIMULTANEOUS_USE_BIT;					//buffer can be resubmitted if already submitted
+	bufferBeginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;					//recorded again for the context's next frame
 
 	//information about how to begin a render pass, only needed for graphical applications
 	VkRenderPassBeginInfo renderPassBeginInfo = {};
@@ -968,56 +2146,312 @@ void VulkanRenderer::recordCommands()
 	renderPassBeginInfo.renderPass = renderPass;											//render pass to begin
 	renderPassBeginInfo.renderArea.offset = { 0,0 };										//start point of render pass in pixels
 	renderPassBeginInfo.renderArea.extent = swapChainExtent;								//size of region to run render pass on
-	VkClearValue clearValues[] = {
-		{0.6f, 0.65f, 0.4f, 1.0f}
-	};
-	renderPassBeginInfo.pClearValues = clearValues;											//List of clear values (TODO: depth attachment clear value)
-	renderPassBeginInfo.clearValueCount = 1;
+	std::array<VkClearValue, 2> clearValues = {};
+	clearValues[0].color = { 0.6f, 0.65f, 0.4f, 1.0f };
+	clearValues[1].depthStencil.depth = reverseDepth ? 0.0f : 1.0f;							//farthest depth
+	renderPassBeginInfo.pClearValues = clearValues.data();									//List of clear values, one per attachment
+	renderPassBeginInfo.clearValueCount = static_cast<uint32_t>(clearValues.size());
+	renderPassBeginInfo.framebuffer = swapChainFramebuffers[imageIndex];
+
+	size_t batchSize = getDrawBatchSize();
+	uint32_t batchCount = static_cast<uint32_t>((getRecordedDrawCount() + batchSize - 1) / batchSize);
+	uint32_t timestampCount = batchCount + 3;
+	context.timestampCount = timestampCount;
+
+	//start recording commands into command buffer
+	VkResult result = vkBeginCommandBuffer(commandBuffer, &bufferBeginInfo);
+	if (result != VK_SUCCESS) {
+		throw std::runtime_error("Failed to start recording a command buffer");
+	}
+		//queries must be reset outside of a render pass before being written
+		if (timestampsSupported) {
+			vkCmdResetQueryPool(commandBuffer, context.timestampQueryPool, 0, timestampCount);
+			vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, context.timestampQueryPool, 0);
+		}
+		if (pipelineStatisticsSupported) {
+			vkCmdResetQueryPool(commandBuffer, context.statisticsQueryPool, 0, 1);
+			vkCmdBeginQuery(commandBuffer, context.statisticsQueryPool, 0, 0);
+		}
 
-	for (size_t i = 0; i < commandBuffers.size(); i++) {
+		//culling writes the indirect draws, which has to happen before the render pass reads them
+		if (gpuCullingEnabled) {
+			gpuCulling.recordCull(commandBuffer, frameIndex, static_cast<uint32_t>(meshList.size()));
+		}
 
-		renderPassBeginInfo.framebuffer = swapChainFramebuffers[i];
+		if (commandBufferMode == CommandBufferMode::Prerecorded) {
+			//the subpass holds nothing but the draws recorded when the scene last changed, every task's prepass ahead of any colour
+			vkCmdBeginRenderPass(commandBuffer, &renderPassBeginInfo, VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS);
 
-		//start recording commands into command buffer
-		VkResult result = vkBeginCommandBuffer(commandBuffers[i], &bufferBeginInfo);
-		if (result != VK_SUCCESS) {
-			throw std::runtime_error("Failed to start recording a command buffer");
+				std::vector<VkCommandBuffer> secondaries;
+				if (prerecordedTaskCount == 0) {
+					secondaries.push_back(context.drawCommands);
+				}
+				else {
+					if (depthPrepassEnabled) {
+						for (uint32_t task = 0; task < prerecordedTaskCount; task++) {
+							secondaries.push_back(secondaryCommandBuffers[task][frameContexts.size() + frameIndex]);
+						}
+					}
+					for (uint32_t task = 0; task < prerecordedTaskCount; task++) {
+						secondaries.push_back(secondaryCommandBuffers[task][frameIndex]);
+					}
+				}
+				vkCmdExecuteCommands(commandBuffer, static_cast<uint32_t>(secondaries.size()), secondaries.data());
 		}
+		else {
 			//Begin render pass
-			vkCmdBeginRenderPass(commandBuffers[i], &renderPassBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
+			vkCmdBeginRenderPass(commandBuffer, &renderPassBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
+
+				recordSceneDraws(commandBuffer, frameIndex);
+		}
 
-				//Bind pipeline to be used in render pass
-				vkCmdBindPipeline(commandBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, graphicsPipeline);
+		//end render pass
+		vkCmdEndRenderPass(commandBuffer);
 
-				for (size_t j = 0; j < meshList.size(); j++) {
+		if (pipelineStatisticsSupported) {
+			vkCmdEndQuery(commandBuffer, context.statisticsQueryPool, 0);
+		}
+		if (timestampsSupported) {
+			vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, context.timestampQueryPool, timestampCount - 1);
+		}
+
+	//stop recording to command buffer
+	result = vkEndCommandBuffer(commandBuffer);
+	if (result != VK_SUCCESS) {
+		throw std::runtime_error("Failed to stop recording a command buffer");
+	}
+}
 
-					VkBuffer vertexBuffers[] = { meshList[j].getVertexBuffer() };					//buffers to bind
-					VkDeviceSize offsets[] = { 0 };												//offsets into buffers being bound
-					vkCmdBindVertexBuffers(commandBuffers[i], 0, 1, vertexBuffers, offsets);	//command to bind vertex buffer before drawing with them
+void VulkanRenderer::beginDrawCommands(VkCommandBuffer commandBuffer)
+{
+	//secondaries record inside the primary's render pass and query, which they need to know about up front
+	//no framebuffer, so the same draws serve whichever image the context's frame acquires
+	VkCommandBufferInheritanceInfo inheritanceInfo = {};
+	inheritanceInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO;
+	inheritanceInfo.renderPass = renderPass;
+	inheritanceInfo.subpass = 0;
+	inheritanceInfo.framebuffer = VK_NULL_HANDLE;
+	inheritanceInfo.pipelineStatistics = pipelineStatisticsSupported ? pipelineStatisticsFlags : 0;
+
+	//only executed by its own context's frames, which never overlap
+	VkCommandBufferBeginInfo bufferBeginInfo = {};
+	bufferBeginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+	bufferBeginInfo.flags = VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT;
+	bufferBeginInfo.pInheritanceInfo = &inheritanceInfo;
 
-					vkCmdBindIndexBuffer(commandBuffers[i], meshList[j].getIndexBuffer(), 0, VK_INDEX_TYPE_UINT32);
+	VkResult result = vkBeginCommandBuffer(commandBuffer, &bufferBeginInfo);
+	if (result != VK_SUCCESS) {
+		throw std::runtime_error("Failed to start recording a secondary command buffer");
+	}
+}
 
-					//dynamic offset amount
-					uint32_t dynamicOffset = static_cast<uint32_t>(modelUniformAlignment) * j;
+void VulkanRenderer::recordSecondaryCommands(uint32_t task, uint32_t taskCount, size_t batchSize)
+{
+	//runs on a worker thread: only touches this task's pool and buffers, everything else is read only
+	VkResult result = vkResetCommandPool(mainDevice.logicalDevice, recordingCommandPools[task], 0);
+	if (result != VK_SUCCESS) {
+		throw std::runtime_error("Failed to reset a recording command pool");
+	}
 
-					//bind descriptor sets
-					vkCmdBindDescriptorSets(commandBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 0, 1, &descriptorSets[i], 1, &dynamicOffset);
+	//contiguous share of the draw list, so executing tasks in order keeps the serial draw order
+	size_t first = drawList.size() * task / taskCount;
+	size_t last = drawList.size() * (task + 1) / taskCount;
 
-					//Execute our pipeline
-					vkCmdDrawIndexed(commandBuffers[i], meshList[j].getIndexCount(), 1, 0, 0, 0);
-				}
+	//colour secondaries, then the depth prepass ones
+	size_t contextCount = frameContexts.size();
+	size_t bufferCount = depthPrepassEnabled ? contextCount * 2 : contextCount;
+	for (size_t b = 0; b < bufferCount; b++) {
+		VkCommandBuffer commandBuffer = secondaryCommandBuffers[task][b];
+		beginDrawCommands(commandBuffer);
 
-			//end render pass
-			vkCmdEndRenderPass(commandBuffers[i]);
+		recordDrawRange(commandBuffer, static_cast<uint32_t>(b % contextCount), first, last, batchSize, b >= contextCount);
 
-		//stop recording to command buffer
-		result = vkEndCommandBuffer(commandBuffers[i]);
+		result = vkEndCommandBuffer(commandBuffer);
 		if (result != VK_SUCCESS) {
-			throw std::runtime_error("Failed to stop recording a command buffer");
+			throw std::runtime_error("Failed to stop recording a secondary command buffer");
+		}
+	}
+}
+
+void VulkanRenderer::recordSceneDraws(VkCommandBuffer commandBuffer, uint32_t frameIndex)
+{
+	//depth first, so the colour pass only shades fragments that pass an equal depth test
+	if (gpuCullingEnabled) {
+		if (depthPrepassEnabled) recordIndirectDraws(commandBuffer, frameIndex, true);
+		recordIndirectDraws(commandBuffer, frameIndex, false);
+	}
+	else {
+		size_t batchSize = getDrawBatchSize();
+		if (depthPrepassEnabled) recordDrawRange(commandBuffer, frameIndex, 0, drawList.size(), batchSize, true);
+		recordDrawRange(commandBuffer, frameIndex, 0, drawList.size(), batchSize, false);
+	}
+}
+
+void VulkanRenderer::recordDrawRange(VkCommandBuffer commandBuffer, uint32_t frameIndex, size_t first, size_t last, size_t batchSize, bool depthOnly)
+{
+	//batches are timed by the colour pass alone, a depth prepass runs before timestamp 1 so only the frame total includes it
+	bool timed = timestampsSupported && !depthOnly;
+	VkQueryPool timestampPool = frameContexts[frameIndex].timestampQueryPool;
+
+	//start of the draws, written by whichever buffer records the first one
+	if (timed && first == 0) {
+		vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, timestampPool, 1);
+	}
+
+	//bind descriptor sets once, every draw reads the same object table and every pipeline shares the layout
+	vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 0, 1, &frameContexts[frameIndex].descriptorSet, 0, nullptr);
+
+	//geometry shares arena pages, so buffers are only rebound when a draw moves to another page
+	//pipelines likewise, secondary buffers inherit no state so each binds its own
+	uint32_t boundPage = std::numeric_limits<uint32_t>::max();
+	VkPipeline boundPipeline = VK_NULL_HANDLE;
+	for (size_t j = first; j < last; j++) {
+		Mesh& mesh = meshList[drawList[j]];
+		VkPipeline pipeline = resolvedPipelines[meshPipelines[drawList[j]]];
+		if (depthOnly) {
+			//only meshes on the default pipeline, others may rasterise differently (topology, culling) and are depth tested in the colour pass alone
+			pipeline = meshPipelines[drawList[j]] == defaultPipeline ? depthPrepassPipeline : VK_NULL_HANDLE;
+		}
+
+		if (pipeline == VK_NULL_HANDLE) {
+			//pipeline not ready and skipping, the batch still ends where it would have
+			if (timed && ((j + 1) % batchSize == 0 || j + 1 == drawList.size())) {
+				vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, timestampPool, static_cast<uint32_t>(2 + j / batchSize));
+			}
+			continue;
+		}
+
+		if (pipeline != boundPipeline) {
+			boundPipeline = pipeline;
+			vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline);
+		}
+
+		if (mesh.getGeometryPage() != boundPage) {
+			boundPage = mesh.getGeometryPage();
+
+			//one buffer per stream of the vertex layout
+			uint32_t streamCount = geometryArena.getVertexStreamCount();
+			VkBuffer vertexBuffers[MAX_VERTEX_STREAMS];									//buffers to bind
+			VkDeviceSize offsets[MAX_VERTEX_STREAMS] = {};								//offsets into buffers being bound
+			for (uint32_t s = 0; s < streamCount; s++) {
+				vertexBuffers[s] = mesh.getVertexBuffer(s);
+			}
+			vkCmdBindVertexBuffers(commandBuffer, 0, streamCount, vertexBuffers, offsets);		//command to bind vertex buffers before drawing with them
+
+			vkCmdBindIndexBuffer(commandBuffer, mesh.getIndexBuffer(), 0, mesh.getIndexType());
+		}
+
+		//Execute our pipeline, offsets select the mesh's level within the page and first instance its entry in the object table
+		//cluster culling leaves each object one or more ranges of its level
+		if (!clusterDrawOffsets.empty()) {
+			for (uint32_t c = clusterDrawOffsets[j]; c < clusterDrawOffsets[j + 1]; c++) {
+				vkCmdDrawIndexed(commandBuffer, clusterDraws[c].indexCount, 1, clusterDraws[c].firstIndex, mesh.getVertexOffset(), drawList[j]);
+			}
+		}
+		else {
+			MeshLod lod = mesh.getLod(selectedLods[drawList[j]]);
+			vkCmdDrawIndexed(commandBuffer, lod.indexCount, 1, lod.firstIndex, mesh.getVertexOffset(), drawList[j]);
+		}
+
+		//end of a draw batch (bottom of pipe: all previous work has finished)
+		if (timed && ((j + 1) % batchSize == 0 || j + 1 == drawList.size())) {
+			vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, timestampPool, static_cast<uint32_t>(2 + j / batchSize));
+		}
+	}
+}
+
+void VulkanRenderer::recordIndirectDraws(VkCommandBuffer commandBuffer, uint32_t frameIndex, bool depthOnly)
+{
+	bool timed = timestampsSupported && !depthOnly;
+	VkQueryPool timestampPool = frameContexts[frameIndex].timestampQueryPool;
+	if (timed) {
+		vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, timestampPool, 1);
+	}
+
+	//indirect draws cover every mesh on a page at once, so they all use the default pipeline (or its depth only counterpart)
+	vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, depthOnly ? depthPrepassPipeline : graphicsPipeline);
+	vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 0, 1, &frameContexts[frameIndex].descriptorSet, 0, nullptr);
+
+	//one indirect call per geometry page replaces the per mesh draws, the cull pass decided which of them draw anything
+	size_t batchSize = getDrawBatchSize();
+	uint32_t pageCount = geometryArena.getPageCount();
+	uint32_t streamCount = geometryArena.getVertexStreamCount();
+	for (uint32_t page = 0; page < pageCount; page++) {
+		VkBuffer vertexBuffers[MAX_VERTEX_STREAMS];
+		VkDeviceSize offsets[MAX_VERTEX_STREAMS] = {};
+		for (uint32_t s = 0; s < streamCount; s++) {
+			vertexBuffers[s] = geometryArena.getVertexBuffer(page, s);
+		}
+		vkCmdBindVertexBuffers(commandBuffer, 0, streamCount, vertexBuffers, offsets);
+		vkCmdBindIndexBuffer(commandBuffer, geometryArena.getIndexBuffer(page), 0, geometryArena.getIndexType(page));
+
+		gpuCulling.recordDraws(commandBuffer, frameIndex, page, static_cast<uint32_t>(meshList.size()));
+
+		if (timed && ((page + 1) % batchSize == 0 || page + 1 == pageCount)) {
+			vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, timestampPool, static_cast<uint32_t>(2 + page / batchSize));
 		}
 	}
 }
 
+void VulkanRenderer::collectQueryResults(uint32_t frameIndex)
+{
+	//only called once the context's latest frame is known to be finished
+	FrameContext& context = frameContexts[frameIndex];
+	uint64_t frameNumber = context.queryFrame;
+	if (frameNumber == 0) return;
+	context.queryFrame = 0;
+
+	GpuFrameStats stats;
+	stats.frameNumber = frameNumber;
+
+	if (timestampsSupported) {
+		uint32_t timestampCount = context.timestampCount;
+		std::vector<uint64_t> timestamps(timestampCount);
+		VkResult result = vkGetQueryPoolResults(mainDevice.logicalDevice, context.timestampQueryPool, 0, timestampCount,
+			timestamps.size() * sizeof(uint64_t), timestamps.data(), sizeof(uint64_t), VK_QUERY_RESULT_64_BIT);
+
+		if (result == VK_SUCCESS) {
+			//convert tick difference to milliseconds, masking off invalid high bits
+			auto ticksToMs = [this](uint64_t begin, uint64_t end) {
+				return static_cast<double>((end - begin) & timestampMask) * timestampPeriod / 1000000.0;
+			};
+
+			stats.gpuFrameMs = ticksToMs(timestamps[0], timestamps[timestampCount - 1]);
+			for (uint32_t batch = 0; batch + 3 < timestampCount; batch++) {
+				stats.batchMs.push_back(ticksToMs(timestamps[1 + batch], timestamps[2 + batch]));
+			}
+			stats.timestampsValid = true;
+		}
+	}
+
+	if (pipelineStatisticsSupported) {
+		uint64_t statistics[5] = {};
+		VkResult result = vkGetQueryPoolResults(mainDevice.logicalDevice, context.statisticsQueryPool, 0, 1,
+			sizeof(statistics), statistics, sizeof(statistics), VK_QUERY_RESULT_64_BIT);
+
+		if (result == VK_SUCCESS) {
+			stats.inputVertices = statistics[0];
+			stats.inputPrimitives = statistics[1];
+			stats.vertexShaderInvocations = statistics[2];
+			stats.clippingPrimitives = statistics[3];
+			stats.fragmentShaderInvocations = statistics[4];
+			stats.pipelineStatisticsValid = true;
+		}
+	}
+
+	if (stats.frameNumber > gpuFrameStats.frameNumber) {
+		gpuFrameStats = stats;
+	}
+}
+
+void VulkanRenderer::collectAllQueryResults()
+{
+	//device must be idle, every pending query is then available
+	for (uint32_t i = 0; i < frameContexts.size(); i++) {
+		collectQueryResults(i);
+	}
+}
+
 void VulkanRenderer::getPhysicalDevice()
 {
 	//Enumerate Physical devices the vkInstance can acces
@@ -1045,15 +2479,11 @@ void VulkanRenderer::getPhysicalDevice()
 	vkGetPhysicalDeviceProperties(mainDevice.physicalDevice, &deviceProperties);
 
 	minUniformBufferOffset = deviceProperties.limits.minUniformBufferOffsetAlignment;
-}
-
-void VulkanRenderer::allocateDynamicBufferTransferSpace()
-{
-	//calculate alignment of model data
-	modelUniformAlignment = (sizeof(UboModel) + minUniformBufferOffset - 1) & ~(minUniformBufferOffset - 1);
-
-	//create space in memory to hold dynamic buffer that is alligned to our required allignment and holds MAX_OBJECTS
-	modelTrnasferSpace = (UboModel*)_aligned_malloc(modelUniformAlignment * MAX_OBJECTS, modelUniformAlignment);
+	minStorageBufferOffset = deviceProperties.limits.minStorageBufferOffsetAlignment;
+	maxStorageBufferRange = deviceProperties.limits.maxStorageBufferRange;
+	maxDrawIndirectCount = deviceProperties.limits.maxDrawIndirectCount;
+	timestampPeriod = deviceProperties.limits.timestampPeriod;
+	deviceName = deviceProperties.deviceName;
 }
 
 bool VulkanRenderer::checkInstanceExtensionSupport(std::vector<const char*>* checkExtensions)
@@ -1117,6 +2547,21 @@ bool VulkanRenderer::checkDeviceExtensionSupport(VkPhysicalDevice device)
 
 }
 
+bool VulkanRenderer::checkDeviceExtensionAvailable(VkPhysicalDevice device, const char* extensionName)
+{
+	uint32_t extensionsCount = 0;
+	vkEnumerateDeviceExtensionProperties(device, nullptr, &extensionsCount, nullptr);
+	std::vector<VkExtensionProperties> extensions(extensionsCount);
+	vkEnumerateDeviceExtensionProperties(device, nullptr, &extensionsCount, extensions.data());
+
+	for (const auto& extension : extensions) {
+		if (strcmp(extensionName, extension.extensionName) == 0) {
+			return true;
+		}
+	}
+	return false;
+}
+
 bool VulkanRenderer::checkDeviceSuitable(VkPhysicalDevice device)
 {
 	/*
@@ -1130,6 +2575,11 @@ bool VulkanRenderer::checkDeviceSuitable(VkPhysicalDevice device)
 	*/
 	QueueFamilyIndices indices = getQueueFamilies(device);
 
+	//no surface to present to, any device with a graphics queue will do (including software ICDs)
+	if (headless) {
+		return indices.isValid();
+	}
+
 	bool extensionsSupported = checkDeviceExtensionSupport(device);
 	
 	bool swapChainValid = false;
@@ -1191,7 +2641,13 @@ QueueFamilyIndices VulkanRenderer::getQueueFamilies(VkPhysicalDevice device)
 
 		//Check if queue family supports presentation
 		VkBool32 presentationSupport = false;
-		vkGetPhysicalDeviceSurfaceSupportKHR(device, i, surface, &presentationSupport);
+		if (surface == VK_NULL_HANDLE) {
+			//nothing is presented when headless, so the graphics queue stands in
+			presentationSupport = indices.graphicsFamily == i;
+		}
+		else {
+			vkGetPhysicalDeviceSurfaceSupportKHR(device, i, surface, &presentationSupport);
+		}
 		// check if queue is presentation type (can be both graphics and presentation)
 		if (queueFamily.queueCount > 0 && presentationSupport) {
 			indices.presentationFamily = i;
@@ -1204,6 +2660,16 @@ QueueFamilyIndices VulkanRenderer::getQueueFamilies(VkPhysicalDevice device)
 		i++;
 	}
 
+	//prefer a transfer only family (DMA engine) so uploads run alongside rendering, otherwise share the graphics family
+	indices.transferFamily = indices.graphicsFamily;
+	for (size_t j = 0; j < queueFamilyList.size(); j++) {
+		VkQueueFlags flags = queueFamilyList[j].queueFlags;
+		if (queueFamilyList[j].queueCount > 0 && (flags & VK_QUEUE_TRANSFER_BIT) && !(flags & (VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT))) {
+			indices.transferFamily = static_cast<int>(j);
+			break;
+		}
+	}
+
 	return indices;
 }
 
@@ -1263,11 +2729,19 @@ VkSurfaceFormatKHR VulkanRenderer::chooseBestSurfaceFormat(const std::vector<VkS
 
 VkPresentModeKHR VulkanRenderer::chooseBestPresentationMode(const std::vector<VkPresentModeKHR> presentationModes)
 {
+	//mailbox replaces a queued image with a newer one, so the CPU never waits on the display and the newest frame is shown
+	//immediate can tear, only low latency takes it when mailbox is missing
+	std::vector<VkPresentModeKHR> preferred;
+	if (framePacing != FramePacingMode::VsyncCapped) {
+		preferred.push_back(VK_PRESENT_MODE_MAILBOX_KHR);
+	}
+	if (framePacing == FramePacingMode::LowLatency) {
+		preferred.push_back(VK_PRESENT_MODE_IMMEDIATE_KHR);
+	}
 
-	//Look for mailbox presentation mode
-	for (const auto& presentationMode : presentationModes) {
-		if (presentationMode == VK_PRESENT_MODE_MAILBOX_KHR) {
-			return presentationMode;
+	for (VkPresentModeKHR mode : preferred) {
+		if (std::find(presentationModes.begin(), presentationModes.end(), mode) != presentationModes.end()) {
+			return mode;
 		}
 	}
 
@@ -1300,6 +2774,60 @@ VkExtent2D VulkanRenderer::chooseSwapExtent(const VkSurfaceCapabilitiesKHR& surf
 	}
 }
 
+VkFormat VulkanRenderer::chooseSupportedFormat(const std::vector<VkFormat>& formats, VkImageTiling tiling, VkFormatFeatureFlags featureFlags)
+{
+	//first of the formats, in order of preference, that supports the features with this tiling
+	for (VkFormat format : formats) {
+		VkFormatProperties properties;
+		vkGetPhysicalDeviceFormatProperties(mainDevice.physicalDevice, format, &properties);
+
+		VkFormatFeatureFlags supported = tiling == VK_IMAGE_TILING_OPTIMAL ? properties.optimalTilingFeatures : properties.linearTilingFeatures;
+		if ((supported & featureFlags) == featureFlags) {
+			return format;
+		}
+	}
+
+	throw std::runtime_error("failed to find a matching format");
+}
+
+VkImage VulkanRenderer::createImage(uint32_t width, uint32_t height, VkFormat format, VkImageTiling tiling, VkImageUsageFlags useFlags, VkMemoryPropertyFlags propFlags, Allocation* imageAllocation)
+{
+	//image creation info
+	VkImageCreateInfo imageCreateInfo = {};
+	imageCreateInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+	imageCreateInfo.imageType = VK_IMAGE_TYPE_2D;								//type of image (1D, 2D or 3D)
+	imageCreateInfo.extent.width = width;										//width of image extent
+	imageCreateInfo.extent.height = height;										//height of image extent
+	imageCreateInfo.extent.depth = 1;											//depth of image (just 1, no 3D aspect)
+	imageCreateInfo.mipLevels = 1;												//number of mipmap levels
+	imageCreateInfo.arrayLayers = 1;											//number of levels in image array
+	imageCreateInfo.format = format;											//format type of image
+	imageCreateInfo.tiling = tiling;											//how image data should be "tiled" (arranged for optimal reading)
+	imageCreateInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;					//layout of image data on creation
+	imageCreateInfo.usage = useFlags;											//bit flags defining what image will be used for
+	imageCreateInfo.samples = VK_SAMPLE_COUNT_1_BIT;							//number of samples for multi-sampling
+	imageCreateInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;					//whether image can be shared between queues
+
+	VkImage image;
+	VkResult result = vkCreateImage(mainDevice.logicalDevice, &imageCreateInfo, nullptr, &image);
+	if (result != VK_SUCCESS) {
+		throw std::runtime_error("failed to create an image");
+	}
+
+	//get memory requirements for a type of image
+	VkMemoryRequirements memoryRequirements;
+	vkGetImageMemoryRequirements(mainDevice.logicalDevice, image, &memoryRequirements);
+
+	//sub-allocate memory using image requirements and user defined properties, optimal images get their own blocks
+	ResourceTiling resourceTiling = tiling == VK_IMAGE_TILING_OPTIMAL ? ResourceTiling::Optimal : ResourceTiling::Linear;
+	*imageAllocation = allocator.allocate(memoryRequirements, propFlags, MemoryLifetime::Persistent, resourceTiling);
+
+	//connect memory to image
+	vkBindImageMemory(mainDevice.logicalDevice, image, imageAllocation->memory, imageAllocation->offset);
+
+	return image;
+}
+
 VkImageView VulkanRenderer::createImageView(VkImage image, VkFormat format, VkImageAspectFlags aspectFlags)
 {
 	VkImageViewCreateInfo viewCreateInfo = {};
@@ -1329,23 +2857,6 @@ VkImageView VulkanRenderer::createImageView(VkImage image, VkFormat format, VkIm
 	return imageView;
 }
 
-VkShaderModule VulkanRenderer::createShaderModule(const std::vector<char>& code)
-{
-	VkShaderModuleCreateInfo shaderModuleCreateInfo = {};
-	shaderModuleCreateInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
-	shaderModuleCreateInfo.codeSize = code.size();
-	shaderModuleCreateInfo.pCode = reinterpret_cast<const uint32_t *> (code.data());
-
-
-	VkShaderModule shaderModule;
-	VkResult result = vkCreateShaderModule(mainDevice.logicalDevice, &shaderModuleCreateInfo, nullptr, &shaderModule);
-	if (result != VK_SUCCESS) {
-		throw std::runtime_error("failed to create a shader module");
-	}
-
-	return shaderModule;
-}
-
 VKAPI_ATTR VkBool32 VKAPI_CALL VulkanRenderer::debugCallback(VkDebugUtilsMessageSeverityFlagBitsEXT messageSeverity, VkDebugUtilsMessageTypeFlagsEXT messageType, const VkDebugUtilsMessengerCallbackDataEXT* pCallbackData, void* pUserData)
 {
 
@@ -12,30 +12,265 @@
 #include <iostream>
 #include <algorithm>
 #include <array>
+#include <chrono>
+#include <limits>
+#include <thread>
 #include "Utilities.h"
 #include "Mesh.h"
+#include "UniformRing.h"
+#include "ThreadPool.h"
+#include "Culling.h"
+#include "GpuCulling.h"
+#include "GpuTimeline.h"
+#include "PipelineCache.h"
+#include "PipelineRegistry.h"
+#include "MeshOptimizer.h"
+#include "MeshSimplifier.h"
+#include "Meshlets.h"
+
+
+//GPU side timings and counters for one completed frame
+struct GpuFrameStats {
+	uint64_t frameNumber = 0;						//frame these results belong to, 0 if none yet
+	bool timestampsValid = false;
+	double gpuFrameMs = 0.0;						//start of command buffer to end of render pass
+	std::vector<double> batchMs;					//each draw batch within the render pass
+	bool pipelineStatisticsValid = false;
+	uint64_t inputVertices = 0;
+	uint64_t inputPrimitives = 0;
+	uint64_t vertexShaderInvocations = 0;
+	uint64_t clippingPrimitives = 0;
+	uint64_t fragmentShaderInvocations = 0;
+};
+
+//frustum culling of the most recent per frame recording
+struct CullingStats {
+	bool gpu = false;								//culled by the compute pass, visible is not read back
+	CullingKernel kernel = CullingKernel::Scalar;
+	uint32_t tested = 0;
+	uint32_t visible = 0;
+	double cullMs = 0.0;
+	uint32_t clustersTested = 0;					//meshlets of the visible objects, 0 unless cluster culling ran
+	uint32_t clustersVisible = 0;
+	uint32_t clusterDraws = 0;						//draws left once adjacent visible meshlets are merged
+	double clusterCullMs = 0.0;
+};
+
+//levels of detail drawn by the most recent frame, empty while no mesh has more than one
+//with GPU culling every live object is counted, the compute pass culls after the level is chosen
+struct LodStats {
+	uint32_t objects[MAX_MESH_LODS] = {};
+	uint64_t triangles[MAX_MESH_LODS] = {};
+	double selectMs = 0.0;							//choosing every object's level on the CPU
+};
+
+//how command buffers are recorded when the scene changes
+enum class RecordingMode {
+	Serial,											//all draws recorded inline into each primary command buffer
+	Parallel										//draws split across worker threads recording secondary command buffers
+};
 
+//what recording does with a mesh whose pipeline is still compiling (or failed to)
+enum class PendingPipelineMode {
+	Fallback,										//draw it with the default pipeline
+	Skip											//leave it out until its pipeline is ready
+};
+
+//when command buffers are recorded
+enum class CommandBufferMode {
+	Prerecorded,									//one per swapchain image, re-recorded only when the scene changes
+	PerFrame										//recorded every frame from a per frame in flight pool that is reset, not freed
+};
+
+//how frames are paced against the display, chosen before init
+enum class FramePacingMode {
+	Throughput,										//mailbox presentation, the CPU runs DEFAULT_FRAMES_IN_FLIGHT frames ahead of the GPU
+	LowLatency,										//mailbox or immediate presentation, one frame in flight so input is sampled as late as possible
+	VsyncCapped										//FIFO presentation, frames are held to the display's refresh
+};
+
+//CPU side timeline of one submitted frame
+struct FrameLatency {
+	uint64_t frameNumber = 0;
+	double limiterWaitMs = 0.0;						//sleeping for the frame rate limit
+	double slotWaitMs = 0.0;						//waiting for the previous frame submitted from the same slot to finish
+	double inputToSubmitMs = 0.0;					//input sample (draw() being called without one) to the queue submission returning
+	double inputToPresentMs = 0.0;					//to the present call returning, 0 headless, the display may show it a refresh or more later
+};
 
 class VulkanRenderer
 {
 public:
 	VulkanRenderer();
 
+	//before init, empty keeps compiled pipelines in memory only
+	void setPipelineCachePath(const std::string& path);
+	//before init, how every mesh's vertices are stored on the GPU
+	void setVertexLayout(const VertexLayout& layout);
 	int init(GLFWwindow* newWindow);
+	//render into offscreen images instead of a window surface (no swapchain needed)
+	int initHeadless(uint32_t width, uint32_t height);
 
+	int createMesh(std::vector<Vertex>* vertices, std::vector<uint32_t>* indices);
+	int createMesh(const MeshData& data);							//data is copied out before returning, e.g. straight from a MeshFile
+	void destroyMesh(int meshID);									//ID may be handed out again by createMesh
 	void updateModel(int modelID, glm::mat4 newModel);
 
+	// - Mesh optimization
+	void setMeshOptimization(const MeshOptimizeSettings& settings);		//applies to meshes created afterwards
+	MeshOptimizeStats getMeshOptimizeStats();								//of the most recent createMesh
+
+	// - Levels of detail
+	void setMeshLods(const MeshLodSettings& settings);						//applies to meshes created afterwards
+	MeshLodStats getMeshLodStats();											//of the most recent createMesh
+	void setLodThreshold(float pixels);										//screen space error a level may show where it is drawn
+	LodStats getLodStats();
+
+	// - Meshlets
+	void setMeshlets(const MeshletSettings& settings);						//applies to meshes created afterwards
+	MeshletStats getMeshletStats();											//of the most recent createMesh
+
+	// - Depth
+	void setReverseDepth(bool enabled);										//before init, near maps to 1 and far to 0 so float depth keeps its precision far away
+	VkFormat getDepthFormat();
+	bool isDepthPrepassSupported();											//the prepass shader was found
+	void setDepthPrepass(bool enabled);										//position only pass before the colour pass, so only the nearest fragments are shaded
+	bool isDepthPrepassEnabled();
+	void setDepthSort(bool enabled);										//records draws front to back, GPU culling keeps object order
+
+	// - Frame pacing
+	void setFramePacing(FramePacingMode mode);								//sets the frames in flight through setFramesInFlight, the present mode is only read when init creates the swapchain
+	FramePacingMode getFramePacing();
+	void setFramesInFlight(uint32_t count);									//1 to MAX_FRAME_DRAWS, after init waits for the GPU to go idle and rebuilds the frame contexts
+	uint32_t getFramesInFlight();
+	void setFrameRateLimit(float framesPerSecond);							//0 for none, sleeps on the CPU before each frame starts
+	void beginFrame();														//optional, before sampling input, does the waiting draw() would otherwise do after it
+	void markInputSampled();												//right after glfwPollEvents, where the frame's latency starts
+	FrameLatency getFrameLatency();											//most recent submitted frame
+	std::vector<FrameLatency> getFrameLatencyHistory();						//up to FRAME_LATENCY_HISTORY frames, oldest first
+
+	// - Synchronization
+	void setTimelineSemaphores(bool enabled);								//before init, false keeps the per frame fences even where timelines are supported
+	bool isTimelineSemaphoreEnabled();										//frames and uploads signal one timeline instead of fences
+
+	// - Uploads
+	bool isMeshUploaded(int meshID);
+	void waitForUploads();
+
 	void draw();
+
+	// - Command recording
+	void setRecordingMode(RecordingMode mode, uint32_t threadCount = 0);		//after init, 0 threads uses every hardware thread (prerecorded only)
+	RecordingMode getRecordingMode();
+	void setCommandBufferMode(CommandBufferMode mode);
+	CommandBufferMode getCommandBufferMode();
+	double getLastRecordMs();												//CPU time of the most recent recording
+
+	// - Culling
+	void setFrustumCulling(bool enabled);									//per frame command buffers only, prerecorded ones draw everything
+	void setCullingKernel(CullingKernel kernel);
+	CullingStats getCullingStats();
+	void setClusterCulling(bool enabled);									//per frame command buffers only, GPU culling draws whole objects
+	bool isGpuCullingSupported();
+	bool isDrawIndirectCountSupported();
+	void setGpuCulling(bool enabled);										//culls in a compute pass and draws indirect, in either command buffer mode
+	bool isGpuCullingEnabled();
+
+	// - Pipelines
+	PipelineHandle requestPipeline(const PipelineDesc& desc);				//compiles in the background, never blocks the frame loop
+	void setMeshPipeline(int meshID, PipelineHandle pipeline);				//reset to the default pipeline when the ID is reused
+	bool isPipelineReady(PipelineHandle pipeline);
+	void setPendingPipelineMode(PendingPipelineMode mode);
+	PipelineRegistryStats getPipelineStats();
+
+	// - Frame completion
+	uint64_t getSubmittedFrameCount();
+	bool isFrameComplete(uint64_t frameNumber);
+	void waitForFrame(uint64_t frameNumber);
+
+	const std::string& getDeviceName();
+
+	// - GPU statistics
+	bool isGpuTimingSupported();
+	bool isPipelineStatisticsSupported();
+	GpuFrameStats getGpuFrameStats();							//most recent frame whose results have been read back
+
+	// - Startup statistics
+	PipelineCacheStats getPipelineCacheStats();
+
+	// - Memory statistics
+	DeviceAllocatorStats getMemoryStats();
+	UploadStats getUploadStats();
+
 	void cleanup();
 	~VulkanRenderer();
 
 private:
-	GLFWwindow* window;
+	GLFWwindow* window = nullptr;
+	bool headless = false;
 
 	int currentFrame = 0;
+	uint32_t framesInFlight = DEFAULT_FRAMES_IN_FLIGHT;				//frame contexts created at init, or by setFramesInFlight after it
+
+	//frame numbers are 1 based, 0 if none
+	uint64_t submittedFrames = 0;
+	uint64_t completedFrames = 0;
+
+	//everything a frame writes on the CPU or records, one per frame in flight so memory follows latency rather than swapchain length
+	//a context is only reused once its previous frame has finished, so none of it needs per image copies
+	struct FrameContext {
+		uint64_t frameNumber = 0;									//last submitted from this context
+		uint64_t timelineValue = 0;									//timeline value that submission signals
+		VkFence fence = VK_NULL_HANDLE;								//null while the timeline is enabled
+		VkSemaphore imageAvailable = VK_NULL_HANDLE;
+		VkSemaphore renderFinished = VK_NULL_HANDLE;
+
+		VkCommandPool commandPool = VK_NULL_HANDLE;					//transient, reset as a whole before each frame
+		VkCommandBuffer commandBuffer = VK_NULL_HANDLE;				//primary, recorded every frame
+		VkCommandBuffer drawCommands = VK_NULL_HANDLE;				//prerecorded draws (secondary, from graphicsCommandPool), serial recording only
+
+		VkDescriptorPool descriptorPool = VK_NULL_HANDLE;
+		VkDescriptorSet descriptorSet = VK_NULL_HANDLE;				//reads this context's segment of the uniform ring
+
+		VkQueryPool timestampQueryPool = VK_NULL_HANDLE;
+		VkQueryPool statisticsQueryPool = VK_NULL_HANDLE;
+		uint32_t timestampCount = 0;								//written by the latest recording
+		uint64_t queryFrame = 0;									//frame with unread queries
+	};
+	std::vector<FrameContext> frameContexts;
+	std::vector<uint64_t> imageFrames;								//frame that last drew to each swapchain image
 
 	//scene objects
 	std::vector<Mesh> meshList;
+	std::vector<int> freeMeshIDs;									//destroyed entries of meshList, reused before growing it
+	SphereBounds objectBounds;										//world space, one per meshList entry
+	std::vector<PipelineHandle> meshPipelines;						//one per meshList entry
+
+	MeshOptimizeSettings meshOptimizeSettings;
+	MeshOptimizeStats meshOptimizeStats;
+	std::vector<Vertex> optimizedVertices;							//reused by createMesh, copied into staging before it returns
+	std::vector<uint32_t> optimizedIndices;
+
+	MeshLodSettings meshLodSettings;
+	MeshLodStats meshLodStats;
+	std::vector<uint32_t> lodIndices;								//reused by createMesh, every level of the mesh being created
+	std::vector<MeshLod> lodRanges;
+	std::vector<uint32_t> selectedLods;								//level each meshList entry is drawn at
+	uint32_t lodMeshCount = 0;										//live meshes with more than one level
+	float lodThreshold = DEFAULT_LOD_THRESHOLD;
+	LodStats lodStats;
+
+	MeshletSettings meshletSettings;
+	MeshletStats meshletStats;
+	std::vector<Meshlet> meshletBuffer;								//reused by createMesh, every level's meshlets of the mesh being created
+	uint32_t meshletMeshCount = 0;									//live meshes split into meshlets
+
+	bool frustumCullingEnabled = true;
+	CullingKernel cullingKernel = getBestCullingKernel();
+	CullingStats cullingStats;
+	bool gpuCullingEnabled = false;
+	bool clusterCullingEnabled = true;
+	bool commandsDirty = false;										//mesh list changed since command buffers were recorded
 
 	//scene settings
 	struct UboViewProjection {
@@ -62,81 +297,190 @@ private:
 		VkPhysicalDevice physicalDevice;
 		VkDevice logicalDevice;
 	} mainDevice;
+	DeviceAllocator allocator;
 	VkQueue graphicsQueue;
 	VkQueue presentationQueue;
-	VkSurfaceKHR surface;
-	VkSwapchainKHR swapchain;
-
-	std::vector<SwapChainImage> swapChainImages;
+	VkQueue transferQueue;											//same as graphicsQueue if there is no transfer only family
+	UploadService uploadService;
+	GeometryArena geometryArena;
+	GpuCulling gpuCulling;
+	VkSurfaceKHR surface = VK_NULL_HANDLE;
+	VkSwapchainKHR swapchain = VK_NULL_HANDLE;
+
+	std::vector<SwapChainImage> swapChainImages;					//swapchain images, or offscreen images when headless
+	std::vector<Allocation> offscreenImageAllocations;
 	std::vector<VkFramebuffer> swapChainFramebuffers;
-	std::vector<VkCommandBuffer> commandBuffers;
+
+	//one depth buffer per framebuffer, so frames in flight never share one
+	std::vector<VkImage> depthBufferImages;
+	std::vector<Allocation> depthBufferImageAllocations;
+	std::vector<VkImageView> depthBufferImageViews;
+	VkFormat depthFormat = VK_FORMAT_UNDEFINED;
+	bool reverseDepth = false;
 
 	// - Descriptors
 	VkDescriptorSetLayout descriptorSetLayout;
 
-	VkDescriptorPool descriptorPool;
-	std::vector<VkDescriptorSet> descriptorSets;
-
-	std::vector<VkBuffer> vpUniformBuffer;
-	std::vector<VkDeviceMemory> vpUniformBufferMemory;
-
-	std::vector<VkBuffer> modelDUniformBuffer;
-	std::vector<VkDeviceMemory> modelDUniformBufferMemory;
+	UniformRing uniformRing;										//view projection and object table, one segment per frame context
 
 	VkDeviceSize minUniformBufferOffset;
-	size_t modelUniformAlignment;
-	UboModel* modelTrnasferSpace;
+	VkDeviceSize minStorageBufferOffset;
+	VkDeviceSize maxStorageBufferRange;
+	uint32_t maxDrawIndirectCount;
+	size_t objectTableBase;											//offset of the object table (storage buffer) within a segment
+	size_t objectCapacity = INITIAL_OBJECT_CAPACITY;				//number of objects each segment currently holds
 
 	// - Pipeline
-	VkPipeline graphicsPipeline;
+	PipelineCache pipelineCache;
+	std::string pipelineCachePath = DEFAULT_PIPELINE_CACHE_PATH;
+	VertexLayout vertexLayout;
+	bool cullPipelineCreated = false;
+	PipelineRegistry pipelineRegistry;
+	PipelineHandle defaultPipeline = 0;
+	VkPipeline graphicsPipeline;									//default pipeline, also stands in for ones still compiling
+	PendingPipelineMode pendingPipelineMode = PendingPipelineMode::Fallback;
+	std::vector<VkPipeline> resolvedPipelines;						//by handle, what the current recording binds (null to skip)
+	uint64_t recordedFinishedCount = 0;								//registry compiles finished when command buffers were recorded
+	bool recordedWithPending = false;								//a recorded draw used a stand in for its pipeline
+	VkPipeline depthPrepassPipeline = VK_NULL_HANDLE;				//position only, no fragment stage, null without its shader
+	bool depthPrepassEnabled = false;
+	bool depthSortEnabled = true;
+	std::vector<uint64_t> depthSortKeys;							//view depth bits above the mesh ID, reused by every sort
 	VkPipelineLayout pipelineLayout;
 	VkRenderPass renderPass;
 
 	// - Pools
 	VkCommandPool graphicsCommandPool;
 
+	// - Per frame recording
+	CommandBufferMode commandBufferMode = CommandBufferMode::Prerecorded;
+	std::vector<uint32_t> drawList;										//meshList entries drawn by the current recording
+
+	// - Cluster culling
+	struct ClusterDraw {
+		uint32_t firstIndex;
+		uint32_t indexCount;
+	};
+	std::vector<ClusterDraw> clusterDraws;								//index ranges left of each drawList entry, empty when not cluster culling
+	std::vector<uint32_t> clusterDrawOffsets;							//drawList entry i draws clusterDraws[offsets[i]] up to offsets[i + 1]
+	std::vector<uint32_t> visibleMeshlets;
+
+	// - Parallel recording
+	RecordingMode recordingMode = RecordingMode::Serial;
+	ThreadPool recordingThreads;
+	std::vector<VkCommandPool> recordingCommandPools;						//one per recording task, only used by that task
+	std::vector<std::vector<VkCommandBuffer>> secondaryCommandBuffers;		//[task][context], then [task][context count + context] for the depth prepass
+	uint32_t prerecordedTaskCount = 0;										//tasks the prerecorded draws were split across, 0 when recorded serially
+	double lastRecordMs = 0.0;
+
+	// - Indirect drawing
+	bool gpuCullingSupported = false;								//device features and the cull shader are both available
+	bool multiDrawIndirectSupported = false;
+	PFN_vkCmdDrawIndexedIndirectCountKHR drawIndexedIndirectCount = nullptr;	//VK_KHR_draw_indirect_count, null if not enabled
+
 	// - Utility
+	std::string deviceName;
 	VkFormat swapChainImageFormat;
 	VkExtent2D swapChainExtent;
 
 	// - Synchronization
-	std::vector<VkSemaphore> imageAvailable;
-	std::vector<VkSemaphore> renderFinished;
-	std::vector<VkFence> drawFences;
+	uint32_t instanceApiVersion = VK_API_VERSION_1_0;
+	bool timelineSemaphoresRequested = true;
+	GpuTimeline gpuTimeline;										//signalled by every frame and upload submission to the graphics queue
+
+	// - Frame pacing
+	FramePacingMode framePacing = FramePacingMode::Throughput;
+	std::chrono::steady_clock::duration frameInterval = std::chrono::steady_clock::duration::zero();	//frame rate limit, zero for none
+	std::chrono::steady_clock::time_point nextFrameStart;
+	bool frameBegun = false;										//beginFrame has waited for the current slot, draw() has not submitted it yet
+	bool inputSampled = false;
+	std::chrono::steady_clock::time_point inputSampleTime;
+	FrameLatency pendingLatency;									//frame being built, filled in by beginFrame and draw
+	std::vector<FrameLatency> frameLatencies;						//ring of FRAME_LATENCY_HISTORY
+	uint64_t frameLatencyCount = 0;									//latencies ever recorded
+
+	// - Queries
+	//pools belong to the frame context that writes them, results are read once its frame has finished
+	bool timestampsSupported = false;
+	bool pipelineStatisticsSupported = false;
+	float timestampPeriod = 1.0f;									//nanoseconds per timestamp tick
+	uint64_t timestampMask = ~0ULL;									//valid bits of timestamp results
+	VkQueryPipelineStatisticFlags pipelineStatisticsFlags = 0;		//counters every statistics query collects
+	GpuFrameStats gpuFrameStats;
 
 	//Vulkan Functions
 	// - Create Functions
+	void createRenderResources();
 	void createInstance();
 	void createLogicalDevice();
 	void createSurface();
 	void createSwapChain();
+	void createOffscreenImages(uint32_t width, uint32_t height);
 	void createRenderPass();
+	void createDepthBufferImages();
 	void createDescriptorSetLayout();
-	void createGraphicsPipeline();
+	void createPipelines();
+	void createPipelineLayout();
 	void createFrameBuffers();
 	void createCommandPool();
+	void createFrameContexts();
+	void destroyFrameContexts();
 	void createCommandBuffers();
 	void createSynchronization();
+	void createQueryPools();
+	void createGpuCulling();
+	void createRecordingPools(uint32_t taskCount);
+	void destroyRecordingPools();
 
 	void createUniformBuffers();
 	void createDescriptorPool();
 	void createDescriptorSets();
-
-	void updateUniformBuffers(uint32_t imageIndex);
+	void writeUniformDescriptors();
+	void resizeUniformBuffers(size_t newCapacity);
+
+	void updateUniformBuffers(uint32_t frameIndex);
+
+	void updateObjectBounds(int meshID);
+	void updateGpuDraw(int meshID);
+	void resizeGpuCulling();
+	void selectLods();
+	void countLodDraws();
+	void buildDrawList();
+	void cullClusters();
+	void sortDrawList();
+	void resolvePipelines();
+	size_t getRecordedDrawCount();
+	size_t getDrawBatchSize();
 
 	// - Record Functions
 	void recordCommands();
+	void recordFrame(uint32_t frameIndex, uint32_t imageIndex);
+	void recordFrameCommands(uint32_t frameIndex, uint32_t imageIndex);
+	void beginDrawCommands(VkCommandBuffer commandBuffer);
+	void recordSecondaryCommands(uint32_t task, uint32_t taskCount, size_t batchSize);
+	void recordSceneDraws(VkCommandBuffer commandBuffer, uint32_t frameIndex);
+	void recordDrawRange(VkCommandBuffer commandBuffer, uint32_t frameIndex, size_t first, size_t last, size_t batchSize, bool depthOnly);
+	void recordIndirectDraws(VkCommandBuffer commandBuffer, uint32_t frameIndex, bool depthOnly);
+
+	// - Frame pacing
+	void recordFrameLatency();
+	int findFrameSlot(uint64_t frameNumber);						//context the frame was submitted from, -1 once the context has moved on
+	bool isFrameSlotComplete(int frameSlot);
+	void waitForFrameSlot(int frameSlot);
+	void pollCompletedFrames();
+
+	// - Query Functions
+	void collectQueryResults(uint32_t frameIndex);
+	void collectAllQueryResults();
 
 	// - Get Functions
 	void getPhysicalDevice();
 
-	// - Allocate Functions
-	void allocateDynamicBufferTransferSpace();
-
 	// - Support Functions
 	// -- Checker Functions
 	bool checkInstanceExtensionSupport(std::vector<const char*>* checkExtensions);
 	bool checkDeviceExtensionSupport(VkPhysicalDevice device);
+	bool checkDeviceExtensionAvailable(VkPhysicalDevice device, const char* extensionName);
 	bool checkDeviceSuitable(VkPhysicalDevice device);
 	bool checkValidationSupport();
 	// -- Getter Functions
@@ -146,9 +490,10 @@ private:
 	VkSurfaceFormatKHR chooseBestSurfaceFormat(const std::vector<VkSurfaceFormatKHR> &formats);
 	VkPresentModeKHR chooseBestPresentationMode(const std::vector<VkPresentModeKHR> presentationModes);
 	VkExtent2D chooseSwapExtent(const VkSurfaceCapabilitiesKHR& surfaceCapabilities);
+	VkFormat chooseSupportedFormat(const std::vector<VkFormat>& formats, VkImageTiling tiling, VkFormatFeatureFlags featureFlags);
 	// -- Create Functions
+	VkImage createImage(uint32_t width, uint32_t height, VkFormat format, VkImageTiling tiling, VkImageUsageFlags useFlags, VkMemoryPropertyFlags propFlags, Allocation* imageAllocation);
 	VkImageView createImageView(VkImage image, VkFormat format, VkImageAspectFlags aspectFlags);
-	VkShaderModule createShaderModule(const std::vector<char>& code);
 	
 
 	// - Debug Functions
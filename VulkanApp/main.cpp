@@ -4,6 +4,8 @@
 #include <stdexcept>
 #include <vector>
 #include <iostream>
+#include <string>
+#include <chrono>
 
 #include "VulkanRenderer.h"
 
@@ -24,7 +26,83 @@ void initWindow(std::string wName = "Test Window", const int width = 800, const
 	window = glfwCreateWindow(width, height, wName.c_str(), nullptr, nullptr);
 }
 
-int main() {
+void createScene() {
+	//vertex data
+	std::vector<Vertex> meshVertices1 = {
+		{{-0.4,  0.4, 0.0}, {1.0, 0.0, 0.0}},			//0
+		{{-0.4, -0.4, 0.0}, {0.0, 1.0, 0.0}},			//1
+		{{ 0.4, -0.4, 0.0}, {0.0, 0.0, 1.0}},			//2
+		{{ 0.4,  0.4, 0.0}, {1.0, 1.0, 0.0}},			//3
+	};
+
+	std::vector<Vertex> meshVertices2 = {
+		{{-0.25,  0.6, 0.0}, {1.0, 0.0, 0.0}},			//0
+		{{-0.25, -0.6, 0.0}, {0.0, 1.0, 0.0}},			//1
+		{{ 0.25, -0.6, 0.0}, {0.0, 0.0, 1.0}},			//2
+		{{ 0.25,  0.6, 0.0}, {1.0, 1.0, 0.0}},			//3
+	};
+
+	//index data
+	std::vector<uint32_t> meshIndices = {
+		0,1,2,
+		2,3,0
+	};
+
+	vulkanRenderer.createMesh(&meshVertices1, &meshIndices);
+	vulkanRenderer.createMesh(&meshVertices2, &meshIndices);
+}
+
+void updateModels(float angle) {
+	glm::mat4 firstModel(1.0);
+	glm::mat4 secondModel(1.0f);
+
+	firstModel = glm::translate(firstModel, glm::vec3(-2.0f, 0.0f, -5.0f));
+	firstModel = glm::rotate(firstModel, glm::radians(angle), glm::vec3(0.0f, 0.0f, 1.0f));
+
+	secondModel = glm::translate(secondModel, glm::vec3(2.0f, 0.0f, -5.0f));
+	secondModel = glm::rotate(secondModel, glm::radians(-angle * 100), glm::vec3(0.0f, 0.0f, 1.0f));
+
+	vulkanRenderer.updateModel(0, firstModel);
+	vulkanRenderer.updateModel(1, secondModel);
+}
+
+//render a fixed number of frames offscreen, no window or display required
+int runHeadless(uint64_t frameCount) {
+	if (vulkanRenderer.initHeadless(800, 600) == EXIT_FAILURE) {
+		return EXIT_FAILURE;
+	}
+	createScene();
+
+	float angle = 0.0f;
+	auto start = std::chrono::steady_clock::now();
+
+	for (uint64_t i = 0; i < frameCount; i++) {
+		angle += 0.1f;
+		if (angle > 360.0f) {
+			angle -= 360.0f;
+		}
+
+		updateModels(angle);
+		vulkanRenderer.draw();
+	}
+
+	//block until the last submitted frame has finished on the GPU
+	vulkanRenderer.waitForFrame(vulkanRenderer.getSubmittedFrameCount());
+	std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+	printf("Rendered %llu headless frames in %.2f ms (%.3f ms/frame)\n", (unsigned long long)frameCount, elapsed.count(), elapsed.count() / frameCount);
+
+	vulkanRenderer.cleanup();
+
+	return 0;
+}
+
+int main(int argc, char** argv) {
+
+	//--headless [frames] renders without a window
+	if (argc > 1 && std::string(argv[1]) == "--headless") {
+		uint64_t frameCount = argc > 2 ? std::stoull(argv[2]) : 1000;
+		return runHeadless(frameCount > 0 ? frameCount : 1);
+	}
 	
 	//Create window
 	initWindow("Test Window", 800, 600);
@@ -33,6 +111,7 @@ int main() {
 	if (vulkanRenderer.init(window) == EXIT_FAILURE) {
 		return EXIT_FAILURE;
 	}
+	createScene();
 
 	float angle = 0.0f;
 	float deltaTime = 0.0f;
@@ -40,7 +119,10 @@ int main() {
 
 	//Loop until closed
 	while (!glfwWindowShouldClose(window)) {
+		//wait for the frame slot before polling, so the input is as fresh as it can be when the frame is submitted
+		vulkanRenderer.beginFrame();
 		glfwPollEvents();
+		vulkanRenderer.markInputSampled();
 
 		float now = glfwGetTime();
 		deltaTime = now - lastTime;
@@ -51,17 +133,7 @@ int main() {
 			angle -= 360.0f;
 		}
 
-		glm::mat4 firstModel(1.0);
-		glm::mat4 secondModel(1.0f);
-
-		firstModel = glm::translate(firstModel, glm::vec3(-2.0f, 0.0f, -5.0f));
-		firstModel = glm::rotate(firstModel, glm::radians(angle), glm::vec3(0.0f, 0.0f, 1.0f));
-
-		secondModel = glm::translate(secondModel, glm::vec3(2.0f, 0.0f, -5.0f));
-		secondModel = glm::rotate(secondModel, glm::radians(-angle * 100), glm::vec3(0.0f, 0.0f, 1.0f));
-
-		vulkanRenderer.updateModel(0, firstModel);
-		vulkanRenderer.updateModel(1, secondModel);
+		updateModels(angle);
 
 		vulkanRenderer.draw();
 	}